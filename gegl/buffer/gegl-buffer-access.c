@@ -41,6 +41,9 @@
 #include "gegl-buffer-iterator-private.h"
 #include "gegl-buffer-formats.h"
 
+/* maximal number of tiles fetched at once by gegl_buffer_get() */
+#define TILE_BATCH_SIZE 16
+
 static void gegl_buffer_iterate_read_fringed (GeglBuffer          *buffer,
                                               const GeglRectangle *roi,
                                               const GeglRectangle *abyss,
@@ -129,16 +132,10 @@ gegl_buffer_get_pixel (GeglBuffer     *buffer,
           tile->x == indice_x &&
           tile->y == indice_y))
       {
-        g_rec_mutex_lock (&buffer->tile_storage->mutex);
-
         if (tile)
           gegl_tile_unref (tile);
 
-        tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                          indice_x, indice_y,
-                                          0);
-
-        g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+        tile = _gegl_buffer_fetch_tile (buffer, indice_x, indice_y, 0, TRUE);
       }
 
     if (tile)
@@ -214,16 +211,10 @@ __gegl_buffer_set_pixel (GeglBuffer     *buffer,
           tile->x == indice_x &&
           tile->y == indice_y))
       {
-        g_rec_mutex_lock (&buffer->tile_storage->mutex);
-
         if (tile)
           gegl_tile_unref (tile);
 
-        tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                          indice_x, indice_y,
-                                          0);
-
-        g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+        tile = _gegl_buffer_fetch_tile (buffer, indice_x, indice_y, 0, TRUE);
       }
 
     if (tile)
@@ -459,13 +450,9 @@ gegl_buffer_iterate_write (GeglBuffer          *buffer,
                        MIN (MIN (height - bufy, tile_height - offsety),
                             abyss_y_total - bufy) == tile_height;
 
-          g_rec_mutex_lock (&buffer->tile_storage->mutex);
-
-          tile = gegl_tile_handler_get_tile ((GeglTileHandler *) buffer,
-                                             index_x, index_y, level,
-                                             ! whole_tile);
-
-          g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+          tile = _gegl_buffer_fetch_tile (buffer,
+                                          index_x, index_y, level,
+                                          ! whole_tile);
 
           if (!tile)
             {
@@ -960,6 +947,12 @@ gegl_buffer_iterate_read_simple (GeglBuffer          *buffer,
   gint buffer_x = roi->x;
   gint buffer_y = roi->y;
 
+  /* the tiles of each row of tiles are fetched in batches */
+  GeglTile *batch[TILE_BATCH_SIZE];
+  gint      batch_x = 0;
+  gint      batch_n = 0;
+  gint      last_x  = gegl_tile_indice (buffer_x + width - 1, tile_width);
+
   const Babl *fish;
 
   if (G_LIKELY (format == buffer->soft_format))
@@ -974,10 +967,13 @@ gegl_buffer_iterate_read_simple (GeglBuffer          *buffer,
       gint offsety = gegl_tile_offset (tiledy, tile_height);
       gint bufx    = 0;
 
+      batch_n = 0;
+
       while (bufx < width)
         {
           gint      tiledx  = buffer_x + bufx;
           gint      offsetx = gegl_tile_offset (tiledx, tile_width);
+          gint      tile_x  = gegl_tile_indice (tiledx, tile_width);
           guchar   *bp, *tile_base, *tp;
           gint      pixels, row, y;
           GeglTile *tile;
@@ -989,12 +985,33 @@ gegl_buffer_iterate_read_simple (GeglBuffer          *buffer,
           else
             pixels = tile_width - offsetx;
 
-          g_rec_mutex_lock (&buffer->tile_storage->mutex);
-          tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                          gegl_tile_indice (tiledx, tile_width),
-                                          gegl_tile_indice (tiledy, tile_height),
-                                          level);
-          g_rec_mutex_unlock (&buffer->tile_storage->mutex);
+          if (batch_n > 0 && tile_x >= batch_x + batch_n)
+            batch_n = 0;
+
+          if (batch_n == 0 && tile_x == last_x)
+            {
+              /* a lone tile is fetched directly */
+              tile = _gegl_buffer_fetch_tile (buffer,
+                                              tile_x,
+                                              gegl_tile_indice (tiledy, tile_height),
+                                              level, TRUE);
+            }
+          else
+            {
+              if (batch_n == 0)
+                {
+                  batch_x = tile_x;
+                  batch_n = MIN (last_x - tile_x + 1, TILE_BATCH_SIZE);
+
+                  _gegl_buffer_fetch_tiles (buffer,
+                                            batch_x,
+                                            gegl_tile_indice (tiledy, tile_height),
+                                            level, batch_n, 1, batch);
+                }
+
+              tile = batch[tile_x - batch_x];
+              batch[tile_x - batch_x] = NULL;
+            }
 
           if (!tile)
             {
@@ -1010,7 +1027,18 @@ gegl_buffer_iterate_read_simple (GeglBuffer          *buffer,
 
           y = bufy;
 
-          if (G_UNLIKELY (fish))
+          if (G_UNLIKELY (fish) && gegl_tile_is_uniform (tile))
+            {
+              gint rows = MIN (height - bufy, tile_height - offsety);
+
+              /* convert a single pixel of uniform tiles, and replicate it */
+              babl_process (fish, tp, bp, 1);
+              gegl_memset_pattern (bp + bpx_size, bp, bpx_size, pixels - 1);
+
+              for (row = 1; row < rows; row++)
+                memcpy (bp + (gsize) row * buf_stride, bp, pixels * bpx_size);
+            }
+          else if (G_UNLIKELY (fish))
             {
               int rows = MIN(height - bufy, tile_height - offsety);
               if (rows == 1)
@@ -2980,16 +3008,7 @@ gegl_buffer_set_color_from_pixel_tile (GeglBuffer            *dst,
         }
       else
         {
-          tile = gegl_tile_new (tile_size);
-
-          gegl_tile_lock (tile);
-
-          gegl_memset_pattern (gegl_tile_get_data (tile),
-                               data->pixel,
-                               data->bpp,
-                               tile_size / data->bpp);
-
-          gegl_tile_unlock (tile);
+          tile = gegl_tile_new_uniform (tile_size, data->pixel, data->bpp);
         }
     }
 
@@ -51,6 +51,8 @@ typedef enum
   _GEGL_TILE_LAST_0_4_8_COMMAND,
 
   GEGL_TILE_COPY = _GEGL_TILE_LAST_0_4_8_COMMAND,
+  GEGL_TILE_GET_N,
+  GEGL_TILE_SET_N,
 
   GEGL_TILE_LAST_COMMAND
 } GeglTileCommand;
@@ -64,6 +66,19 @@ typedef struct _GeglTileCopyParams
   gint        dst_z;
 } GeglTileCopyParams;
 
+/* the data of GEGL_TILE_GET_N and GEGL_TILE_SET_N, which act on the
+ * width x height tiles whose top-left tile is given by the command's
+ * coordinates.  the tiles are listed in row-major order; GET_N only fetches
+ * the tiles whose entry is NULL, and SET_N skips the NULL entries.
+ */
+typedef struct _GeglTileBatchParams
+{
+  gint        width;
+  gint        height;
+
+  GeglTile  **tiles;
+} GeglTileBatchParams;
+
 G_END_DECLS
 
 #include "gegl-buffer.h"
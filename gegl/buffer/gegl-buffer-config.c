@@ -39,7 +39,14 @@ enum
   PROP_SWAP_COMPRESSION,
   PROP_TILE_WIDTH,
   PROP_TILE_HEIGHT,
+  PROP_TILE_SIZE_TARGET,
   PROP_QUEUE_SIZE,
+  PROP_TILE_DEDUP,
+  PROP_TILE_ALLOC_HUGE_PAGES,
+  PROP_TILE_ALLOC_NUMA,
+  PROP_SWAP_RAM_SIZE,
+  PROP_FILE_COMPRESSION,
+  PROP_FILE_MIPMAP_LEVELS,
 };
 
 static void
@@ -64,6 +71,10 @@ gegl_buffer_config_get_property (GObject    *gobject,
         g_value_set_int (value, config->tile_height);
         break;
 
+      case PROP_TILE_SIZE_TARGET:
+        g_value_set_int (value, config->tile_size_target);
+        break;
+
       case PROP_SWAP:
         g_value_set_string (value, config->swap);
         break;
@@ -76,6 +87,30 @@ gegl_buffer_config_get_property (GObject    *gobject,
         g_value_set_int (value, config->queue_size);
         break;
 
+      case PROP_TILE_DEDUP:
+        g_value_set_boolean (value, config->tile_dedup);
+        break;
+
+      case PROP_TILE_ALLOC_HUGE_PAGES:
+        g_value_set_boolean (value, config->tile_alloc_huge_pages);
+        break;
+
+      case PROP_TILE_ALLOC_NUMA:
+        g_value_set_boolean (value, config->tile_alloc_numa);
+        break;
+
+      case PROP_SWAP_RAM_SIZE:
+        g_value_set_uint64 (value, config->swap_ram_size);
+        break;
+
+      case PROP_FILE_COMPRESSION:
+        g_value_set_string (value, config->file_compression);
+        break;
+
+      case PROP_FILE_MIPMAP_LEVELS:
+        g_value_set_int (value, config->file_mipmap_levels);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -101,9 +136,27 @@ gegl_buffer_config_set_property (GObject      *gobject,
       case PROP_TILE_HEIGHT:
         config->tile_height = g_value_get_int (value);
         break;
+      case PROP_TILE_SIZE_TARGET:
+        config->tile_size_target = g_value_get_int (value);
+        break;
       case PROP_QUEUE_SIZE:
         config->queue_size = g_value_get_int (value);
         break;
+      case PROP_TILE_DEDUP:
+        config->tile_dedup = g_value_get_boolean (value);
+        break;
+      case PROP_TILE_ALLOC_HUGE_PAGES:
+        config->tile_alloc_huge_pages = g_value_get_boolean (value);
+        break;
+      case PROP_TILE_ALLOC_NUMA:
+        config->tile_alloc_numa = g_value_get_boolean (value);
+        break;
+      case PROP_SWAP_RAM_SIZE:
+        config->swap_ram_size = g_value_get_uint64 (value);
+        break;
+      case PROP_FILE_MIPMAP_LEVELS:
+        config->file_mipmap_levels = g_value_get_int (value);
+        break;
       case PROP_SWAP:
         g_free (config->swap);
         config->swap = g_value_dup_string (value);
@@ -112,6 +165,10 @@ gegl_buffer_config_set_property (GObject      *gobject,
         g_free (config->swap_compression);
         config->swap_compression = g_value_dup_string (value);
         break;
+      case PROP_FILE_COMPRESSION:
+        g_free (config->file_compression);
+        config->file_compression = g_value_dup_string (value);
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -125,6 +182,7 @@ gegl_buffer_config_finalize (GObject *gobject)
 
   g_free (config->swap);
   g_free (config->swap_compression);
+  g_free (config->file_compression);
 
   G_OBJECT_CLASS (gegl_buffer_config_parent_class)->finalize (gobject);
 }
@@ -159,6 +217,15 @@ gegl_buffer_config_class_init (GeglBufferConfigClass *klass)
                                                      G_PARAM_CONSTRUCT |
                                                      G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_TILE_SIZE_TARGET,
+                                   g_param_spec_int ("tile-size-target",
+                                                     "Tile size target",
+                                                     "size in bytes the tiles of created buffers are sized for, according to their format; 0 uses tile-width and tile-height",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT |
+                                                     G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_TILE_CACHE_SIZE,
                                    g_param_spec_uint64 ("tile-cache-size",
                                                         "Tile Cache size",
@@ -194,6 +261,60 @@ gegl_buffer_config_class_init (GeglBufferConfigClass *klass)
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_CONSTRUCT |
                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_DEDUP,
+                                   g_param_spec_boolean ("tile-dedup",
+                                                         "Tile deduplication",
+                                                         "Store identical tile data only once in the swap and in buffer files",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_ALLOC_HUGE_PAGES,
+                                   g_param_spec_boolean ("tile-alloc-huge-pages",
+                                                         "Huge page tile allocation",
+                                                         "Back the blocks tiles are allocated from with huge pages",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_ALLOC_NUMA,
+                                   g_param_spec_boolean ("tile-alloc-numa",
+                                                         "NUMA-aware tile allocation",
+                                                         "Allocate tiles from blocks local to the NUMA node of the allocating thread",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SWAP_RAM_SIZE,
+                                   g_param_spec_uint64 ("swap-ram-size",
+                                                        "Swap RAM size",
+                                                        "size in bytes of the compressed data the swap keeps in memory before writing it to disk; 0 disables the in-memory tier",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FILE_COMPRESSION,
+                                   g_param_spec_string ("file-compression",
+                                                        "File compression",
+                                                        "compression algorithm used for the tiles of saved buffer files",
+                                                        "fast",
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FILE_MIPMAP_LEVELS,
+                                   g_param_spec_int ("file-mipmap-levels",
+                                                     "File mipmap levels",
+                                                     "number of mipmap levels stored in saved buffer files, in addition to the full resolution tiles",
+                                                     0, 15, 0,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT |
+                                                     G_PARAM_STATIC_STRINGS));
 }
 
 static void
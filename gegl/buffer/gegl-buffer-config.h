@@ -48,7 +48,14 @@ struct _GeglBufferConfig
   guint64  tile_cache_size;
   gint     tile_width;
   gint     tile_height;
+  gint     tile_size_target;
   gint     queue_size;
+  gboolean tile_dedup;
+  gboolean tile_alloc_huge_pages;
+  gboolean tile_alloc_numa;
+  guint64  swap_ram_size;
+  gchar   *file_compression;
+  gint     file_mipmap_levels;
 };
 
 struct _GeglBufferConfigClass
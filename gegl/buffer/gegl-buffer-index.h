@@ -13,8 +13,14 @@ G_BEGIN_DECLS
 #define GEGL_FILE_SPEC_REV     0
 #define GEGL_MAGIC             {'G','E','G','L'}
 
+/* the revision of files whose tiles are found through a GeglBufferIndex
+ * rather than a list of GeglBufferTile blocks, see below.
+ */
+#define GEGL_FILE_SPEC_REV_INDEX 2
+
 #define GEGL_FLAG_TILE         1
 #define GEGL_FLAG_FREE_TILE    0xf+2
+#define GEGL_FLAG_INDEX        3
 
 /* a VOID message, indicating that the specified tile has been rewritten */
 #define GEGL_FLAG_INVALIDATED  2
@@ -100,6 +106,63 @@ typedef struct {
                             own state when revision differs. */
 } GeglBufferTile;
 
+/* In files of revision GEGL_FILE_SPEC_REV_INDEX the next offset of the
+ * header points to a single GeglBufferIndex block, holding a dense grid of
+ * GeglBufferIndexEntry's for each stored mipmap level.  The entry of a tile
+ * is thus found with a single read, without loading the rest of the index,
+ * and tiles which aren't stored have a zeroed entry.
+ *
+ * The files are only ever appended to: updated tiles and a new index are
+ * written at the end of the file, before the header is pointed at the new
+ * index.
+ */
+
+#define GEGL_FILE_MAX_LEVELS      16
+#define GEGL_FILE_MAX_CODECS      4
+#define GEGL_FILE_CODEC_NAME_SIZE 16
+
+typedef struct {
+  gint32  x;       /* the grid of the level, in tile coordinates */
+  gint32  y;
+  guint32 width;
+  guint32 height;
+
+  guint64 offset;  /* offset of the entries of the level, stored row by row,
+                      0 if the level isn't stored */
+} GeglBufferIndexLevel;
+
+typedef struct {
+  GeglBufferBlock      block;    /* the length includes the entries of all
+                                    levels, which follow the block */
+  guint32              n_levels;
+  guint32              n_codecs;
+
+  gchar                codecs[GEGL_FILE_MAX_CODECS][GEGL_FILE_CODEC_NAME_SIZE];
+                                 /* names of the GeglCompression algorithms
+                                    the tiles are compressed with */
+
+  GeglBufferIndexLevel levels[GEGL_FILE_MAX_LEVELS];
+} GeglBufferIndex;
+
+typedef struct {
+  guint64 offset;  /* offset into file of the tile data, 0 if not stored */
+  guint32 length;  /* length of the tile data */
+  guint16 codec;   /* 0 for uncompressed data, otherwise 1 + the index of
+                      the algorithm in the codecs of the index */
+  guint16 flags;
+  guint32 rev;     /* revision of the tile */
+  guint32 padding;
+} GeglBufferIndexEntry;
+
+/* an entry of an index being built, along with the coordinates of its tile
+ */
+typedef struct {
+  gint32               x;
+  gint32               y;
+  gint32               z;
+  GeglBufferIndexEntry entry;
+} GeglBufferIndexItem;
+
 /* A convenience union to allow quick and simple casting */
 typedef union {
   guint32          length;
@@ -130,6 +193,32 @@ GeglBufferItem *gegl_buffer_read_header(int      i,
 GList          *gegl_buffer_read_index (int      i,
                                         goffset *offset);
 
+/* reads the GeglBufferIndex block at @offset, without its entries, returns
+ * NULL if it isn't a valid index.
+ */
+GeglBufferIndex *gegl_buffer_read_tile_index     (int                         i,
+                                                  goffset                     offset);
+/* returns the offset of the entry of tile @x, @y, @z, or 0 if the index
+ * has no entry for it.
+ */
+goffset          gegl_buffer_index_entry_offset  (const GeglBufferIndex      *index,
+                                                  gint                        x,
+                                                  gint                        y,
+                                                  gint                        z);
+/* decodes the @data stored for @entry into the @tile_size bytes of @dest */
+gboolean         gegl_buffer_index_decode        (const GeglBufferIndex      *index,
+                                                  const GeglBufferIndexEntry *entry,
+                                                  const Babl                 *format,
+                                                  gconstpointer               data,
+                                                  gpointer                    dest,
+                                                  gint                        tile_size);
+/* builds the index of @items, to be written at @offset, the codecs of the
+ * index are left for the caller to fill in.
+ */
+GeglBufferIndex *gegl_buffer_index_pack          (const GeglBufferIndexItem  *items,
+                                                  gint                        n_items,
+                                                  goffset                     offset);
+
 #define struct_check_padding(type, size) \
   if (sizeof (type) != size) \
     {\
@@ -142,7 +231,9 @@ GList          *gegl_buffer_read_index (int      i,
     }
 #define GEGL_BUFFER_STRUCT_CHECK_PADDING \
   {struct_check_padding (GeglBufferBlock, 16);\
-  struct_check_padding (GeglBufferHeader, 256);}
+  struct_check_padding (GeglBufferHeader, 256);\
+  struct_check_padding (GeglBufferIndexEntry, 24);\
+  struct_check_padding (GeglBufferIndex, 472);}
 #define GEGL_BUFFER_SANITY {static gboolean done=FALSE;if(!done){GEGL_BUFFER_STRUCT_CHECK_PADDING;done=TRUE;}}
 
 G_END_DECLS
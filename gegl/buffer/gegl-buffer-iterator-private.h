@@ -26,6 +26,12 @@ G_STATIC_ASSERT (GEGL_BUFFER_READWRITE == 0x3);
 #define GEGL_ITERATOR_INCOMPATIBLE (1 << 2)
 #define GEGL_ITERATOR_NO_NOTIFY    (1 << 3)
 
+/*  stats  */
+
+gint gegl_buffer_iterator_get_conversions        (void);
+gint gegl_buffer_iterator_get_conversions_cached (void);
+void gegl_buffer_iterator_reset_stats            (void);
+
 G_END_DECLS
 
 #endif
@@ -47,6 +47,7 @@ typedef enum {
   GeglIteratorTileMode_DirectTile,
   GeglIteratorTileMode_LinearTile,
   GeglIteratorTileMode_GetBuffer,
+  GeglIteratorTileMode_View,
   GeglIteratorTileMode_Empty,
 } GeglIteratorTileMode;
 
@@ -72,6 +73,8 @@ typedef struct _SubIterState {
   gpointer             indirect_data;
   /* Linear data members */
   GeglTile            *linear_tile;
+  /* View data members */
+  GeglTileView        *current_view;
 } SubIterState;
 
 struct _GeglBufferIteratorPriv
@@ -90,6 +93,13 @@ struct _GeglBufferIteratorPriv
                                         */
 };
 
+/* number of tiles converted between the storage format and the requested
+ * format, and number of conversions avoided by reusing a tile view.  these
+ * are updated atomically, since iterators run concurrently.
+ */
+static gint iterator_conversions        = 0;
+static gint iterator_conversions_cached = 0;
+
 static inline gint *
 get_access_order (GeglBufferIterator *iter)
 {
@@ -214,12 +224,24 @@ release_tile (GeglBufferIterator *iter,
       sub->current_tile = NULL;
       iter->items[index].data = NULL;
 
+      sub->current_tile_mode = GeglIteratorTileMode_Empty;
+    }
+  else if (sub->current_tile_mode == GeglIteratorTileMode_View)
+    {
+      gegl_tile_view_unref (sub->current_view);
+
+      sub->current_view       = NULL;
+      iter->items[index].data = NULL;
+
       sub->current_tile_mode = GeglIteratorTileMode_Empty;
     }
   else if (sub->current_tile_mode == GeglIteratorTileMode_GetBuffer)
     {
       if (sub->access_mode & GEGL_ACCESS_WRITE)
         {
+          if (sub->format != sub->buffer->soft_format)
+            g_atomic_int_inc (&iterator_conversions);
+
           gegl_buffer_set_unlocked_no_notify (sub->buffer,
                                               &sub->current_roi,
                                               sub->level,
@@ -354,16 +376,12 @@ get_tile (GeglBufferIterator *iter,
       sub->current_roi.width  = tile_width;
       sub->current_roi.height = tile_height;
 
-      g_rec_mutex_lock (&sub->buffer->tile_storage->mutex);
-
-      sub->current_tile = gegl_tile_handler_get_tile (
-        (GeglTileHandler *) sub->buffer,
+      sub->current_tile = _gegl_buffer_fetch_tile (
+        sub->buffer,
         tile_x, tile_y, sub->level,
         ! (sub->can_discard_data &&
            gegl_rectangle_contains (&sub->full_roi, &sub->current_roi)));
 
-      g_rec_mutex_unlock (&sub->buffer->tile_storage->mutex);
-
       if (sub->access_mode & GEGL_ACCESS_WRITE)
         gegl_tile_lock (sub->current_tile);
       else
@@ -383,19 +401,109 @@ level_to_scale (int level)
   return level?1.0/(1<<level):1.0;
 }
 
+/* Whether the current ROI of a sub-iterator that needs format conversion is
+ * exactly one tile of its buffer, whose converted data can be shared through
+ * a tile view. */
+static inline gboolean
+can_use_view (GeglBufferIterator *iter,
+              int                 index)
+{
+  GeglBufferIteratorPriv *priv   = iter->priv;
+  SubIterState           *sub    = &priv->sub_iter[index];
+  GeglBuffer             *buffer = sub->buffer;
+
+  return (sub->access_mode & GEGL_ACCESS_READ)                          &&
+         sub->level  == 0                                               &&
+         sub->format != buffer->soft_format                             &&
+         sub->current_roi.width  == buffer->tile_width                  &&
+         sub->current_roi.height == buffer->tile_height                 &&
+         gegl_tile_offset (sub->current_roi.x + buffer->shift_x,
+                           buffer->tile_width)  == 0                    &&
+         gegl_tile_offset (sub->current_roi.y + buffer->shift_y,
+                           buffer->tile_height) == 0                    &&
+         gegl_rectangle_contains (&buffer->abyss, &sub->current_roi);
+}
+
+/* Fetches the view of the current tile of a sub-iterator in the requested
+ * format, converting the tile only if it has no up to date view. */
+static inline GeglTileView *
+get_view (GeglBufferIterator *iter,
+          int                 index)
+{
+  GeglBufferIteratorPriv *priv   = iter->priv;
+  SubIterState           *sub    = &priv->sub_iter[index];
+  GeglBuffer             *buffer = sub->buffer;
+  GeglTile               *tile;
+  GeglTileView           *view;
+
+  tile = _gegl_buffer_fetch_tile (
+    buffer,
+    gegl_tile_indice (sub->current_roi.x + buffer->shift_x, buffer->tile_width),
+    gegl_tile_indice (sub->current_roi.y + buffer->shift_y, buffer->tile_height),
+    0, TRUE);
+
+  if (! tile)
+    return NULL;
+
+  gegl_tile_read_lock (tile);
+
+  view = gegl_tile_get_view (tile, buffer->soft_format, sub->format);
+
+  if (view)
+    {
+      g_atomic_int_inc (&iterator_conversions_cached);
+    }
+  else
+    {
+      view = gegl_tile_create_view (tile, buffer->soft_format, sub->format);
+
+      g_atomic_int_inc (&iterator_conversions);
+    }
+
+  gegl_tile_read_unlock (tile);
+  gegl_tile_unref (tile);
+
+  return view;
+}
+
 static inline void
 get_indirect (GeglBufferIterator *iter,
               int        index)
 {
   GeglBufferIteratorPriv *priv = iter->priv;
   SubIterState           *sub  = &priv->sub_iter[index];
+  GeglTileView           *view = NULL;
+
+  if (can_use_view (iter, index))
+    view = get_view (iter, index);
+
+  /* read-only access can use the shared view data directly */
+  if (view && ! (sub->access_mode & GEGL_ACCESS_WRITE))
+    {
+      sub->current_view       = view;
+      sub->current_row_stride = sub->current_roi.width * sub->format_bpp;
+
+      iter->items[index].data = view->data;
+      sub->current_tile_mode  = GeglIteratorTileMode_View;
+
+      return;
+    }
 
   sub->indirect_data = gegl_scratch_alloc (sub->format_bpp        *
                                            sub->current_roi.width *
                                            sub->current_roi.height);
 
-  if (sub->access_mode & GEGL_ACCESS_READ)
+  if (view)
     {
+      memcpy (sub->indirect_data, view->data, view->size);
+
+      gegl_tile_view_unref (view);
+    }
+  else if (sub->access_mode & GEGL_ACCESS_READ)
+    {
+      if (sub->format != sub->buffer->soft_format)
+        g_atomic_int_inc (&iterator_conversions);
+
       gegl_buffer_get_unlocked (sub->buffer, level_to_scale (sub->level), &sub->current_roi, sub->format,
                                 sub->indirect_data, GEGL_AUTO_ROWSTRIDE, sub->abyss_policy);
     }
@@ -432,7 +540,8 @@ needs_rows (GeglBufferIterator *iter,
   GeglBufferIteratorPriv *priv = iter->priv;
   SubIterState           *sub  = &priv->sub_iter[index];
 
-  if (sub->current_tile_mode == GeglIteratorTileMode_GetBuffer)
+  if (sub->current_tile_mode == GeglIteratorTileMode_GetBuffer ||
+      sub->current_tile_mode == GeglIteratorTileMode_View)
    return FALSE;
 
   if (iter->items[index].roi.width  != sub->buffer->tile_width ||
@@ -443,6 +552,73 @@ needs_rows (GeglBufferIterator *iter,
 }
 
 /* Do the final setup of the iter struct */
+static inline gboolean
+is_direct_candidate (SubIterState *sub)
+{
+  return gegl_buffer_get_format (sub->buffer) == sub->format &&
+         ! g_object_get_data (G_OBJECT (sub->buffer), "is-linear");
+}
+
+/* Picks the sub-iterator whose tile grid is iterated over.  When the buffers
+ * have different tile sizes, as with tile sizes picked per format, the finest
+ * grid is used if the tiles of all the other buffers are made of whole tiles
+ * of it; every buffer then keeps direct access to its tiles, the coarser ones
+ * being accessed by rows, instead of all the buffers but the first being
+ * copied through a temporary buffer.
+ */
+static inline gint
+get_origin_index (GeglBufferIterator *iter)
+{
+  GeglBufferIteratorPriv *priv   = iter->priv;
+  gint                    origin = 0;
+  SubIterState           *origin_sub;
+  gint                    origin_offset_x;
+  gint                    origin_offset_y;
+
+  for (gint index = 1; index < priv->used_slots; index++)
+    {
+      SubIterState *sub = &priv->sub_iter[index];
+
+      if (is_direct_candidate (sub) &&
+          (gint64) sub->buffer->tile_width * sub->buffer->tile_height <
+          (gint64) priv->sub_iter[origin].buffer->tile_width *
+                   priv->sub_iter[origin].buffer->tile_height)
+        {
+          origin = index;
+        }
+    }
+
+  if (origin == 0)
+    return 0;
+
+  origin_sub      = &priv->sub_iter[origin];
+  origin_offset_x = origin_sub->buffer->shift_x + origin_sub->full_roi.x;
+  origin_offset_y = origin_sub->buffer->shift_y + origin_sub->full_roi.y;
+
+  for (gint index = 0; index < priv->used_slots; index++)
+    {
+      SubIterState *sub = &priv->sub_iter[index];
+      gint          offset_x;
+      gint          offset_y;
+
+      if (! is_direct_candidate (sub))
+        continue;
+
+      offset_x = sub->buffer->shift_x + sub->full_roi.x;
+      offset_y = sub->buffer->shift_y + sub->full_roi.y;
+
+      if (sub->buffer->tile_width  % origin_sub->buffer->tile_width  != 0 ||
+          sub->buffer->tile_height % origin_sub->buffer->tile_height != 0 ||
+          abs (origin_offset_x - offset_x) % origin_sub->buffer->tile_width  != 0 ||
+          abs (origin_offset_y - offset_y) % origin_sub->buffer->tile_height != 0)
+        {
+          return 0;
+        }
+    }
+
+  return origin;
+}
+
 static inline void
 prepare_iterator (GeglBufferIterator *iter)
 {
@@ -451,18 +627,18 @@ prepare_iterator (GeglBufferIterator *iter)
   gint origin_offset_x;
   gint origin_offset_y;
 
-  /* Set up the origin tile */
-  /* FIXME: Pick the most compatable buffer, not just the first */
+  /* Set up the origin tile, in the coordinates of the first sub-iterator */
   {
-    GeglBuffer *buf = priv->sub_iter[0].buffer;
+    gint        origin = get_origin_index (iter);
+    GeglBuffer *buf    = priv->sub_iter[origin].buffer;
+
+    origin_offset_x = buf->shift_x + priv->sub_iter[origin].full_roi.x;
+    origin_offset_y = buf->shift_y + priv->sub_iter[origin].full_roi.y;
 
-    priv->origin_tile.x      = buf->shift_x;
-    priv->origin_tile.y      = buf->shift_y;
+    priv->origin_tile.x      = origin_offset_x - priv->sub_iter[0].full_roi.x;
+    priv->origin_tile.y      = origin_offset_y - priv->sub_iter[0].full_roi.y;
     priv->origin_tile.width  = buf->tile_width;
     priv->origin_tile.height = buf->tile_height;
-
-    origin_offset_x = buf->shift_x + priv->sub_iter[0].full_roi.x;
-    origin_offset_y = buf->shift_y + priv->sub_iter[0].full_roi.y;
   }
 
   /* Set up access order */
@@ -537,14 +713,27 @@ prepare_iterator (GeglBufferIterator *iter)
             }
         }
 
+      /* The tiles of a coarser grid are fetched again for each of their
+       * parts, their data must be kept.
+       */
+      if ((sub->buffer->tile_width  != priv->origin_tile.width ||
+           sub->buffer->tile_height != priv->origin_tile.height) &&
+          ! g_object_get_data (G_OBJECT (sub->buffer), "is-linear"))
+        {
+          sub->can_discard_data = FALSE;
+        }
+
       /* Format converison needed */
       if (gegl_buffer_get_format (sub->buffer) != sub->format)
         sub->access_mode |= GEGL_ITERATOR_INCOMPATIBLE;
       /* Incompatiable tiles */
-      else if ((priv->origin_tile.width  != sub->buffer->tile_width)  ||
-               (priv->origin_tile.height != sub->buffer->tile_height) ||
+      else if ((sub->buffer->tile_width  % priv->origin_tile.width  != 0) ||
+               (sub->buffer->tile_height % priv->origin_tile.height != 0) ||
                (abs(origin_offset_x - current_offset_x) % priv->origin_tile.width != 0) ||
-               (abs(origin_offset_y - current_offset_y) % priv->origin_tile.height != 0))
+               (abs(origin_offset_y - current_offset_y) % priv->origin_tile.height != 0) ||
+               (g_object_get_data (G_OBJECT (sub->buffer), "is-linear") &&
+                (priv->origin_tile.width  != sub->buffer->tile_width ||
+                 priv->origin_tile.height != sub->buffer->tile_height)))
         {
           /* Get the whole tile if the buffer is a linear buffer. */
           if (g_object_get_data (G_OBJECT (sub->buffer), "is-linear"))
@@ -810,7 +999,11 @@ gegl_buffer_iterator_next (GeglBufferIterator *iter)
             release_tile (iter, index);
         }
 
-      if (increment_rects (iter) == FALSE)
+      /* stop at a tile boundary when processing has been cancelled, the
+       * caller sees the iteration end as if the area had been covered
+       */
+      if (increment_rects (iter) == FALSE ||
+          (gegl_buffer_ext_is_cancelled && gegl_buffer_ext_is_cancelled ()))
         {
           gegl_buffer_iterator_stop (iter);
           return FALSE;
@@ -826,3 +1019,22 @@ gegl_buffer_iterator_next (GeglBufferIterator *iter)
       return FALSE;
     }
 }
+
+gint
+gegl_buffer_iterator_get_conversions (void)
+{
+  return g_atomic_int_get (&iterator_conversions);
+}
+
+gint
+gegl_buffer_iterator_get_conversions_cached (void)
+{
+  return g_atomic_int_get (&iterator_conversions_cached);
+}
+
+void
+gegl_buffer_iterator_reset_stats (void)
+{
+  g_atomic_int_set (&iterator_conversions,        0);
+  g_atomic_int_set (&iterator_conversions_cached, 0);
+}
@@ -37,6 +37,7 @@
 #include "gegl-buffer.h"
 #include "gegl-buffer-private.h"
 #include "gegl-buffer-index.h"
+#include "gegl-compression.h"
 #include "gegl-debug.h"
 
 #include <glib/gprintf.h>
@@ -65,10 +66,10 @@ typedef struct
   gboolean         got_header;
 } LoadInfo;
 
-static void seekto(LoadInfo *info, gint offset)
+static void seekto(LoadInfo *info, goffset offset)
 {
   info->offset = offset;
-  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "seek to %i", offset);
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "seek to %i", (gint)offset);
   if(lseek (info->i, info->offset, SEEK_SET) == -1)
     {
       g_warning ("failed seeking");
@@ -240,6 +241,146 @@ gegl_buffer_read_index (int           i,
   return ret;
 }
 
+GeglBufferIndex *
+gegl_buffer_read_tile_index (int     i,
+                             goffset offset)
+{
+  GeglBufferIndex *index;
+  ssize_t          sz_read;
+  guint            z;
+
+  if (offset == 0)
+    return NULL;
+
+  if (lseek (i, offset, SEEK_SET) == -1)
+    {
+      g_warning ("failed seeking to %i", (gint)offset);
+      return NULL;
+    }
+
+  index   = g_malloc (sizeof (GeglBufferIndex));
+  sz_read = read (i, index, sizeof (GeglBufferIndex));
+
+  if (sz_read != sizeof (GeglBufferIndex)        ||
+      index->block.flags != GEGL_FLAG_INDEX      ||
+      index->block.length < sizeof (GeglBufferIndex) ||
+      index->n_levels > GEGL_FILE_MAX_LEVELS     ||
+      index->n_codecs > GEGL_FILE_MAX_CODECS)
+    {
+      g_warning ("invalid tile index at %i", (gint)offset);
+      g_free (index);
+      return NULL;
+    }
+
+  /* the entries of every stored level have to lie within the block, so
+   * that a corrupt grid can't make us read, or allocate, past it
+   */
+  for (z = 0; z < index->n_levels; z++)
+    {
+      const GeglBufferIndexLevel *level = &index->levels[z];
+      guint64                     start;
+
+      if (! level->offset)
+        continue;
+
+      start = (guint64) offset + sizeof (GeglBufferIndex);
+
+      if (level->offset < start                                       ||
+          level->offset - offset > index->block.length                ||
+          (guint64) level->width * level->height >
+          (index->block.length - (level->offset - offset)) /
+          sizeof (GeglBufferIndexEntry))
+        {
+          g_warning ("invalid level %i in tile index at %i", z, (gint)offset);
+          g_free (index);
+          return NULL;
+        }
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "read tile index: length:%i levels:%i",
+             index->block.length, index->n_levels);
+
+  return index;
+}
+
+goffset
+gegl_buffer_index_entry_offset (const GeglBufferIndex *index,
+                                gint                   x,
+                                gint                   y,
+                                gint                   z)
+{
+  const GeglBufferIndexLevel *level;
+
+  if (z < 0 || z >= index->n_levels)
+    return 0;
+
+  level = &index->levels[z];
+
+  if (! level->offset                               ||
+      x < level->x || x - level->x >= level->width  ||
+      y < level->y || y - level->y >= level->height)
+    {
+      return 0;
+    }
+
+  return level->offset +
+         ((goffset) (y - level->y) * level->width + (x - level->x)) *
+         sizeof (GeglBufferIndexEntry);
+}
+
+gboolean
+gegl_buffer_index_decode (const GeglBufferIndex      *index,
+                          const GeglBufferIndexEntry *entry,
+                          const Babl                 *format,
+                          gconstpointer               data,
+                          gpointer                    dest,
+                          gint                        tile_size)
+{
+  const GeglCompression *compression;
+  gchar                  name[GEGL_FILE_CODEC_NAME_SIZE + 1];
+
+  if (entry->codec == 0)
+    {
+      if (entry->length != tile_size)
+        {
+          g_warning ("tile data is %i bytes, expected %i",
+                     entry->length, tile_size);
+          return FALSE;
+        }
+
+      memcpy (dest, data, tile_size);
+      return TRUE;
+    }
+
+  if (entry->codec > index->n_codecs)
+    {
+      g_warning ("tile data compressed with unknown codec %i", entry->codec);
+      return FALSE;
+    }
+
+  memcpy (name, index->codecs[entry->codec - 1], GEGL_FILE_CODEC_NAME_SIZE);
+  name[GEGL_FILE_CODEC_NAME_SIZE] = '\0';
+
+  compression = gegl_compression (name);
+
+  if (! compression)
+    {
+      g_warning ("tile data compressed with unsupported algorithm '%s'", name);
+      return FALSE;
+    }
+
+  if (! gegl_compression_decompress (
+          compression, format,
+          dest, tile_size / babl_format_get_bytes_per_pixel (format),
+          data, entry->length))
+    {
+      g_warning ("failed to decompress tile data");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 
 static void sanity(void) { GEGL_BUFFER_SANITY; }
 
@@ -258,6 +399,120 @@ gegl_buffer_open (const gchar *path)
                        NULL);
 }
 
+/* loads the tiles of a file with a GeglBufferIndex, the stored mipmap
+ * levels are left out, they are only used by buffers opened from the file.
+ */
+static void
+load_indexed (LoadInfo   *info,
+              GeglBuffer *buffer)
+{
+  GeglBufferIndex      *index;
+  GeglBufferIndexLevel *level;
+  GeglBufferIndexEntry *entries;
+  guchar               *data      = NULL;
+  gint                  data_size = 0;
+  gsize                 n_entries;
+  gsize                 i;
+  gint                  n_loaded  = 0;
+
+  index = gegl_buffer_read_tile_index (info->i, info->header.next);
+
+  if (! index)
+    return;
+
+  level = &index->levels[0];
+
+  if (index->n_levels == 0 || ! level->offset)
+    {
+      g_free (index);
+      return;
+    }
+
+  /* the entries of the level are read at once, and the tiles in the order
+   * they were written in
+   */
+  n_entries = (gsize) level->width * level->height;
+  entries   = g_new (GeglBufferIndexEntry, n_entries);
+
+  seekto (info, level->offset);
+  {
+    ssize_t sz_read = read (info->i, entries,
+                            n_entries * sizeof (GeglBufferIndexEntry));
+    if (sz_read != n_entries * sizeof (GeglBufferIndexEntry))
+      {
+        g_warning ("failed reading tile index of %s", info->path);
+        n_entries = 0;
+      }
+    else
+      {
+        info->offset += sz_read;
+      }
+  }
+
+  for (i = 0; i < n_entries; i++)
+    {
+      GeglBufferIndexEntry *entry = &entries[i];
+      GeglTile             *tile;
+      ssize_t               sz_read;
+
+      if (! entry->offset)
+        continue;
+
+      /* tiles are never stored larger than their uncompressed size */
+      if (entry->length == 0 || entry->length > (guint) info->tile_size)
+        {
+          g_warning ("invalid tile entry %i in %s", (gint) i, info->path);
+          continue;
+        }
+
+      if (entry->length > data_size)
+        {
+          data_size = entry->length;
+          data      = g_realloc (data, data_size);
+        }
+
+      if (info->offset != entry->offset)
+        seekto (info, entry->offset);
+
+      sz_read = read (info->i, data, entry->length);
+      if (sz_read != entry->length)
+        {
+          g_warning ("failed reading tile data of %s", info->path);
+          info->offset = -1;
+          continue;
+        }
+      info->offset += sz_read;
+
+      tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                        level->x + (gint) (i % level->width),
+                                        level->y + (gint) (i / level->width),
+                                        0);
+      g_assert (tile);
+      gegl_tile_lock (tile);
+
+      if (gegl_buffer_index_decode (index, entry, info->format,
+                                    data, gegl_tile_get_data (tile),
+                                    info->tile_size))
+        {
+          n_loaded++;
+        }
+      else
+        {
+          /* leave the tile empty rather than half decoded */
+          memset (gegl_tile_get_data (tile), 0, info->tile_size);
+        }
+
+      gegl_tile_unlock (tile);
+      gegl_tile_unref (tile);
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "%i tiles loaded", n_loaded);
+
+  g_free (data);
+  g_free (entries);
+  g_free (index);
+}
+
 GeglBuffer *
 gegl_buffer_load (const gchar *path)
 {
@@ -301,6 +556,16 @@ gegl_buffer_load (const gchar *path)
   */
   g_assert (babl_format_get_bytes_per_pixel (info->format) == info->header.bytes_per_pixel);
 
+  if (gegl_buffer_header_get_rev (&info->header) == GEGL_FILE_SPEC_REV_INDEX)
+    {
+      load_indexed (info, ret);
+
+      GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "buffer loaded %s", info->path);
+
+      load_info_destroy (info);
+      return ret;
+    }
+
   info->tiles = gegl_buffer_read_index (info->i, &info->offset);
 
   /* load each tile */
@@ -134,12 +134,30 @@ void              gegl_buffer_get_unlocked (GeglBuffer          *buffer,
 GeglBuffer *      gegl_buffer_new_ram     (const GeglRectangle *extent,
                                            const Babl          *format);
 
+/* the tile size of new buffers of @format, picked according to the
+ * "tile-size-target" config property; @aspect is the preferred ratio of the
+ * width of the tiles to their height, or 0.0 for the ratio of the configured
+ * tile size.
+ */
+void              gegl_buffer_get_tile_size_for_format (const Babl *format,
+                                                        gdouble     aspect,
+                                                        gint       *tile_width,
+                                                        gint       *tile_height);
+
+/* hints the time it takes to compute a pixel of @buffer, in seconds, which
+ * the tile cache uses to keep expensive tiles longer.
+ */
+void              gegl_buffer_set_pixel_cost (GeglBuffer *buffer,
+                                              gdouble     pixel_cost);
+
 void              gegl_buffer_emit_changed_signal (GeglBuffer *buffer,
                                                    const GeglRectangle *rect);
 
 /* the instance size of a GeglTile is a bit large, and should if possible be
  * trimmed down
  */
+typedef struct _GeglTileView GeglTileView;
+
 struct _GeglTile
 {
  /* GObject          parent_instance;*/
@@ -172,6 +190,12 @@ struct _GeglTile
   guint            keep_identity:1;  /* maintain data pointer identity, rather
                                       * than data content only
                                       */
+  guint            is_uniform_tile:1; /* whether all the pixels of the tile
+                                       * data are equal, so that its first
+                                       * pixel stands for the whole tile
+                                       * (allowing for false negatives, but
+                                       * not false positives)
+                                       */
 
   gint             clone_state; /* tile clone/unclone state & spinlock */
   gint            *n_clones;    /* an array of two atomic counters, shared
@@ -187,6 +211,11 @@ struct _GeglTile
 
   guint64          damage;
 
+  guintptr         cache_time;  /* the cache time of the tile's last fetch
+                                 * through the storage index, see
+                                 * gegl_tile_handler_cache_tile_accessed()
+                                 */
+
   /* called when the tile is about to be destroyed */
   GDestroyNotify   destroy_notify;
   gpointer         destroy_notify_data;
@@ -196,15 +225,79 @@ struct _GeglTile
    */
   GeglTileCallback unlock_notify;
   gpointer         unlock_notify_data;
+
+  /* the tile data converted to the format it was last read in through an
+   * iterator, valid as long as the tile revision doesn't change
+   */
+  GeglTileView    *view;
 };
 
+/* a converted, read-only, copy of the data of a tile.  views are shared
+ * among the readers of the tile, and dropped when the tile is written to.
+ */
+struct _GeglTileView
+{
+  gint             ref_count;
+  const Babl      *src_format;  /* the format the tile data was read as */
+  const Babl      *format;      /* the format of the view data */
+  guint            rev;         /* the tile revision the view was made of */
+  gint             size;
+  guchar          *data;
+};
+
+GeglTileView * gegl_tile_get_view     (GeglTile     *tile,
+                                       const Babl   *src_format,
+                                       const Babl   *format);
+GeglTileView * gegl_tile_create_view  (GeglTile     *tile,
+                                       const Babl   *src_format,
+                                       const Babl   *format);
+void           gegl_tile_view_unref   (GeglTileView *view);
+
+guint64        gegl_tile_view_get_total (void);
+
 gboolean gegl_tile_needs_store    (GeglTile *tile);
 void     gegl_tile_unlock_no_void (GeglTile *tile);
 gboolean gegl_tile_damage         (GeglTile *tile,
                                    guint64   damage);
 
+/* creates a tile of @size bytes, filled with the @bpp bytes of @pixel, and
+ * marked as uniform.  the tile is dirty, use gegl_tile_mark_as_stored() when
+ * creating it from stored data.
+ */
+GeglTile * gegl_tile_new_uniform  (gint          size,
+                                   gconstpointer pixel,
+                                   gint          bpp);
+
+/* returns a 64-bit hash of the data of @tile, used for finding tiles with
+ * identical content.  equal hashes don't imply equal data.
+ */
+guint64    gegl_tile_hash         (GeglTile     *tile);
+
+/* uniform tiles, including the empty ones, can be read, converted and stored
+ * as a single pixel.
+ */
+#define gegl_tile_is_uniform(tile) ((tile)->is_uniform_tile || \
+                                    (tile)->is_zero_tile)
+
 void _gegl_buffer_drop_hot_tile (GeglBuffer *buffer);
 
+GeglTile * _gegl_buffer_fetch_tile (GeglBuffer *buffer,
+                                    gint        x,
+                                    gint        y,
+                                    gint        z,
+                                    gboolean    preserve_data);
+
+/* fetches a rectangle of tiles, like _gegl_buffer_fetch_tile() with
+ * preserve_data, through a single GEGL_TILE_GET_N command.
+ */
+void       _gegl_buffer_fetch_tiles (GeglBuffer  *buffer,
+                                     gint         x,
+                                     gint         y,
+                                     gint         z,
+                                     gint         width,
+                                     gint         height,
+                                     GeglTile   **tiles);
+
 GeglRectangle _gegl_get_required_for_scale (const GeglRectangle *roi,
                                             gdouble              scale);
 
@@ -219,6 +312,8 @@ gboolean gegl_buffer_scan_compatible (GeglBuffer *bufferA,
 extern void (*gegl_tile_handler_cache_ext_flush) (void *tile_handler_cache, const GeglRectangle *rect);
 extern void (*gegl_buffer_ext_flush) (GeglBuffer *buffer, const GeglRectangle *rect);
 extern void (*gegl_buffer_ext_invalidate) (GeglBuffer *buffer, const GeglRectangle *rect);
+/* set by gegl_parallel_init(), iterators stop early when it returns TRUE */
+extern gboolean (*gegl_buffer_ext_is_cancelled) (void);
 
 
 extern void (*gegl_resample_bilinear) (guchar *dest_buf,
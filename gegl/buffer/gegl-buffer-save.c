@@ -30,6 +30,7 @@
 #include <io.h>
 #define write _write
 #define close _close
+#define lseek _lseek
 #endif
 #include <errno.h>
 
@@ -39,6 +40,8 @@
 #include "gegl-buffer.h"
 #include "gegl-buffer-types.h"
 #include "gegl-buffer-private.h"
+#include "gegl-buffer-config.h"
+#include "gegl-compression.h"
 #include "gegl-debug.h"
 #include "gegl-tile-storage.h"
 #include "gegl-tile.h"
@@ -63,20 +66,20 @@ typedef SSIZE_T ssize_t;
 #define BINARY_FLAG 0
 #endif
 
+/* maximal tile-data compression ratio, above which tiles are stored
+ * uncompressed, to avoid decompression overhead.
+ */
+#define COMPRESSION_MAX_RATIO 0.95
+
 typedef struct
 {
   GeglBufferHeader header;
-  GList           *tiles;
+  GArray          *items;
   gchar           *path;
   gint             o;
 
   gint             tile_size;
-  gint             offset;
-  gint             entry_count;
-  GeglBufferBlock *in_holding; /* we need to write one block added behind
-                                * to be able to recompute the forward pointing
-                                * link from one entry to the next.
-                                */
+  goffset          offset;
 } SaveInfo;
 
 
@@ -101,30 +104,30 @@ gegl_tile_entry_destroy (GeglBufferTile *entry)
   g_free (entry);
 }
 
-static gsize write_block (SaveInfo        *info,
-                          GeglBufferBlock *block)
+static gboolean
+write_data (SaveInfo      *info,
+            gconstpointer  data,
+            gsize          size)
 {
-   gssize ret = 0;
-
-   if (info->in_holding)
-     {
-       glong allocated_pos = info->offset + info->in_holding->length;
-       info->in_holding->next = allocated_pos;
-
-       if (block == NULL)
-         info->in_holding->next = 0;
-
-       ret = write (info->o, info->in_holding, info->in_holding->length);
-       if (ret == -1)
-         ret = 0;
-       info->offset += ret;
-       g_assert (allocated_pos == info->offset);
-     }
-  /* write block should also allocate the block and update the
-   * previously added blocks next pointer
-   */
-   info->in_holding = block;
-   return ret;
+  const guchar *src = data;
+
+  while (size > 0)
+    {
+      ssize_t ret = write (info->o, src, size);
+
+      if (ret <= 0)
+        {
+          g_warning ("%s: Could not write to '%s': %s",
+                     G_STRFUNC, info->path, g_strerror (errno));
+          return FALSE;
+        }
+
+      info->offset += ret;
+      src          += ret;
+      size         -= ret;
+    }
+
+  return TRUE;
 }
 
 static void
@@ -136,55 +139,206 @@ save_info_destroy (SaveInfo *info)
     g_free (info->path);
   if (info->o != -1)
     close (info->o);
-  if (info->tiles != NULL)
-    {
-      GList *iter;
-      for (iter = info->tiles; iter; iter = iter->next)
-        gegl_tile_entry_destroy (iter->data);
-      g_list_free (info->tiles);
-      info->tiles = NULL;
-    }
+  if (info->items)
+    g_array_free (info->items, TRUE);
   g_slice_free (SaveInfo, info);
 }
 
+GeglBufferIndex *
+gegl_buffer_index_pack (const GeglBufferIndexItem *items,
+                        gint                       n_items,
+                        goffset                    offset)
+{
+  GeglBufferIndex      *index;
+  GeglBufferIndexEntry *entries;
+  gboolean              used[GEGL_FILE_MAX_LEVELS]  = { FALSE, };
+  gint                  x0[GEGL_FILE_MAX_LEVELS];
+  gint                  y0[GEGL_FILE_MAX_LEVELS];
+  gint                  x1[GEGL_FILE_MAX_LEVELS];
+  gint                  y1[GEGL_FILE_MAX_LEVELS];
+  gsize                 first[GEGL_FILE_MAX_LEVELS] = { 0, };
+  gsize                 n_entries = 0;
+  gsize                 size;
+  gint                  n_levels  = 0;
+  gint                  i;
+  gint                  z;
+
+  /* the grid of each level is the bounding box of its tiles */
+  for (i = 0; i < n_items; i++)
+    {
+      const GeglBufferIndexItem *item = &items[i];
 
+      z = item->z;
 
-static glong z_order (const GeglBufferTile *entry)
-{
-  glong value;
+      if (z < 0 || z >= GEGL_FILE_MAX_LEVELS)
+        continue;
+
+      if (! used[z])
+        {
+          x0[z] = x1[z] = item->x;
+          y0[z] = y1[z] = item->y;
+          used[z] = TRUE;
+        }
+      else
+        {
+          x0[z] = MIN (x0[z], item->x);
+          y0[z] = MIN (y0[z], item->y);
+          x1[z] = MAX (x1[z], item->x);
+          y1[z] = MAX (y1[z], item->y);
+        }
 
-  gint  i;
-  gint  srcA = entry->x;
-  gint  srcB = entry->y;
-  gint  srcC = entry->z;
+      n_levels = MAX (n_levels, z + 1);
+    }
 
-  /* interleave the 10 least significant bits of all coordinates,
-   * this gives us Z-order / morton order of the space and should
-   * work well as a hash
-   */
-  value = 0;
-  for (i = 20; i >= 0; i--)
+  for (z = 0; z < n_levels; z++)
     {
-#define ADD_BIT(bit)    do { value |= (((bit) != 0) ? 1 : 0); value <<= 1; \
-    } \
-  while (0)
-      ADD_BIT (srcA & (1 << i));
-      ADD_BIT (srcB & (1 << i));
-      ADD_BIT (srcC & (1 << i));
-#undef ADD_BIT
+      if (used[z])
+        {
+          first[z]   = n_entries;
+          n_entries += (gsize) (x1[z] - x0[z] + 1) * (y1[z] - y0[z] + 1);
+        }
     }
-  return value;
+
+  size  = sizeof (GeglBufferIndex) + n_entries * sizeof (GeglBufferIndexEntry);
+  index = g_malloc0 (size);
+
+  index->block.length = size;
+  index->block.flags  = GEGL_FLAG_INDEX;
+  index->block.next   = 0;
+  index->n_levels     = n_levels;
+
+  for (z = 0; z < n_levels; z++)
+    {
+      GeglBufferIndexLevel *level = &index->levels[z];
+
+      if (! used[z])
+        continue;
+
+      level->x      = x0[z];
+      level->y      = y0[z];
+      level->width  = x1[z] - x0[z] + 1;
+      level->height = y1[z] - y0[z] + 1;
+      level->offset = offset + sizeof (GeglBufferIndex) +
+                      first[z] * sizeof (GeglBufferIndexEntry);
+    }
+
+  entries = (GeglBufferIndexEntry *) (index + 1);
+
+  for (i = 0; i < n_items; i++)
+    {
+      const GeglBufferIndexItem  *item = &items[i];
+      const GeglBufferIndexLevel *level;
+
+      z = item->z;
+
+      if (z < 0 || z >= GEGL_FILE_MAX_LEVELS)
+        continue;
+
+      level = &index->levels[z];
+
+      entries[first[z] + (gsize) (item->y - level->y) * level->width +
+                         (item->x - level->x)] = item->entry;
+    }
+
+  return index;
 }
 
-static gint z_order_compare (gconstpointer a,
-                             gconstpointer b)
+/* collects the tiles of @roi to be written, for levels 0 to @n_levels - 1.
+ * the tiles of level 0 are written if they exist, and those of the mipmap
+ * levels if any of the tiles they are downscaled from are written.
+ */
+static void
+collect_tiles (SaveInfo            *info,
+               GeglBuffer          *buffer,
+               const GeglRectangle *roi,
+               gint                 n_levels)
 {
-  const GeglBufferTile *entryA = a;
-  const GeglBufferTile *entryB = b;
+  gint      tile_width  = buffer->tile_storage->tile_width;
+  gint      tile_height = buffer->tile_storage->tile_height;
+  gboolean *prev        = NULL;
+  gint      prev_x      = 0;
+  gint      prev_y      = 0;
+  gint      prev_width  = 0;
+  gint      prev_height = 0;
+  gint      z;
+
+  info->items = g_array_new (FALSE, TRUE, sizeof (GeglBufferIndexItem));
+
+  if (roi->width <= 0 || roi->height <= 0)
+    return;
 
-  return z_order (entryB) - z_order (entryA);
-}
+  for (z = 0; z < n_levels; z++)
+    {
+      gint      x0     = gegl_tile_indice (roi->x, tile_width << z);
+      gint      y0     = gegl_tile_indice (roi->y, tile_height << z);
+      gint      x1     = gegl_tile_indice (roi->x + roi->width - 1,
+                                           tile_width << z);
+      gint      y1     = gegl_tile_indice (roi->y + roi->height - 1,
+                                           tile_height << z);
+      gint      width  = x1 - x0 + 1;
+      gint      height = y1 - y0 + 1;
+      gboolean *present;
+      gint      tx;
+      gint      ty;
+
+      present = g_new0 (gboolean, width * height);
+
+      for (ty = y0; ty <= y1; ty++)
+        for (tx = x0; tx <= x1; tx++)
+          {
+            gboolean stored = FALSE;
+
+            if (z == 0)
+              {
+                stored = gegl_tile_source_exist (GEGL_TILE_SOURCE (buffer),
+                                                 tx, ty, z);
+              }
+            else
+              {
+                gint i, j;
+
+                for (j = 0; j < 2; j++)
+                  for (i = 0; i < 2; i++)
+                    {
+                      gint px = 2 * tx + i - prev_x;
+                      gint py = 2 * ty + j - prev_y;
+
+                      if (px >= 0 && px < prev_width &&
+                          py >= 0 && py < prev_height &&
+                          prev[py * prev_width + px])
+                        {
+                          stored = TRUE;
+                        }
+                    }
+              }
+
+            if (stored)
+              {
+                GeglBufferIndexItem item = { tx, ty, z, };
 
+                GEGL_NOTE (GEGL_DEBUG_BUFFER_SAVE,
+                           "Found tile to save, tx, ty, z = %d, %d, %d",
+                           tx, ty, z);
+
+                g_array_append_val (info->items, item);
+                present[(ty - y0) * width + (tx - x0)] = TRUE;
+              }
+          }
+
+      g_free (prev);
+      prev        = present;
+      prev_x      = x0;
+      prev_y      = y0;
+      prev_width  = width;
+      prev_height = height;
+
+      /* further levels would be a single tile as well */
+      if (width == 1 && height == 1)
+        break;
+    }
+
+  g_free (prev);
+}
 
 void
 gegl_buffer_header_init (GeglBufferHeader *header,
@@ -224,12 +378,17 @@ gegl_buffer_save (GeglBuffer          *buffer,
                   const gchar         *path,
                   const GeglRectangle *roi)
 {
-  SaveInfo *info = g_slice_new0 (SaveInfo);
-
-  glong prediction = 0;
-  gint bpp;
-  gint tile_width;
-  gint tile_height;
+  SaveInfo              *info = g_slice_new0 (SaveInfo);
+  GeglBufferConfig      *config = gegl_buffer_config ();
+  const Babl            *format;
+  const GeglCompression *compression = NULL;
+  GeglBufferIndex       *index;
+  guchar                *compressed = NULL;
+  gint                   max_compressed_size = 0;
+  gint                   bpp;
+  gint                   tile_width;
+  gint                   tile_height;
+  guint                  i;
 
   GEGL_BUFFER_SANITY;
 
@@ -240,11 +399,6 @@ gegl_buffer_save (GeglBuffer          *buffer,
              "starting to save buffer %s, roi: %d,%d %dx%d",
              path, roi->x, roi->y, roi->width, roi->height);
 
-  /* a header should follow the same structure as a blockdef with
-   * respect to the flags and next offsets, thus this is a valid
-   * cast shortcut.
-   */
-
   info->path = g_strdup (path);
 
 #ifndef G_OS_WIN32
@@ -255,9 +409,14 @@ gegl_buffer_save (GeglBuffer          *buffer,
 
 
   if (info->o == -1)
-    g_warning ("%s: Could not open '%s': %s", G_STRFUNC, info->path, g_strerror(errno));
+    {
+      g_warning ("%s: Could not open '%s': %s", G_STRFUNC, info->path, g_strerror(errno));
+      save_info_destroy (info);
+      return;
+    }
   tile_width  = buffer->tile_storage->tile_width;
   tile_height = buffer->tile_storage->tile_height;
+  format      = buffer->tile_storage->format;
   g_object_get (buffer, "px-size", &bpp, NULL);
 
   info->header.x           = roi->x;
@@ -268,127 +427,113 @@ gegl_buffer_save (GeglBuffer          *buffer,
                            tile_width,
                            tile_height,
                            bpp,
-                           buffer->tile_storage->format
+                           format
                            );
-  info->header.next = (prediction += sizeof (GeglBufferHeader));
-  info->tile_size = tile_width * tile_height * bpp;
+  info->header.flags = (info->header.flags & ~0xff) | GEGL_FILE_SPEC_REV_INDEX;
+  info->tile_size    = tile_width * tile_height * bpp;
 
   g_assert (info->tile_size % 16 == 0);
 
   GEGL_NOTE (GEGL_DEBUG_BUFFER_SAVE,
              "collecting list of tiles to be written");
-  {
-    gint z;
-    gint factor = 1;
 
-    for (z = 0; z < 1; z++)
-      {
-        gint bufy = roi->y;
-        while (bufy < roi->y + roi->height)
-          {
-            gint tiledy  = roi->y + bufy;
-            gint offsety = gegl_tile_offset (tiledy, tile_height);
-            gint bufx    = roi->x;
+  collect_tiles (info, buffer, roi, 1 + config->file_mipmap_levels);
 
-            while (bufx < roi->x + roi->width)
-              {
-                gint tiledx  = roi->x + bufx;
-                gint offsetx = gegl_tile_offset (tiledx, tile_width);
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_SAVE,
+             "size of list of tiles to be written: %d",
+             info->items->len);
 
-                gint tx = gegl_tile_indice (tiledx / factor, tile_width);
-                gint ty = gegl_tile_indice (tiledy / factor, tile_height);
+  /* the index directly follows the header, and is followed by the tiles,
+   * the entries are filled in as the tiles are written.
+   */
+  index = gegl_buffer_index_pack ((GeglBufferIndexItem *) info->items->data,
+                                  info->items->len,
+                                  sizeof (GeglBufferHeader));
+  info->header.next = sizeof (GeglBufferHeader);
+
+  if (! write_data (info, &info->header, sizeof (GeglBufferHeader)) ||
+      lseek (info->o, info->header.next + index->block.length,
+             SEEK_SET) == -1)
+    {
+      g_free (index);
+      save_info_destroy (info);
+      return;
+    }
+  info->offset = info->header.next + index->block.length;
+  g_free (index);
 
-                if (gegl_tile_source_exist (GEGL_TILE_SOURCE (buffer), tx, ty, z))
-                  {
-                    GeglBufferTile *entry;
+  if (config->file_compression &&
+      strlen (config->file_compression) < GEGL_FILE_CODEC_NAME_SIZE)
+    {
+      compression = gegl_compression (config->file_compression);
+    }
 
-                    GEGL_NOTE (GEGL_DEBUG_BUFFER_SAVE,
-                               "Found tile to save, tx, ty, z = %d, %d, %d",
-                               tx, ty, z);
+  if (compression)
+    {
+      max_compressed_size = info->tile_size * COMPRESSION_MAX_RATIO;
+      compressed          = g_malloc (max_compressed_size);
+    }
 
-                    entry = gegl_tile_entry_new (tx, ty, z);
-                    info->tiles = g_list_prepend (info->tiles, entry);
-                    info->entry_count++;
-                  }
-                bufx += (tile_width - offsetx) * factor;
-              }
-            bufy += (tile_height - offsety) * factor;
-          }
-        factor *= 2;
-      }
-  GEGL_NOTE (GEGL_DEBUG_BUFFER_SAVE,
-             "size of list of tiles to be written: %d",
-             g_list_length (info->tiles));
-  }
+  /* save each tile */
+  for (i = 0; i < info->items->len; i++)
+    {
+      GeglBufferIndexItem *item = &g_array_index (info->items,
+                                                  GeglBufferIndexItem, i);
+      GeglTile            *tile;
+      guchar              *data;
+      gint                 compressed_size;
+      goffset              offset = info->offset;
+
+      tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                        item->x,
+                                        item->y,
+                                        item->z);
+      if (! tile)
+        continue;
+
+      data = gegl_tile_get_data (tile);
+      g_assert (data);
+
+      if (compression &&
+          gegl_compression_compress (compression, format,
+                                     data, info->tile_size / bpp,
+                                     compressed, &compressed_size,
+                                     max_compressed_size))
+        {
+          item->entry.codec  = 1;
+          item->entry.length = compressed_size;
+          data               = compressed;
+        }
+      else
+        {
+          item->entry.codec  = 0;
+          item->entry.length = info->tile_size;
+        }
 
-  /* sort the list of tiles into zorder */
-  info->tiles = g_list_sort (info->tiles, z_order_compare);
+      item->entry.rev = gegl_tile_get_rev (tile);
 
-  /* set the offset in the file each tile will be stored on */
-  {
-    GList *iter;
-    gint   predicted_offset = sizeof (GeglBufferHeader) +
-                              sizeof (GeglBufferTile) * (info->entry_count);
-    for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferTile *entry = iter->data;
-        entry->block.next = iter->next?
-                            (prediction += sizeof (GeglBufferTile)):0;
-        entry->offset = predicted_offset;
-        predicted_offset += info->tile_size;
-      }
-  }
+      if (write_data (info, data, item->entry.length))
+        item->entry.offset = offset;
 
-  /* save the header */
-  {
-    ssize_t ret = write (info->o, &info->header, sizeof (GeglBufferHeader));
-    if (ret != -1)
-      info->offset += ret;
-  }
-  g_assert (info->offset == info->header.next);
+      gegl_tile_unref (tile);
+    }
+
+  g_free (compressed);
 
   /* save the index */
-  {
-    GList *iter;
-    for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferItem *item = iter->data;
+  index = gegl_buffer_index_pack ((GeglBufferIndexItem *) info->items->data,
+                                  info->items->len,
+                                  info->header.next);
+  if (compression)
+    {
+      index->n_codecs = 1;
+      strcpy (index->codecs[0], config->file_compression);
+    }
 
-        write_block (info, &item->block);
+  if (lseek (info->o, info->header.next, SEEK_SET) != -1)
+    write_data (info, index, index->block.length);
 
-      }
-  }
-  write_block (info, NULL); /* terminate the index */
+  g_free (index);
 
-  /* update header to point to start of new index (already done for
-   * this serial saver, and the header is already written.
-   */
-
-  /* save each tile */
-  {
-    GList *iter;
-    for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferTile *entry = iter->data;
-        guchar          *data;
-        GeglTile        *tile;
-
-        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
-                                          entry->x,
-                                          entry->y,
-                                          entry->z);
-        g_assert (tile);
-        data = gegl_tile_get_data (tile);
-        g_assert (data);
-
-        g_assert (info->offset == entry->offset);
-        {
-          ssize_t ret = write (info->o, data, info->tile_size);
-          if (ret != -1)
-            info->offset += ret;
-        }
-        gegl_tile_unref (tile);
-      }
-  }
   save_info_destroy (info);
 }
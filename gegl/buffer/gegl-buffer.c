@@ -533,6 +533,20 @@ gegl_buffer_constructor (GType                  type,
               buffer->format = babl_format ("RGBA float");
             }
 
+          if (buffer->tile_width <= 0 || buffer->tile_height <= 0)
+            {
+              gint tile_width;
+              gint tile_height;
+
+              gegl_buffer_get_tile_size_for_format (buffer->format, 0.0,
+                                                    &tile_width, &tile_height);
+
+              if (buffer->tile_width <= 0)
+                buffer->tile_width = tile_width;
+              if (buffer->tile_height <= 0)
+                buffer->tile_height = tile_height;
+            }
+
           /* make a new backend & storage */
 
           if (buffer->path)
@@ -707,6 +721,14 @@ gegl_buffer_constructor (GType                  type,
   if (! buffer->soft_format)
     buffer->soft_format = buffer->format;
 
+  /* inherit the tile size when no size was given for a buffer on top of
+   * another tile source
+   */
+  if (buffer->tile_width <= 0)
+    buffer->tile_width = buffer->tile_storage->tile_width;
+  if (buffer->tile_height <= 0)
+    buffer->tile_height = buffer->tile_storage->tile_height;
+
   g_assert (buffer->tile_width == buffer->tile_storage->tile_width);
   g_assert (buffer->tile_height == buffer->tile_storage->tile_height);
 
@@ -754,6 +776,64 @@ gegl_buffer_get_tile_int (GeglTileSource *source,
   return tile;
 }
 
+static gpointer
+gegl_buffer_get_tiles_int (GeglTileSource      *source,
+                           gint                 x,
+                           gint                 y,
+                           gint                 z,
+                           GeglTileBatchParams *params)
+{
+  GeglTileHandler *handler = (GeglTileHandler*) (source);
+  GeglBuffer      *buffer  = (GeglBuffer*) handler;
+  gint             n_tiles = params->width * params->height;
+  gint            *missing;
+  gint             n_missing = 0;
+  gint             i;
+
+  missing = g_new (gint, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      if (! params->tiles[i])
+        missing[n_missing++] = i;
+    }
+
+  if (! gegl_tile_source_command (handler->source, GEGL_TILE_GET_N,
+                                  x, y, z, params))
+    {
+      g_free (missing);
+
+      return NULL;
+    }
+
+  /* see gegl_buffer_get_tile_int() */
+  while (n_missing--)
+    {
+      GeglTile *tile;
+
+      i    = missing[n_missing];
+      tile = params->tiles[i];
+
+      if (tile)
+        {
+          if (!tile->tile_storage)
+            {
+              gegl_tile_lock (tile);
+              tile->tile_storage = buffer->tile_storage;
+              gegl_tile_unlock (tile);
+              tile->rev--;
+            }
+          tile->x = x + i % params->width;
+          tile->y = y + i / params->width;
+          tile->z = z;
+        }
+    }
+
+  g_free (missing);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
 
 static gpointer
 gegl_buffer_command (GeglTileSource *source,
@@ -769,6 +849,11 @@ gegl_buffer_command (GeglTileSource *source,
     {
       case GEGL_TILE_GET:
         return gegl_buffer_get_tile_int (source, x, y, z);
+      case GEGL_TILE_GET_N:
+        return gegl_buffer_get_tiles_int (source, x, y, z, data);
+      case GEGL_TILE_SET_N:
+        return gegl_tile_source_command (handler->source,
+                                         command, x, y, z, data);
       default:
         return gegl_tile_handler_source_command (handler, command, x, y, z, data);
     }
@@ -870,16 +955,23 @@ gegl_buffer_class_init (GeglBufferClass *class)
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
 
+  /* the tile size defaults to -1, rather than to the configured tile size
+   * at the time the class is initialized: it is resolved when the buffer is
+   * constructed, from the configuration and the format of the buffer, or
+   * from the tile source the buffer is created on top of.
+   */
   g_object_class_install_property (gobject_class, PROP_TILE_HEIGHT,
-                                   g_param_spec_int ("tile-height", "tile-height", "height of a tile",
-                                                     -1, G_MAXINT, gegl_buffer_config()->tile_height,
+                                   g_param_spec_int ("tile-height", "tile-height",
+                                                     "height of a tile, -1 to pick it when the buffer is constructed",
+                                                     -1, G_MAXINT, -1,
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_CONSTRUCT_ONLY |
                                                      G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (gobject_class, PROP_TILE_WIDTH,
-                                   g_param_spec_int ("tile-width", "tile-width", "width of a tile",
-                                                     -1, G_MAXINT, gegl_buffer_config()->tile_width,
+                                   g_param_spec_int ("tile-width", "tile-width",
+                                                     "width of a tile, -1 to pick it when the buffer is constructed",
+                                                     -1, G_MAXINT, -1,
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_CONSTRUCT_ONLY |
                                                      G_PARAM_STATIC_STRINGS));
@@ -1003,6 +1095,60 @@ gegl_buffer_new_ram (const GeglRectangle *extent,
                        NULL);
 }
 
+#define GEGL_BUFFER_MIN_TILE_SIZE_LOG2 3
+#define GEGL_BUFFER_MAX_TILE_SIZE_LOG2 11
+
+void
+gegl_buffer_get_tile_size_for_format (const Babl *format,
+                                      gdouble     aspect,
+                                      gint       *tile_width,
+                                      gint       *tile_height)
+{
+  GeglBufferConfig *config = gegl_buffer_config ();
+  gdouble           n_pixels;
+  gint              width_log2;
+  gint              height_log2;
+
+  if (config->tile_size_target <= 0 || ! format)
+    {
+      *tile_width  = config->tile_width;
+      *tile_height = config->tile_height;
+
+      return;
+    }
+
+  if (aspect <= 0.0)
+    aspect = (gdouble) MAX (config->tile_width,  1) /
+                       MAX (config->tile_height, 1);
+
+  n_pixels = (gdouble) config->tile_size_target /
+             babl_format_get_bytes_per_pixel (format);
+
+  /* keep the tile dimensions powers of two, so that the tile grids of
+   * buffers of different formats nest, and can be iterated over together
+   */
+  height_log2 = floor (log2 (sqrt (n_pixels / aspect)) + 0.5);
+  height_log2 = CLAMP (height_log2, GEGL_BUFFER_MIN_TILE_SIZE_LOG2,
+                                    GEGL_BUFFER_MAX_TILE_SIZE_LOG2);
+
+  width_log2  = floor (log2 (n_pixels) - height_log2 + 0.5);
+  width_log2  = CLAMP (width_log2,  GEGL_BUFFER_MIN_TILE_SIZE_LOG2,
+                                    GEGL_BUFFER_MAX_TILE_SIZE_LOG2);
+
+  *tile_width  = 1 << width_log2;
+  *tile_height = 1 << height_log2;
+}
+
+void
+gegl_buffer_set_pixel_cost (GeglBuffer *buffer,
+                            gdouble     pixel_cost)
+{
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+
+  gegl_tile_handler_cache_set_pixel_cost (buffer->tile_storage->cache,
+                                          pixel_cost);
+}
+
 GeglBuffer *
 gegl_buffer_new (const GeglRectangle *extent,
                  const Babl          *format)
@@ -1275,6 +1421,87 @@ gegl_buffer_thaw_changed (GeglBuffer *buffer)
     }
 }
 
+/* fetches a tile like gegl_tile_handler_get_tile(), taking the storage
+ * mutex only if the tile can't be found in the storage index.
+ */
+GeglTile *
+_gegl_buffer_fetch_tile (GeglBuffer *buffer,
+                         gint        x,
+                         gint        y,
+                         gint        z,
+                         gboolean    preserve_data)
+{
+  GeglTileStorage *tile_storage = buffer->tile_storage;
+  GeglTile        *tile         = NULL;
+
+  if (preserve_data && ! gegl_tile_handler_cache_ext_flush)
+    tile = gegl_tile_storage_index_lookup (tile_storage, x, y, z);
+
+  if (! tile)
+    {
+      g_rec_mutex_lock (&tile_storage->mutex);
+
+      tile = gegl_tile_handler_get_tile ((GeglTileHandler *) buffer,
+                                         x, y, z, preserve_data);
+
+      g_rec_mutex_unlock (&tile_storage->mutex);
+    }
+
+  return tile;
+}
+
+void
+_gegl_buffer_fetch_tiles (GeglBuffer  *buffer,
+                          gint         x,
+                          gint         y,
+                          gint         z,
+                          gint         width,
+                          gint         height,
+                          GeglTile   **tiles)
+{
+  GeglTileStorage *tile_storage = buffer->tile_storage;
+  gint             n_tiles      = width * height;
+  gint             n_missing    = 0;
+  gint             i;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      tiles[i] = NULL;
+
+      if (! gegl_tile_handler_cache_ext_flush)
+        {
+          tiles[i] = gegl_tile_storage_index_lookup (tile_storage,
+                                                     x + i % width,
+                                                     y + i / width,
+                                                     z);
+        }
+
+      if (! tiles[i])
+        n_missing++;
+    }
+
+  if (n_missing)
+    {
+      g_rec_mutex_lock (&tile_storage->mutex);
+
+      gegl_tile_source_get_tiles (GEGL_TILE_SOURCE (buffer),
+                                  x, y, z, width, height, tiles);
+
+      /* see gegl_tile_handler_get_tile() */
+      for (i = 0; i < n_tiles; i++)
+        {
+          if (! tiles[i])
+            {
+              tiles[i] = gegl_tile_handler_create_tile (
+                GEGL_TILE_HANDLER (buffer),
+                x + i % width, y + i / width, z);
+            }
+        }
+
+      g_rec_mutex_unlock (&tile_storage->mutex);
+    }
+}
+
 GeglTile *
 gegl_buffer_get_tile (GeglBuffer *buffer,
                       gint        x,
@@ -1289,6 +1516,14 @@ gegl_buffer_get_tile (GeglBuffer *buffer,
   GeglTileStorage *tile_storage = buffer->tile_storage;
   g_assert (tile_storage);
 
+  if (! gegl_tile_handler_cache_ext_flush)
+    {
+      tile = gegl_tile_storage_index_lookup (tile_storage, x, y, z);
+
+      if (tile)
+        return tile;
+    }
+
   g_rec_mutex_lock (&tile_storage->mutex);
 
   tile = gegl_tile_source_command (source, GEGL_TILE_GET,
@@ -1303,6 +1538,7 @@ gegl_buffer_get_tile (GeglBuffer *buffer,
 void (*gegl_tile_handler_cache_ext_flush) (void *cache, const GeglRectangle *rect)=NULL;
 void (*gegl_buffer_ext_flush) (GeglBuffer *buffer, const GeglRectangle *rect)=NULL;
 void (*gegl_buffer_ext_invalidate) (GeglBuffer *buffer, const GeglRectangle *rect)=NULL;
+gboolean (*gegl_buffer_ext_is_cancelled) (void)=NULL;
 
 void (*gegl_resample_bilinear) (guchar              *dest_buf,
                                 const guchar        *source_buf,
@@ -64,6 +64,12 @@ struct _GeglRectangle
  * Create a new GeglBuffer of a given format with a given extent. It is
  * possible to pass in NULL for both extent and format, a NULL extent creates
  * an empty buffer and a NULL format makes the buffer default to "RGBA float".
+ *
+ * The tile size of the buffer is picked from the tile size configuration,
+ * and from @format when the "tile-size-target" configuration is set.  To
+ * give a tile size explicitly, create the buffer with g_object_new() and
+ * the "tile-width" and "tile-height" properties, whose defaults of -1 stand
+ * for this choice.
  */
 GeglBuffer *    gegl_buffer_new               (const GeglRectangle *extent,
                                                const Babl          *format);
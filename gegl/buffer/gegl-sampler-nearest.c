@@ -164,8 +164,6 @@ gegl_sampler_get_pixel (GeglSampler    *sampler,
           tile->x == indice_x &&
           tile->y == indice_y))
       {
-        g_rec_mutex_lock (&buffer->tile_storage->mutex);
-
         if (tile)
           {
             gegl_tile_read_unlock (tile);
@@ -173,14 +171,10 @@ gegl_sampler_get_pixel (GeglSampler    *sampler,
             gegl_tile_unref (tile);
           }
 
-        tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                          indice_x, indice_y,
-                                          0);
+        tile = _gegl_buffer_fetch_tile (buffer, indice_x, indice_y, 0, TRUE);
         nearest_sampler->hot_tile = tile;
 
         gegl_tile_read_lock (tile);
-
-        g_rec_mutex_unlock (&buffer->tile_storage->mutex);
       }
 
     if (tile)
@@ -18,6 +18,11 @@
 
 #include "config.h"
 
+#ifdef HAVE_SCHED_GETCPU
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +33,10 @@
 
 #include <glib-object.h>
 
+#ifdef G_OS_UNIX
+#include <sys/mman.h>
+#endif
+
 #include "gegl-buffer-config.h"
 #include "gegl-memory.h"
 #include "gegl-memory-private.h"
@@ -45,6 +54,12 @@
 #define GEGL_TILE_BLOCK_MAX_BUFFERS   1024
 #define GEGL_TILE_BLOCKS_PER_TRIM     10
 #define GEGL_TILE_SENTINEL_BLOCK      ((GeglTileBlock *) ~(guintptr) 0)
+#define GEGL_TILE_MAX_NODES           8
+#define GEGL_TILE_HUGE_PAGE_SIZE      ((gsize) 2 << 20)
+
+#if defined (G_OS_UNIX) && defined (MAP_ANONYMOUS)
+#define GEGL_TILE_MAP_BLOCKS
+#endif
 
 
 /*  private types  */
@@ -70,6 +85,12 @@ struct _GeglTileBlock
 
   GeglTileBlock            *next;
   GeglTileBlock            *prev;
+
+  gint                      node;
+  gboolean                  mapped; /* allocated with mmap(), rather than
+                                     * malloc()
+                                     */
+  gboolean                  huge;   /* backed by huge pages */
 };
 
 
@@ -77,7 +98,10 @@ struct _GeglTileBlock
 
 static gint                    gegl_tile_log2i            (guint                      n);
 
-static GeglTileBlock         * gegl_tile_block_new        (GeglTileBlock * volatile  *block_ptr,
+static GeglTileBlock         * gegl_tile_block_alloc_mem  (gsize                     *size,
+                                                           gboolean                   numa);
+static GeglTileBlock         * gegl_tile_block_new        (gint                       node,
+                                                           GeglTileBlock * volatile  *block_ptr,
                                                            gsize                      size);
 static void                    gegl_tile_block_free       (GeglTileBlock             *block,
                                                            GeglTileBlock            **head_block);
@@ -88,17 +112,29 @@ static inline GeglTileBuffer * gegl_tile_buffer_from_data (gpointer
 
 static gpointer                gegl_tile_alloc_fallback   (gsize                      size);
 
+static void                    gegl_tile_alloc_init_nodes (void);
+static inline gint             gegl_tile_alloc_get_node   (void);
+
 
 /*  local variables  */
 
 static const gint     gegl_tile_divisors[] = {1, 3, 5};
-static GeglTileBlock *gegl_tile_blocks[G_N_ELEMENTS (gegl_tile_divisors)]
+static GeglTileBlock *gegl_tile_blocks[GEGL_TILE_MAX_NODES]
+                                      [G_N_ELEMENTS (gegl_tile_divisors)]
                                       [GEGL_TILE_MAX_SIZE_LOG2];
-static GeglTileBlock *gegl_tile_empty_block;
+static GeglTileBlock *gegl_tile_empty_blocks[GEGL_TILE_MAX_NODES];
 static gint           gegl_tile_n_blocks;
 static gint           gegl_tile_max_n_blocks;
 
+/* the NUMA node of each cpu */
+static gint           gegl_tile_n_nodes = 1;
+static gint           gegl_tile_n_cpus;
+static guint8        *gegl_tile_cpu_nodes;
+
+static gboolean       gegl_tile_no_hugetlb;
+
 static guintptr       gegl_tile_alloc_total;
+static guintptr       gegl_tile_alloc_huge_pages_total;
 
 
 /*  private functions  */
@@ -136,8 +172,121 @@ gegl_tile_log2i (guint n)
 
 #endif /* HAVE___BUILTIN_CLZ */
 
+/* allocates the memory of a new block of (at least) @size bytes, updating
+ * @size to its actual size.
+ *
+ * blocks of per-node pools are mapped directly, rather than reusing heap
+ * memory, so that their pages are placed on the node of the thread which
+ * touches them first: the thread initializing the block, and then the
+ * threads writing the data of the tiles they allocate, which for
+ * gegl_parallel_distribute_area() are the threads processing the
+ * corresponding areas.
+ *
+ * blocks backed by huge pages are rounded up to a whole number of huge
+ * pages.  they use explicit huge pages if any are reserved, and transparent
+ * huge pages otherwise.
+ */
 static GeglTileBlock *
-gegl_tile_block_new (GeglTileBlock * volatile *block_ptr,
+gegl_tile_block_alloc_mem (gsize    *size,
+                           gboolean  numa)
+{
+  GeglTileBlock *block;
+
+#ifdef GEGL_TILE_MAP_BLOCKS
+  gboolean huge = gegl_buffer_config ()->tile_alloc_huge_pages &&
+                  *size >= GEGL_TILE_HUGE_PAGE_SIZE / 2;
+
+  if (huge || numa)
+    {
+      guint8 *mem      = MAP_FAILED;
+      gsize   map_size = *size;
+
+      if (huge)
+        {
+          map_size = (map_size + GEGL_TILE_HUGE_PAGE_SIZE - 1) /
+                     GEGL_TILE_HUGE_PAGE_SIZE                  *
+                     GEGL_TILE_HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+          if (! gegl_tile_no_hugetlb)
+            {
+              mem = mmap (NULL, map_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+              /* no reserved huge pages left, don't try again */
+              if (mem == MAP_FAILED)
+                gegl_tile_no_hugetlb = TRUE;
+            }
+#endif
+
+          if (mem == MAP_FAILED)
+            {
+              gsize offset;
+
+              /* map an extra huge page, and trim the mapping to a huge-page
+               * boundary, so that it can be backed by transparent huge pages
+               */
+              mem = mmap (NULL, map_size + GEGL_TILE_HUGE_PAGE_SIZE,
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+              if (mem == MAP_FAILED)
+                return NULL;
+
+              offset = (GEGL_TILE_HUGE_PAGE_SIZE -
+                        (guintptr) mem % GEGL_TILE_HUGE_PAGE_SIZE) %
+                       GEGL_TILE_HUGE_PAGE_SIZE;
+
+              if (offset)
+                munmap (mem, offset);
+
+              munmap (mem + offset + map_size,
+                      GEGL_TILE_HUGE_PAGE_SIZE - offset);
+
+              mem += offset;
+
+#if defined (HAVE_MADVISE) && defined (MADV_HUGEPAGE)
+              madvise (mem, map_size, MADV_HUGEPAGE);
+#endif
+            }
+        }
+      else
+        {
+          mem = mmap (NULL, map_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+          if (mem == MAP_FAILED)
+            return NULL;
+        }
+
+      block = (GeglTileBlock *) mem;
+
+      block->mapped = TRUE;
+      block->huge   = huge;
+
+      if (huge)
+        g_atomic_pointer_add (&gegl_tile_alloc_huge_pages_total, +map_size);
+
+      *size = map_size;
+
+      return block;
+    }
+#endif /* GEGL_TILE_MAP_BLOCKS */
+
+  block = gegl_try_malloc (*size);
+
+  if (block)
+    {
+      block->mapped = FALSE;
+      block->huge   = FALSE;
+    }
+
+  return block;
+}
+
+static GeglTileBlock *
+gegl_tile_block_new (gint                      node,
+                     GeglTileBlock * volatile *block_ptr,
                      gsize                     size)
 {
   GeglTileBlock *block;
@@ -150,10 +299,10 @@ gegl_tile_block_new (GeglTileBlock * volatile *block_ptr,
 
   do
     {
-      block = gegl_tile_empty_block;
+      block = gegl_tile_empty_blocks[node];
     }
   while (block &&
-         ! g_atomic_pointer_compare_and_exchange (&gegl_tile_empty_block,
+         ! g_atomic_pointer_compare_and_exchange (&gegl_tile_empty_blocks[node],
                                                   block, NULL));
 
   if (block && block->size - GEGL_TILE_BLOCK_BUFFER_OFFSET < buffer_size)
@@ -188,11 +337,17 @@ gegl_tile_block_new (GeglTileBlock * volatile *block_ptr,
 
       block_size = GEGL_TILE_BLOCK_BUFFER_OFFSET + n_buffers * buffer_size;
 
-      block = gegl_try_malloc (block_size);
+      block = gegl_tile_block_alloc_mem (&block_size,
+                                         gegl_tile_alloc_get_n_nodes () > 1);
 
       if (! block)
         return NULL;
 
+      /* use the whole block when its size was rounded up */
+      n_buffers = (block_size - GEGL_TILE_BLOCK_BUFFER_OFFSET) / buffer_size;
+
+      block->node = node;
+
       n_blocks = g_atomic_int_add (&gegl_tile_n_blocks, +1) + 1;
 
       if (n_blocks % GEGL_TILE_BLOCKS_PER_TRIM == 0)
@@ -249,13 +404,13 @@ gegl_tile_block_free (GeglTileBlock  *block,
   if (G_LIKELY(block->next))
     block->next->prev = block->prev;
 
-  if (! gegl_tile_empty_block)
+  if (! gegl_tile_empty_blocks[block->node])
     {
       block->prev = NULL;
       block->next = NULL;
 
-      if (g_atomic_pointer_compare_and_exchange (&gegl_tile_empty_block,
-                                                 NULL, block))
+      if (g_atomic_pointer_compare_and_exchange (
+            &gegl_tile_empty_blocks[block->node], NULL, block))
         {
           return;
         }
@@ -268,11 +423,24 @@ static void
 gegl_tile_block_free_mem (GeglTileBlock *block)
 {
   guintptr block_size = block->size;
+  gboolean mapped     = block->mapped;
 #ifdef HAVE_MALLOC_TRIM
   gint     n_blocks;
 #endif
 
-  gegl_free (block);
+#ifdef GEGL_TILE_MAP_BLOCKS
+  if (mapped)
+    {
+      if (block->huge)
+        g_atomic_pointer_add (&gegl_tile_alloc_huge_pages_total, -block_size);
+
+      munmap (block, block_size);
+    }
+  else
+#endif
+    {
+      gegl_free (block);
+    }
 
 #ifdef HAVE_MALLOC_TRIM
   n_blocks = g_atomic_int_add (&gegl_tile_n_blocks, -1) - 1;
@@ -281,7 +449,8 @@ gegl_tile_block_free_mem (GeglTileBlock *block)
   g_atomic_pointer_add (&gegl_tile_alloc_total, -block_size);
 
 #ifdef HAVE_MALLOC_TRIM
-  if (gegl_tile_max_n_blocks - n_blocks >= GEGL_TILE_BLOCKS_PER_TRIM)
+  if (! mapped &&
+      gegl_tile_max_n_blocks - n_blocks >= GEGL_TILE_BLOCKS_PER_TRIM)
     {
       gegl_tile_max_n_blocks = (n_blocks + (GEGL_TILE_BLOCKS_PER_TRIM - 1)) /
                                GEGL_TILE_BLOCKS_PER_TRIM                    *
@@ -330,29 +499,112 @@ gegl_tile_alloc_enabled (void)
   return enabled;
 }
 
+/* reads the cpus of each NUMA node */
+static void
+gegl_tile_alloc_init_nodes (void)
+{
+#if defined (HAVE_SCHED_GETCPU) && defined (GEGL_TILE_MAP_BLOCKS)
+  gint node;
+
+  gegl_tile_n_cpus    = g_get_num_processors ();
+  gegl_tile_cpu_nodes = g_new0 (guint8, gegl_tile_n_cpus);
+
+  for (node = 0; node < GEGL_TILE_MAX_NODES; node++)
+    {
+      gchar  *path;
+      gchar  *cpulist;
+      gchar **ranges;
+      gint    i;
+
+      path = g_strdup_printf ("/sys/devices/system/node/node%d/cpulist", node);
+
+      if (! g_file_get_contents (path, &cpulist, NULL, NULL))
+        {
+          g_free (path);
+
+          continue;
+        }
+
+      /* the list is made of comma-separated cpus and ranges of cpus */
+      ranges = g_strsplit (g_strstrip (cpulist), ",", -1);
+
+      for (i = 0; ranges[i]; i++)
+        {
+          gchar *end;
+          gint   first;
+          gint   last;
+          gint   cpu;
+
+          first = last = strtol (ranges[i], &end, 10);
+
+          if (*end == '-')
+            last = strtol (end + 1, NULL, 10);
+
+          for (cpu = MAX (first, 0); cpu <= last && cpu < gegl_tile_n_cpus; cpu++)
+            gegl_tile_cpu_nodes[cpu] = node;
+        }
+
+      gegl_tile_n_nodes = node + 1;
+
+      g_strfreev (ranges);
+      g_free (cpulist);
+      g_free (path);
+    }
+#endif
+}
+
+/* returns the node whose pool tiles are allocated from on the current
+ * thread
+ */
+static inline gint
+gegl_tile_alloc_get_node (void)
+{
+#ifdef HAVE_SCHED_GETCPU
+  if (gegl_tile_n_nodes > 1 && gegl_buffer_config ()->tile_alloc_numa)
+    {
+      gint cpu = sched_getcpu ();
+
+      if (cpu >= 0 && cpu < gegl_tile_n_cpus)
+        return gegl_tile_cpu_nodes[cpu];
+    }
+#endif
+
+  return 0;
+}
+
 
 /*  public functions  */
 
 void
 gegl_tile_alloc_init (void)
 {
+  gegl_tile_alloc_init_nodes ();
 }
 
 void
 gegl_tile_alloc_cleanup (void)
 {
-  GeglTileBlock *block;
+  gint node;
 
-  do
+  for (node = 0; node < GEGL_TILE_MAX_NODES; node++)
     {
-      block = gegl_tile_empty_block;
+      GeglTileBlock *block;
+
+      do
+        {
+          block = gegl_tile_empty_blocks[node];
+        }
+      while (block &&
+             ! g_atomic_pointer_compare_and_exchange (
+                 &gegl_tile_empty_blocks[node], block, NULL));
+
+      if (block)
+        gegl_tile_block_free_mem (block);
     }
-  while (block &&
-         ! g_atomic_pointer_compare_and_exchange (&gegl_tile_empty_block,
-                                                  block, NULL));
 
-  if (block)
-    gegl_tile_block_free_mem (block);
+  g_clear_pointer (&gegl_tile_cpu_nodes, g_free);
+  gegl_tile_n_cpus  = 0;
+  gegl_tile_n_nodes = 1;
 }
 
 gpointer
@@ -362,6 +614,7 @@ gegl_tile_alloc (gsize size)
   GeglTileBlock             *block;
   GeglTileBuffer            *buffer;
   GeglTileBuffer           **next_buffer;
+  gint                       node;
   gint                       n;
   gint                       i;
   gint                       j;
@@ -388,7 +641,8 @@ gegl_tile_alloc (gsize size)
 
   j = gegl_tile_log2i (n);
 
-  block_ptr = &gegl_tile_blocks[i][j];
+  node      = gegl_tile_alloc_get_node ();
+  block_ptr = &gegl_tile_blocks[node][i][j];
 
   do
     {
@@ -401,7 +655,7 @@ gegl_tile_alloc (gsize size)
 
   if (! block)
     {
-      block = gegl_tile_block_new (block_ptr, size);
+      block = gegl_tile_block_new (node, block_ptr, size);
 
       if (! block)
         {
@@ -506,3 +760,15 @@ gegl_tile_alloc_get_total (void)
 {
   return gegl_tile_alloc_total;
 }
+
+guint64
+gegl_tile_alloc_get_huge_pages_total (void)
+{
+  return gegl_tile_alloc_huge_pages_total;
+}
+
+gint
+gegl_tile_alloc_get_n_nodes (void)
+{
+  return gegl_buffer_config ()->tile_alloc_numa ? gegl_tile_n_nodes : 1;
+}
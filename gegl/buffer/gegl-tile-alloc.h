@@ -32,7 +32,9 @@ gpointer   gegl_tile_alloc           (gsize    size) G_GNUC_MALLOC;
 gpointer   gegl_tile_alloc0          (gsize    size) G_GNUC_MALLOC;
 void       gegl_tile_free            (gpointer ptr);
 
-guint64    gegl_tile_alloc_get_total (void);
+guint64    gegl_tile_alloc_get_total            (void);
+guint64    gegl_tile_alloc_get_huge_pages_total (void);
+gint       gegl_tile_alloc_get_n_nodes          (void);
 
 G_END_DECLS
 
@@ -47,6 +47,7 @@
 #define lseek _lseek
 #define ftruncate _chsize_s
 #endif
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -61,10 +62,17 @@
 #include "gegl-buffer-index.h"
 #include "gegl-buffer-swap.h"
 #include "gegl-buffer-types.h"
+#include "gegl-buffer-private.h"
 #include "gegl-debug.h"
 #include "gegl-buffer-config.h"
+#include "gegl-scratch.h"
 
 
+/* maximal size of a single read of adjacent tiles, when fetching several
+ * tiles at once.
+ */
+#define COALESCED_READ_MAX (1 << 20)
+
 #ifndef HAVE_FSYNC
 
 #ifdef G_OS_WIN32
@@ -105,6 +113,22 @@ struct _GeglTileBackendFile
   /* list of offsets to tiles that are free */
   GSList          *free_list;
 
+  /* hashtable mapping the hashes of the data of tiles written while tile
+   * deduplication is enabled to their entries, and hashtable of the number
+   * of entries of the tile slots which are shared by more than one entry,
+   * identical tiles share a slot which is copied on write.
+   */
+  GHashTable      *dedup;
+  GHashTable      *shared;
+
+  /* the index of a file in the indexed format (GEGL_FILE_SPEC_REV_INDEX),
+   * in which the entries of the tiles which aren't in the index hashtable
+   * are looked up, and the set of tiles of the index which were voided
+   * since it was loaded.  NULL for files in the linked format.
+   */
+  GeglBufferIndex *file_index;
+  GHashTable      *file_voided;
+
   /* offset to next pre allocated tile slot */
   guint            next_pre_alloc;
 
@@ -171,6 +195,8 @@ static gint file_size      = 0;
 static gint peak_allocs    = 0;
 static gint peak_file_size = 0;
 
+static guint64 dedup_total = 0;
+
 static GQueue  queue      = G_QUEUE_INIT;
 static GMutex  mutex      = { 0, };
 static GCond   queue_cond = { 0, };
@@ -188,11 +214,10 @@ gegl_tile_backend_file_finish_writing (GeglTileBackendFile *self)
   g_mutex_unlock (&mutex);
 }
 
+/* must be called with mutex held */
 static void
-gegl_tile_backend_file_push_queue (GeglFileBackendThreadParams *params)
+gegl_tile_backend_file_enqueue (GeglFileBackendThreadParams *params)
 {
-  g_mutex_lock (&mutex);
-
   /* block if the queue has gotten too big */
   while (queue_size > gegl_buffer_config ()->queue_size)
     g_cond_wait (&max_cond, &mutex);
@@ -214,6 +239,14 @@ gegl_tile_backend_file_push_queue (GeglFileBackendThreadParams *params)
 
   /* wake up the writer thread */
   g_cond_signal (&queue_cond);
+}
+
+static void
+gegl_tile_backend_file_push_queue (GeglFileBackendThreadParams *params)
+{
+  g_mutex_lock (&mutex);
+
+  gegl_tile_backend_file_enqueue (params);
 
   g_mutex_unlock (&mutex);
 }
@@ -323,13 +356,50 @@ gegl_tile_backend_file_writer_thread (gpointer ignored)
   return NULL;
 }
 
+/* reads @size bytes at @offset of the file into @dest */
+static gboolean
+gegl_tile_backend_file_read_data (GeglTileBackendFile *self,
+                                  goffset              offset,
+                                  guchar              *dest,
+                                  gint                 size)
+{
+  gint to_be_read = size;
+
+  if (self->in_offset != offset)
+    {
+      if (lseek (self->i, offset, SEEK_SET) < 0)
+        {
+          g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
+          return FALSE;
+        }
+      self->in_offset = offset;
+    }
+
+  while (to_be_read > 0)
+    {
+      gint byte_read;
+
+      byte_read = read (self->i, dest + size - to_be_read, to_be_read);
+      if (byte_read <= 0)
+        {
+          g_message ("unable to read tile data from self: "
+                     "%s (%d/%d bytes read)",
+                     g_strerror (errno), byte_read, to_be_read);
+          return FALSE;
+        }
+      to_be_read      -= byte_read;
+      self->in_offset += byte_read;
+    }
+
+  return TRUE;
+}
+
 static void
 gegl_tile_backend_file_entry_read (GeglTileBackendFile  *self,
                                    GeglFileBackendEntry *entry,
                                    guchar               *dest)
 {
   gint    tile_size  = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
-  gint    to_be_read = tile_size;
   goffset offset     = entry->tile->offset;
 
   gegl_tile_backend_file_ensure_exist (self);
@@ -342,12 +412,13 @@ gegl_tile_backend_file_entry_read (GeglTileBackendFile  *self,
       if (entry->tile_link)
         queued_op = entry->tile_link->data;
       else if (in_progress && in_progress->entry == entry &&
-               in_progress->operation == OP_WRITE)
+               in_progress->operation == OP_WRITE &&
+               in_progress->offset == offset)
         queued_op = in_progress;
 
       if (queued_op)
         {
-          memcpy (dest, queued_op->source, to_be_read);
+          memcpy (dest, queued_op->source, tile_size);
           g_mutex_unlock (&mutex);
 
           GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i from queue", entry->tile->x, entry->tile->y, entry->tile->z);
@@ -358,32 +429,7 @@ gegl_tile_backend_file_entry_read (GeglTileBackendFile  *self,
       g_mutex_unlock (&mutex);
     }
 
-  if (self->in_offset != offset)
-    {
-      if (lseek (self->i, offset, SEEK_SET) < 0)
-        {
-          g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
-          return;
-        }
-      self->in_offset = offset;
-    }
-
-  while (to_be_read > 0)
-    {
-      GError *error = NULL;
-      gint    byte_read;
-
-      byte_read = read (self->i, dest + tile_size - to_be_read, to_be_read);
-      if (byte_read <= 0)
-        {
-          g_message ("unable to read tile data from self: "
-                     "%s (%d/%d bytes read) %s",
-                     g_strerror (errno), byte_read, to_be_read, error?error->message:"--");
-          return;
-        }
-      to_be_read      -= byte_read;
-      self->in_offset += byte_read;
-    }
+  gegl_tile_backend_file_read_data (self, offset, dest, tile_size);
 
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i", entry->tile->x, entry->tile->y, entry->tile->z, (gint)offset);
 }
@@ -447,21 +493,20 @@ gegl_tile_backend_file_file_entry_create (gint x,
   return entry;
 }
 
-static inline GeglFileBackendEntry *
-gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
+/* allocates a tile slot for @entry */
+static void
+gegl_tile_backend_file_entry_alloc (GeglTileBackendFile  *self,
+                                    GeglFileBackendEntry *entry)
 {
-  GeglFileBackendEntry *entry = gegl_tile_backend_file_file_entry_create (0,0,0);
-
-  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Creating new entry");
-
   gegl_tile_backend_file_ensure_exist (self);
 
   if (self->free_list)
     {
-      guint64 offset = *(guint64*)self->free_list->data;
+      guint64 *offset = self->free_list->data;
 
-      entry->tile->offset = offset;
-      self->free_list = g_slist_remove (self->free_list, self->free_list->data);
+      entry->tile->offset = *offset;
+      self->free_list = g_slist_delete_link (self->free_list, self->free_list);
+      g_free (offset);
 
       GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "  set offset %i from free list", ((gint)entry->tile->offset));
     }
@@ -492,16 +537,228 @@ gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
         }
     }
   gegl_tile_backend_file_dbg_alloc (gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self)));
+}
+
+static inline GeglFileBackendEntry *
+gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
+{
+  GeglFileBackendEntry *entry = gegl_tile_backend_file_file_entry_create (0,0,0);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Creating new entry");
+
+  gegl_tile_backend_file_entry_alloc (self, entry);
+
   return entry;
 }
 
+/* removes @entry from the deduplication table, its data is about to change */
+static void
+gegl_tile_backend_file_entry_unhash (GeglTileBackendFile  *self,
+                                     GeglFileBackendEntry *entry)
+{
+  if (! entry->hashed)
+    return;
+
+  if (g_hash_table_lookup (self->dedup, &entry->hash) == entry)
+    g_hash_table_remove (self->dedup, &entry->hash);
+
+  entry->hashed = FALSE;
+}
+
+static gint
+gegl_tile_backend_file_slot_get_n_entries (GeglTileBackendFile *self,
+                                           guint64              offset)
+{
+  gpointer n_entries = g_hash_table_lookup (self->shared, &offset);
+
+  return n_entries ? GPOINTER_TO_INT (n_entries) : 1;
+}
+
+static void
+gegl_tile_backend_file_slot_set_n_entries (GeglTileBackendFile *self,
+                                           guint64              offset,
+                                           gint                 n_entries)
+{
+  if (n_entries > 1)
+    {
+      guint64 *key = g_new (guint64, 1);
+      *key = offset;
+
+      g_hash_table_insert (self->shared, key, GINT_TO_POINTER (n_entries));
+    }
+  else
+    {
+      g_hash_table_remove (self->shared, &offset);
+    }
+}
+
+/* releases the tile slot of @entry, which is only freed if no other entry
+ * shares it
+ */
+static void
+gegl_tile_backend_file_entry_release (GeglTileBackendFile  *self,
+                                      GeglFileBackendEntry *entry)
+{
+  gint tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+  gint n_entries;
+
+  gegl_tile_backend_file_entry_unhash (self, entry);
+
+  n_entries = gegl_tile_backend_file_slot_get_n_entries (self,
+                                                         entry->tile->offset);
+
+  if (n_entries > 1)
+    {
+      gegl_tile_backend_file_slot_set_n_entries (self, entry->tile->offset,
+                                                 n_entries - 1);
+
+      dedup_total -= tile_size;
+    }
+  else
+    {
+      guint64 *offset = g_new (guint64, 1);
+      *offset = entry->tile->offset;
+
+      self->free_list = g_slist_prepend (self->free_list, offset);
+
+      gegl_tile_backend_file_dbg_dealloc (tile_size);
+    }
+}
+
+/* drops the queued write of the data of @entry, which is replaced by the data
+ * of another slot
+ */
+static void
+gegl_tile_backend_file_entry_cancel_write (GeglFileBackendEntry *entry)
+{
+  if (! entry->tile_link)
+    return;
+
+  g_mutex_lock (&mutex);
+
+  if (entry->tile_link)
+    {
+      GeglFileBackendThreadParams *queued_op = entry->tile_link->data;
+
+      queued_op->file->pending_ops -= 1;
+      queue_size -= queued_op->length + sizeof (GList) +
+        sizeof (GeglFileBackendThreadParams);
+      g_queue_delete_link (&queue, entry->tile_link);
+      entry->tile_link = NULL;
+      g_free (queued_op->source);
+      g_free (queued_op);
+
+      if (queue_size < gegl_buffer_config ()->queue_size)
+        g_cond_signal (&max_cond);
+    }
+
+  g_mutex_unlock (&mutex);
+}
+
+/* returns an entry whose data is @data, or NULL.  entries are matched by
+ * hash, and their data is verified.  @queued is set if the data of the entry
+ * is still queued for writing, in which case it isn't in its slot yet.
+ */
+static GeglFileBackendEntry *
+gegl_tile_backend_file_dedup_lookup (GeglTileBackendFile *self,
+                                     guint64              hash,
+                                     const guchar        *data,
+                                     gboolean            *queued)
+{
+  GeglFileBackendEntry        *entry;
+  GeglFileBackendThreadParams *queued_op = NULL;
+  gint                         tile_size;
+  guchar                      *slot;
+  gboolean                     equal;
+
+  entry = g_hash_table_lookup (self->dedup, &hash);
+
+  if (! entry)
+    return NULL;
+
+  tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+
+  g_mutex_lock (&mutex);
+
+  if (entry->tile_link)
+    queued_op = entry->tile_link->data;
+  else if (in_progress && in_progress->entry == entry &&
+           in_progress->operation == OP_WRITE &&
+           in_progress->offset == entry->tile->offset)
+    queued_op = in_progress;
+
+  if (queued_op)
+    equal = ! memcmp (queued_op->source, data, tile_size);
+
+  g_mutex_unlock (&mutex);
+
+  *queued = queued_op != NULL;
+
+  if (! queued_op)
+    {
+      slot = gegl_scratch_alloc (tile_size);
+
+      equal = gegl_tile_backend_file_read_data (self, entry->tile->offset,
+                                                slot, tile_size) &&
+              ! memcmp (slot, data, tile_size);
+
+      gegl_scratch_free (slot);
+    }
+
+  return equal ? entry : NULL;
+}
+
+/* resets the deduplication state after the index was reloaded */
+static void
+gegl_tile_backend_file_dedup_reset (GeglTileBackendFile *self)
+{
+  GHashTableIter        iter;
+  GHashTable           *slots;
+  GeglFileBackendEntry *entry;
+  gpointer              n_entries;
+  gint                  tile_size;
+
+  tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+
+  g_hash_table_iter_init (&iter, self->shared);
+
+  while (g_hash_table_iter_next (&iter, NULL, &n_entries))
+    dedup_total -= (guint64) (GPOINTER_TO_INT (n_entries) - 1) * tile_size;
+
+  g_hash_table_remove_all (self->dedup);
+  g_hash_table_remove_all (self->shared);
+
+  slots = g_hash_table_new (g_int64_hash, g_int64_equal);
+
+  g_hash_table_iter_init (&iter, self->index);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
+    {
+      guint64 offset = entry->tile->offset;
+
+      entry->hashed = FALSE;
+
+      if (g_hash_table_contains (slots, &offset))
+        {
+          gegl_tile_backend_file_slot_set_n_entries (
+            self, offset,
+            gegl_tile_backend_file_slot_get_n_entries (self, offset) + 1);
+
+          dedup_total += tile_size;
+        }
+      else
+        {
+          g_hash_table_add (slots, &entry->tile->offset);
+        }
+    }
+
+  g_hash_table_unref (slots);
+}
+
 static void
 gegl_tile_backend_file_file_entry_destroy (GeglTileBackendFile  *self,
                                            GeglFileBackendEntry *entry)
 {
-  guint64 *offset = g_new (guint64, 1);
-  *offset = entry->tile->offset;
-
   if (entry->tile_link || entry->block_link)
     {
       gint   i;
@@ -526,11 +783,9 @@ gegl_tile_backend_file_file_entry_destroy (GeglTileBackendFile  *self,
       g_mutex_unlock (&mutex);
     }
 
-  self->free_list = g_slist_prepend (self->free_list, offset);
+  gegl_tile_backend_file_entry_release (self, entry);
   g_hash_table_remove (self->index, entry);
 
-  gegl_tile_backend_file_dbg_dealloc (gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self)));
-
   g_free (entry->tile);
   g_free (entry);
 }
@@ -653,6 +908,12 @@ gegl_tile_backend_file_write_block (GeglTileBackendFile  *self,
   return TRUE;
 }
 
+guint64
+gegl_tile_backend_file_get_dedup_total (void)
+{
+  return dedup_total;
+}
+
 void
 gegl_tile_backend_file_stats (void)
 {
@@ -693,6 +954,93 @@ gegl_tile_backend_file_lookup_entry (GeglTileBackendFile *self,
   return ret;
 }
 
+/* looks up the entry of tile @x, @y, @z in the index of a file in the indexed
+ * format, for tiles which aren't in the index hashtable.  returns FALSE if the
+ * file doesn't store the tile, or if it was voided since.
+ */
+static gboolean
+gegl_tile_backend_file_lookup_file_entry (GeglTileBackendFile  *self,
+                                          gint                  x,
+                                          gint                  y,
+                                          gint                  z,
+                                          GeglBufferIndexEntry *file_entry)
+{
+  GeglBufferTile       key_tile;
+  GeglFileBackendEntry key = { &key_tile, NULL, NULL };
+  goffset              offset;
+
+  if (! self->file_index)
+    return FALSE;
+
+  offset = gegl_buffer_index_entry_offset (self->file_index, x, y, z);
+
+  if (! offset)
+    return FALSE;
+
+  key_tile.x = x;
+  key_tile.y = y;
+  key_tile.z = z;
+
+  if (g_hash_table_contains (self->file_voided, &key))
+    return FALSE;
+
+  return gegl_tile_backend_file_read_data (self, offset,
+                                           (guchar *) file_entry,
+                                           sizeof (GeglBufferIndexEntry)) &&
+         file_entry->offset != 0;
+}
+
+/* reads, and decompresses, the tile of @file_entry */
+static GeglTile *
+gegl_tile_backend_file_read_file_tile (GeglTileBackendFile        *self,
+                                       const GeglBufferIndexEntry *file_entry)
+{
+  GeglTileBackend *backend   = GEGL_TILE_BACKEND (self);
+  gint             tile_size = gegl_tile_backend_get_tile_size (backend);
+  GeglTile        *tile;
+  gboolean         success;
+
+  if (file_entry->length == 0 || file_entry->length > (guint) tile_size)
+    {
+      g_warning ("invalid tile entry at %i", (gint) file_entry->offset);
+      return NULL;
+    }
+
+  tile = gegl_tile_new (tile_size);
+  gegl_tile_set_rev (tile, file_entry->rev);
+  gegl_tile_mark_as_stored (tile);
+
+  if (file_entry->codec == 0 && file_entry->length == tile_size)
+    {
+      success = gegl_tile_backend_file_read_data (self, file_entry->offset,
+                                                  gegl_tile_get_data (tile),
+                                                  tile_size);
+    }
+  else
+    {
+      guchar *data = gegl_scratch_alloc (file_entry->length);
+
+      success = gegl_tile_backend_file_read_data (self, file_entry->offset,
+                                                  data, file_entry->length) &&
+                gegl_buffer_index_decode (self->file_index, file_entry,
+                                          gegl_tile_backend_get_format (backend),
+                                          data, gegl_tile_get_data (tile),
+                                          tile_size);
+
+      gegl_scratch_free (data);
+    }
+
+  if (! success)
+    {
+      gegl_tile_unref (tile);
+      return NULL;
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read file entry at %i", (gint)file_entry->offset);
+
+  return tile;
+}
+
 /* this is the only place that actually should
  * instantiate tiles, when the cache is large enough
  * that should make sure we don't hit this function
@@ -715,7 +1063,18 @@ gegl_tile_backend_file_get_tile (GeglTileSource *self,
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
 
   if (!entry)
-    return NULL;
+    {
+      GeglBufferIndexEntry file_entry;
+
+      if (gegl_tile_backend_file_lookup_file_entry (tile_backend_file,
+                                                    x, y, z, &file_entry))
+        {
+          return gegl_tile_backend_file_read_file_tile (tile_backend_file,
+                                                        &file_entry);
+        }
+
+      return NULL;
+    }
 
   tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
   tile      = gegl_tile_new (tile_size);
@@ -736,10 +1095,71 @@ gegl_tile_backend_file_set_tile (GeglTileSource *self,
   GeglTileBackend      *backend;
   GeglTileBackendFile  *tile_backend_file;
   GeglFileBackendEntry *entry;
+  GeglFileBackendEntry *dedup_entry = NULL;
+  gboolean              dedup;
+  gboolean              queued      = FALSE;
+  guint64               hash        = 0;
 
   backend           = GEGL_TILE_BACKEND (self);
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
+  dedup             = gegl_buffer_config ()->tile_dedup;
+
+  if (dedup)
+    {
+      gegl_tile_backend_file_ensure_exist (tile_backend_file);
+
+      hash        = gegl_tile_hash (tile);
+      dedup_entry = gegl_tile_backend_file_dedup_lookup (
+        tile_backend_file, hash, gegl_tile_get_data (tile), &queued);
+    }
+
+  if (dedup_entry)
+    {
+      /* share the slot of the identical tile */
+      if (entry == NULL)
+        {
+          entry = gegl_tile_backend_file_file_entry_create (x, y, z);
+          g_hash_table_insert (tile_backend_file->index, entry, entry);
+        }
+      else if (entry->tile->offset != dedup_entry->tile->offset)
+        {
+          gegl_tile_backend_file_entry_cancel_write (entry);
+          gegl_tile_backend_file_entry_release (tile_backend_file, entry);
+        }
+      else
+        {
+          dedup_entry = NULL;
+        }
+
+      if (dedup_entry)
+        {
+          entry->tile->offset = dedup_entry->tile->offset;
+
+          gegl_tile_backend_file_slot_set_n_entries (
+            tile_backend_file, entry->tile->offset,
+            gegl_tile_backend_file_slot_get_n_entries (tile_backend_file,
+                                                       entry->tile->offset) + 1);
+
+          dedup_total += gegl_tile_backend_get_tile_size (backend);
+
+          /* the entries sharing a slot whose data isn't written yet queue
+           * their own (identical) write, so that they are read from the
+           * queue until then, and the data still reaches the slot if the
+           * other entry is rewritten in the meantime.
+           */
+          if (queued)
+            {
+              gegl_tile_backend_file_entry_write (tile_backend_file, entry,
+                                                  gegl_tile_get_data (tile));
+            }
+        }
+
+      entry->tile->rev = gegl_tile_get_rev (tile);
+
+      gegl_tile_mark_as_stored (tile);
+      return NULL;
+    }
 
   if (entry == NULL)
     {
@@ -749,10 +1169,33 @@ gegl_tile_backend_file_set_tile (GeglTileSource *self,
       entry->tile->z = z;
       g_hash_table_insert (tile_backend_file->index, entry, entry);
     }
+  else if (gegl_tile_backend_file_slot_get_n_entries (tile_backend_file,
+                                                      entry->tile->offset) > 1)
+    {
+      /* copy on write, the queued write of the entry, if any, is for the
+       * shared slot
+       */
+      gegl_tile_backend_file_entry_cancel_write (entry);
+      gegl_tile_backend_file_entry_release (tile_backend_file, entry);
+      gegl_tile_backend_file_entry_alloc (tile_backend_file, entry);
+    }
+  else
+    {
+      gegl_tile_backend_file_entry_unhash (tile_backend_file, entry);
+    }
   entry->tile->rev = gegl_tile_get_rev (tile);
 
   gegl_tile_backend_file_entry_write (tile_backend_file, entry, gegl_tile_get_data (tile));
   gegl_tile_mark_as_stored (tile);
+
+  if (dedup && ! g_hash_table_contains (tile_backend_file->dedup, &hash))
+    {
+      entry->hash   = hash;
+      entry->hashed = TRUE;
+
+      g_hash_table_insert (tile_backend_file->dedup, &entry->hash, entry);
+    }
+
   return NULL;
 }
 
@@ -776,6 +1219,13 @@ gegl_tile_backend_file_void_tile (GeglTileSource *self,
       gegl_tile_backend_file_file_entry_destroy (tile_backend_file, entry);
     }
 
+  if (tile_backend_file->file_index &&
+      gegl_buffer_index_entry_offset (tile_backend_file->file_index, x, y, z))
+    {
+      g_hash_table_add (tile_backend_file->file_voided,
+                        gegl_tile_backend_file_file_entry_create (x, y, z));
+    }
+
   return NULL;
 }
 
@@ -794,9 +1244,454 @@ gegl_tile_backend_file_exist_tile (GeglTileSource *self,
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
 
+  if (entry == NULL)
+    {
+      GeglBufferIndexEntry file_entry;
+
+      if (gegl_tile_backend_file_lookup_file_entry (tile_backend_file,
+                                                    x, y, z, &file_entry))
+        {
+          return (gpointer)0x1;
+        }
+    }
+
   return entry!=NULL?((gpointer)0x1):NULL;
 }
 
+typedef struct
+{
+  gint    index;
+  goffset offset;
+} FileRead;
+
+static gint
+gegl_tile_backend_file_read_compare (const FileRead *read1,
+                                     const FileRead *read2)
+{
+  if (read1->offset < read2->offset)
+    return -1;
+  else if (read1->offset > read2->offset)
+    return +1;
+  else
+    return 0;
+}
+
+static gpointer
+gegl_tile_backend_file_get_tiles (GeglTileSource      *self,
+                                  gint                 x,
+                                  gint                 y,
+                                  gint                 z,
+                                  GeglTileBatchParams *params)
+{
+  GeglTileBackendFile  *tile_backend_file = GEGL_TILE_BACKEND_FILE (self);
+  gint                  tile_size;
+  gint                  n_tiles = params->width * params->height;
+  GeglBufferTile        key_tile;
+  GeglFileBackendEntry  key     = { &key_tile, NULL, NULL };
+  FileRead             *reads;
+  gint                  n_reads = 0;
+  gint                 *misses   = NULL;
+  gint                  n_misses = 0;
+  gint                  i;
+  gint                  j;
+
+  tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+
+  gegl_tile_backend_file_ensure_exist (tile_backend_file);
+
+  reads = g_new (FileRead, n_tiles);
+
+  if (tile_backend_file->file_index)
+    misses = g_new (gint, n_tiles);
+
+  key_tile.z = z;
+
+  /* look up all the entries, taking the data of the tiles which are still
+   * queued, under a single lock of the queue.
+   */
+  g_mutex_lock (&mutex);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GeglFileBackendEntry        *entry;
+      GeglFileBackendThreadParams *queued_op = NULL;
+      GeglTile                    *tile;
+
+      if (params->tiles[i])
+        continue;
+
+      key_tile.x = x + i % params->width;
+      key_tile.y = y + i / params->width;
+
+      entry = g_hash_table_lookup (tile_backend_file->index, &key);
+
+      if (! entry)
+        {
+          if (misses)
+            misses[n_misses++] = i;
+
+          continue;
+        }
+
+      tile = gegl_tile_new (tile_size);
+      gegl_tile_set_rev (tile, entry->tile->rev);
+      gegl_tile_mark_as_stored (tile);
+
+      params->tiles[i] = tile;
+
+      if (entry->tile_link)
+        queued_op = entry->tile_link->data;
+      else if (in_progress && in_progress->entry == entry &&
+               in_progress->operation == OP_WRITE &&
+               in_progress->offset == entry->tile->offset)
+        queued_op = in_progress;
+
+      if (queued_op)
+        {
+          memcpy (gegl_tile_get_data (tile), queued_op->source, tile_size);
+        }
+      else
+        {
+          reads[n_reads].index  = i;
+          reads[n_reads].offset = entry->tile->offset;
+          n_reads++;
+        }
+    }
+
+  g_mutex_unlock (&mutex);
+
+  /* look up the tiles which aren't in the index hashtable in the index of
+   * the file
+   */
+  for (i = 0; i < n_misses; i++)
+    {
+      GeglBufferIndexEntry file_entry;
+      gint                 k = misses[i];
+
+      if (gegl_tile_backend_file_lookup_file_entry (tile_backend_file,
+                                                    x + k % params->width,
+                                                    y + k / params->width,
+                                                    z, &file_entry))
+        {
+          params->tiles[k] = gegl_tile_backend_file_read_file_tile (
+            tile_backend_file, &file_entry);
+        }
+    }
+
+  g_free (misses);
+
+  /* read the rest in file order, coalescing the reads of adjacent tiles */
+  qsort (reads, n_reads, sizeof (FileRead),
+         (GCompareFunc) gegl_tile_backend_file_read_compare);
+
+  for (i = 0; i < n_reads; i = j)
+    {
+      guchar *data;
+      gint    size = tile_size;
+
+      for (j = i + 1; j < n_reads; j++)
+        {
+          if (reads[j].offset != reads[i].offset + size ||
+              size + tile_size > COALESCED_READ_MAX)
+            {
+              break;
+            }
+
+          size += tile_size;
+        }
+
+      if (j == i + 1)
+        {
+          gegl_tile_backend_file_read_data (
+            tile_backend_file, reads[i].offset,
+            gegl_tile_get_data (params->tiles[reads[i].index]), tile_size);
+        }
+      else
+        {
+          data = gegl_scratch_alloc (size);
+
+          if (gegl_tile_backend_file_read_data (tile_backend_file,
+                                                reads[i].offset, data, size))
+            {
+              gint k;
+
+              for (k = i; k < j; k++)
+                {
+                  memcpy (gegl_tile_get_data (params->tiles[reads[k].index]),
+                          data + (k - i) * tile_size,
+                          tile_size);
+                }
+            }
+
+          gegl_scratch_free (data);
+        }
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read %i entries of %i,%i,%i (%ix%i)", n_reads, x, y, z, params->width, params->height);
+
+  g_free (reads);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
+static gint
+gegl_tile_backend_file_write_compare (gconstpointer a,
+                                      gconstpointer b)
+{
+  const GeglFileBackendThreadParams *params1 = *(GeglFileBackendThreadParams * const *) a;
+  const GeglFileBackendThreadParams *params2 = *(GeglFileBackendThreadParams * const *) b;
+
+  if (params1->offset < params2->offset)
+    return -1;
+  else if (params1->offset > params2->offset)
+    return +1;
+  else
+    return 0;
+}
+
+static gpointer
+gegl_tile_backend_file_set_tiles (GeglTileSource      *self,
+                                  gint                 x,
+                                  gint                 y,
+                                  gint                 z,
+                                  GeglTileBatchParams *params)
+{
+  GeglTileBackendFile          *tile_backend_file = GEGL_TILE_BACKEND_FILE (self);
+  gint                          length;
+  gint                          n_tiles = params->width * params->height;
+  GeglFileBackendThreadParams **ops;
+  gint                          n_ops   = 0;
+  gint                          i;
+
+  /* deduplicated tiles, and the tiles sharing slots, are set one at a time */
+  if (gegl_buffer_config ()->tile_dedup ||
+      g_hash_table_size (tile_backend_file->shared))
+    {
+      return NULL;
+    }
+
+  length = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+
+  gegl_tile_backend_file_ensure_exist (tile_backend_file);
+
+  ops = g_new (GeglFileBackendThreadParams *, n_tiles);
+
+  /* prepare the writes, and allocate the new entries, without holding the
+   * queue lock
+   */
+  for (i = 0; i < n_tiles; i++)
+    {
+      GeglTile                    *tile = params->tiles[i];
+      GeglFileBackendEntry        *entry;
+      GeglFileBackendThreadParams *op;
+      gint                         tx   = x + i % params->width;
+      gint                         ty   = y + i / params->width;
+
+      if (! tile)
+        continue;
+
+      entry = gegl_tile_backend_file_lookup_entry (tile_backend_file,
+                                                   tx, ty, z);
+
+      if (entry == NULL)
+        {
+          entry          = gegl_tile_backend_file_file_entry_new (tile_backend_file);
+          entry->tile->x = tx;
+          entry->tile->y = ty;
+          entry->tile->z = z;
+          g_hash_table_insert (tile_backend_file->index, entry, entry);
+        }
+      entry->tile->rev = gegl_tile_get_rev (tile);
+
+      op            = g_new0 (GeglFileBackendThreadParams, 1);
+      op->operation = OP_WRITE;
+      op->length    = length;
+      op->offset    = entry->tile->offset;
+      op->file      = tile_backend_file;
+      op->source    = g_malloc (length);
+      op->entry     = entry;
+
+      memcpy (op->source, gegl_tile_get_data (tile), length);
+
+      ops[n_ops++] = op;
+
+      gegl_tile_mark_as_stored (tile);
+    }
+
+  /* ... and queue them in file order under a single lock */
+  qsort (ops, n_ops, sizeof (GeglFileBackendThreadParams *),
+         gegl_tile_backend_file_write_compare);
+
+  g_mutex_lock (&mutex);
+
+  for (i = 0; i < n_ops; i++)
+    {
+      GeglFileBackendThreadParams *op = ops[i];
+
+      if (op->entry->tile_link)
+        {
+          GeglFileBackendThreadParams *queued_op = op->entry->tile_link->data;
+          guchar                      *source    = queued_op->source;
+
+          /* the tile is already queued, replace its data */
+          queued_op->source = op->source;
+          op->source        = source;
+        }
+      else
+        {
+          gegl_tile_backend_file_enqueue (op);
+
+          ops[i] = NULL;
+        }
+    }
+
+  g_mutex_unlock (&mutex);
+
+  for (i = 0; i < n_ops; i++)
+    {
+      if (ops[i])
+        {
+          g_free (ops[i]->source);
+          g_free (ops[i]);
+        }
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "pushed %i entry writes of %i,%i,%i (%ix%i)", n_ops, x, y, z, params->width, params->height);
+
+  g_free (ops);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
+/* reads the entries of level @z of @index */
+static GeglBufferIndexEntry *
+gegl_tile_backend_file_read_level (GeglTileBackendFile   *self,
+                                   const GeglBufferIndex *index,
+                                   gint                   z,
+                                   gsize                 *n_entries)
+{
+  const GeglBufferIndexLevel *level = &index->levels[z];
+  GeglBufferIndexEntry       *entries;
+
+  *n_entries = 0;
+
+  if (! level->offset)
+    return NULL;
+
+  entries = g_new (GeglBufferIndexEntry, (gsize) level->width * level->height);
+
+  if (! gegl_tile_backend_file_read_data (
+          self, level->offset, (guchar *) entries,
+          (gsize) level->width * level->height *
+          sizeof (GeglBufferIndexEntry)))
+    {
+      g_free (entries);
+      return NULL;
+    }
+
+  *n_entries = (gsize) level->width * level->height;
+
+  return entries;
+}
+
+/* appends a new index to a file in the indexed format, holding the entries
+ * of the index hashtable, and those of the index of the file which weren't
+ * voided or rewritten since, and points the header to it.  the index of the
+ * file is kept for looking up tiles, it remains valid since the file is only
+ * appended to.
+ */
+static void
+gegl_tile_backend_file_write_file_index (GeglTileBackendFile *self)
+{
+  GeglFileBackendThreadParams *params;
+  GeglBufferIndex             *index = self->file_index;
+  GeglBufferIndex             *new_index;
+  GArray                      *items;
+  GHashTableIter               iter;
+  GeglFileBackendEntry        *entry;
+  GeglBufferTile               key_tile;
+  GeglFileBackendEntry         key   = { &key_tile, NULL, NULL };
+  gint                         tile_size;
+  gint                         z;
+
+  tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
+  items     = g_array_new (FALSE, TRUE, sizeof (GeglBufferIndexItem));
+
+  g_hash_table_iter_init (&iter, self->index);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
+    {
+      GeglBufferIndexItem item = { entry->tile->x,
+                                   entry->tile->y,
+                                   entry->tile->z, };
+
+      item.entry.offset = entry->tile->offset;
+      item.entry.length = tile_size;
+      item.entry.rev    = entry->tile->rev;
+
+      g_array_append_val (items, item);
+    }
+
+  for (z = 0; z < index->n_levels; z++)
+    {
+      const GeglBufferIndexLevel *level = &index->levels[z];
+      GeglBufferIndexEntry       *entries;
+      gsize                       n_entries;
+      gsize                       i;
+
+      entries = gegl_tile_backend_file_read_level (self, index, z, &n_entries);
+
+      for (i = 0; i < n_entries; i++)
+        {
+          GeglBufferIndexItem item;
+
+          if (! entries[i].offset)
+            continue;
+
+          key_tile.x = level->x + (gint) (i % level->width);
+          key_tile.y = level->y + (gint) (i / level->width);
+          key_tile.z = z;
+
+          if (g_hash_table_contains (self->index, &key) ||
+              g_hash_table_contains (self->file_voided, &key))
+            {
+              continue;
+            }
+
+          item.x     = key_tile.x;
+          item.y     = key_tile.y;
+          item.z     = z;
+          item.entry = entries[i];
+
+          g_array_append_val (items, item);
+        }
+
+      g_free (entries);
+    }
+
+  new_index = gegl_buffer_index_pack ((GeglBufferIndexItem *) items->data,
+                                      items->len, self->next_pre_alloc);
+  new_index->n_codecs = index->n_codecs;
+  memcpy (new_index->codecs, index->codecs, sizeof (index->codecs));
+
+  g_array_free (items, TRUE);
+
+  params            = g_new0 (GeglFileBackendThreadParams, 1);
+  params->operation = OP_WRITE;
+  params->length    = new_index->block.length;
+  params->offset    = self->next_pre_alloc;
+  params->file      = self;
+  params->source    = (guchar *) new_index;
+
+  gegl_tile_backend_file_push_queue (params);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "pushed index write at %i", (gint)self->next_pre_alloc);
+
+  self->header.next     = self->next_pre_alloc;
+  self->next_pre_alloc += params->length;
+  self->total           = MAX (self->total, self->next_pre_alloc);
+}
+
 static gpointer
 gegl_tile_backend_file_flush (GeglTileSource *source,
                               GeglTile       *tile,
@@ -816,6 +1711,16 @@ gegl_tile_backend_file_flush (GeglTileSource *source,
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "flushing %s", self->path);
 
   self->header.rev ++;
+
+  if (self->file_index)
+    {
+      gegl_tile_backend_file_write_file_index (self);
+      gegl_tile_backend_file_write_header (self);
+
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "flushed %s", self->path);
+
+      return (gpointer)0xf0f;
+    }
   self->header.next = self->next_pre_alloc; /* this is the offset
                                                we start handing
                                                out headers from*/
@@ -877,6 +1782,10 @@ gegl_tile_backend_file_command (GeglTileSource  *self,
         return gegl_tile_backend_file_exist_tile (self, data, x, y, z);
       case GEGL_TILE_FLUSH:
         return gegl_tile_backend_file_flush (self, data, x, y, z);
+      case GEGL_TILE_GET_N:
+        return gegl_tile_backend_file_get_tiles (self, x, y, z, data);
+      case GEGL_TILE_SET_N:
+        return gegl_tile_backend_file_set_tiles (self, x, y, z, data);
 
       default:
         break;
@@ -983,6 +1892,13 @@ gegl_tile_backend_file_finalize (GObject *object)
   if (self->free_list)
     gegl_tile_backend_file_free_free_list (self);
 
+  g_hash_table_unref (self->dedup);
+  g_hash_table_unref (self->shared);
+
+  g_free (self->file_index);
+  if (self->file_voided)
+    g_hash_table_unref (self->file_voided);
+
   if (self->path)
     {
       if (gegl_buffer_swap_has_file (self->path))
@@ -1046,6 +1962,146 @@ gegl_tile_backend_file_equalfunc (gconstpointer a,
   return FALSE;
 }
 
+static void
+gegl_tile_backend_file_file_voided_free (gpointer data)
+{
+  GeglFileBackendEntry *entry = data;
+
+  g_free (entry->tile);
+  g_free (entry);
+}
+
+/* refetches tile @x, @y, @z, which was changed in the file by another
+ * instance
+ */
+static void
+gegl_tile_backend_file_refetch (GeglTileBackendFile *self,
+                                gint                 x,
+                                gint                 y,
+                                gint                 z)
+{
+  GeglTileStorage      *storage  =
+    (void*)gegl_tile_backend_peek_storage (GEGL_TILE_BACKEND (self));
+  GeglFileBackendEntry *existing =
+    gegl_tile_backend_file_lookup_entry (self, x, y, z);
+  GeglBufferTile        key_tile;
+  GeglFileBackendEntry  key      = { &key_tile, NULL, NULL };
+
+  if (existing)
+    gegl_tile_backend_file_file_entry_destroy (self, existing);
+
+  key_tile.x = x;
+  key_tile.y = y;
+  key_tile.z = z;
+
+  g_hash_table_remove (self->file_voided, &key);
+
+  gegl_tile_source_refetch (GEGL_TILE_SOURCE (storage), x, y, z);
+
+  if (z == 0)
+    {
+      GeglRectangle rect;
+
+      rect.width  = self->header.tile_width;
+      rect.height = self->header.tile_height;
+      rect.x      = x * self->header.tile_width;
+      rect.y      = y * self->header.tile_height;
+
+      g_signal_emit_by_name (storage, "changed", &rect, NULL);
+    }
+}
+
+/* loads the index of a file in the indexed format.  only the index block is
+ * read, the entries of the tiles are looked up as the tiles are requested.
+ * when the index was rewritten by another instance, the tiles whose entries
+ * differ are refetched.
+ */
+static void
+gegl_tile_backend_file_load_file_index (GeglTileBackendFile *self)
+{
+  GeglBufferIndex *index;
+  goffset          file_size;
+  gint             k;
+
+  index = gegl_buffer_read_tile_index (self->i, self->header.next);
+
+  if (! index)
+    index = gegl_buffer_index_pack (NULL, 0, 0);
+
+  if (! self->file_voided)
+    {
+      self->file_voided =
+        g_hash_table_new_full (gegl_tile_backend_file_hashfunc,
+                               gegl_tile_backend_file_equalfunc,
+                               gegl_tile_backend_file_file_voided_free,
+                               NULL);
+    }
+
+  /* compare the entries of both indices both ways, to catch the tiles
+   * which were added as well as those which were dropped
+   */
+  for (k = 0; self->file_index && k < 2; k++)
+    {
+      const GeglBufferIndex *from = k ? index : self->file_index;
+      const GeglBufferIndex *to   = k ? self->file_index : index;
+      gint                   z;
+
+      for (z = 0; z < from->n_levels; z++)
+        {
+          const GeglBufferIndexLevel *level = &from->levels[z];
+          GeglBufferIndexEntry       *entries;
+          gsize                       n_entries;
+          gsize                       i;
+
+          entries = gegl_tile_backend_file_read_level (self, from, z,
+                                                       &n_entries);
+
+          for (i = 0; i < n_entries; i++)
+            {
+              GeglBufferIndexEntry other;
+              gint                 x = level->x + (gint) (i % level->width);
+              gint                 y = level->y + (gint) (i / level->width);
+              goffset              offset;
+
+              if (! entries[i].offset)
+                continue;
+
+              offset = gegl_buffer_index_entry_offset (to, x, y, z);
+
+              if (offset &&
+                  gegl_tile_backend_file_read_data (
+                    self, offset,
+                    (guchar *) &other, sizeof (GeglBufferIndexEntry)) &&
+                  other.offset == entries[i].offset &&
+                  other.rev    == entries[i].rev)
+                {
+                  continue;
+                }
+
+              gegl_tile_backend_file_refetch (self, x, y, z);
+            }
+
+          g_free (entries);
+        }
+    }
+
+  g_free (self->file_index);
+  self->file_index = index;
+
+  /* new tiles, and new indices, are appended to the file */
+  file_size = lseek (self->i, 0, SEEK_END);
+  self->in_offset = self->out_offset = -1;
+
+  if (file_size > self->next_pre_alloc)
+    self->next_pre_alloc = file_size;
+  self->total = MAX (self->total, self->next_pre_alloc);
+
+  gegl_tile_backend_file_free_free_list (self);
+  gegl_tile_backend_file_dedup_reset (self);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "loaded file index of %s, %i levels",
+             self->path, self->file_index->n_levels);
+}
 
 static void
 gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
@@ -1081,6 +2137,12 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
       GEGL_NOTE(GEGL_DEBUG_TILE_BACKEND, "loading index: %s", self->path);
     }
 
+  if (gegl_buffer_header_get_rev (&self->header) == GEGL_FILE_SPEC_REV_INDEX)
+    {
+      gegl_tile_backend_file_load_file_index (self);
+      return;
+    }
+
   tile_size       = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
   offset          = self->header.next;
   self->tiles     = gegl_buffer_read_index (self->i, &offset);
@@ -1137,6 +2199,7 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
     }
   g_list_free (self->tiles);
   gegl_tile_backend_file_free_free_list (self);
+  gegl_tile_backend_file_dedup_reset (self);
   self->next_pre_alloc = max; /* if bigger than own? */
   self->total          = max;
   self->tiles          = NULL;
@@ -1314,6 +2377,13 @@ gegl_tile_backend_file_init (GeglTileBackendFile *self)
   self->o                          = -1;
   self->index                      = NULL;
   self->free_list                  = NULL;
+  self->file_index                 = NULL;
+  self->file_voided                = NULL;
+  self->dedup                      = g_hash_table_new (g_int64_hash,
+                                                       g_int64_equal);
+  self->shared                     = g_hash_table_new_full (g_int64_hash,
+                                                            g_int64_equal,
+                                                            g_free, NULL);
   self->next_pre_alloc             = 256; /* reserved space for header */
   self->total                      = 256; /* reserved space for header */
   self->pending_ops                = 0;
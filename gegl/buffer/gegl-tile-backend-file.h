@@ -54,6 +54,10 @@ typedef struct
      tile data or a GeglBufferBlock*/
   GList          *tile_link;
   GList          *block_link;
+  /* the hash of the tile data, valid while the entry is in the deduplication
+     table of the file */
+  guint64         hash;
+  gboolean        hashed;
 } GeglFileBackendEntry;
 
 typedef struct
@@ -76,6 +80,8 @@ GType gegl_tile_backend_file_get_type (void);
 
 void  gegl_tile_backend_file_stats    (void);
 
+guint64 gegl_tile_backend_file_get_dedup_total (void);
+
 gboolean gegl_tile_backend_file_try_lock (GeglTileBackendFile *file);
 gboolean gegl_tile_backend_file_unlock   (GeglTileBackendFile *file);
 
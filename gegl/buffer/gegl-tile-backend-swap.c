@@ -19,6 +19,10 @@
 
 #include "config.h"
 
+#ifdef HAVE_FALLOCATE_PUNCH_HOLE
+#define _GNU_SOURCE
+#endif
+
 #include <fcntl.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -31,6 +35,7 @@
 #define lseek _lseek
 #define ftruncate _chsize_s
 #endif
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -79,6 +84,31 @@
  */
 #define COMPRESSION_MAX_RATIO 0.95
 
+/* maximal size of a single read of adjacent blocks, when fetching several
+ * tiles at once.
+ */
+#define COALESCED_READ_MAX (1 << 20)
+
+/* minimal size of the free space at the end of the swap file above which the
+ * file is truncated, in bytes and as a factor of the file size.
+ */
+#define TRUNCATE_MIN_SIZE  (1 << 20)
+#define TRUNCATE_MIN_RATIO 0.25
+
+/* granularity of the holes punched in the swap file for freed space */
+#define HOLE_ALIGNMENT 4096
+
+/* minimal size of the swap file, and maximal ratio of its live data to its
+ * size, for the writer thread to compact it while idle.
+ */
+#define COMPACT_MIN_SIZE  (4 << 20)
+#define COMPACT_MAX_RATIO 0.5
+
+/* maximal amount of data moved by the compaction between checks for queued
+ * work.
+ */
+#define COMPACT_STEP_MAX (1 << 20)
+
 
 G_DEFINE_TYPE (GeglTileBackendSwap, gegl_tile_backend_swap, GEGL_TYPE_TILE_BACKEND)
 
@@ -98,6 +128,18 @@ typedef struct
   const GeglCompression *compression;
   GList                 *link;
   gint64                 offset;
+  guint8                *pixel;  /* the pixel of a uniform tile, which takes
+                                  * no space in the swap
+                                  */
+  guint64                hash;    /* the hash of the data, valid while hashed */
+  gboolean               hashed;  /* whether the block is in dedup_table */
+  gint                   n_dedup; /* the number of references to the block
+                                  * obtained through dedup_table
+                                  */
+  guint8                *ram;      /* the compressed data of the block, while
+                                   * it's held in the RAM tier
+                                   */
+  GList                 *ram_link; /* the link of the block in ram_queue */
 } SwapBlock;
 
 typedef struct
@@ -119,6 +161,14 @@ typedef struct
   ThreadOp    operation;
 } ThreadParams;
 
+typedef struct
+{
+  gint       index;
+  SwapBlock *block;
+  gint64     offset;
+  gint       size;
+} SwapRead;
+
 typedef struct _SwapGap
 {
   gint64           start;
@@ -147,19 +197,47 @@ static void        gegl_tile_backend_swap_gap_search             (gint64
                                                                   SwapGap                  **left_gap,
                                                                   SwapGap                  **right_gap);
 static gint64      gegl_tile_backend_swap_find_offset            (gint                       block_size);
+static void        gegl_tile_backend_swap_free_extent            (gint64                     start,
+                                                                  gint64                     end);
 static void        gegl_tile_backend_swap_free_block             (SwapBlock                 *block);
+static gboolean    gegl_tile_backend_swap_truncate               (SwapGap                   *gap);
+static void        gegl_tile_backend_swap_punch_hole             (SwapGap                   *gap,
+                                                                  gint64                     start,
+                                                                  gint64                     end);
+static gint        gegl_tile_backend_swap_block_compare          (const SwapBlock           *block1,
+                                                                  const SwapBlock           *block2);
+static gint        gegl_tile_backend_swap_block_search_func      (const SwapBlock           *block,
+                                                                  const gint64              *end);
+static gboolean    gegl_tile_backend_swap_compact                (void);
+static gboolean    gegl_tile_backend_swap_write_data             (gint64                     offset,
+                                                                  const guint8              *data,
+                                                                  gint                       size);
+static void        gegl_tile_backend_swap_ram_store              (SwapBlock                 *block,
+                                                                  const guint8              *data,
+                                                                  gint                       size);
+static void        gegl_tile_backend_swap_ram_remove             (SwapBlock                 *block);
+static void        gegl_tile_backend_swap_ram_trim               (void);
 static gint        gegl_tile_backend_swap_get_data_size          (ThreadParams              *params);
 static gint        gegl_tile_backend_swap_get_data_cost          (ThreadParams              *params);
 static void        gegl_tile_backend_swap_free_data              (ThreadParams              *params);
 static void        gegl_tile_backend_swap_write                  (ThreadParams              *params);
 static void        gegl_tile_backend_swap_destroy                (ThreadParams              *params);
 static gpointer    gegl_tile_backend_swap_writer_thread          (gpointer ignored);
+static GeglTile   *gegl_tile_backend_swap_read_queued            (SwapBlock                 *block,
+                                                                  const Babl                *format,
+                                                                  gint                       tile_size);
+static gboolean    gegl_tile_backend_swap_read_data              (gint64                     offset,
+                                                                  guint8                    *data,
+                                                                  gint                       size);
 static GeglTile   *gegl_tile_backend_swap_entry_read             (GeglTileBackendSwap       *self,
                                                                   SwapEntry                 *entry);
 static void        gegl_tile_backend_swap_entry_write            (GeglTileBackendSwap       *self,
                                                                   SwapEntry                 *entry,
-                                                                  GeglTile                  *tile);
+                                                                  GeglTile                  *tile,
+                                                                  gboolean                   lock);
 static SwapBlock * gegl_tile_backend_swap_block_create           (void);
+static SwapBlock * gegl_tile_backend_swap_uniform_block_create   (GeglTile                  *tile,
+                                                                  gint                       bpp);
 static void        gegl_tile_backend_swap_block_free             (SwapBlock                 *block);
 static SwapBlock * gegl_tile_backend_swap_block_ref              (SwapBlock                 *block,
                                                                   gint                       tile_size);
@@ -167,6 +245,17 @@ static void        gegl_tile_backend_swap_block_unref            (SwapBlock
                                                                   gint                       tile_size,
                                                                   gboolean                   lock);
 static gboolean    gegl_tile_backend_swap_block_is_unique        (SwapBlock                 *block);
+static gboolean    gegl_tile_backend_swap_block_claim            (SwapBlock                 *block);
+static gboolean    gegl_tile_backend_swap_block_equals           (SwapBlock                 *block,
+                                                                  const guint8              *data,
+                                                                  const Babl                *format,
+                                                                  gint                       tile_size);
+static SwapBlock * gegl_tile_backend_swap_dedup_lookup           (GeglTile                  *tile,
+                                                                  const Babl                *format,
+                                                                  gint                       tile_size,
+                                                                  guint64                   *hash);
+static void        gegl_tile_backend_swap_dedup_insert           (SwapBlock                 *block,
+                                                                  guint64                    hash);
 static SwapBlock * gegl_tile_backend_swap_empty_block            (void);
 static SwapEntry * gegl_tile_backend_swap_entry_create           (GeglTileBackendSwap       *self,
                                                                   gint                       x,
@@ -188,7 +277,8 @@ static gpointer    gegl_tile_backend_swap_set_tile               (GeglTileSource
                                                                   GeglTile                  *tile,
                                                                   gint                       x,
                                                                   gint                       y,
-                                                                  gint                       z);
+                                                                  gint                       z,
+                                                                  gboolean                   lock);
 static gpointer    gegl_tile_backend_swap_void_tile              (GeglTileSource            *self,
                                                                   gint                       x,
                                                                   gint                       y,
@@ -198,6 +288,16 @@ static gpointer    gegl_tile_backend_swap_exist_tile             (GeglTileSource
                                                                   gint                       x,
                                                                   gint                       y,
                                                                   gint                       z);
+static gpointer    gegl_tile_backend_swap_get_tiles              (GeglTileSource            *self,
+                                                                  gint                       x,
+                                                                  gint                       y,
+                                                                  gint                       z,
+                                                                  GeglTileBatchParams       *params);
+static gpointer    gegl_tile_backend_swap_set_tiles              (GeglTileSource            *self,
+                                                                  gint                       x,
+                                                                  gint                       y,
+                                                                  gint                       z,
+                                                                  GeglTileBatchParams       *params);
 static gpointer    gegl_tile_backend_swap_copy_tile              (GeglTileSource            *self,
                                                                   gint                       x,
                                                                   gint                       y,
@@ -216,6 +316,9 @@ static void        gegl_tile_backend_swap_constructed            (GObject
 static void        gegl_tile_backend_swap_finalize               (GObject                   *object);
 static void        gegl_tile_backend_swap_ensure_exist           (void);
 static void        gegl_tile_backend_swap_class_init             (GeglTileBackendSwapClass  *klass);
+static void        gegl_tile_backend_swap_ram_size_notify        (GObject                   *config,
+                                                                  GParamSpec                *pspec,
+                                                                  gpointer                   data);
 static void        gegl_tile_backend_swap_tile_cache_size_notify (GObject                   *config,
                                                                   GParamSpec                *pspec,
                                                                   gpointer                   data);
@@ -243,6 +346,15 @@ static gint64                 queued_total       = 0;
 static gint64                 queued_cost        = 0;
 static gint64                 queued_max         = 0;
 static gint                   queue_stalls       = 0;
+static gint                   dedup_hits         = 0;
+static guint64                dedup_total        = 0;
+static guint64                ram_total          = 0;
+static guint64                ram_max            = 0;
+static gint                   ram_hits           = 0;
+static gint                   disk_hits          = 0;
+static gboolean               compact            = FALSE;
+static gboolean               punch_holes        = TRUE;
+static gint                   reads_pending      = 0;
 
 static GThread      *writer_thread           = NULL;
 static GQueue       *queue                   = NULL;
@@ -255,6 +367,27 @@ static GMutex        queue_mutex;
 static GCond         queue_cond;
 static GCond         push_cond;
 
+/* maps the hashes of the data of the blocks written while tile deduplication
+ * is enabled to the blocks, so that identical tiles of any buffer share a
+ * single block.  dedup_mutex is never held while locking queue_mutex.
+ */
+static GHashTable   *dedup_table             = NULL;
+static GMutex        dedup_mutex;
+
+/* the blocks held in the RAM tier, most recently stored first.  compressed
+ * tile data is kept in memory until the tier exceeds swap-ram-size, and only
+ * the least recently stored blocks are written to the swap file.  the tier is
+ * only modified by the writer thread, under queue_mutex.
+ */
+static GQueue        ram_queue               = G_QUEUE_INIT;
+
+/* the blocks stored in the swap file, by offset, which the compaction moves
+ * from the end of the file to the free space before them.  a block is only
+ * moved while no reader is about to read from an offset it looked up, as
+ * counted by reads_pending.  the tree is only accessed by the writer thread.
+ */
+static GTree        *block_tree              = NULL;
+
 
 static void
 gegl_tile_backend_swap_push_queue (ThreadParams *params,
@@ -455,21 +588,14 @@ gegl_tile_backend_swap_find_offset (gint block_size)
 }
 
 static void
-gegl_tile_backend_swap_free_block (SwapBlock *block)
+gegl_tile_backend_swap_free_extent (gint64 start,
+                                    gint64 end)
 {
   SwapGap *left_gap;
   SwapGap *right_gap;
-  gint64   start;
-  gint64   end;
-
-  /* storage for entry not allocated yet.  nothing more to do. */
-  if (block->offset < 0)
-    return;
-
-  start = block->offset;
-  end   = start + block->size;
-
-  block->offset = -1;
+  SwapGap *gap       = NULL;
+  gint64   hole_start = start;
+  gint64   hole_end   = end;
 
   total -= end - start;
 
@@ -480,6 +606,8 @@ gegl_tile_backend_swap_free_block (SwapBlock *block)
       left_gap->end = end;
 
       start = end;
+
+      gap = left_gap;
     }
 
   if (right_gap && right_gap->start == end)
@@ -487,6 +615,9 @@ gegl_tile_backend_swap_free_block (SwapBlock *block)
       right_gap->start = start;
 
       end = start;
+
+      if (! gap)
+        gap = right_gap;
     }
 
   if (left_gap && right_gap && left_gap->end == right_gap->start)
@@ -501,8 +632,6 @@ gegl_tile_backend_swap_free_block (SwapBlock *block)
 
   if (start < end)
     {
-      SwapGap *gap;
-
       gap = gegl_tile_backend_swap_gap_new (start, end);
 
       if (left_gap)
@@ -514,6 +643,227 @@ gegl_tile_backend_swap_free_block (SwapBlock *block)
 
       g_tree_insert (gap_tree, gap, NULL);
     }
+
+  if (! gegl_tile_backend_swap_truncate (gap))
+    gegl_tile_backend_swap_punch_hole (gap, hole_start, hole_end);
+
+  if (file_size >= COMPACT_MIN_SIZE && total <= file_size * COMPACT_MAX_RATIO)
+    compact = TRUE;
+}
+
+static void
+gegl_tile_backend_swap_free_block (SwapBlock *block)
+{
+  gint64 start;
+
+  /* storage for entry not allocated yet.  nothing more to do. */
+  if (block->offset < 0)
+    return;
+
+  g_tree_remove (block_tree, block);
+
+  start = block->offset;
+
+  block->offset = -1;
+
+  gegl_tile_backend_swap_free_extent (start, start + block->size);
+}
+
+/* shrinks the swap file if @gap is a large enough gap at its end.  returns
+ * TRUE if the file was truncated, in which case @gap is freed.
+ */
+static gboolean
+gegl_tile_backend_swap_truncate (SwapGap *gap)
+{
+  SwapGap *left_gap;
+  SwapGap *right_gap;
+  gint64   size = gap->end - gap->start;
+
+  if (gap->end != file_size          ||
+      out_fd < 0                     ||
+      size < TRUNCATE_MIN_SIZE       ||
+      size < file_size * TRUNCATE_MIN_RATIO)
+    {
+      return FALSE;
+    }
+
+  gegl_tile_backend_swap_gap_search (gap->start, &left_gap, &right_gap);
+
+  if (left_gap)
+    left_gap->next = NULL;
+  else
+    gap_list = NULL;
+
+  g_tree_remove (gap_tree, gap);
+
+  gegl_tile_backend_swap_resize (gap->start);
+
+  gegl_tile_backend_swap_gap_free (gap);
+
+  return TRUE;
+}
+
+/* deallocates the pages of the swap file between @start and @end which lie
+ * entirely in @gap, so that freed space doesn't take up disk space.
+ */
+static void
+gegl_tile_backend_swap_punch_hole (SwapGap *gap,
+                                   gint64   start,
+                                   gint64   end)
+{
+#ifdef HAVE_FALLOCATE_PUNCH_HOLE
+  if (! punch_holes || out_fd < 0)
+    return;
+
+  start = MAX (start / HOLE_ALIGNMENT * HOLE_ALIGNMENT, gap->start);
+  end   = MIN ((end + HOLE_ALIGNMENT - 1) / HOLE_ALIGNMENT * HOLE_ALIGNMENT,
+               gap->end);
+
+  start = (start + HOLE_ALIGNMENT - 1) / HOLE_ALIGNMENT * HOLE_ALIGNMENT;
+  end   = end / HOLE_ALIGNMENT * HOLE_ALIGNMENT;
+
+  if (start >= end)
+    return;
+
+  if (fallocate (out_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 start, end - start) != 0)
+    {
+      /* the file system doesn't support it, don't try again */
+      if (errno == EOPNOTSUPP || errno == ENOSYS)
+        punch_holes = FALSE;
+      else
+        g_warning ("failed to punch hole in swap file: %s", g_strerror (errno));
+    }
+#endif
+}
+
+static gint
+gegl_tile_backend_swap_block_compare (const SwapBlock *block1,
+                                      const SwapBlock *block2)
+{
+  return (block1->offset > block2->offset) - (block1->offset < block2->offset);
+}
+
+static gint
+gegl_tile_backend_swap_block_search_func (const SwapBlock *block,
+                                          const gint64    *end)
+{
+  gint64 block_end = block->offset + block->size;
+
+  return (*end > block_end) - (*end < block_end);
+}
+
+/* moves the blocks at the end of the swap file to the first gaps before them
+ * that they fit in, letting the file be truncated.  returns TRUE if there
+ * might be more blocks to move.  called by the writer thread while the queue
+ * is empty, without holding any lock; readers are only held back by the
+ * reading of the moved blocks.
+ */
+static gboolean
+gegl_tile_backend_swap_compact (void)
+{
+  gint64 moved = 0;
+
+  while (moved < COMPACT_STEP_MAX)
+    {
+      SwapGap   *left_gap;
+      SwapGap   *right_gap;
+      SwapGap   *gap;
+      SwapBlock *block;
+      guint8    *data;
+      gint64     end;
+      gint64     offset;
+      gboolean   success;
+
+      /* the last block of the file */
+      gegl_tile_backend_swap_gap_search (file_size, &left_gap, &right_gap);
+
+      if (left_gap && left_gap->end == file_size)
+        end = left_gap->start;
+      else
+        end = file_size;
+
+      block = g_tree_search (
+        block_tree,
+        (GCompareFunc) gegl_tile_backend_swap_block_search_func,
+        &end);
+
+      if (! block)
+        return FALSE;
+
+      for (gap = gap_list; gap && gap->start < block->offset; gap = gap->next)
+        {
+          if (gap->end - gap->start >= block->size)
+            break;
+        }
+
+      if (! gap || gap->start >= block->offset)
+        return FALSE;
+
+      data = gegl_scratch_alloc (block->size);
+
+      g_mutex_lock (&read_mutex);
+
+      reading = TRUE;
+
+      success = gegl_tile_backend_swap_read_data (block->offset, data,
+                                                  block->size);
+
+      reading = FALSE;
+
+      g_mutex_unlock (&read_mutex);
+
+      if (! success)
+        {
+          gegl_scratch_free (data);
+
+          return FALSE;
+        }
+
+      /* takes the space at the start of the gap found above */
+      offset = gegl_tile_backend_swap_find_offset (block->size);
+
+      writing = TRUE;
+
+      success = gegl_tile_backend_swap_write_data (offset, data, block->size);
+
+      writing = FALSE;
+
+      gegl_scratch_free (data);
+
+      g_mutex_lock (&queue_mutex);
+
+      if (success && g_atomic_int_get (&reads_pending) == 0)
+        {
+          gint64 old_offset = block->offset;
+
+          g_tree_remove (block_tree, block);
+
+          block->offset = offset;
+
+          g_tree_insert (block_tree, block, block);
+
+          offset = old_offset;
+        }
+      else
+        {
+          success = FALSE;
+        }
+
+      g_mutex_unlock (&queue_mutex);
+
+      /* free the copy which isn't used */
+      gegl_tile_backend_swap_free_extent (offset, offset + block->size);
+
+      if (! success)
+        return FALSE;
+
+      moved += block->size;
+
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "compaction moved %i bytes from %i to %i", block->size, (gint)offset, (gint)block->offset);
+    }
+
+  return TRUE;
 }
 
 static gint
@@ -560,6 +910,48 @@ gegl_tile_backend_swap_free_data (ThreadParams *params)
     }
 }
 
+/* writes @size bytes of @data at @offset of the swap file.  must be called
+ * from the writer thread.
+ */
+static gboolean
+gegl_tile_backend_swap_write_data (gint64        offset,
+                                   const guint8 *data,
+                                   gint          size)
+{
+  gint to_be_written = size;
+
+  if (out_offset != offset)
+    {
+      if (lseek (out_fd, offset, SEEK_SET) < 0)
+        {
+          g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
+          return FALSE;
+        }
+      out_offset = offset;
+    }
+
+  while (to_be_written > 0)
+    {
+      gint wrote;
+      wrote = write (out_fd, data, to_be_written);
+      if (wrote <= 0)
+        {
+          g_message ("unable to write tile data to self: "
+                     "%s (%d/%d bytes written)",
+                     g_strerror (errno), wrote, to_be_written);
+          return FALSE;
+        }
+
+      data          += wrote;
+      to_be_written -= wrote;
+      out_offset    += wrote;
+
+      write_total   += wrote;
+    }
+
+  return TRUE;
+}
+
 static void
 gegl_tile_backend_swap_write (ThreadParams *params)
 {
@@ -567,8 +959,6 @@ gegl_tile_backend_swap_write (ThreadParams *params)
   gint64        offset = params->block->offset;
   gint          to_be_written;
 
-  gegl_tile_backend_swap_ensure_exist ();
-
   if (params->tile)
     {
       data          = gegl_tile_get_data (params->tile);
@@ -610,6 +1000,34 @@ gegl_tile_backend_swap_write (ThreadParams *params)
       to_be_written = params->compressed_size;
     }
 
+  /* compressed data is kept in the RAM tier, if it's enabled.  incompressible
+   * data goes straight to the swap file.
+   */
+  if (params->block->compression && to_be_written <= ram_max)
+    {
+      if (offset < 0 && ! params->block->ram)
+        g_atomic_pointer_add (&total_uncompressed, +params->size);
+
+      gegl_tile_backend_swap_ram_store (params->block, data, to_be_written);
+
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "writer thread stored %i bytes in memory", to_be_written);
+
+      return;
+    }
+
+  if (params->block->ram)
+    {
+      g_mutex_lock (&queue_mutex);
+
+      gegl_tile_backend_swap_ram_remove (params->block);
+
+      g_mutex_unlock (&queue_mutex);
+
+      g_atomic_pointer_add (&total_uncompressed, -params->size);
+    }
+
+  gegl_tile_backend_swap_ensure_exist ();
+
   if (offset >= 0 && params->block->size != to_be_written)
     {
       g_atomic_pointer_add (&total_uncompressed, -params->size);
@@ -627,41 +1045,15 @@ gegl_tile_backend_swap_write (ThreadParams *params)
       params->block->offset = offset;
       params->block->size   = to_be_written;
 
+      g_tree_insert (block_tree, params->block, params->block);
+
       g_atomic_pointer_add (&total_uncompressed, +params->size);
     }
 
   writing = TRUE;
 
-  if (out_offset != offset)
-    {
-      if (lseek (out_fd, offset, SEEK_SET) < 0)
-        {
-          g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
-
-          goto error;
-        }
-      out_offset = offset;
-    }
-
-  while (to_be_written > 0)
-    {
-      gint wrote;
-      wrote = write (out_fd, data, to_be_written);
-      if (wrote <= 0)
-        {
-          g_message ("unable to write tile data to self: "
-                     "%s (%d/%d bytes written)",
-                     g_strerror (errno), wrote, to_be_written);
-
-          goto error;
-        }
-
-      data          += wrote;
-      to_be_written -= wrote;
-      out_offset    += wrote;
-
-      write_total   += wrote;
-    }
+  if (! gegl_tile_backend_swap_write_data (offset, data, to_be_written))
+    goto error;
 
   writing = FALSE;
 
@@ -679,12 +1071,116 @@ error:
   return;
 }
 
+/* moves @block to the head of the RAM tier, holding a copy of @data, and
+ * reclaims the space it took in the swap file, if any.  must be called from
+ * the writer thread.
+ */
+static void
+gegl_tile_backend_swap_ram_store (SwapBlock    *block,
+                                  const guint8 *data,
+                                  gint          size)
+{
+  guint8 *ram = g_malloc (size);
+
+  memcpy (ram, data, size);
+
+  gegl_tile_backend_swap_free_block (block);
+
+  g_mutex_lock (&queue_mutex);
+
+  if (block->ram)
+    gegl_tile_backend_swap_ram_remove (block);
+
+  block->ram  = ram;
+  block->size = size;
+
+  g_queue_push_head (&ram_queue, block);
+  block->ram_link = g_queue_peek_head_link (&ram_queue);
+
+  ram_total += size;
+
+  g_mutex_unlock (&queue_mutex);
+}
+
+/* drops the data of @block from the RAM tier.  must be called from the writer
+ * thread, with queue_mutex held.
+ */
+static void
+gegl_tile_backend_swap_ram_remove (SwapBlock *block)
+{
+  g_queue_delete_link (&ram_queue, block->ram_link);
+  block->ram_link = NULL;
+
+  ram_total -= block->size;
+
+  g_clear_pointer (&block->ram, g_free);
+}
+
+/* writes the least recently stored blocks of the RAM tier to the swap file,
+ * until the tier fits in swap-ram-size.  the blocks are read from memory
+ * until they're written, so that queue_mutex isn't held during the writes.
+ * must be called from the writer thread.
+ */
+static void
+gegl_tile_backend_swap_ram_trim (void)
+{
+  while (ram_total > ram_max)
+    {
+      SwapBlock *block = g_queue_peek_tail (&ram_queue);
+      gint64     offset;
+      gboolean   success;
+
+      gegl_tile_backend_swap_ensure_exist ();
+
+      offset = gegl_tile_backend_swap_find_offset (block->size);
+
+      writing = TRUE;
+
+      success = gegl_tile_backend_swap_write_data (offset, block->ram,
+                                                   block->size);
+
+      writing = FALSE;
+
+      g_mutex_lock (&queue_mutex);
+
+      if (success)
+        {
+          gegl_tile_backend_swap_ram_remove (block);
+
+          block->offset = offset;
+        }
+
+      g_mutex_unlock (&queue_mutex);
+
+      if (! success)
+        {
+          /* keep the block, and the rest of the tier, in memory */
+          gegl_tile_backend_swap_free_extent (offset, offset + block->size);
+
+          break;
+        }
+
+      g_tree_insert (block_tree, block, block);
+
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "writer thread moved %i bytes from memory to %i", block->size, (gint)offset);
+    }
+}
+
 static void
 gegl_tile_backend_swap_destroy (ThreadParams *params)
 {
-  if (params->block->offset >= 0)
+  if (params->block->offset >= 0 || params->block->ram)
     g_atomic_pointer_add (&total_uncompressed, -params->size);
 
+  if (params->block->ram)
+    {
+      g_mutex_lock (&queue_mutex);
+
+      gegl_tile_backend_swap_ram_remove (params->block);
+
+      g_mutex_unlock (&queue_mutex);
+    }
+
   gegl_tile_backend_swap_free_block (params->block);
 
   gegl_tile_backend_swap_block_free (params->block);
@@ -701,6 +1197,20 @@ gegl_tile_backend_swap_writer_thread (gpointer ignored)
 
       while (g_queue_is_empty (queue) && !exit_thread)
         {
+          /* compact the swap file while there's nothing else to do, a step
+           * at a time, checking for queued work in between.
+           */
+          if (compact)
+            {
+              g_mutex_unlock (&queue_mutex);
+
+              compact = gegl_tile_backend_swap_compact ();
+
+              g_mutex_lock (&queue_mutex);
+
+              continue;
+            }
+
           busy = FALSE;
 
           g_cond_wait (&queue_cond, &queue_mutex);
@@ -722,6 +1232,7 @@ gegl_tile_backend_swap_writer_thread (gpointer ignored)
         {
         case OP_WRITE:
           gegl_tile_backend_swap_write (params);
+          gegl_tile_backend_swap_ram_trim ();
           break;
         case OP_DESTROY:
           gegl_tile_backend_swap_destroy (params);
@@ -742,6 +1253,97 @@ gegl_tile_backend_swap_writer_thread (gpointer ignored)
   return NULL;
 }
 
+/* returns a new tile holding the data of @block if it's still in the queue,
+ * or in the RAM tier, or NULL if it has to be read from the swap file.  must
+ * be called with queue_mutex held.
+ */
+static GeglTile *
+gegl_tile_backend_swap_read_queued (SwapBlock  *block,
+                                    const Babl *format,
+                                    gint        tile_size)
+{
+  ThreadParams *queued_op = NULL;
+  GeglTile     *tile;
+
+  if (block->link)
+    queued_op = block->link->data;
+  else if (in_progress && in_progress->block == block)
+    queued_op = in_progress;
+
+  if (! queued_op && ! block->ram)
+    return NULL;
+
+  if (queued_op && queued_op->tile)
+    {
+      tile = gegl_tile_dup (queued_op->tile);
+    }
+  else
+    {
+      gint bpp = babl_format_get_bytes_per_pixel (format);
+
+      tile = gegl_tile_new (tile_size);
+
+      if (! gegl_compression_decompress (
+              block->compression, format,
+              gegl_tile_get_data (tile), tile_size / bpp,
+              queued_op ? queued_op->compressed      : block->ram,
+              queued_op ? queued_op->compressed_size : block->size))
+        {
+          g_warning ("failed to decompress tile");
+        }
+
+      if (! queued_op)
+        ram_hits++;
+    }
+
+  gegl_tile_mark_as_stored (tile);
+
+  return tile;
+}
+
+/* reads @size bytes at @offset of the swap file into @data.  must be called
+ * with read_mutex held.
+ */
+static gboolean
+gegl_tile_backend_swap_read_data (gint64  offset,
+                                  guint8 *data,
+                                  gint    size)
+{
+  gint to_be_read = size;
+
+  if (in_offset != offset)
+    {
+      if (lseek (in_fd, offset, SEEK_SET) < 0)
+        {
+          g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
+          return FALSE;
+        }
+      in_offset = offset;
+    }
+
+  while (to_be_read > 0)
+    {
+      gint bytes_read;
+
+      bytes_read = read (in_fd, data + size - to_be_read, to_be_read);
+
+      if (bytes_read <= 0)
+        {
+          g_message ("unable to read tile data from swap: "
+                     "%s (%d/%d bytes read)",
+                     g_strerror (errno), bytes_read, to_be_read);
+          return FALSE;
+        }
+
+      to_be_read -= bytes_read;
+      in_offset  += bytes_read;
+
+      read_total += bytes_read;
+    }
+
+  return TRUE;
+}
+
 static GeglTile *
 gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
                                    SwapEntry           *entry)
@@ -754,7 +1356,7 @@ gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
   gint64           offset;
   gint             tile_size;
   gint             bpp;
-  gint             to_be_read;
+  gboolean         success;
 
   format    = gegl_tile_backend_get_format (backend);
   tile_size = gegl_tile_backend_get_tile_size (backend);
@@ -768,54 +1370,38 @@ gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
 
       return tile;
     }
-
-  g_mutex_lock (&queue_mutex);
-
-  if (entry->block->link || in_progress)
+  else if (entry->block->pixel)
     {
-      ThreadParams *queued_op = NULL;
+      tile = gegl_tile_new_uniform (tile_size, entry->block->pixel, bpp);
 
-      if (entry->block->link)
-        queued_op = entry->block->link->data;
-      else if (in_progress->block == entry->block)
-        queued_op = in_progress;
+      gegl_tile_mark_as_stored (tile);
 
-      if (queued_op)
-        {
-          if (queued_op->tile)
-            {
-              tile = gegl_tile_dup (queued_op->tile);
-            }
-          else
-            {
-              tile = gegl_tile_new (tile_size);
-              dest = gegl_tile_get_data (tile);
+      return tile;
+    }
 
-              if (! gegl_compression_decompress (
-                      entry->block->compression, format,
-                      dest, tile_size / bpp,
-                      queued_op->compressed, queued_op->compressed_size))
-                {
-                  g_warning ("failed to decompress tile");
-                }
-            }
+  g_mutex_lock (&queue_mutex);
 
-          g_mutex_unlock (&queue_mutex);
+  tile = gegl_tile_backend_swap_read_queued (entry->block, format, tile_size);
 
-          gegl_tile_mark_as_stored (tile);
+  if (tile)
+    {
+      g_mutex_unlock (&queue_mutex);
 
-          GEGL_NOTE(GEGL_DEBUG_TILE_BACKEND, "read entry %i, %i, %i from queue", entry->x, entry->y, entry->z);
+      GEGL_NOTE(GEGL_DEBUG_TILE_BACKEND, "read entry %i, %i, %i from queue", entry->x, entry->y, entry->z);
 
-          return tile;
-        }
+      return tile;
     }
 
   offset = entry->block->offset;
 
+  g_atomic_int_inc (&reads_pending);
+
   g_mutex_unlock (&queue_mutex);
 
   if (offset < 0 || in_fd < 0)
     {
+      g_atomic_int_add (&reads_pending, -1);
+
       g_warning ("no swap storage allocated for tile");
       return NULL;
     }
@@ -833,58 +1419,20 @@ gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
 
   reading = TRUE;
 
-  if (in_offset != offset)
-    {
-      if (lseek (in_fd, offset, SEEK_SET) < 0)
-        {
-          reading = FALSE;
-
-          g_mutex_unlock (&read_mutex);
-
-          g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
-          return tile;
-        }
-      in_offset = offset;
-    }
-
-  to_be_read = entry->block->size;
-
-  while (to_be_read > 0)
-    {
-      GError *error = NULL;
-      gint    bytes_read;
-
-      bytes_read = read (in_fd,
-                         data + entry->block->size - to_be_read, to_be_read);
-
-      if (bytes_read <= 0)
-        {
-          reading = FALSE;
-
-          g_mutex_unlock (&read_mutex);
-
-          if (entry->block->compression)
-            gegl_scratch_free (data);
-
-          g_message ("unable to read tile data from swap: "
-                     "%s (%d/%d bytes read) %s",
-                     g_strerror (errno), bytes_read, to_be_read, error?error->message:"--");
-          return tile;
-        }
-
-      to_be_read -= bytes_read;
-      in_offset  += bytes_read;
-
-      read_total += bytes_read;
-    }
+  success = gegl_tile_backend_swap_read_data (offset, data, entry->block->size);
 
   reading = FALSE;
 
+  disk_hits++;
+
   g_mutex_unlock (&read_mutex);
 
+  g_atomic_int_add (&reads_pending, -1);
+
   if (entry->block->compression)
     {
-      if (! gegl_compression_decompress (
+      if (success &&
+          ! gegl_compression_decompress (
               entry->block->compression, format,
               dest, tile_size / bpp,
               data, entry->block->size))
@@ -903,7 +1451,8 @@ gegl_tile_backend_swap_entry_read (GeglTileBackendSwap *self,
 static void
 gegl_tile_backend_swap_entry_write (GeglTileBackendSwap *self,
                                     SwapEntry           *entry,
-                                    GeglTile            *tile)
+                                    GeglTile            *tile,
+                                    gboolean             lock)
 {
   GeglTileBackend *backend = GEGL_TILE_BACKEND (self);
   ThreadParams    *params;
@@ -915,7 +1464,8 @@ gegl_tile_backend_swap_entry_write (GeglTileBackendSwap *self,
   size     = gegl_tile_backend_get_tile_size (backend);
   cost     = (size + n_clones / 2) / n_clones;
 
-  g_mutex_lock (&queue_mutex);
+  if (lock)
+    g_mutex_lock (&queue_mutex);
 
   if (entry->block->link)
     {
@@ -935,7 +1485,8 @@ gegl_tile_backend_swap_entry_write (GeglTileBackendSwap *self,
           queued_total += size;
           queued_cost  += cost;
 
-          g_mutex_unlock (&queue_mutex);
+          if (lock)
+            g_mutex_unlock (&queue_mutex);
 
           GEGL_NOTE(GEGL_DEBUG_TILE_BACKEND, "tile %i, %i, %i at %i is already enqueued, changed data", entry->x, entry->y, entry->z, (gint)entry->block->offset);
 
@@ -960,7 +1511,8 @@ gegl_tile_backend_swap_entry_write (GeglTileBackendSwap *self,
 
   gegl_tile_backend_swap_push_queue (params, /* head = */ FALSE);
 
-  g_mutex_unlock (&queue_mutex);
+  if (lock)
+    g_mutex_unlock (&queue_mutex);
 
   GEGL_NOTE(GEGL_DEBUG_TILE_BACKEND, "pushed write of entry %i, %i, %i at %i", entry->x, entry->y, entry->z, (gint)entry->block->offset);
 }
@@ -973,6 +1525,40 @@ gegl_tile_backend_swap_block_create (void)
   block->ref_count = 1;
   block->link      = NULL;
   block->offset    = -1;
+  block->pixel     = NULL;
+  block->hashed    = FALSE;
+  block->n_dedup   = 0;
+  block->ram       = NULL;
+  block->ram_link  = NULL;
+
+  return block;
+}
+
+/* returns a new block holding the pixel of @tile if the tile is uniform, or
+ * NULL otherwise.  tiles which weren't created as uniform are checked by
+ * comparing their data against itself, shifted by one pixel, which bails out
+ * early for all but flat tiles, and is cheap compared to storing the tile.
+ */
+static SwapBlock *
+gegl_tile_backend_swap_uniform_block_create (GeglTile *tile,
+                                             gint      bpp)
+{
+  SwapBlock *block;
+  guint8    *data = gegl_tile_get_data (tile);
+
+  if (! tile->is_uniform_tile &&
+      memcmp (data, data + bpp, tile->size - bpp))
+    {
+      return NULL;
+    }
+
+  block = gegl_tile_backend_swap_block_create ();
+
+  block->size        = bpp;
+  block->compression = NULL;
+  block->pixel       = g_malloc (bpp);
+
+  memcpy (block->pixel, data, bpp);
 
   return block;
 }
@@ -982,6 +1568,8 @@ gegl_tile_backend_swap_block_free (SwapBlock *block)
 {
   g_return_if_fail (block->ref_count == 0);
 
+  g_free (block->pixel);
+
   g_slice_free (SwapBlock, block);
 }
 
@@ -1001,8 +1589,51 @@ gegl_tile_backend_swap_block_unref (SwapBlock *block,
                                     gint       tile_size,
                                     gboolean   lock)
 {
-  if (g_atomic_int_dec_and_test (&block->ref_count))
+  gboolean last;
+
+  /* hashed blocks can gain references through dedup_table at any time, so
+   * their last reference is only dropped under dedup_mutex, along with their
+   * mapping.  the writer thread hashes blocks under dedup_mutex too, so
+   * whether the block is hashed is only known while holding it.
+   */
+  g_mutex_lock (&dedup_mutex);
+
+  if (block->hashed)
+    {
+      last = g_atomic_int_dec_and_test (&block->ref_count);
+
+      if (last)
+        {
+          if (g_hash_table_lookup (dedup_table, &block->hash) == block)
+            g_hash_table_remove (dedup_table, &block->hash);
+
+          block->hashed = FALSE;
+        }
+      else if (block->n_dedup >= block->ref_count)
+        {
+          /* the block is no longer shared by as many entries */
+          dedup_total -= (guint64) (block->n_dedup - block->ref_count + 1) *
+                         tile_size;
+          block->n_dedup = block->ref_count - 1;
+        }
+    }
+  else
     {
+      last = g_atomic_int_dec_and_test (&block->ref_count);
+    }
+
+  g_mutex_unlock (&dedup_mutex);
+
+  if (last)
+    {
+      /* uniform blocks have no swap space to reclaim */
+      if (block->pixel)
+        {
+          gegl_tile_backend_swap_block_free (block);
+
+          return;
+        }
+
       if (lock)
         g_mutex_lock (&queue_mutex);
 
@@ -1053,6 +1684,170 @@ gegl_tile_backend_swap_block_is_unique (SwapBlock *block)
   return g_atomic_int_get (&block->ref_count) == 1;
 }
 
+/* returns TRUE if the data of @block, held by a single entry, can be
+ * overwritten, in which case the block is removed from dedup_table, as its
+ * hash is about to become stale.
+ */
+static gboolean
+gegl_tile_backend_swap_block_claim (SwapBlock *block)
+{
+  gboolean unique;
+
+  if (block->pixel)
+    return FALSE;
+
+  g_mutex_lock (&dedup_mutex);
+
+  unique = gegl_tile_backend_swap_block_is_unique (block);
+
+  if (unique && block->hashed)
+    {
+      if (g_hash_table_lookup (dedup_table, &block->hash) == block)
+        g_hash_table_remove (dedup_table, &block->hash);
+
+      block->hashed = FALSE;
+    }
+
+  g_mutex_unlock (&dedup_mutex);
+
+  return unique;
+}
+
+/* checks if the data of @block is @data.  blocks are looked up by the hash of
+ * their data, which is verified before sharing them.  the caller must hold a
+ * reference to @block, so that it isn't rewritten in the meantime.
+ */
+static gboolean
+gegl_tile_backend_swap_block_equals (SwapBlock    *block,
+                                     const guint8 *data,
+                                     const Babl   *format,
+                                     gint          tile_size)
+{
+  const GeglCompression *block_compression;
+  GeglTile              *tile;
+  guint8                *buffer;
+  gint64                 offset;
+  gint                   size;
+  gboolean               equal;
+
+  g_mutex_lock (&queue_mutex);
+
+  tile = gegl_tile_backend_swap_read_queued (block, format, tile_size);
+
+  offset            = block->offset;
+  size              = block->size;
+  block_compression = block->compression;
+
+  if (! tile)
+    g_atomic_int_inc (&reads_pending);
+
+  g_mutex_unlock (&queue_mutex);
+
+  if (tile)
+    {
+      equal = ! memcmp (gegl_tile_get_data (tile), data, tile_size);
+
+      gegl_tile_unref (tile);
+
+      return equal;
+    }
+
+  if (offset < 0 || in_fd < 0)
+    {
+      g_atomic_int_add (&reads_pending, -1);
+
+      return FALSE;
+    }
+
+  buffer = gegl_scratch_alloc (tile_size + (block_compression ? size : 0));
+
+  g_mutex_lock (&read_mutex);
+
+  reading = TRUE;
+
+  equal = gegl_tile_backend_swap_read_data (
+    offset,
+    block_compression ? buffer + tile_size : buffer,
+    size);
+
+  reading = FALSE;
+
+  g_mutex_unlock (&read_mutex);
+
+  g_atomic_int_add (&reads_pending, -1);
+
+  if (equal && block_compression)
+    {
+      equal = gegl_compression_decompress (
+        block_compression, format,
+        buffer, tile_size / babl_format_get_bytes_per_pixel (format),
+        buffer + tile_size, size);
+    }
+
+  if (equal)
+    equal = ! memcmp (buffer, data, tile_size);
+
+  gegl_scratch_free (buffer);
+
+  return equal;
+}
+
+/* returns a new reference to a block holding the same data as @tile, or NULL
+ * if there's none, in which case @hash is the hash to register the block
+ * the tile is written to with.
+ */
+static SwapBlock *
+gegl_tile_backend_swap_dedup_lookup (GeglTile   *tile,
+                                     const Babl *format,
+                                     gint        tile_size,
+                                     guint64    *hash)
+{
+  SwapBlock *block;
+
+  *hash = gegl_tile_hash (tile);
+
+  g_mutex_lock (&dedup_mutex);
+
+  block = g_hash_table_lookup (dedup_table, hash);
+
+  if (block)
+    gegl_tile_backend_swap_block_ref (block, tile_size);
+
+  g_mutex_unlock (&dedup_mutex);
+
+  if (block &&
+      ! gegl_tile_backend_swap_block_equals (block,
+                                             gegl_tile_get_data (tile),
+                                             format, tile_size))
+    {
+      gegl_tile_backend_swap_block_unref (block, tile_size, TRUE);
+
+      block = NULL;
+    }
+
+  return block;
+}
+
+/* registers @block, whose data has just been queued for writing, as holding
+ * data hashing to @hash, unless another block already does.
+ */
+static void
+gegl_tile_backend_swap_dedup_insert (SwapBlock *block,
+                                     guint64    hash)
+{
+  g_mutex_lock (&dedup_mutex);
+
+  if (! block->hashed && ! g_hash_table_contains (dedup_table, &hash))
+    {
+      block->hash   = hash;
+      block->hashed = TRUE;
+
+      g_hash_table_insert (dedup_table, &block->hash, block);
+    }
+
+  g_mutex_unlock (&dedup_mutex);
+}
+
 static SwapBlock *
 gegl_tile_backend_swap_empty_block (void)
 {
@@ -1140,19 +1935,44 @@ gegl_tile_backend_swap_set_tile (GeglTileSource *self,
                                  GeglTile       *tile,
                                  gint            x,
                                  gint            y,
-                                 gint            z)
+                                 gint            z,
+                                 gboolean        lock)
 {
   GeglTileBackendSwap *swap;
   SwapEntry           *entry;
   SwapBlock           *src_block = NULL;
+  const Babl          *format;
   gint                 tile_size;
+  gboolean             dedup;
+  gboolean             shared    = FALSE;
+  guint64              hash      = 0;
 
   swap      = GEGL_TILE_BACKEND_SWAP (self);
   entry     = gegl_tile_backend_swap_lookup_entry (swap, x, y, z);
+  format    = gegl_tile_backend_get_format (GEGL_TILE_BACKEND (swap));
   tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (swap));
 
+  /* verifying deduplication candidates locks queue_mutex, which batched
+   * writes already hold
+   */
+  dedup = lock && gegl_buffer_config ()->tile_dedup;
+
   if (tile->is_zero_tile)
-    src_block = gegl_tile_backend_swap_empty_block ();
+    {
+      src_block = gegl_tile_backend_swap_empty_block ();
+    }
+  else
+    {
+      src_block = gegl_tile_backend_swap_uniform_block_create (
+        tile,
+        babl_format_get_bytes_per_pixel (format));
+
+      if (! src_block && dedup)
+        {
+          src_block = gegl_tile_backend_swap_dedup_lookup (tile, format,
+                                                           tile_size, &hash);
+        }
+    }
 
   if (entry)
     {
@@ -1163,18 +1983,20 @@ gegl_tile_backend_swap_set_tile (GeglTileSource *self,
               gegl_tile_backend_swap_block_unref (
                 entry->block,
                 tile_size,
-                TRUE);
+                lock);
               entry->block = gegl_tile_backend_swap_block_ref (
                 src_block,
                 tile_size);
+
+              shared = TRUE;
             }
         }
-      else if (! gegl_tile_backend_swap_block_is_unique (entry->block))
+      else if (! gegl_tile_backend_swap_block_claim (entry->block))
         {
           gegl_tile_backend_swap_block_unref (
             entry->block,
             tile_size,
-            TRUE);
+            lock);
           entry->block = gegl_tile_backend_swap_block_create ();
         }
     }
@@ -1182,10 +2004,37 @@ gegl_tile_backend_swap_set_tile (GeglTileSource *self,
     {
       entry = gegl_tile_backend_swap_entry_create (swap, x, y, z, src_block);
       g_hash_table_add (swap->index, entry);
+
+      shared = TRUE;
     }
 
   if (! src_block)
-    gegl_tile_backend_swap_entry_write (swap, entry, tile);
+    {
+      gegl_tile_backend_swap_entry_write (swap, entry, tile, lock);
+
+      if (dedup)
+        gegl_tile_backend_swap_dedup_insert (entry->block, hash);
+    }
+  else if (src_block->pixel)
+    {
+      gegl_tile_backend_swap_block_unref (src_block, tile_size, lock);
+    }
+  else if (src_block != gegl_tile_backend_swap_empty_block ())
+    {
+      /* the block was found by the lookup, drop the reference it took */
+      if (shared)
+        {
+          g_mutex_lock (&dedup_mutex);
+
+          src_block->n_dedup++;
+          dedup_total += tile_size;
+          dedup_hits++;
+
+          g_mutex_unlock (&dedup_mutex);
+        }
+
+      gegl_tile_backend_swap_block_unref (src_block, tile_size, lock);
+    }
 
   gegl_tile_mark_as_stored (tile);
 
@@ -1231,6 +2080,234 @@ gegl_tile_backend_swap_exist_tile (GeglTileSource *self,
   return GINT_TO_POINTER (entry != NULL);
 }
 
+static gint
+gegl_tile_backend_swap_read_compare (const SwapRead *read1,
+                                     const SwapRead *read2)
+{
+  if (read1->offset < read2->offset)
+    return -1;
+  else if (read1->offset > read2->offset)
+    return +1;
+  else
+    return 0;
+}
+
+static gpointer
+gegl_tile_backend_swap_get_tiles (GeglTileSource      *self,
+                                  gint                 x,
+                                  gint                 y,
+                                  gint                 z,
+                                  GeglTileBatchParams *params)
+{
+  GeglTileBackendSwap *swap    = GEGL_TILE_BACKEND_SWAP (self);
+  GeglTileBackend     *backend = GEGL_TILE_BACKEND (self);
+  gint                 n_tiles = params->width * params->height;
+  const Babl          *format;
+  SwapRead            *reads;
+  gint                 n_reads = 0;
+  gint                 tile_size;
+  gint                 bpp;
+  gint                 i;
+  gint                 j;
+
+  format    = gegl_tile_backend_get_format (backend);
+  tile_size = gegl_tile_backend_get_tile_size (backend);
+  bpp       = babl_format_get_bytes_per_pixel (format);
+
+  reads = g_new (SwapRead, n_tiles);
+
+  /* look up all the entries, taking the data of the blocks which are still
+   * queued, under a single lock of the queue.
+   */
+  g_mutex_lock (&queue_mutex);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      SwapEntry *entry;
+
+      if (params->tiles[i])
+        continue;
+
+      entry = gegl_tile_backend_swap_lookup_entry (swap,
+                                                   x + i % params->width,
+                                                   y + i / params->width,
+                                                   z);
+
+      if (! entry)
+        continue;
+
+      if (entry->block == gegl_tile_backend_swap_empty_block ())
+        {
+          params->tiles[i] = gegl_tile_handler_empty_new_tile (tile_size);
+
+          gegl_tile_mark_as_stored (params->tiles[i]);
+
+          continue;
+        }
+      else if (entry->block->pixel)
+        {
+          params->tiles[i] = gegl_tile_new_uniform (tile_size,
+                                                    entry->block->pixel, bpp);
+
+          gegl_tile_mark_as_stored (params->tiles[i]);
+
+          continue;
+        }
+
+      params->tiles[i] = gegl_tile_backend_swap_read_queued (entry->block,
+                                                             format,
+                                                             tile_size);
+
+      if (! params->tiles[i])
+        {
+          if (entry->block->offset < 0 || in_fd < 0)
+            {
+              g_warning ("no swap storage allocated for tile");
+              continue;
+            }
+
+          reads[n_reads].index  = i;
+          reads[n_reads].block  = entry->block;
+          reads[n_reads].offset = entry->block->offset;
+          reads[n_reads].size   = entry->block->size;
+          n_reads++;
+        }
+    }
+
+  if (n_reads)
+    g_atomic_int_inc (&reads_pending);
+
+  g_mutex_unlock (&queue_mutex);
+
+  /* read the rest in file order, coalescing the reads of adjacent blocks */
+  qsort (reads, n_reads, sizeof (SwapRead),
+         (GCompareFunc) gegl_tile_backend_swap_read_compare);
+
+  for (i = 0; i < n_reads; i = j)
+    {
+      gint64    start = reads[i].offset;
+      gint      size  = reads[i].size;
+      guint8   *data;
+      gboolean  direct;
+      gboolean  success;
+      gint      k;
+
+      for (j = i + 1; j < n_reads; j++)
+        {
+          if (reads[j].offset != start + size ||
+              size + reads[j].size > COALESCED_READ_MAX)
+            {
+              break;
+            }
+
+          size += reads[j].size;
+        }
+
+      for (k = i; k < j; k++)
+        {
+          params->tiles[reads[k].index] = gegl_tile_new (tile_size);
+
+          gegl_tile_mark_as_stored (params->tiles[reads[k].index]);
+        }
+
+      /* a single uncompressed block is read directly into its tile */
+      direct = j == i + 1 && ! reads[i].block->compression;
+
+      if (direct)
+        data = gegl_tile_get_data (params->tiles[reads[i].index]);
+      else
+        data = gegl_scratch_alloc (size);
+
+      g_mutex_lock (&read_mutex);
+
+      reading = TRUE;
+
+      success = gegl_tile_backend_swap_read_data (start, data, size);
+
+      reading = FALSE;
+
+      disk_hits += j - i;
+
+      g_mutex_unlock (&read_mutex);
+
+      if (direct)
+        continue;
+
+      /* like gegl_tile_backend_swap_entry_read(), the tiles are handed out
+       * even if reading failed
+       */
+      if (success)
+        {
+          for (k = i; k < j; k++)
+            {
+              const guint8 *src  = data + (reads[k].offset - start);
+              guint8       *dest = gegl_tile_get_data (
+                                     params->tiles[reads[k].index]);
+
+              if (reads[k].block->compression)
+                {
+                  if (! gegl_compression_decompress (
+                          reads[k].block->compression, format,
+                          dest, tile_size / bpp,
+                          src, reads[k].size))
+                    {
+                      g_warning ("failed to decompress tile");
+                    }
+                }
+              else
+                {
+                  memcpy (dest, src, tile_size);
+                }
+            }
+        }
+
+      gegl_scratch_free (data);
+    }
+
+  if (n_reads)
+    g_atomic_int_add (&reads_pending, -1);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read %i entries of %i, %i, %i (%ix%i)", n_reads, x, y, z, params->width, params->height);
+
+  g_free (reads);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
+static gpointer
+gegl_tile_backend_swap_set_tiles (GeglTileSource      *self,
+                                  gint                 x,
+                                  gint                 y,
+                                  gint                 z,
+                                  GeglTileBatchParams *params)
+{
+  gint n_tiles = params->width * params->height;
+  gint i;
+
+  /* deduplicated tiles are set one at a time, see set_tile() */
+  if (gegl_buffer_config ()->tile_dedup)
+    return NULL;
+
+  /* queue all the writes under a single lock of the queue */
+  g_mutex_lock (&queue_mutex);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      if (params->tiles[i])
+        {
+          gegl_tile_backend_swap_set_tile (self, params->tiles[i],
+                                           x + i % params->width,
+                                           y + i / params->width,
+                                           z,
+                                           /* lock = */ FALSE);
+        }
+    }
+
+  g_mutex_unlock (&queue_mutex);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
 static gpointer
 gegl_tile_backend_swap_copy_tile (GeglTileSource           *self,
                                   gint                      x,
@@ -1307,7 +2384,7 @@ gegl_tile_backend_swap_command (GeglTileSource  *self,
       case GEGL_TILE_GET:
         return gegl_tile_backend_swap_get_tile (self, x, y, z);
       case GEGL_TILE_SET:
-        return gegl_tile_backend_swap_set_tile (self, data, x, y, z);
+        return gegl_tile_backend_swap_set_tile (self, data, x, y, z, TRUE);
       case GEGL_TILE_IDLE:
         return NULL;
       case GEGL_TILE_VOID:
@@ -1318,6 +2395,10 @@ gegl_tile_backend_swap_command (GeglTileSource  *self,
         return NULL;
       case GEGL_TILE_COPY:
         return gegl_tile_backend_swap_copy_tile (self, x, y, z, data);
+      case GEGL_TILE_GET_N:
+        return gegl_tile_backend_swap_get_tiles (self, x, y, z, data);
+      case GEGL_TILE_SET_N:
+        return gegl_tile_backend_swap_set_tiles (self, x, y, z, data);
 
       default:
         break;
@@ -1461,6 +2542,20 @@ gegl_tile_backend_swap_compression_notify (GObject    *config,
   g_mutex_unlock (&queue_mutex);
 }
 
+static void
+gegl_tile_backend_swap_ram_size_notify (GObject    *config,
+                                        GParamSpec *pspec,
+                                        gpointer    data)
+{
+  g_mutex_lock (&queue_mutex);
+
+  g_object_get (config,
+                "swap-ram-size", &ram_max,
+                NULL);
+
+  g_mutex_unlock (&queue_mutex);
+}
+
 static void
 gegl_tile_backend_swap_tile_cache_size_notify (GObject    *config,
                                                GParamSpec *pspec,
@@ -1491,6 +2586,10 @@ gegl_tile_backend_swap_class_init (GeglTileBackendSwapClass *klass)
 
   gap_tree = g_tree_new ((GCompareFunc) gegl_tile_backend_swap_gap_compare);
 
+  block_tree = g_tree_new ((GCompareFunc) gegl_tile_backend_swap_block_compare);
+
+  dedup_table = g_hash_table_new (g_int64_hash, g_int64_equal);
+
   queue         = g_queue_new ();
   writer_thread = g_thread_new ("swap writer",
                                 gegl_tile_backend_swap_writer_thread,
@@ -1509,6 +2608,13 @@ gegl_tile_backend_swap_class_init (GeglTileBackendSwapClass *klass)
 
   gegl_tile_backend_swap_tile_cache_size_notify (G_OBJECT (gegl_buffer_config ()),
                                                  NULL, NULL);
+
+  g_signal_connect (gegl_buffer_config (), "notify::swap-ram-size",
+                    G_CALLBACK (gegl_tile_backend_swap_ram_size_notify),
+                    NULL);
+
+  gegl_tile_backend_swap_ram_size_notify (G_OBJECT (gegl_buffer_config ()),
+                                          NULL, NULL);
 }
 
 void
@@ -1517,6 +2623,11 @@ gegl_tile_backend_swap_cleanup (void)
   if (! writer_thread)
     return;
 
+  g_signal_handlers_disconnect_by_func (
+    gegl_buffer_config (),
+    gegl_tile_backend_swap_ram_size_notify,
+    NULL);
+
   g_signal_handlers_disconnect_by_func (
     gegl_buffer_config (),
     gegl_tile_backend_swap_tile_cache_size_notify,
@@ -1546,6 +2657,14 @@ gegl_tile_backend_swap_cleanup (void)
   g_tree_unref (gap_tree);
   gap_tree = NULL;
 
+  g_tree_unref (block_tree);
+  block_tree = NULL;
+
+  g_clear_pointer (&dedup_table, g_hash_table_unref);
+
+  if (! g_queue_is_empty (&ram_queue))
+    g_warning ("tile-backend-swap RAM tier wasn't empty before freeing\n");
+
   if (gap_list)
     {
       if (gap_list->next)
@@ -1667,6 +2786,36 @@ gegl_tile_backend_swap_get_write_total (void)
   return write_total;
 }
 
+gint
+gegl_tile_backend_swap_get_dedup_hits (void)
+{
+  return dedup_hits;
+}
+
+guint64
+gegl_tile_backend_swap_get_dedup_total (void)
+{
+  return dedup_total;
+}
+
+guint64
+gegl_tile_backend_swap_get_ram_total (void)
+{
+  return ram_total;
+}
+
+gint
+gegl_tile_backend_swap_get_ram_hits (void)
+{
+  return ram_hits;
+}
+
+gint
+gegl_tile_backend_swap_get_disk_hits (void)
+{
+  return disk_hits;
+}
+
 void
 gegl_tile_backend_swap_reset_stats (void)
 {
@@ -1674,4 +2823,9 @@ gegl_tile_backend_swap_reset_stats (void)
   write_total = 0;
 
   queue_stalls = 0;
+
+  dedup_hits = 0;
+
+  ram_hits  = 0;
+  disk_hits = 0;
 }
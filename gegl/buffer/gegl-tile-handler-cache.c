@@ -18,6 +18,8 @@
 
 #include "config.h"
 
+#include <math.h>
+
 #include <glib.h>
 #include <glib-object.h>
 
@@ -38,6 +40,9 @@
 #define GEGL_CACHE_TRIM_RATIO_MAX  0.50
 #define GEGL_CACHE_TRIM_RATIO_RATE 2.0
 
+#define GEGL_CACHE_COST_UNIT       0.001 /* seconds */
+#define GEGL_CACHE_MAX_CREDITS     4
+
 typedef struct CacheItem
 {
   GeglTile *tile; /* The tile */
@@ -47,6 +52,13 @@ typedef struct CacheItem
   gint      x;    /* The coordinates this tile was cached for */
   gint      y;
   gint      z;
+
+  gint      credits; /* The number of times the tile is spared when reaching
+                      * the end of the queue, -1 until it's first reached
+                      */
+  guintptr  time;    /* The cache time the item was last moved to the front
+                      * of the queue
+                      */
 } CacheItem;
 
 #define LINK_GET_CACHE(l) \
@@ -94,6 +106,8 @@ static guintptr           cache_total_max       = 0; /* maximal value of cache_t
 static volatile guintptr  cache_total_uncloned  = 0; /* approximate amount of uncloned bytes stored */
 static gint               cache_hits            = 0;
 static gint               cache_misses          = 0;
+static gint               cache_spared          = 0;
+static gdouble            cache_time_saved      = 0.0; /* seconds */
 static guintptr           cache_time            = 0;
 
 
@@ -146,6 +160,8 @@ gegl_tile_handler_cache_reinit (GeglTileHandlerCache *cache)
       cache->tile_storage->hot_tile = NULL;
     }
 
+  gegl_tile_storage_index_clear (cache->tile_storage);
+
   g_hash_table_remove_all (cache->items);
 
   while ((link = g_queue_pop_head_link (&cache->queue)))
@@ -178,6 +194,32 @@ gegl_tile_handler_cache_dispose (GObject *object)
   G_OBJECT_CLASS (gegl_tile_handler_cache_parent_class)->dispose (object);
 }
 
+/* the time it takes to compute a tile of the cache */
+static inline gdouble
+gegl_tile_handler_cache_get_tile_cost (GeglTileHandlerCache *cache)
+{
+  return cache->pixel_cost * cache->tile_storage->tile_width *
+                             cache->tile_storage->tile_height;
+}
+
+/* counts the hits through the storage index of @cache in the saved time,
+ * at the current cost of its tiles.
+ */
+static void
+gegl_tile_handler_cache_count_index_hits (GeglTileHandlerCache *cache)
+{
+  gint n_hits = g_atomic_int_and ((guint *) &cache->index_hits, 0);
+
+  cache_time_saved += n_hits * gegl_tile_handler_cache_get_tile_cost (cache);
+}
+
+/* advances the global cache time, which orders the accesses to all caches */
+static inline guintptr
+gegl_tile_handler_cache_next_time (void)
+{
+  return (guintptr) g_atomic_pointer_add (&cache_time, 1) + 1;
+}
+
 static GeglTile *
 gegl_tile_handler_cache_get_tile_command (GeglTileSource *tile_store,
                                           gint        x,
@@ -194,23 +236,193 @@ gegl_tile_handler_cache_get_tile_command (GeglTileSource *tile_store,
   tile = gegl_tile_handler_cache_get_tile (cache, x, y, z);
   if (tile)
     {
-      /* we don't bother making cache_{hits,misses} atomic, since they're only
-       * needed for GeglStats.
+      /* cache_hits is atomic, since hits through the storage index are
+       * counted without the mutex.  we don't bother making cache_misses
+       * atomic, since it's only needed for GeglStats.
        */
-      cache_hits++;
-      return tile;
+      g_atomic_int_inc (&cache_hits);
+      cache_time_saved += gegl_tile_handler_cache_get_tile_cost (cache);
     }
-  cache_misses++;
+  else
+    {
+      cache_misses++;
 
-  if (source)
-    tile = gegl_tile_source_get_tile (source, x, y, z);
+      if (source)
+        tile = gegl_tile_source_get_tile (source, x, y, z);
 
+      if (tile)
+        gegl_tile_handler_cache_insert (cache, tile, x, y, z);
+    }
+
+  /* let the tile be fetched without the storage mutex from now on */
   if (tile)
-    gegl_tile_handler_cache_insert (cache, tile, x, y, z);
+    {
+      gegl_tile_storage_index_insert (cache->tile_storage, tile,
+                                      g_hash_table_size (cache->items));
+    }
 
   return tile;
 }
 
+static gpointer
+gegl_tile_handler_cache_get_tiles_command (GeglTileSource      *tile_store,
+                                           gint                 x,
+                                           gint                 y,
+                                           gint                 z,
+                                           GeglTileBatchParams *params)
+{
+  GeglTileHandlerCache *cache   = (GeglTileHandlerCache*) (tile_store);
+  GeglTileSource       *source  = ((GeglTileHandler*) (tile_store))->source;
+  gint                  n_tiles = params->width * params->height;
+  gint                 *hits;
+  gint                 *misses;
+  gint                  n_hits   = 0;
+  gint                  n_misses = 0;
+  gint                  i;
+
+  if (gegl_tile_handler_cache_ext_flush)
+    gegl_tile_handler_cache_ext_flush (cache, NULL);
+
+  hits   = g_new (gint, 2 * n_tiles);
+  misses = hits + n_tiles;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      if (params->tiles[i])
+        continue;
+
+      params->tiles[i] = gegl_tile_handler_cache_get_tile (
+        cache,
+        x + i % params->width,
+        y + i / params->width,
+        z);
+
+      if (params->tiles[i])
+        hits[n_hits++] = i;
+      else
+        misses[n_misses++] = i;
+    }
+
+  g_atomic_int_add (&cache_hits, n_hits);
+  cache_misses     += n_misses;
+  cache_time_saved += n_hits * gegl_tile_handler_cache_get_tile_cost (cache);
+
+  /* fetch all the missing tiles from the source at once */
+  if (n_misses && source)
+    {
+      gegl_tile_source_get_tiles (source, x, y, z,
+                                  params->width, params->height,
+                                  params->tiles);
+
+      for (i = 0; i < n_misses; i++)
+        {
+          gint      j    = misses[i];
+          GeglTile *tile = params->tiles[j];
+
+          if (tile)
+            {
+              gegl_tile_handler_cache_insert (cache, tile,
+                                              x + j % params->width,
+                                              y + j / params->width,
+                                              z);
+
+              hits[n_hits++] = j;
+            }
+        }
+    }
+
+  /* let the tiles be fetched without the storage mutex from now on */
+  for (i = 0; i < n_hits; i++)
+    {
+      gegl_tile_storage_index_insert (cache->tile_storage,
+                                      params->tiles[hits[i]],
+                                      g_hash_table_size (cache->items));
+    }
+
+  g_free (hits);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
+static gint
+gegl_tile_handler_cache_item_compare (gconstpointer a,
+                                      gconstpointer b)
+{
+  const CacheItem *item1 = *(const CacheItem * const *) a;
+  const CacheItem *item2 = *(const CacheItem * const *) b;
+
+  if (item1->z != item2->z)
+    return item1->z < item2->z ? -1 : +1;
+  else if (item1->y != item2->y)
+    return item1->y < item2->y ? -1 : +1;
+  else if (item1->x != item2->x)
+    return item1->x < item2->x ? -1 : +1;
+  else
+    return 0;
+}
+
+/* stores all the dirty tiles of the cache, sending each run of horizontally
+ * adjacent tiles to the backend as a single GEGL_TILE_SET_N command.
+ */
+static void
+gegl_tile_handler_cache_flush (GeglTileHandlerCache *cache)
+{
+  GeglTileSource  *storage = GEGL_TILE_SOURCE (cache->tile_storage);
+  GPtrArray       *items;
+  GeglTile       **tiles;
+  GList           *link;
+  guint            i;
+  guint            j;
+
+  items = g_ptr_array_new ();
+
+  g_rec_mutex_lock (&cache->tile_storage->mutex);
+
+  for (link = g_queue_peek_head_link (&cache->queue);
+       link;
+       link = g_list_next (link))
+    {
+      CacheItem *item = LINK_GET_ITEM (link);
+
+      if (item->tile && gegl_tile_needs_store (item->tile))
+        g_ptr_array_add (items, item);
+    }
+
+  g_ptr_array_sort (items, gegl_tile_handler_cache_item_compare);
+
+  tiles = g_new (GeglTile *, items->len);
+
+  for (i = 0; i < items->len; i = j)
+    {
+      const CacheItem *first = g_ptr_array_index (items, i);
+
+      tiles[0] = first->tile;
+
+      for (j = i + 1; j < items->len; j++)
+        {
+          const CacheItem *item = g_ptr_array_index (items, j);
+
+          if (item->z != first->z ||
+              item->y != first->y ||
+              item->x != first->x + (gint) (j - i))
+            {
+              break;
+            }
+
+          tiles[j - i] = item->tile;
+        }
+
+      gegl_tile_source_set_tiles (storage,
+                                  first->x, first->y, first->z,
+                                  j - i, 1, tiles);
+    }
+
+  g_rec_mutex_unlock (&cache->tile_storage->mutex);
+
+  g_free (tiles);
+  g_ptr_array_free (items, TRUE);
+}
+
 static gpointer
 gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
                                  GeglTileCommand  command,
@@ -225,22 +437,10 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
   switch (command)
     {
       case GEGL_TILE_FLUSH:
-        {
-          GList *link;
-
-          if (gegl_tile_handler_cache_ext_flush)
-            gegl_tile_handler_cache_ext_flush (cache, NULL);
+        if (gegl_tile_handler_cache_ext_flush)
+          gegl_tile_handler_cache_ext_flush (cache, NULL);
 
-          for (link = g_queue_peek_head_link (&cache->queue);
-               link;
-               link = g_list_next (link))
-            {
-              CacheItem *item = LINK_GET_ITEM (link);
-
-              if (item->tile)
-                gegl_tile_store (item->tile);
-            }
-        }
+        gegl_tile_handler_cache_flush (cache);
         break;
       case GEGL_TILE_GET:
         /* XXX: we should perhaps store a NIL result, and place the empty
@@ -248,6 +448,15 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
          * to work in sync operation with backend.
          */
         return gegl_tile_handler_cache_get_tile_command (tile_store, x, y, z);
+      case GEGL_TILE_GET_N:
+        return gegl_tile_handler_cache_get_tiles_command (tile_store,
+                                                          x, y, z, data);
+      case GEGL_TILE_SET_N:
+        /* the cache doesn't act on stores, so the batch is passed on as is */
+        if (handler->source)
+          return gegl_tile_source_command (handler->source,
+                                           command, x, y, z, data);
+        break;
       case GEGL_TILE_IS_CACHED:
         return GINT_TO_POINTER(gegl_tile_handler_cache_has_tile (cache, x, y, z));
       case GEGL_TILE_EXIST:
@@ -479,7 +688,8 @@ gegl_tile_handler_cache_get_tile (GeglTileHandlerCache *cache,
     {
       g_queue_unlink (&cache->queue, &result->link);
       g_queue_push_head_link (&cache->queue, &result->link);
-      cache->time = ++cache_time;
+      result->credits = -1;
+      result->time    = cache->time = gegl_tile_handler_cache_next_time ();
       if (result->tile == NULL)
       {
         g_printerr ("NULL tile in %s %p %i %i %i %p\n", __FUNCTION__, result, result->x, result->y, result->z,
@@ -509,6 +719,31 @@ gegl_tile_handler_cache_has_tile (GeglTileHandlerCache *cache,
   return FALSE;
 }
 
+/* the number of times a tile is spared by the trimming when reaching the end
+ * of its cache's queue, so that tiles which are expensive to compute stay in
+ * the cache longer than cheap ones which were used as recently: one more
+ * credit each time the compute time of the tile doubles, starting at
+ * GEGL_CACHE_COST_UNIT, and one more when the backend has no clean copy of
+ * the tile, so that evicting it would cost a write as well.
+ */
+static gint
+gegl_tile_handler_cache_get_credits (GeglTileHandlerCache *cache,
+                                     GeglTile             *tile)
+{
+  gdouble cost = gegl_tile_handler_cache_get_tile_cost (cache);
+  gint    credits;
+
+  if (cost < GEGL_CACHE_COST_UNIT)
+    return 0;
+
+  credits = floor (log2 (cost / GEGL_CACHE_COST_UNIT)) + 1;
+
+  if (! gegl_tile_is_stored (tile))
+    credits++;
+
+  return MIN (credits, GEGL_CACHE_MAX_CREDITS);
+}
+
 static gboolean
 gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
 {
@@ -518,6 +753,8 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
   static gdouble  ratio  = GEGL_CACHE_TRIM_RATIO_MIN;
   guint64         target_size;
   static guint    counter;
+  gint            pass   = 0;
+  gboolean        spared = FALSE;
 
   cache = NULL;
   link  = NULL;
@@ -585,15 +822,43 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
           g_mutex_unlock (&mutex);
 
           if (! cache)
-            break;
+            {
+              /* every cache was walked while sparing some of the tiles,
+               * walk them again, with fewer credits left.
+               */
+              if (spared && ++pass <= GEGL_CACHE_MAX_CREDITS)
+                {
+                  spared = FALSE;
+
+                  continue;
+                }
+
+              break;
+            }
 
           link = g_queue_peek_tail_link (&cache->queue);
         }
 
-      for (; link; link = g_list_previous (link))
+      for (; link; link = prev_link)
         {
           last_writable = LINK_GET_ITEM (link);
           tile          = last_writable->tile;
+          prev_link     = g_list_previous (link);
+
+          /* the tile was fetched through the storage index since it was last
+           * moved to the front of the queue, move it there now.
+           */
+          if ((guintptr) g_atomic_pointer_get (&tile->cache_time) >
+              last_writable->time)
+            {
+              last_writable->time    = tile->cache_time;
+              last_writable->credits = -1;
+
+              g_queue_unlink (&cache->queue, link);
+              g_queue_push_head_link (&cache->queue, link);
+
+              continue;
+            }
 
           /* if the tile's ref-count is greater than one, then someone is still
            * using the tile, and we must keep it in the cache, so that we can
@@ -610,6 +875,22 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
           if (tile->keep_identity)
             continue;
 
+          /* keep tiles which are expensive to compute for a while longer */
+          if (last_writable->credits < 0)
+            {
+              last_writable->credits =
+                gegl_tile_handler_cache_get_credits (cache, tile);
+            }
+
+          if (last_writable->credits > 0)
+            {
+              last_writable->credits--;
+              cache_spared++;
+              spared = TRUE;
+
+              continue;
+            }
+
           /* a set of cloned tiles is only counted once toward the total cache
            * size, so the entire set has to be removed from the cache in order
            * to reclaim the memory of a single tile.  in other words, in a set
@@ -625,6 +906,17 @@ gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
               continue;
             }
 
+          /* the tile might have been fetched through the storage index in
+           * the meantime, check again once it can't be anymore.
+           */
+          gegl_tile_storage_index_remove (cache->tile_storage,
+                                          last_writable->x,
+                                          last_writable->y,
+                                          last_writable->z);
+
+          if (g_atomic_int_get (&tile->ref_count) > 1)
+            continue;
+
           break;
         }
 
@@ -689,6 +981,7 @@ gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cache,
       if (g_queue_is_empty (&cache->queue))
         cache->time = cache->stamp = 0;
 
+      gegl_tile_storage_index_remove (cache->tile_storage, x, y, z);
       drop_hot_tile (item->tile);
       gegl_tile_mark_as_stored (item->tile); /* to cheat it out of being stored */
       item->tile->tile_storage = NULL;
@@ -837,6 +1130,7 @@ gegl_tile_handler_cache_remove (GeglTileHandlerCache *cache,
 
   if (item)
     {
+      gegl_tile_storage_index_remove (cache->tile_storage, x, y, z);
       drop_hot_tile (item->tile);
 
       gegl_tile_handler_cache_remove_item (cache, item);
@@ -855,6 +1149,7 @@ gegl_tile_handler_cache_void (GeglTileHandlerCache *cache,
   item = cache_lookup (cache, x, y, z);
   if (item)
     {
+      gegl_tile_storage_index_remove (cache->tile_storage, x, y, z);
       drop_hot_tile (item->tile);
 
       if (gegl_tile_damage (item->tile, damage))
@@ -884,6 +1179,7 @@ gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
   item->x         = x;
   item->y         = y;
   item->z         = z;
+  item->credits   = -1;
 
   // XXX : remove entry if it already exists
   gegl_tile_handler_cache_remove (cache, x, y, z);
@@ -895,7 +1191,7 @@ gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
 
   /* XXX: this is a window when the tile is a zero tile during update */
 
-  cache->time = ++cache_time;
+  item->time = cache->time = gegl_tile_handler_cache_next_time ();
 
   if (g_atomic_int_add (gegl_tile_n_cached_clones (tile), 1) == 0)
     total = g_atomic_pointer_add (&cache_total, tile->size) + tile->size;
@@ -931,6 +1227,24 @@ gegl_tile_handler_cache_tile_uncloned (GeglTileHandlerCache *cache,
   cache_total_max = MAX (cache_total_max, total);
 }
 
+/* called for tiles fetched through the storage index, without the storage
+ * mutex, in place of moving them to the front of the cache queue.  the
+ * access time is recorded on the tile, and the trimming moves the tile to
+ * the front once it reaches it.
+ */
+void
+gegl_tile_handler_cache_tile_accessed (GeglTileHandlerCache *cache,
+                                       GeglTile             *tile)
+{
+  guintptr time = gegl_tile_handler_cache_next_time ();
+
+  g_atomic_pointer_set (&tile->cache_time, time);
+  g_atomic_pointer_set (&cache->time, time);
+
+  g_atomic_int_inc (&cache_hits);
+  g_atomic_int_inc (&cache->index_hits);
+}
+
 GeglTileHandler *
 gegl_tile_handler_cache_new (void)
 {
@@ -965,6 +1279,8 @@ gegl_tile_handler_cache_disconnect (GeglTileHandlerCache *cache)
       g_queue_unlink (&cache_queue, &cache->link);
       g_mutex_unlock (&mutex);
 
+      gegl_tile_handler_cache_count_index_hits (cache);
+
       g_rec_mutex_unlock (&cache->tile_storage->mutex);
     }
 }
@@ -990,7 +1306,7 @@ gegl_tile_handler_cache_get_total_uncompressed (void)
 gint
 gegl_tile_handler_cache_get_hits (void)
 {
-  return cache_hits;
+  return g_atomic_int_get (&cache_hits);
 }
 
 gint
@@ -999,12 +1315,66 @@ gegl_tile_handler_cache_get_misses (void)
   return cache_misses;
 }
 
+gint
+gegl_tile_handler_cache_get_spared (void)
+{
+  return cache_spared;
+}
+
+gdouble
+gegl_tile_handler_cache_get_time_saved (void)
+{
+  gdouble  time_saved = cache_time_saved;
+  GList   *link;
+
+  /* add the hits through the storage indices not counted yet */
+  g_mutex_lock (&mutex);
+
+  for (link = g_queue_peek_head_link (&cache_queue);
+       link;
+       link = g_list_next (link))
+    {
+      GeglTileHandlerCache *cache = LINK_GET_CACHE (link);
+
+      time_saved += g_atomic_int_get (&cache->index_hits) *
+                    gegl_tile_handler_cache_get_tile_cost (cache);
+    }
+
+  g_mutex_unlock (&mutex);
+
+  return time_saved;
+}
+
+void
+gegl_tile_handler_cache_set_pixel_cost (GeglTileHandlerCache *cache,
+                                        gdouble               pixel_cost)
+{
+  gegl_tile_handler_cache_count_index_hits (cache);
+
+  cache->pixel_cost = MAX (pixel_cost, 0.0);
+}
+
 void
 gegl_tile_handler_cache_reset_stats (void)
 {
-  cache_total_max = cache_total;
-  cache_hits      = 0;
-  cache_misses    = 0;
+  GList *link;
+
+  g_mutex_lock (&mutex);
+
+  for (link = g_queue_peek_head_link (&cache_queue);
+       link;
+       link = g_list_next (link))
+    {
+      g_atomic_int_set (&LINK_GET_CACHE (link)->index_hits, 0);
+    }
+
+  g_mutex_unlock (&mutex);
+
+  cache_total_max  = cache_total;
+  g_atomic_int_set (&cache_hits, 0);
+  cache_misses     = 0;
+  cache_spared     = 0;
+  cache_time_saved = 0.0;
 }
 
 
@@ -47,6 +47,12 @@ struct _GeglTileHandlerCache
   GQueue           queue;
   guintptr         time;
   guintptr         stamp;
+  gint             index_hits; /* hits through the storage index, not yet
+                                * counted in the saved time
+                                */
+  gdouble          pixel_cost; /* seconds it takes to compute a pixel of the
+                                * cached tiles, 0 when unknown
+                                */
 };
 
 struct _GeglTileHandlerCacheClass
@@ -76,12 +82,18 @@ GeglTile        * gegl_tile_handler_cache_get_tile           (GeglTileHandlerCac
                                                               gint                  z);
 void              gegl_tile_handler_cache_tile_uncloned      (GeglTileHandlerCache *cache,
                                                               GeglTile             *tile);
+void              gegl_tile_handler_cache_tile_accessed      (GeglTileHandlerCache *cache,
+                                                              GeglTile             *tile);
+void              gegl_tile_handler_cache_set_pixel_cost     (GeglTileHandlerCache *cache,
+                                                              gdouble               pixel_cost);
 
 gsize             gegl_tile_handler_cache_get_total              (void);
 gsize             gegl_tile_handler_cache_get_total_max          (void);
 gsize             gegl_tile_handler_cache_get_total_uncompressed (void);
 gint              gegl_tile_handler_cache_get_hits               (void);
 gint              gegl_tile_handler_cache_get_misses             (void);
+gint              gegl_tile_handler_cache_get_spared             (void);
+gdouble           gegl_tile_handler_cache_get_time_saved         (void);
 
 void              gegl_tile_handler_cache_reset_stats            (void);
 
@@ -39,19 +39,12 @@ finalize (GObject *object)
 }
 
 static GeglTile *
-get_tile (GeglTileSource *gegl_tile_source,
-          gint            x,
-          gint            y,
-          gint            z)
+new_tile (GeglTileHandlerEmpty *empty,
+          gint                  x,
+          gint                  y,
+          gint                  z)
 {
-  GeglTileSource       *source = ((GeglTileHandler *) gegl_tile_source)->source;
-  GeglTileHandlerEmpty *empty  = (GeglTileHandlerEmpty *) gegl_tile_source;
-  GeglTile             *tile   = NULL;
-
-  if (source)
-    tile = gegl_tile_source_get_tile (source, x, y, z);
-  if (tile)
-    return tile;
+  GeglTile *tile;
 
   if (!empty->tile)
     {
@@ -80,6 +73,59 @@ get_tile (GeglTileSource *gegl_tile_source,
   return tile;
 }
 
+static GeglTile *
+get_tile (GeglTileSource *gegl_tile_source,
+          gint            x,
+          gint            y,
+          gint            z)
+{
+  GeglTileSource       *source = ((GeglTileHandler *) gegl_tile_source)->source;
+  GeglTileHandlerEmpty *empty  = (GeglTileHandlerEmpty *) gegl_tile_source;
+  GeglTile             *tile   = NULL;
+
+  if (source)
+    tile = gegl_tile_source_get_tile (source, x, y, z);
+  if (tile)
+    return tile;
+
+  return new_tile (empty, x, y, z);
+}
+
+static gpointer
+get_tiles (GeglTileSource      *gegl_tile_source,
+           gint                 x,
+           gint                 y,
+           gint                 z,
+           GeglTileBatchParams *params)
+{
+  GeglTileSource       *source = ((GeglTileHandler *) gegl_tile_source)->source;
+  GeglTileHandlerEmpty *empty  = (GeglTileHandlerEmpty *) gegl_tile_source;
+  gint                  n      = params->width * params->height;
+  gint                  i;
+
+  /* if the source can't batch the request, let the sender fall back to
+   * fetching the tiles one by one.
+   */
+  if (! source ||
+      ! gegl_tile_source_command (source, GEGL_TILE_GET_N, x, y, z, params))
+    {
+      return NULL;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      if (! params->tiles[i])
+        {
+          params->tiles[i] = new_tile (empty,
+                                       x + i % params->width,
+                                       y + i / params->width,
+                                       z);
+        }
+    }
+
+  return GINT_TO_POINTER (TRUE);
+}
+
 static gpointer
 gegl_tile_handler_empty_command (GeglTileSource  *buffer,
                                  GeglTileCommand  command,
@@ -88,8 +134,14 @@ gegl_tile_handler_empty_command (GeglTileSource  *buffer,
                                  gint             z,
                                  gpointer         data)
 {
+  GeglTileSource *source = ((GeglTileHandler *) buffer)->source;
+
   if (command == GEGL_TILE_GET)
     return get_tile (buffer, x, y, z);
+  else if (command == GEGL_TILE_GET_N)
+    return get_tiles (buffer, x, y, z, data);
+  else if (command == GEGL_TILE_SET_N && source)
+    return gegl_tile_source_command (source, command, x, y, z, data);
 
   return gegl_tile_handler_source_command (buffer, command, x, y, z, data);
 }
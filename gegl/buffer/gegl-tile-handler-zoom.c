@@ -182,6 +182,8 @@ get_tile (GeglTileSource *gegl_tile_source,
     guint64     damage;
     GeglTile   *source_tile[2][2] = { { NULL, NULL }, { NULL, NULL } };
     gboolean    empty             = TRUE;
+    gboolean    uniform;
+    guchar     *pixel;
 
     if (tile)
       damage = tile->damage;
@@ -243,6 +245,32 @@ get_tile (GeglTileSource *gegl_tile_source,
     bpp    = babl_format_get_bytes_per_pixel (format);
     stride = tile_width * bpp;
 
+    /* if the four source tiles are uniform in the same color, so is the
+     * downscaled tile, and we can simply fill it.
+     */
+    uniform = ! ~damage;
+    pixel   = g_alloca (bpp);
+
+    for (i = 0; i < 2 && uniform; i++)
+      for (j = 0; j < 2 && uniform; j++)
+        {
+          uniform = source_tile[i][j] &&
+                    gegl_tile_is_uniform (source_tile[i][j]);
+
+          if (uniform)
+            {
+              gegl_tile_read_lock (source_tile[i][j]);
+
+              if (i == 0 && j == 0)
+                memcpy (pixel, gegl_tile_get_data (source_tile[i][j]), bpp);
+              else
+                uniform = ! memcmp (gegl_tile_get_data (source_tile[i][j]),
+                                    pixel, bpp);
+
+              gegl_tile_read_unlock (source_tile[i][j]);
+            }
+        }
+
     if (! tile)
       tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (zoom), x, y, z);
 
@@ -253,6 +281,22 @@ get_tile (GeglTileSource *gegl_tile_source,
 
     gegl_tile_lock (tile);
 
+    if (uniform)
+      {
+        gegl_memset_pattern (gegl_tile_get_data (tile), pixel, bpp,
+                             tile_width * tile_height);
+
+        for (i = 0; i < 2; i++)
+          for (j = 0; j < 2; j++)
+            gegl_tile_unref (source_tile[i][j]);
+
+        gegl_tile_unlock (tile);
+
+        tile->is_uniform_tile = TRUE;
+
+        return tile;
+      }
+
     for (i = 0; i < 2; i++)
       for (j = 0; j < 2; j++)
         {
@@ -311,6 +355,14 @@ gegl_tile_handler_zoom_command (GeglTileSource  *tile_store,
 
   if (command == GEGL_TILE_GET)
     return get_tile (tile_store, x, y, z);
+  /* level-0 tiles are passed through as is, and so can be batched; higher
+   * levels are rendered tile by tile.
+   */
+  else if ((command == GEGL_TILE_GET_N && z == 0) ||
+           command == GEGL_TILE_SET_N)
+    return handler->source ?
+      gegl_tile_source_command (handler->source, command, x, y, z, data) :
+      NULL;
   else
     return gegl_tile_handler_source_command (handler, command, x, y, z, data);
 }
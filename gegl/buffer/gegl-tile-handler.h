@@ -65,7 +65,12 @@ void    gegl_tile_handler_set_source (GeglTileHandler *handler,
 
 #define gegl_tile_handler_get_source(handler) (((GeglTileHandler*)handler)->source)
 
-#define gegl_tile_handler_source_command(handler,command,x,y,z,data) (gegl_tile_handler_get_source(handler)?gegl_tile_source_command(gegl_tile_handler_get_source(handler), command, x, y, z, data):NULL)
+/* the batched commands, GEGL_TILE_GET_N and GEGL_TILE_SET_N, are not passed
+ * on implicitly, since a handler may need to see every tile individually.
+ * handlers which support them forward them explicitly; otherwise, the
+ * command is left unhandled, and the sender falls back to per-tile commands.
+ */
+#define gegl_tile_handler_source_command(handler,command,x,y,z,data) ((gegl_tile_handler_get_source(handler) && (command) != GEGL_TILE_GET_N && (command) != GEGL_TILE_SET_N)?gegl_tile_source_command(gegl_tile_handler_get_source(handler), command, x, y, z, data):NULL)
 
 /**
  * gegl_tile_handler_create_tile: (skip) (attributes skip-reason=unknown_since_abc95c82)
@@ -134,6 +134,96 @@ gegl_tile_source_set_tile (GeglTileSource *source,
 {
   return gegl_tile_source_command (source, GEGL_TILE_SET, x, y, z, tile) != NULL;
 }
+
+/**
+ * gegl_tile_source_get_tiles:
+ * @source: a GeglTileSource *
+ * @x: x coordinate of the top-left tile
+ * @y: y coordinate of the top-left tile
+ * @z: tile zoom level
+ * @width: number of tile columns
+ * @height: number of tile rows
+ * @tiles: an array of @width x @height tiles, in row-major order
+ *
+ * Get the tiles of a rectangle of tiles with a single GEGL_TILE_GET_N
+ * command, letting the handlers and the backend batch their lookups and
+ * I/O.  Only the NULL entries of @tiles are fetched; when @source doesn't
+ * handle the batch, they are fetched one at a time with GEGL_TILE_GET.
+ * Entries of tiles that could not be provided are left NULL.
+ */
+static inline void
+gegl_tile_source_get_tiles (GeglTileSource  *source,
+                            gint             x,
+                            gint             y,
+                            gint             z,
+                            gint             width,
+                            gint             height,
+                            GeglTile       **tiles)
+{
+  GeglTileBatchParams params;
+  gint                i, j;
+
+  params.width  = width;
+  params.height = height;
+  params.tiles  = tiles;
+
+  if (gegl_tile_source_command (source, GEGL_TILE_GET_N, x, y, z, &params))
+    return;
+
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++)
+      {
+        if (! tiles[j * width + i])
+          {
+            tiles[j * width + i] = gegl_tile_source_get_tile (source,
+                                                              x + i, y + j, z);
+          }
+      }
+}
+
+/**
+ * gegl_tile_source_set_tiles:
+ * @source: a GeglTileSource *
+ * @x: x coordinate of the top-left tile
+ * @y: y coordinate of the top-left tile
+ * @z: tile zoom level
+ * @width: number of tile columns
+ * @height: number of tile rows
+ * @tiles: an array of @width x @height tiles, in row-major order
+ *
+ * Set the non-NULL entries of @tiles with a single GEGL_TILE_SET_N command,
+ * or one at a time with GEGL_TILE_SET when @source doesn't handle the batch.
+ */
+static inline void
+gegl_tile_source_set_tiles (GeglTileSource  *source,
+                            gint             x,
+                            gint             y,
+                            gint             z,
+                            gint             width,
+                            gint             height,
+                            GeglTile       **tiles)
+{
+  GeglTileBatchParams params;
+  gint                i, j;
+
+  params.width  = width;
+  params.height = height;
+  params.tiles  = tiles;
+
+  if (gegl_tile_source_command (source, GEGL_TILE_SET_N, x, y, z, &params))
+    return;
+
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++)
+      {
+        if (tiles[j * width + i])
+          {
+            gegl_tile_source_set_tile (source, x + i, y + j, z,
+                                       tiles[j * width + i]);
+          }
+      }
+}
+
 /**
  * gegl_tile_source_is_cached:
  * @source: a GeglTileSource *
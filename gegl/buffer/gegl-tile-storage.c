@@ -23,12 +23,46 @@
 
 #include "gegl-buffer.h"
 #include "gegl-buffer-types.h"
+#include "gegl-buffer-private.h"
 #include "gegl-tile-storage.h"
+#include "gegl-tile.h"
 #include "gegl-tile-handler-empty.h"
 #include "gegl-tile-handler-zoom.h"
 #include "gegl-tile-handler-private.h"
 
 
+/* the index is a 2-way set-associative table of the cached level-0 tiles of
+ * the storage, which can be looked up without taking the storage mutex, so
+ * that threads fetching different tiles don't serialize on it.
+ *
+ * the index doesn't hold references to its tiles.  entries are only added
+ * and removed by the cache, with the storage mutex held, and the cache
+ * removes a tile from the index before dropping it.  every slot has a bit
+ * lock, so that a tile can't be dropped between finding it in the index and
+ * referencing it.
+ *
+ * the index grows along with the cache.  replaced indices are emptied, but
+ * are only freed together with the storage, since concurrent lookups may
+ * still be using them.
+ */
+#define INDEX_MIN_SIZE 64
+#define INDEX_MAX_SIZE (1 << 20)
+
+typedef struct
+{
+  gint      lock;
+  gint      x;
+  gint      y;
+  GeglTile *tile;
+} IndexSlot;
+
+struct _GeglTileStorageIndex
+{
+  gint      size; /* a power of two */
+  IndexSlot slots[];
+};
+
+
 G_DEFINE_TYPE (GeglTileStorage, gegl_tile_storage, GEGL_TYPE_TILE_HANDLER_CHAIN)
 
 static GObjectClass * parent_class = NULL;
@@ -167,6 +201,222 @@ gegl_tile_storage_take_hot_tile (GeglTileStorage *tile_storage,
     }
 }
 
+/* returns the first of the two slots a tile can be in */
+static inline IndexSlot *
+index_get_slots (GeglTileStorageIndex *index,
+                 gint                  x,
+                 gint                  y)
+{
+  guint hash = ((guint) x * 73856093u) ^ ((guint) y * 19349663u);
+
+  return &index->slots[hash & (index->size - 2)];
+}
+
+static void
+index_put (GeglTileStorageIndex *index,
+           gint                  x,
+           gint                  y,
+           GeglTile             *tile,
+           gboolean              locked)
+{
+  IndexSlot *slots = index_get_slots (index, x, y);
+
+  if (slots[0].tile == tile || slots[1].tile == tile)
+    return;
+
+  if (locked)
+    {
+      g_bit_lock (&slots[0].lock, 0);
+      g_bit_lock (&slots[1].lock, 0);
+    }
+
+  /* keep the most recently inserted tile first, unless it replaces the
+   * first tile
+   */
+  if (slots[0].x != x || slots[0].y != y || ! slots[0].tile)
+    {
+      slots[1].x    = slots[0].x;
+      slots[1].y    = slots[0].y;
+      slots[1].tile = slots[0].tile;
+    }
+
+  slots[0].x    = x;
+  slots[0].y    = y;
+  slots[0].tile = tile;
+
+  if (locked)
+    {
+      g_bit_unlock (&slots[1].lock, 0);
+      g_bit_unlock (&slots[0].lock, 0);
+    }
+}
+
+static void
+index_empty (GeglTileStorageIndex *index)
+{
+  gint i;
+
+  for (i = 0; i < index->size; i++)
+    {
+      IndexSlot *slot = &index->slots[i];
+
+      if (slot->tile)
+        {
+          g_bit_lock (&slot->lock, 0);
+          slot->tile = NULL;
+          g_bit_unlock (&slot->lock, 0);
+        }
+    }
+}
+
+static GeglTileStorageIndex *
+index_grow (GeglTileStorage *tile_storage,
+            gint             n_cached_tiles)
+{
+  GeglTileStorageIndex *old_index = tile_storage->index;
+  GeglTileStorageIndex *index;
+  gint                  size;
+  gint                  i;
+
+  size = old_index ? 2 * old_index->size : INDEX_MIN_SIZE;
+
+  while (size < 4 * n_cached_tiles && size < INDEX_MAX_SIZE)
+    size *= 2;
+
+  index = g_malloc0 (sizeof (GeglTileStorageIndex) + size * sizeof (IndexSlot));
+  index->size = size;
+
+  if (old_index)
+    {
+      /* move the entries over in reverse, to keep the most recent first */
+      for (i = old_index->size - 1; i >= 0; i--)
+        {
+          IndexSlot *slot = &old_index->slots[i];
+
+          if (slot->tile)
+            index_put (index, slot->x, slot->y, slot->tile, FALSE);
+        }
+    }
+
+  g_atomic_pointer_set (&tile_storage->index, index);
+
+  if (old_index)
+    {
+      index_empty (old_index);
+
+      tile_storage->old_indices = g_slist_prepend (tile_storage->old_indices,
+                                                   old_index);
+    }
+
+  return index;
+}
+
+/* returns a new reference to the cached tile at (x, y, z), or NULL if it
+ * isn't in the index, in which case it should be fetched through the
+ * storage with the mutex held.  this doesn't take the storage mutex; the
+ * access is recorded on the tile, for the cache to find when trimming.
+ */
+GeglTile *
+gegl_tile_storage_index_lookup (GeglTileStorage *tile_storage,
+                                gint             x,
+                                gint             y,
+                                gint             z)
+{
+  GeglTileStorageIndex *index;
+  IndexSlot            *slot;
+  GeglTile             *tile = NULL;
+  gint                  i;
+
+  if (z != 0)
+    return NULL;
+
+  index = g_atomic_pointer_get (&tile_storage->index);
+
+  if (! index)
+    return NULL;
+
+  slot = index_get_slots (index, x, y);
+
+  for (i = 0; i < 2 && ! tile; i++, slot++)
+    {
+      /* check without the lock first, so that slots holding other tiles
+       * aren't contended for.
+       */
+      if (slot->x != x || slot->y != y || ! slot->tile)
+        continue;
+
+      g_bit_lock (&slot->lock, 0);
+
+      if (slot->tile && slot->x == x && slot->y == y)
+        tile = gegl_tile_ref (slot->tile);
+
+      g_bit_unlock (&slot->lock, 0);
+    }
+
+  if (tile)
+    gegl_tile_handler_cache_tile_accessed (tile_storage->cache, tile);
+
+  return tile;
+}
+
+/* called by the cache, with the storage mutex held, for tiles which are
+ * in the cache, and fully valid.
+ */
+void
+gegl_tile_storage_index_insert (GeglTileStorage *tile_storage,
+                                GeglTile        *tile,
+                                gint             n_cached_tiles)
+{
+  GeglTileStorageIndex *index = tile_storage->index;
+
+  if (tile->z != 0 || tile->damage)
+    return;
+
+  if (! index ||
+      (index->size < 4 * n_cached_tiles && index->size < INDEX_MAX_SIZE))
+    {
+      index = index_grow (tile_storage, n_cached_tiles);
+    }
+
+  index_put (index, tile->x, tile->y, tile, TRUE);
+}
+
+/* called by the cache, with the storage mutex held, before a tile is
+ * removed from it, or becomes invalid.
+ */
+void
+gegl_tile_storage_index_remove (GeglTileStorage *tile_storage,
+                                gint             x,
+                                gint             y,
+                                gint             z)
+{
+  GeglTileStorageIndex *index = tile_storage->index;
+  IndexSlot            *slot;
+  gint                  i;
+
+  if (! index || z != 0)
+    return;
+
+  slot = index_get_slots (index, x, y);
+
+  for (i = 0; i < 2; i++, slot++)
+    {
+      if (slot->tile && slot->x == x && slot->y == y)
+        {
+          g_bit_lock (&slot->lock, 0);
+          slot->tile = NULL;
+          g_bit_unlock (&slot->lock, 0);
+        }
+    }
+}
+
+void
+gegl_tile_storage_index_clear (GeglTileStorage *tile_storage)
+{
+  if (tile_storage->index)
+    index_empty (tile_storage->index);
+}
+
 static void
 gegl_tile_storage_dispose (GObject *object)
 {
@@ -188,6 +438,9 @@ gegl_tile_storage_finalize (GObject *object)
 
   g_rec_mutex_clear (&self->mutex);
 
+  g_free (self->index);
+  g_slist_free_full (self->old_indices, g_free);
+
   (*G_OBJECT_CLASS (parent_class)->finalize)(object);
 }
 
@@ -38,6 +38,7 @@ G_BEGIN_DECLS
 #define GEGL_TILE_STORAGE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GEGL_TYPE_TILE_STORAGE, GeglTileStorageClass))
 
 typedef struct _GeglTileStorageClass GeglTileStorageClass;
+typedef struct _GeglTileStorageIndex GeglTileStorageIndex;
 
 struct _GeglTileStorage
 {
@@ -56,6 +57,11 @@ struct _GeglTileStorage
 
   GeglTile      *hot_tile; /* cached tile for speeding up gegl_buffer_get_pixel
                               and gegl_buffer_set_pixel (1x1 sized gets/sets)*/
+
+  GeglTileStorageIndex *index;     /* the cached level-0 tiles that can be
+                                    * fetched without taking the mutex
+                                    */
+  GSList               *old_indices;
 };
 
 struct _GeglTileStorageClass
@@ -78,6 +84,19 @@ GeglTile * gegl_tile_storage_try_steal_hot_tile (GeglTileStorage *tile_storage,
 void       gegl_tile_storage_take_hot_tile      (GeglTileStorage *tile_storage,
                                                  GeglTile        *tile);
 
+GeglTile * gegl_tile_storage_index_lookup       (GeglTileStorage *tile_storage,
+                                                 gint             x,
+                                                 gint             y,
+                                                 gint             z);
+void       gegl_tile_storage_index_insert       (GeglTileStorage *tile_storage,
+                                                 GeglTile        *tile,
+                                                 gint             n_cached_tiles);
+void       gegl_tile_storage_index_remove       (GeglTileStorage *tile_storage,
+                                                 gint             x,
+                                                 gint             y,
+                                                 gint             z);
+void       gegl_tile_storage_index_clear        (GeglTileStorage *tile_storage);
+
 G_END_DECLS
 
 #endif
@@ -27,6 +27,8 @@
 #include <glib-object.h>
 
 #include "gegl-buffer.h"
+#include "gegl-buffer-config.h"
+#include "gegl-memory.h"
 #include "gegl-tile.h"
 #include "gegl-tile-alloc.h"
 #include "gegl-buffer-private.h"
@@ -44,6 +46,18 @@ enum
   CLONE_STATE_UNCLONING
 };
 
+/* the share of the tile cache size that converted tile views may take */
+#define GEGL_TILE_VIEW_MAX_CACHE_SHARE 0.25
+
+/* protects the view pointers of all tiles; views are only looked up once
+ * per tile per iterator chunk, so a single lock is plenty.
+ */
+static GMutex          gegl_tile_view_mutex;
+static guint64         gegl_tile_view_total;
+
+static void            gegl_tile_drop_view (GeglTile *tile);
+
+
 GeglTile *gegl_tile_ref (GeglTile *tile)
 {
   g_atomic_int_inc (&tile->ref_count);
@@ -63,6 +77,9 @@ void gegl_tile_unref (GeglTile *tile)
    */
   gegl_tile_store (tile);
 
+  if (tile->view)
+    gegl_tile_drop_view (tile);
+
   if (g_atomic_int_dec_and_test (gegl_tile_n_clones (tile)))
     { /* no clones */
       if (tile->destroy_notify == (gpointer) &free_data_directly)
@@ -133,6 +150,7 @@ gegl_tile_dup (GeglTile *src)
       tile->size                = src->size;
       tile->is_zero_tile        = src->is_zero_tile;
       tile->is_global_tile      = src->is_global_tile;
+      tile->is_uniform_tile     = src->is_uniform_tile;
       tile->clone_state         = CLONE_STATE_CLONED;
       tile->n_clones            = src->n_clones;
 
@@ -183,6 +201,92 @@ gegl_tile_new (gint size)
   return tile;
 }
 
+GeglTile *
+gegl_tile_new_uniform (gint          size,
+                       gconstpointer pixel,
+                       gint          bpp)
+{
+  GeglTile *tile = gegl_tile_new (size);
+
+  gegl_memset_pattern (tile->data, pixel, bpp, size / bpp);
+
+  tile->is_uniform_tile = TRUE;
+
+  /* mark the tile as dirty, like a tile written to, so that it gets stored;
+   * backends creating it from stored data mark it as stored.
+   */
+  tile->rev++;
+
+  return tile;
+}
+
+#define HASH_PRIME1 0x9e3779b185ebca87ull
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4full
+
+static inline guint64
+gegl_tile_hash_round (guint64 hash,
+                      guint64 word)
+{
+  hash += word * HASH_PRIME2;
+  hash  = (hash << 31) | (hash >> 33);
+
+  return hash * HASH_PRIME1;
+}
+
+guint64
+gegl_tile_hash (GeglTile *tile)
+{
+  const guchar *data = tile->data;
+  gint          size = tile->size;
+  guint64       lanes[4];
+  guint64       hash;
+  guint64       word;
+  gint          i;
+  gint          j;
+
+  /* hash four independent lanes, so that the rounds of consecutive words
+   * don't wait on each other.
+   */
+  for (j = 0; j < 4; j++)
+    lanes[j] = HASH_PRIME1 * (j + 1);
+
+  for (i = 0; i + 32 <= size; i += 32)
+    {
+      for (j = 0; j < 4; j++)
+        {
+          memcpy (&word, data + i + 8 * j, sizeof (word));
+
+          lanes[j] = gegl_tile_hash_round (lanes[j], word);
+        }
+    }
+
+  hash = size;
+
+  for (j = 0; j < 4; j++)
+    hash = gegl_tile_hash_round (hash, lanes[j]);
+
+  for (; i + 8 <= size; i += 8)
+    {
+      memcpy (&word, data + i, sizeof (word));
+
+      hash = gegl_tile_hash_round (hash, word);
+    }
+
+  if (i < size)
+    {
+      word = 0;
+      memcpy (&word, data + i, size - i);
+
+      hash = gegl_tile_hash_round (hash, word);
+    }
+
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME2;
+  hash ^= hash >> 29;
+
+  return hash;
+}
+
 static inline void
 gegl_tile_unclone (GeglTile *tile)
 {
@@ -346,7 +450,12 @@ gegl_tile_unlock (GeglTile *tile)
   if (g_atomic_int_dec_and_test (&tile->lock_count))
     {
       g_atomic_int_inc (&tile->rev);
-      tile->damage = 0;
+      tile->damage          = 0;
+      tile->is_zero_tile    = FALSE;
+      tile->is_uniform_tile = FALSE;
+
+      if (tile->view)
+        gegl_tile_drop_view (tile);
 
       if (tile->unlock_notify != NULL)
         {
@@ -366,7 +475,12 @@ gegl_tile_unlock_no_void (GeglTile *tile)
   if (g_atomic_int_dec_and_test (&tile->lock_count))
     {
       g_atomic_int_inc (&tile->rev);
-      tile->damage = 0;
+      tile->damage          = 0;
+      tile->is_zero_tile    = FALSE;
+      tile->is_uniform_tile = FALSE;
+
+      if (tile->view)
+        gegl_tile_drop_view (tile);
 
       if (tile->unlock_notify != NULL)
         {
@@ -522,3 +636,150 @@ void gegl_tile_set_unlock_notify (GeglTile         *tile,
   tile->unlock_notify      = unlock_notify;
   tile->unlock_notify_data = unlock_notify_data;
 }
+
+
+/*  converted views  */
+
+
+static void
+gegl_tile_drop_view (GeglTile *tile)
+{
+  GeglTileView *view;
+
+  g_mutex_lock (&gegl_tile_view_mutex);
+
+  view       = tile->view;
+  tile->view = NULL;
+
+  if (view)
+    gegl_tile_view_total -= view->size;
+
+  g_mutex_unlock (&gegl_tile_view_mutex);
+
+  if (view)
+    gegl_tile_view_unref (view);
+}
+
+/* returns a new reference to the view of @tile in @format, if the tile has
+ * one that is up to date, or NULL otherwise.
+ */
+GeglTileView *
+gegl_tile_get_view (GeglTile   *tile,
+                    const Babl *src_format,
+                    const Babl *format)
+{
+  GeglTileView *view = NULL;
+
+  if (! tile->view)
+    return NULL;
+
+  g_mutex_lock (&gegl_tile_view_mutex);
+
+  if (tile->view                          &&
+      tile->view->format     == format     &&
+      tile->view->src_format == src_format &&
+      tile->view->rev        == tile->rev)
+    {
+      view = tile->view;
+
+      g_atomic_int_inc (&view->ref_count);
+    }
+
+  g_mutex_unlock (&gegl_tile_view_mutex);
+
+  return view;
+}
+
+/* converts the data of @tile, interpreted as @src_format, to @format, and
+ * returns it as a new view.  the view replaces the tile's current view, as
+ * long as the total size of the views stays within budget.  the caller
+ * should hold a read lock on the tile.
+ */
+GeglTileView *
+gegl_tile_create_view (GeglTile   *tile,
+                       const Babl *src_format,
+                       const Babl *format)
+{
+  GeglTileView *view;
+  GeglTileView *old_view = NULL;
+  gint          n_pixels;
+  guint         rev;
+
+  n_pixels = tile->size / babl_format_get_bytes_per_pixel (src_format);
+
+  view = g_slice_new (GeglTileView);
+
+  view->ref_count  = 1;
+  view->src_format = src_format;
+  view->format     = format;
+  view->size       = n_pixels * babl_format_get_bytes_per_pixel (format);
+  view->data       = gegl_malloc (view->size);
+  view->rev        = rev = g_atomic_int_get (&tile->rev);
+
+  if (gegl_tile_is_uniform (tile))
+    {
+      gint bpp = babl_format_get_bytes_per_pixel (format);
+
+      /* convert a single pixel, and replicate it */
+      babl_process (babl_fish (src_format, format),
+                    tile->data, view->data, 1);
+      gegl_memset_pattern (view->data + bpp, view->data, bpp, n_pixels - 1);
+    }
+  else
+    {
+      babl_process (babl_fish (src_format, format),
+                    tile->data, view->data, n_pixels);
+    }
+
+  g_mutex_lock (&gegl_tile_view_mutex);
+
+  /* don't publish the view if the tile changed, or is being changed, while
+   * we were converting it.  the data of tiles which keep their identity,
+   * like the tiles of buffers wrapping user data, may be changed behind our
+   * back, without bumping the revision, so their views are never kept.
+   */
+  if (! tile->keep_identity                       &&
+      g_atomic_int_get (&tile->rev)        == rev &&
+      g_atomic_int_get (&tile->lock_count) == 0)
+    {
+      guint64 max_total = gegl_buffer_config ()->tile_cache_size *
+                          GEGL_TILE_VIEW_MAX_CACHE_SHARE;
+      guint64 total     = gegl_tile_view_total;
+
+      if (tile->view)
+        total -= tile->view->size;
+
+      if (total + view->size <= max_total)
+        {
+          old_view   = tile->view;
+          tile->view = view;
+
+          g_atomic_int_inc (&view->ref_count);
+
+          gegl_tile_view_total = total + view->size;
+        }
+    }
+
+  g_mutex_unlock (&gegl_tile_view_mutex);
+
+  if (old_view)
+    gegl_tile_view_unref (old_view);
+
+  return view;
+}
+
+void
+gegl_tile_view_unref (GeglTileView *view)
+{
+  if (! g_atomic_int_dec_and_test (&view->ref_count))
+    return;
+
+  gegl_free (view->data);
+  g_slice_free (GeglTileView, view);
+}
+
+guint64
+gegl_tile_view_get_total (void)
+{
+  return gegl_tile_view_total;
+}
@@ -63,11 +63,18 @@ enum
   PROP_SWAP_COMPRESSION,
   PROP_TILE_WIDTH,
   PROP_TILE_HEIGHT,
+  PROP_TILE_SIZE_TARGET,
   PROP_THREADS,
   PROP_USE_OPENCL,
   PROP_QUEUE_SIZE,
   PROP_APPLICATION_LICENSE,
-  PROP_MIPMAP_RENDERING
+  PROP_MIPMAP_RENDERING,
+  PROP_TILE_DEDUP,
+  PROP_TILE_ALLOC_HUGE_PAGES,
+  PROP_TILE_ALLOC_NUMA,
+  PROP_SWAP_RAM_SIZE,
+  PROP_FILE_COMPRESSION,
+  PROP_FILE_MIPMAP_LEVELS
 };
 
 gint _gegl_threads = 1;
@@ -98,6 +105,10 @@ gegl_config_get_property (GObject    *gobject,
         g_value_set_int (value, config->tile_height);
         break;
 
+      case PROP_TILE_SIZE_TARGET:
+        g_value_set_int (value, config->tile_size_target);
+        break;
+
       case PROP_QUALITY:
         g_value_set_double (value, config->quality);
         break;
@@ -110,6 +121,14 @@ gegl_config_get_property (GObject    *gobject,
         g_value_set_string (value, config->swap_compression);
         break;
 
+      case PROP_FILE_COMPRESSION:
+        g_value_set_string (value, config->file_compression);
+        break;
+
+      case PROP_FILE_MIPMAP_LEVELS:
+        g_value_set_int (value, config->file_mipmap_levels);
+        break;
+
       case PROP_THREADS:
         g_value_set_int (value, _gegl_threads);
         break;
@@ -130,6 +149,22 @@ gegl_config_get_property (GObject    *gobject,
         g_value_set_boolean (value, config->mipmap_rendering);
         break;
 
+      case PROP_TILE_DEDUP:
+        g_value_set_boolean (value, config->tile_dedup);
+        break;
+
+      case PROP_TILE_ALLOC_HUGE_PAGES:
+        g_value_set_boolean (value, config->tile_alloc_huge_pages);
+        break;
+
+      case PROP_TILE_ALLOC_NUMA:
+        g_value_set_boolean (value, config->tile_alloc_numa);
+        break;
+
+      case PROP_SWAP_RAM_SIZE:
+        g_value_set_uint64 (value, config->swap_ram_size);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -158,6 +193,9 @@ gegl_config_set_property (GObject      *gobject,
       case PROP_TILE_HEIGHT:
         config->tile_height = g_value_get_int (value);
         break;
+      case PROP_TILE_SIZE_TARGET:
+        config->tile_size_target = g_value_get_int (value);
+        break;
       case PROP_QUALITY:
         config->quality = g_value_get_double (value);
         return;
@@ -169,6 +207,13 @@ gegl_config_set_property (GObject      *gobject,
         g_free (config->swap_compression);
         config->swap_compression = g_value_dup_string (value);
         break;
+      case PROP_FILE_COMPRESSION:
+        g_free (config->file_compression);
+        config->file_compression = g_value_dup_string (value);
+        break;
+      case PROP_FILE_MIPMAP_LEVELS:
+        config->file_mipmap_levels = g_value_get_int (value);
+        break;
       case PROP_THREADS:
         _gegl_threads = g_value_get_int (value);
         return;
@@ -178,6 +223,18 @@ gegl_config_set_property (GObject      *gobject,
       case PROP_MIPMAP_RENDERING:
         config->mipmap_rendering = g_value_get_boolean (value);
         break;
+      case PROP_TILE_DEDUP:
+        config->tile_dedup = g_value_get_boolean (value);
+        break;
+      case PROP_TILE_ALLOC_HUGE_PAGES:
+        config->tile_alloc_huge_pages = g_value_get_boolean (value);
+        break;
+      case PROP_TILE_ALLOC_NUMA:
+        config->tile_alloc_numa = g_value_get_boolean (value);
+        break;
+      case PROP_SWAP_RAM_SIZE:
+        config->swap_ram_size = g_value_get_uint64 (value);
+        break;
       case PROP_QUEUE_SIZE:
         config->queue_size = g_value_get_int (value);
         break;
@@ -198,6 +255,7 @@ gegl_config_finalize (GObject *gobject)
 
   g_free (config->swap);
   g_free (config->swap_compression);
+  g_free (config->file_compression);
   g_free (config->application_license);
 
   G_OBJECT_CLASS (gegl_config_parent_class)->finalize (gobject);
@@ -232,6 +290,14 @@ gegl_config_class_init (GeglConfigClass *klass)
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_TILE_SIZE_TARGET,
+                                   g_param_spec_int ("tile-size-target",
+                                                     "Tile size target",
+                                                     "size in bytes the tiles of created buffers are sized for, according to their format; 0 uses tile-width and tile-height",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_STATIC_STRINGS));
+
   {
     uint64_t default_tile_cache_size = 1024l * 1024 * 1024;
     uint64_t mem_total = default_tile_cache_size;
@@ -445,6 +511,54 @@ gegl_config_class_init (GeglConfigClass *klass)
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_STATIC_STRINGS |
                                                         G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_DEDUP,
+                                   g_param_spec_boolean ("tile-dedup",
+                                                         "Tile deduplication",
+                                                         "Store identical tile data only once in the swap and in buffer files",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_ALLOC_HUGE_PAGES,
+                                   g_param_spec_boolean ("tile-alloc-huge-pages",
+                                                         "Huge page tile allocation",
+                                                         "Back the blocks tiles are allocated from with huge pages",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_ALLOC_NUMA,
+                                   g_param_spec_boolean ("tile-alloc-numa",
+                                                         "NUMA-aware tile allocation",
+                                                         "Allocate tiles from blocks local to the NUMA node of the allocating thread",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SWAP_RAM_SIZE,
+                                   g_param_spec_uint64 ("swap-ram-size",
+                                                        "Swap RAM size",
+                                                        "size in bytes of the compressed data the swap keeps in memory before writing it to disk; 0 disables the in-memory tier",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FILE_COMPRESSION,
+                                   g_param_spec_string ("file-compression",
+                                                        "File compression",
+                                                        "compression algorithm used for the tiles of saved buffer files",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FILE_MIPMAP_LEVELS,
+                                   g_param_spec_int ("file-mipmap-levels",
+                                                     "File mipmap levels",
+                                                     "number of mipmap levels stored in saved buffer files, in addition to the full resolution tiles",
+                                                     0, 15, 0,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -455,7 +569,14 @@ gegl_config_init (GeglConfig *self)
                          "queue-size",
                          "tile-width",
                          "tile-height",
+                         "tile-size-target",
                          "tile-cache-size",
+                         "tile-dedup",
+                         "tile-alloc-huge-pages",
+                         "tile-alloc-numa",
+                         "swap-ram-size",
+                         "file-compression",
+                         "file-mipmap-levels",
                          NULL};
   GeglBufferConfig *bconf = gegl_buffer_config ();
   for (int i = 0; forward_props[i]; i++)
@@ -42,10 +42,17 @@ struct _GeglConfig
   gdouble  quality;
   gint     tile_width;
   gint     tile_height;
+  gint     tile_size_target;
   gboolean use_opencl;
   gint     queue_size;
   gboolean mipmap_rendering;
   gchar   *application_license;
+  gboolean tile_dedup;
+  gboolean tile_alloc_huge_pages;
+  gboolean tile_alloc_numa;
+  guint64  swap_ram_size;
+  gchar   *file_compression;
+  gint     file_mipmap_levels;
 };
 
 struct _GeglConfigClass
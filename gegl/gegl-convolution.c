@@ -0,0 +1,750 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-convolution.h"
+
+/* the kernel is decomposed into at most this many separable kernels */
+#define SEPARABLE_MAX_RANK       8
+/* relative (frobenius norm) error of the decomposition, below which the
+ * separable method is considered exact
+ */
+#define SEPARABLE_TOLERANCE      1e-5
+#define SEPARABLE_ITERATIONS     64
+
+/* the smallest block size of FFT convolution */
+#define FFT_MIN_SIZE             64
+
+/* relative costs used for choosing the method: a butterfly of the FFT is a
+ * few times as expensive as a multiply-add of the direct methods, which the
+ * compiler vectorizes.
+ */
+#define FFT_BUTTERFLY_COST       4.0
+#define FFT_MULTIPLY_COST        6.0
+
+struct _GeglConvolution
+{
+  gfloat *kernel;
+  gint    width;
+  gint    height;
+  gint    origin_x;
+  gint    origin_y;
+  gint    n_taps;
+
+  /* the separable decomposition, kernel = sum (columns[r] x rows[r]) */
+  gint    rank;
+  gfloat *columns;
+  gfloat *rows;
+};
+
+typedef struct
+{
+  gint    size;
+  gint   *reverse;
+  gfloat *cos_table;
+  gfloat *sin_table;
+} FFTPlan;
+
+
+static void
+gegl_convolution_decompose (GeglConvolution *convolution)
+{
+  gint     width    = convolution->width;
+  gint     height   = convolution->height;
+  gdouble *residual = g_new (gdouble, width * height);
+  gdouble *u        = g_new (gdouble, height);
+  gdouble *v        = g_new (gdouble, width);
+  gdouble  total    = 0.0;
+  gint     max_rank;
+  gint     r, i, j;
+
+  convolution->rank = 0;
+
+  /* the separable method only saves work if it needs fewer taps */
+  max_rank = MIN (SEPARABLE_MAX_RANK,
+                  (width * height - 1) / (width + height));
+
+  if (max_rank < 1)
+    goto done;
+
+  for (i = 0; i < width * height; i++)
+    {
+      residual[i] = convolution->kernel[i];
+      total      += residual[i] * residual[i];
+    }
+
+  if (total == 0.0)
+    goto done;
+
+  convolution->columns = g_new (gfloat, max_rank * height);
+  convolution->rows    = g_new (gfloat, max_rank * width);
+
+  for (r = 0; r < max_rank; r++)
+    {
+      gdouble sigma = 0.0;
+      gdouble error = 0.0;
+      gdouble best  = -1.0;
+      gint    iter;
+
+      /* start the power iteration from the strongest row */
+      for (j = 0; j < height; j++)
+        {
+          gdouble norm = 0.0;
+
+          for (i = 0; i < width; i++)
+            norm += residual[j * width + i] * residual[j * width + i];
+
+          if (norm > best)
+            {
+              best = norm;
+              memcpy (v, residual + j * width, width * sizeof (gdouble));
+            }
+        }
+
+      for (iter = 0; iter < SEPARABLE_ITERATIONS; iter++)
+        {
+          gdouble norm = 0.0;
+
+          for (j = 0; j < height; j++)
+            {
+              u[j] = 0.0;
+              for (i = 0; i < width; i++)
+                u[j] += residual[j * width + i] * v[i];
+            }
+
+          for (i = 0; i < width; i++)
+            {
+              v[i] = 0.0;
+              for (j = 0; j < height; j++)
+                v[i] += residual[j * width + i] * u[j];
+
+              norm += v[i] * v[i];
+            }
+
+          if (norm == 0.0)
+            break;
+
+          norm = sqrt (norm);
+          for (i = 0; i < width; i++)
+            v[i] /= norm;
+        }
+
+      for (j = 0; j < height; j++)
+        {
+          u[j] = 0.0;
+          for (i = 0; i < width; i++)
+            u[j] += residual[j * width + i] * v[i];
+
+          sigma += u[j] * u[j];
+        }
+
+      if (sigma == 0.0)
+        break;
+
+      for (j = 0; j < height; j++)
+        convolution->columns[r * height + j] = u[j];
+      for (i = 0; i < width; i++)
+        convolution->rows[r * width + i] = v[i];
+
+      for (j = 0; j < height; j++)
+        for (i = 0; i < width; i++)
+          {
+            residual[j * width + i] -= u[j] * v[i];
+            error += residual[j * width + i] * residual[j * width + i];
+          }
+
+      if (error <= SEPARABLE_TOLERANCE * SEPARABLE_TOLERANCE * total)
+        {
+          convolution->rank = r + 1;
+          break;
+        }
+    }
+
+done:
+  g_free (residual);
+  g_free (u);
+  g_free (v);
+}
+
+GeglConvolution *
+gegl_convolution_new (const gfloat *kernel,
+                      gint          width,
+                      gint          height,
+                      gint          origin_x,
+                      gint          origin_y)
+{
+  GeglConvolution *convolution;
+  gint             i;
+
+  g_return_val_if_fail (kernel != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  convolution = g_slice_new0 (GeglConvolution);
+
+  convolution->kernel   = g_memdup2 (kernel, width * height * sizeof (gfloat));
+  convolution->width    = width;
+  convolution->height   = height;
+  convolution->origin_x = CLAMP (origin_x, 0, width  - 1);
+  convolution->origin_y = CLAMP (origin_y, 0, height - 1);
+
+  for (i = 0; i < width * height; i++)
+    {
+      if (kernel[i] != 0.0f)
+        convolution->n_taps++;
+    }
+
+  gegl_convolution_decompose (convolution);
+
+  return convolution;
+}
+
+GeglConvolution *
+gegl_convolution_new_from_buffer (GeglBuffer          *kernel,
+                                  const GeglRectangle *rect,
+                                  gboolean             normalize)
+{
+  GeglConvolution *convolution;
+  gfloat          *data;
+  gint             n;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (kernel), NULL);
+
+  if (! rect)
+    rect = gegl_buffer_get_extent (kernel);
+
+  g_return_val_if_fail (rect->width > 0 && rect->height > 0, NULL);
+
+  data = g_new (gfloat, rect->width * rect->height);
+
+  gegl_buffer_get (kernel, rect, 1.0, babl_format ("Y float"), data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  n = rect->width * rect->height;
+
+  if (normalize)
+    {
+      gdouble sum = 0.0;
+      gint    i;
+
+      for (i = 0; i < n; i++)
+        sum += data[i];
+
+      if (sum != 0.0)
+        {
+          for (i = 0; i < n; i++)
+            data[i] /= sum;
+        }
+    }
+
+  convolution = gegl_convolution_new (data, rect->width, rect->height,
+                                      rect->width / 2, rect->height / 2);
+
+  g_free (data);
+
+  return convolution;
+}
+
+void
+gegl_convolution_free (GeglConvolution *convolution)
+{
+  g_return_if_fail (convolution != NULL);
+
+  g_free (convolution->kernel);
+  g_free (convolution->columns);
+  g_free (convolution->rows);
+
+  g_slice_free (GeglConvolution, convolution);
+}
+
+gint
+gegl_convolution_get_rank (GeglConvolution *convolution)
+{
+  g_return_val_if_fail (convolution != NULL, 0);
+
+  return convolution->rank;
+}
+
+void
+gegl_convolution_get_margins (GeglConvolution *convolution,
+                              gint            *left,
+                              gint            *right,
+                              gint            *top,
+                              gint            *bottom)
+{
+  g_return_if_fail (convolution != NULL);
+
+  if (left)
+    *left   = convolution->origin_x;
+  if (right)
+    *right  = convolution->width - 1 - convolution->origin_x;
+  if (top)
+    *top    = convolution->origin_y;
+  if (bottom)
+    *bottom = convolution->height - 1 - convolution->origin_y;
+}
+
+static gint
+fft_get_size (GeglConvolution *convolution,
+              gint             result_width,
+              gint             result_height)
+{
+  gint extent = MAX (convolution->width, convolution->height);
+  gint fit    = MAX (result_width  + convolution->width  - 1,
+                     result_height + convolution->height - 1);
+  gint size   = FFT_MIN_SIZE;
+  gint fit_size;
+
+  /* blocks of about twice the kernel size balance the cost of the
+   * transforms against the overlap, but there is no point in blocks larger
+   * than the area to process.
+   */
+  while (size < 2 * extent)
+    size *= 2;
+
+  for (fit_size = 1; fit_size < fit; fit_size *= 2);
+
+  return MIN (size, fit_size);
+}
+
+GeglConvolutionMethod
+gegl_convolution_choose_method (GeglConvolution     *convolution,
+                                const GeglRectangle *result)
+{
+  gdouble direct;
+  gdouble separable = G_MAXDOUBLE;
+  gdouble fft;
+  gint    width;
+  gint    height;
+  gint    size;
+  gint    n_blocks;
+
+  g_return_val_if_fail (convolution != NULL, GEGL_CONVOLUTION_METHOD_DIRECT);
+  g_return_val_if_fail (result != NULL, GEGL_CONVOLUTION_METHOD_DIRECT);
+
+  width  = MAX (result->width,  1);
+  height = MAX (result->height, 1);
+
+  /* per output component */
+  direct = convolution->n_taps;
+
+  if (convolution->rank > 0)
+    {
+      separable = convolution->rank *
+                  (convolution->height *
+                   (gdouble) (width + convolution->width - 1) / width +
+                   convolution->width);
+    }
+
+  size     = fft_get_size (convolution, width, height);
+  n_blocks = ((width  + size - convolution->width)  / (size - convolution->width  + 1)) *
+             ((height + size - convolution->height) / (size - convolution->height + 1));
+
+  /* a forward and an inverse transform per block, each processing two
+   * components at once
+   */
+  fft = ((gdouble) size * size *
+         (log2 (size) * FFT_BUTTERFLY_COST + FFT_MULTIPLY_COST / 2.0) *
+         n_blocks) /
+        ((gdouble) width * height);
+
+  if (fft < direct && fft < separable)
+    return GEGL_CONVOLUTION_METHOD_FFT;
+  else if (separable < direct)
+    return GEGL_CONVOLUTION_METHOD_SEPARABLE;
+  else
+    return GEGL_CONVOLUTION_METHOD_DIRECT;
+}
+
+static void
+convolve_direct (GeglConvolution *convolution,
+                 const gfloat    *src,
+                 gint             src_width,
+                 gfloat          *dst,
+                 gint             width,
+                 gint             height,
+                 gint             n_components)
+{
+  gint row_length = width * n_components;
+  gint x, y, i, j;
+
+  for (y = 0; y < height; y++)
+    {
+      gfloat *d = dst + y * row_length;
+
+      memset (d, 0, row_length * sizeof (gfloat));
+
+      for (j = 0; j < convolution->height; j++)
+        for (i = 0; i < convolution->width; i++)
+          {
+            gfloat        k = convolution->kernel[j * convolution->width + i];
+            const gfloat *s;
+
+            if (k == 0.0f)
+              continue;
+
+            s = src + ((y + j) * src_width + i) * n_components;
+
+            for (x = 0; x < row_length; x++)
+              d[x] += k * s[x];
+          }
+    }
+}
+
+static void
+convolve_separable (GeglConvolution *convolution,
+                    const gfloat    *src,
+                    gint             src_width,
+                    gfloat          *dst,
+                    gint             width,
+                    gint             height,
+                    gint             n_components)
+{
+  gint    row_length     = width * n_components;
+  gint    src_row_length = src_width * n_components;
+  gfloat *tmp            = g_new (gfloat, src_row_length);
+  gint    x, y, i, j, r;
+
+  memset (dst, 0, row_length * height * sizeof (gfloat));
+
+  for (y = 0; y < height; y++)
+    {
+      gfloat *d = dst + y * row_length;
+
+      for (r = 0; r < convolution->rank; r++)
+        {
+          const gfloat *column = convolution->columns + r * convolution->height;
+          const gfloat *row    = convolution->rows    + r * convolution->width;
+
+          /* vertical pass, into a single row */
+          memset (tmp, 0, src_row_length * sizeof (gfloat));
+
+          for (j = 0; j < convolution->height; j++)
+            {
+              const gfloat *s = src + (y + j) * src_row_length;
+              gfloat        k = column[j];
+
+              if (k == 0.0f)
+                continue;
+
+              for (x = 0; x < src_row_length; x++)
+                tmp[x] += k * s[x];
+            }
+
+          /* horizontal pass */
+          for (i = 0; i < convolution->width; i++)
+            {
+              const gfloat *t = tmp + i * n_components;
+              gfloat        k = row[i];
+
+              if (k == 0.0f)
+                continue;
+
+              for (x = 0; x < row_length; x++)
+                d[x] += k * t[x];
+            }
+        }
+    }
+
+  g_free (tmp);
+}
+
+static FFTPlan *
+fft_plan_new (gint size)
+{
+  FFTPlan *plan = g_slice_new (FFTPlan);
+  gint     bits = 0;
+  gint     i;
+
+  while ((1 << bits) < size)
+    bits++;
+
+  plan->size      = size;
+  plan->reverse   = g_new (gint,   size);
+  plan->cos_table = g_new (gfloat, size / 2);
+  plan->sin_table = g_new (gfloat, size / 2);
+
+  for (i = 0; i < size; i++)
+    {
+      gint reversed = 0;
+      gint b;
+
+      for (b = 0; b < bits; b++)
+        {
+          if (i & (1 << b))
+            reversed |= 1 << (bits - 1 - b);
+        }
+
+      plan->reverse[i] = reversed;
+    }
+
+  for (i = 0; i < size / 2; i++)
+    {
+      plan->cos_table[i] = cos (2.0 * G_PI * i / size);
+      plan->sin_table[i] = sin (2.0 * G_PI * i / size);
+    }
+
+  return plan;
+}
+
+static void
+fft_plan_free (FFTPlan *plan)
+{
+  g_free (plan->reverse);
+  g_free (plan->cos_table);
+  g_free (plan->sin_table);
+
+  g_slice_free (FFTPlan, plan);
+}
+
+/* in-place radix-2 transform of @plan->size complex values, @stride apart */
+static void
+fft_1d (const FFTPlan *plan,
+        gfloat        *re,
+        gfloat        *im,
+        gint           stride,
+        gboolean       inverse)
+{
+  gint n    = plan->size;
+  gint sign = inverse ? 1 : -1;
+  gint len;
+  gint i, k;
+
+  for (i = 0; i < n; i++)
+    {
+      gint j = plan->reverse[i];
+
+      if (i < j)
+        {
+          gfloat t;
+
+          t = re[i * stride]; re[i * stride] = re[j * stride]; re[j * stride] = t;
+          t = im[i * stride]; im[i * stride] = im[j * stride]; im[j * stride] = t;
+        }
+    }
+
+  for (len = 2; len <= n; len *= 2)
+    {
+      gint half = len / 2;
+      gint step = n / len;
+
+      for (i = 0; i < n; i += len)
+        for (k = 0; k < half; k++)
+          {
+            gfloat wr = plan->cos_table[k * step];
+            gfloat wi = sign * plan->sin_table[k * step];
+            gint   a  = (i + k) * stride;
+            gint   b  = (i + k + half) * stride;
+            gfloat xr = re[b] * wr - im[b] * wi;
+            gfloat xi = re[b] * wi + im[b] * wr;
+
+            re[b] = re[a] - xr;
+            im[b] = im[a] - xi;
+            re[a] += xr;
+            im[a] += xi;
+          }
+    }
+}
+
+static void
+fft_2d (const FFTPlan *plan,
+        gfloat        *re,
+        gfloat        *im,
+        gboolean       inverse)
+{
+  gint n = plan->size;
+  gint i;
+
+  for (i = 0; i < n; i++)
+    fft_1d (plan, re + i * n, im + i * n, 1, inverse);
+
+  for (i = 0; i < n; i++)
+    fft_1d (plan, re + i, im + i, n, inverse);
+}
+
+/* overlap-save convolution: the input is split in overlapping blocks,
+ * which are multiplied by the kernel's spectrum; the parts of the result
+ * that didn't wrap around are kept.  pairs of components are transformed
+ * together, as the real and imaginary parts of the signal, which is
+ * possible because the kernel is real.
+ */
+static void
+convolve_fft (GeglConvolution *convolution,
+              const gfloat    *src,
+              gint             src_width,
+              gint             src_height,
+              gfloat          *dst,
+              gint             width,
+              gint             height,
+              gint             n_components)
+{
+  gint     size         = fft_get_size (convolution, width, height);
+  gint     valid_width  = size - convolution->width  + 1;
+  gint     valid_height = size - convolution->height + 1;
+  gfloat   scale        = 1.0f / ((gfloat) size * size);
+  FFTPlan *plan         = fft_plan_new (size);
+  gfloat  *kernel_re    = g_new0 (gfloat, size * size);
+  gfloat  *kernel_im    = g_new0 (gfloat, size * size);
+  gfloat  *re           = g_new (gfloat, size * size);
+  gfloat  *im           = g_new (gfloat, size * size);
+  gint     bx, by, x, y, c, i;
+
+  for (y = 0; y < convolution->height; y++)
+    {
+      memcpy (kernel_re + y * size,
+              convolution->kernel + y * convolution->width,
+              convolution->width * sizeof (gfloat));
+    }
+
+  fft_2d (plan, kernel_re, kernel_im, FALSE);
+
+  for (c = 0; c < n_components; c += 2)
+    {
+      gboolean pair = c + 1 < n_components;
+
+      for (by = 0; by < height; by += valid_height)
+        for (bx = 0; bx < width; bx += valid_width)
+          {
+            gint block_width  = MIN (valid_width,  width  - bx);
+            gint block_height = MIN (valid_height, height - by);
+
+            for (y = 0; y < size; y++)
+              for (x = 0; x < size; x++)
+                {
+                  gint sx = bx + x;
+                  gint sy = by + y;
+
+                  if (sx < src_width && sy < src_height)
+                    {
+                      const gfloat *s = src + (sy * src_width + sx) * n_components + c;
+
+                      re[y * size + x] = s[0];
+                      im[y * size + x] = pair ? s[1] : 0.0f;
+                    }
+                  else
+                    {
+                      re[y * size + x] = 0.0f;
+                      im[y * size + x] = 0.0f;
+                    }
+                }
+
+            fft_2d (plan, re, im, FALSE);
+
+            /* correlation, multiply by the conjugate of the kernel */
+            for (i = 0; i < size * size; i++)
+              {
+                gfloat a = re[i];
+                gfloat b = im[i];
+
+                re[i] = a * kernel_re[i] + b * kernel_im[i];
+                im[i] = b * kernel_re[i] - a * kernel_im[i];
+              }
+
+            fft_2d (plan, re, im, TRUE);
+
+            for (y = 0; y < block_height; y++)
+              for (x = 0; x < block_width; x++)
+                {
+                  gfloat *d = dst + ((by + y) * width + bx + x) * n_components + c;
+
+                  d[0] = re[y * size + x] * scale;
+                  if (pair)
+                    d[1] = im[y * size + x] * scale;
+                }
+          }
+    }
+
+  fft_plan_free (plan);
+  g_free (kernel_re);
+  g_free (kernel_im);
+  g_free (re);
+  g_free (im);
+}
+
+void
+gegl_convolution_process (GeglConvolution       *convolution,
+                          GeglBuffer            *input,
+                          GeglBuffer            *output,
+                          const GeglRectangle   *result,
+                          const Babl            *format,
+                          GeglAbyssPolicy        abyss_policy,
+                          GeglConvolutionMethod  method)
+{
+  GeglRectangle  src_rect;
+  gint           n_components;
+  gfloat        *src;
+  gfloat        *dst;
+
+  g_return_if_fail (convolution != NULL);
+  g_return_if_fail (GEGL_IS_BUFFER (input));
+  g_return_if_fail (GEGL_IS_BUFFER (output));
+  g_return_if_fail (result != NULL);
+  g_return_if_fail (format != NULL);
+
+  n_components = babl_format_get_n_components (format);
+
+  g_return_if_fail (babl_format_get_bytes_per_pixel (format) ==
+                    n_components * sizeof (gfloat));
+
+  if (result->width <= 0 || result->height <= 0)
+    return;
+
+  if (method == GEGL_CONVOLUTION_METHOD_AUTO)
+    method = gegl_convolution_choose_method (convolution, result);
+  else if (method == GEGL_CONVOLUTION_METHOD_SEPARABLE &&
+           convolution->rank == 0)
+    method = GEGL_CONVOLUTION_METHOD_DIRECT;
+
+  src_rect.x      = result->x - convolution->origin_x;
+  src_rect.y      = result->y - convolution->origin_y;
+  src_rect.width  = result->width  + convolution->width  - 1;
+  src_rect.height = result->height + convolution->height - 1;
+
+  src = g_new (gfloat, src_rect.width * src_rect.height * n_components);
+  dst = g_new (gfloat, result->width  * result->height  * n_components);
+
+  gegl_buffer_get (input, &src_rect, 1.0, format, src,
+                   GEGL_AUTO_ROWSTRIDE, abyss_policy);
+
+  switch (method)
+    {
+    case GEGL_CONVOLUTION_METHOD_SEPARABLE:
+      convolve_separable (convolution, src, src_rect.width,
+                          dst, result->width, result->height, n_components);
+      break;
+
+    case GEGL_CONVOLUTION_METHOD_FFT:
+      convolve_fft (convolution, src, src_rect.width, src_rect.height,
+                    dst, result->width, result->height, n_components);
+      break;
+
+    default:
+      convolve_direct (convolution, src, src_rect.width,
+                       dst, result->width, result->height, n_components);
+      break;
+    }
+
+  gegl_buffer_set (output, result, 0, format, dst, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (src);
+  g_free (dst);
+}
@@ -0,0 +1,137 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_CONVOLUTION_H__
+#define __GEGL_CONVOLUTION_H__
+
+G_BEGIN_DECLS
+
+/***
+ * GeglConvolution:
+ *
+ * A #GeglConvolution applies a kernel of arbitrary size to a buffer, for
+ * use by operations.  Depending on the kernel and on the size of the area
+ * to process, the kernel is either applied directly, as a sum of separable
+ * (row and column) kernels, when it is of low rank, or by multiplication in
+ * the frequency domain, using overlap-save FFT convolution.
+ *
+ * The kernel is not flipped: the result at (x, y) is the sum of
+ * kernel (i, j) * input (x + i - origin_x, y + j - origin_y).
+ */
+
+typedef struct _GeglConvolution GeglConvolution;
+
+typedef enum
+{
+  GEGL_CONVOLUTION_METHOD_AUTO,
+  GEGL_CONVOLUTION_METHOD_DIRECT,
+  GEGL_CONVOLUTION_METHOD_SEPARABLE,
+  GEGL_CONVOLUTION_METHOD_FFT
+} GeglConvolutionMethod;
+
+/**
+ * gegl_convolution_new: (skip)
+ * @kernel: (array): @width * @height kernel coefficients, in row order
+ * @width: the kernel width
+ * @height: the kernel height
+ * @origin_x: the kernel column applied to the output pixel's own column
+ * @origin_y: the kernel row applied to the output pixel's own row
+ *
+ * Return value: a new #GeglConvolution, free with gegl_convolution_free().
+ */
+GeglConvolution      * gegl_convolution_new             (const gfloat          *kernel,
+                                                         gint                   width,
+                                                         gint                   height,
+                                                         gint                   origin_x,
+                                                         gint                   origin_y);
+
+/**
+ * gegl_convolution_new_from_buffer: (skip)
+ * @kernel: a #GeglBuffer holding the kernel
+ * @rect: the area of @kernel to use, or %NULL for its extent
+ * @normalize: whether to scale the kernel so its coefficients sum to 1
+ *
+ * Creates a #GeglConvolution from the luminance of @kernel, centered on the
+ * middle of @rect.  Kernels whose coefficients sum to 0 are not normalized.
+ *
+ * Return value: a new #GeglConvolution, free with gegl_convolution_free().
+ */
+GeglConvolution      * gegl_convolution_new_from_buffer (GeglBuffer            *kernel,
+                                                         const GeglRectangle   *rect,
+                                                         gboolean               normalize);
+
+/**
+ * gegl_convolution_free: (skip)
+ * @convolution: a #GeglConvolution
+ */
+void                   gegl_convolution_free            (GeglConvolution       *convolution);
+
+/**
+ * gegl_convolution_get_rank: (skip)
+ * @convolution: a #GeglConvolution
+ *
+ * Return value: the number of separable kernels the kernel decomposes into,
+ * or 0 if the separable method isn't applicable to the kernel.
+ */
+gint                   gegl_convolution_get_rank        (GeglConvolution       *convolution);
+
+/**
+ * gegl_convolution_get_margins: (skip)
+ * @convolution: a #GeglConvolution
+ * @left: (out) (optional): the number of input columns needed left of the result
+ * @right: (out) (optional): the number of input columns needed right of the result
+ * @top: (out) (optional): the number of input rows needed above the result
+ * @bottom: (out) (optional): the number of input rows needed below the result
+ */
+void                   gegl_convolution_get_margins     (GeglConvolution       *convolution,
+                                                         gint                  *left,
+                                                         gint                  *right,
+                                                         gint                  *top,
+                                                         gint                  *bottom);
+
+/**
+ * gegl_convolution_choose_method: (skip)
+ * @convolution: a #GeglConvolution
+ * @result: the area to be processed
+ *
+ * Return value: the method estimated to be the fastest for computing
+ * @result, never %GEGL_CONVOLUTION_METHOD_AUTO.
+ */
+GeglConvolutionMethod  gegl_convolution_choose_method   (GeglConvolution       *convolution,
+                                                         const GeglRectangle   *result);
+
+/**
+ * gegl_convolution_process: (skip)
+ * @convolution: a #GeglConvolution
+ * @input: the input buffer
+ * @output: the output buffer
+ * @result: the area of @output to compute
+ * @format: a format with float components, used for reading @input and
+ * writing @output; every component is convolved separately
+ * @abyss_policy: the abyss policy used when reading @input
+ * @method: the method to use, or %GEGL_CONVOLUTION_METHOD_AUTO
+ */
+void                   gegl_convolution_process         (GeglConvolution       *convolution,
+                                                         GeglBuffer            *input,
+                                                         GeglBuffer            *output,
+                                                         const GeglRectangle   *result,
+                                                         const Babl            *format,
+                                                         GeglAbyssPolicy        abyss_policy,
+                                                         GeglConvolutionMethod  method);
+
+G_END_DECLS
+
+#endif  /* __GEGL_CONVOLUTION_H__ */
@@ -539,6 +539,11 @@ gegl_config_parse_env (GeglConfig *config)
                     NULL);
     }
 
+  if (g_getenv ("GEGL_TILE_SIZE_TARGET"))
+    g_object_set (config,
+                  "tile-size-target", atoi (g_getenv ("GEGL_TILE_SIZE_TARGET")),
+                  NULL);
+
   if (g_getenv ("GEGL_THREADS"))
     {
       _gegl_threads = atoi(g_getenv("GEGL_THREADS"));
@@ -593,6 +598,51 @@ gegl_config_parse_env (GeglConfig *config)
                     "swap-compression", g_getenv ("GEGL_SWAP_COMPRESSION"),
                     NULL);
     }
+
+  if (g_getenv ("GEGL_SWAP_RAM_SIZE"))
+    {
+      g_object_set (config,
+                    "swap-ram-size",
+                    (guint64) atoll(g_getenv("GEGL_SWAP_RAM_SIZE")) * 1024 * 1024,
+                    NULL);
+    }
+
+  if (g_getenv ("GEGL_TILE_DEDUP"))
+    {
+      const char *dedup_env = g_getenv ("GEGL_TILE_DEDUP");
+
+      if (g_ascii_strcasecmp (dedup_env, "yes") == 0)
+        g_object_set (config, "tile-dedup", TRUE, NULL);
+      else if (g_ascii_strcasecmp (dedup_env, "no") == 0)
+        g_object_set (config, "tile-dedup", FALSE, NULL);
+      else
+        g_warning ("Unknown value for GEGL_TILE_DEDUP: %s", dedup_env);
+    }
+
+  if (g_getenv ("GEGL_TILE_ALLOC_HUGE_PAGES"))
+    {
+      const char *huge_pages_env = g_getenv ("GEGL_TILE_ALLOC_HUGE_PAGES");
+
+      if (g_ascii_strcasecmp (huge_pages_env, "yes") == 0)
+        g_object_set (config, "tile-alloc-huge-pages", TRUE, NULL);
+      else if (g_ascii_strcasecmp (huge_pages_env, "no") == 0)
+        g_object_set (config, "tile-alloc-huge-pages", FALSE, NULL);
+      else
+        g_warning ("Unknown value for GEGL_TILE_ALLOC_HUGE_PAGES: %s",
+                   huge_pages_env);
+    }
+
+  if (g_getenv ("GEGL_TILE_ALLOC_NUMA"))
+    {
+      const char *numa_env = g_getenv ("GEGL_TILE_ALLOC_NUMA");
+
+      if (g_ascii_strcasecmp (numa_env, "yes") == 0)
+        g_object_set (config, "tile-alloc-numa", TRUE, NULL);
+      else if (g_ascii_strcasecmp (numa_env, "no") == 0)
+        g_object_set (config, "tile-alloc-numa", FALSE, NULL);
+      else
+        g_warning ("Unknown value for GEGL_TILE_ALLOC_NUMA: %s", numa_env);
+    }
 }
 
 GeglConfig *
@@ -31,6 +31,11 @@ gdouble   gegl_parallel_distribute_get_thread_time       (void);
 gint      gegl_parallel_distribute_get_optimal_n_threads (gdouble n_elements,
                                                           gdouble thread_cost);
 
+/* returns the innermost cancellable, and the earliest deadline, of the
+ * cancellation scopes of the current thread.
+ */
+GCancellable * gegl_parallel_get_cancellable             (gint64 *deadline);
+
 
 /*  stats  */
 
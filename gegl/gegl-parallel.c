@@ -20,6 +20,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib.h>
 
@@ -27,17 +28,31 @@
 #include "gegl-config.h"
 #include "gegl-parallel.h"
 #include "gegl-parallel-private.h"
+#include "gegl-buffer-private.h"
 
 
 #define GEGL_PARALLEL_DISTRIBUTE_MAX_THREADS           GEGL_MAX_THREADS
 #define GEGL_PARALLEL_DISTRIBUTE_THREAD_TIME_N_SAMPLES 10
+#define GEGL_PARALLEL_REDUCE_BLOCK_TILES               4
+#define GEGL_PARALLEL_REDUCE_TILE_SIZE                 128
+#define GEGL_PARALLEL_REDUCE_MAX_BLOCKS                256
 
 
+typedef struct _GeglParallelCancellable GeglParallelCancellable;
+
+struct _GeglParallelCancellable
+{
+  GCancellable            *cancellable;
+  gint64                   deadline;
+  GeglParallelCancellable *prev;
+};
+
 typedef struct
 {
-  GeglParallelDistributeFunc func;
-  gint                       n;
-  gpointer                   user_data;
+  GeglParallelDistributeFunc  func;
+  gint                        n;
+  gpointer                    user_data;
+  GeglParallelCancellable    *cancellable;
 } GeglParallelDistributeTask;
 
 typedef struct
@@ -78,6 +93,12 @@ static gint                         gegl_parallel_distribute_n_assigned_threads;
 
 static gdouble                      gegl_parallel_distribute_thread_time;
 
+/* the stack of cancellation scopes of the current thread.  worker threads
+ * inherit the top of the stack of the thread distributing the work, for the
+ * duration of the task.
+ */
+static GPrivate                     gegl_parallel_cancellable;
+
 
 /*  public functions  */
 
@@ -90,6 +111,8 @@ gegl_parallel_init (void)
                     NULL);
 
   gegl_parallel_notify_threads (gegl_config ());
+
+  gegl_buffer_ext_is_cancelled = gegl_parallel_is_cancelled;
 }
 
 void
@@ -99,6 +122,8 @@ gegl_parallel_cleanup (void)
                                         gegl_parallel_notify_threads,
                                         NULL);
 
+  gegl_buffer_ext_is_cancelled = NULL;
+
   /* stop all threads */
   gegl_parallel_set_n_threads (0, /* finish_tasks = */ FALSE);
 }
@@ -170,9 +195,10 @@ gegl_parallel_distribute (gint                       max_n,
       return;
     }
 
-  task.n         = max_n;
-  task.func      = func;
-  task.user_data = user_data;
+  task.n           = max_n;
+  task.func        = func;
+  task.user_data   = user_data;
+  task.cancellable = g_private_get (&gegl_parallel_cancellable);
 
   gegl_parallel_distribute_n_assigned_threads = task.n - 1;
 
@@ -379,6 +405,219 @@ gegl_parallel_distribute_area (const GeglRectangle            *area,
     &data);
 }
 
+typedef struct
+{
+  const GeglRectangle        *area;
+  gint                        x0;
+  gint                        y0;
+  gint                        block_width;
+  gint                        block_height;
+  gint                        n_columns;
+  gsize                       partial_size;
+  guint8                     *partials;
+  gconstpointer               identity;
+  GeglParallelReduceAreaFunc  func;
+  gpointer                    user_data;
+} GeglParallelReduceAreaData;
+
+static void
+gegl_parallel_reduce_area_func (gsize                       offset,
+                                gsize                       size,
+                                GeglParallelReduceAreaData *data)
+{
+  gsize i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      GeglRectangle block;
+      gpointer      partial = data->partials + i * data->partial_size;
+
+      block.x      = data->x0 + (i % data->n_columns) * data->block_width;
+      block.y      = data->y0 + (i / data->n_columns) * data->block_height;
+      block.width  = data->block_width;
+      block.height = data->block_height;
+
+      gegl_rectangle_intersect (&block, &block, data->area);
+
+      memcpy (partial, data->identity, data->partial_size);
+
+      data->func (&block, partial, data->user_data);
+    }
+}
+
+void
+gegl_parallel_reduce_area (const GeglRectangle        *area,
+                           GeglBuffer                 *buffer,
+                           gdouble                     thread_cost,
+                           gsize                       partial_size,
+                           GeglParallelReduceAreaFunc  func,
+                           GeglParallelMergeFunc       merge,
+                           gpointer                    result,
+                           gpointer                    user_data)
+{
+  GeglParallelReduceAreaData data;
+  gint                       tile_width  = GEGL_PARALLEL_REDUCE_TILE_SIZE;
+  gint                       tile_height = GEGL_PARALLEL_REDUCE_TILE_SIZE;
+  gint                       shift_x     = 0;
+  gint                       shift_y     = 0;
+  gint                       n_rows;
+  gsize                      n_blocks;
+  gsize                      i;
+
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (buffer == NULL || GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (partial_size > 0);
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (merge != NULL);
+  g_return_if_fail (result != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  if (buffer)
+    {
+      tile_width  = buffer->tile_width;
+      tile_height = buffer->tile_height;
+      shift_x     = buffer->shift_x;
+      shift_y     = buffer->shift_y;
+    }
+
+  /* align the blocks to the tile grid of the buffer, so that each tile is
+   * only read by a single thread.  the blocks don't depend on anything else,
+   * in particular not on the configured tile size, or the number of threads.
+   */
+  data.x0           = (gint) floor ((gdouble) (area->x + shift_x) / tile_width)  *
+                      tile_width  - shift_x;
+  data.y0           = (gint) floor ((gdouble) (area->y + shift_y) / tile_height) *
+                      tile_height - shift_y;
+  data.block_width  = GEGL_PARALLEL_REDUCE_BLOCK_TILES * tile_width;
+  data.block_height = GEGL_PARALLEL_REDUCE_BLOCK_TILES * tile_height;
+
+  while (TRUE)
+    {
+      data.n_columns = (area->x + area->width  - data.x0 + data.block_width  - 1) /
+                       data.block_width;
+      n_rows         = (area->y + area->height - data.y0 + data.block_height - 1) /
+                       data.block_height;
+
+      if ((gsize) data.n_columns * n_rows <= GEGL_PARALLEL_REDUCE_MAX_BLOCKS)
+        break;
+
+      data.block_width  *= 2;
+      data.block_height *= 2;
+    }
+
+  n_blocks = (gsize) data.n_columns * n_rows;
+
+  if (n_blocks == 1)
+    {
+      func (area, result, user_data);
+
+      return;
+    }
+
+  data.area         = area;
+  data.partial_size = partial_size;
+  data.partials     = g_malloc (n_blocks * partial_size);
+  data.identity     = g_memdup2 (result, partial_size);
+  data.func         = func;
+  data.user_data    = user_data;
+
+  gegl_parallel_distribute_range (
+    n_blocks,
+    thread_cost / ((gdouble) data.block_width * data.block_height),
+    (GeglParallelDistributeRangeFunc) gegl_parallel_reduce_area_func,
+    &data);
+
+  for (i = 0; i < n_blocks; i++)
+    merge (result, data.partials + i * partial_size, user_data);
+
+  g_free ((gpointer) data.identity);
+  g_free (data.partials);
+}
+
+void
+gegl_parallel_push_cancellable (GCancellable *cancellable,
+                                gint64        deadline)
+{
+  GeglParallelCancellable *scope;
+
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  scope = g_slice_new (GeglParallelCancellable);
+
+  scope->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  scope->deadline    = deadline;
+  scope->prev        = g_private_get (&gegl_parallel_cancellable);
+
+  g_private_set (&gegl_parallel_cancellable, scope);
+}
+
+void
+gegl_parallel_pop_cancellable (void)
+{
+  GeglParallelCancellable *scope = g_private_get (&gegl_parallel_cancellable);
+
+  g_return_if_fail (scope != NULL);
+
+  g_private_set (&gegl_parallel_cancellable, scope->prev);
+
+  g_clear_object (&scope->cancellable);
+  g_slice_free (GeglParallelCancellable, scope);
+}
+
+gboolean
+gegl_parallel_is_cancelled (void)
+{
+  GeglParallelCancellable *scope = g_private_get (&gegl_parallel_cancellable);
+  gint64                   now   = 0;
+
+  for (; scope; scope = scope->prev)
+    {
+      if (scope->cancellable &&
+          g_cancellable_is_cancelled (scope->cancellable))
+        {
+          return TRUE;
+        }
+
+      if (scope->deadline)
+        {
+          if (! now)
+            now = g_get_monotonic_time ();
+
+          if (now >= scope->deadline)
+            return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+GCancellable *
+gegl_parallel_get_cancellable (gint64 *deadline)
+{
+  GeglParallelCancellable *scope = g_private_get (&gegl_parallel_cancellable);
+  GCancellable            *cancellable = NULL;
+  gint64                   min_deadline = 0;
+
+  for (; scope; scope = scope->prev)
+    {
+      if (! cancellable)
+        cancellable = scope->cancellable;
+
+      if (scope->deadline &&
+          (! min_deadline || scope->deadline < min_deadline))
+        {
+          min_deadline = scope->deadline;
+        }
+    }
+
+  if (deadline)
+    *deadline = min_deadline;
+
+  return cancellable;
+}
+
 
 /*  public functions (stats)  */
 
@@ -489,9 +728,14 @@ gegl_parallel_distribute_thread_func (GeglParallelDistributeThread *thread)
         }
       else if (thread->task)
         {
+          g_private_set (&gegl_parallel_cancellable,
+                         thread->task->cancellable);
+
           thread->task->func (thread->i, thread->task->n,
                               thread->task->user_data);
 
+          g_private_set (&gegl_parallel_cancellable, NULL);
+
           if (g_atomic_int_dec_and_test (
                 &gegl_parallel_distribute_completion_counter))
             {
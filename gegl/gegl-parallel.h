@@ -69,6 +69,37 @@ typedef void (* GeglParallelDistributeRangeFunc) (gsize                offset,
 typedef void (* GeglParallelDistributeAreaFunc)  (const GeglRectangle *area,
                                                   gpointer             user_data);
 
+/**
+ * GeglParallelReduceAreaFunc:
+ * @area: the current sub-area
+ * @partial: the partial result of @area
+ * @user_data: user data pointer
+ *
+ * Specifies the type of the function passed to gegl_parallel_reduce_area()
+ * for processing a sub-area.
+ *
+ * The function should accumulate the sub-area specified by @area into
+ * @partial, which initially holds the identity of the reduction.
+ */
+typedef void (* GeglParallelReduceAreaFunc)      (const GeglRectangle *area,
+                                                  gpointer             partial,
+                                                  gpointer             user_data);
+
+/**
+ * GeglParallelMergeFunc:
+ * @result: the result of the reduction
+ * @partial: a partial result
+ * @user_data: user data pointer
+ *
+ * Specifies the type of the function passed to gegl_parallel_reduce_area()
+ * for merging partial results.
+ *
+ * The function should combine @partial into @result.
+ */
+typedef void (* GeglParallelMergeFunc)           (gpointer             result,
+                                                  gconstpointer        partial,
+                                                  gpointer             user_data);
+
 
 /**
  * gegl_parallel_distribute:
@@ -119,6 +150,79 @@ void   gegl_parallel_distribute_area  (const GeglRectangle             *area,
                                        GeglParallelDistributeAreaFunc   func,
                                        gpointer                         user_data);
 
+/**
+ * gegl_parallel_reduce_area:
+ * @area: the area to process
+ * @buffer: (nullable): the buffer @area is read from, or %NULL
+ * @thread_cost: the cost of using each additional thread, relative
+ *               to the cost of processing a single data element
+ * @partial_size: the size of the partial results, in bytes
+ * @func: (scope call): the function accumulating a sub-area
+ * @merge: (scope call): the function merging partial results
+ * @result: the result of the reduction, which should initially hold its
+ *          identity, such as 0 for a sum, and be @partial_size bytes large
+ * @user_data: user data to pass to the functions
+ *
+ * Computes a reduction, like a histogram or the moments of an image, over
+ * an area, using multiple threads.  The area is divided into blocks
+ * aligned to the tile grid of @buffer, or to a fixed grid if @buffer is
+ * %NULL, and @func is called on different threads to accumulate each
+ * block into its own partial result.  The partial results are then merged
+ * into @result by @merge, in order.
+ *
+ * The blocks only depend on @area and on the tile grid of @buffer, so that
+ * the result of the reduction is the same regardless of the number of
+ * threads, even when @merge isn't associative, as is the case for floating
+ * point sums.
+ */
+void   gegl_parallel_reduce_area      (const GeglRectangle             *area,
+                                       GeglBuffer                      *buffer,
+                                       gdouble                          thread_cost,
+                                       gsize                            partial_size,
+                                       GeglParallelReduceAreaFunc       func,
+                                       GeglParallelMergeFunc            merge,
+                                       gpointer                         result,
+                                       gpointer                         user_data);
+
+/**
+ * gegl_parallel_push_cancellable:
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @deadline: a g_get_monotonic_time() timestamp after which processing
+ *            should stop, or 0 for no deadline
+ *
+ * Enters a cancellation scope on the current thread.  Until the matching
+ * gegl_parallel_pop_cancellable(), processing done on this thread, including
+ * work distributed to other threads by gegl_parallel_distribute() and
+ * friends, is considered cancelled once @cancellable is cancelled or
+ * @deadline has passed.  Scopes nest; processing is cancelled if any of the
+ * enclosing scopes is.
+ *
+ * Cancelled processing stops at the next chunk boundary, and its partial
+ * results are not marked valid in any cache.
+ */
+void     gegl_parallel_push_cancellable (GCancellable *cancellable,
+                                         gint64        deadline);
+
+/**
+ * gegl_parallel_pop_cancellable:
+ *
+ * Leaves the innermost cancellation scope entered by
+ * gegl_parallel_push_cancellable() on the current thread.
+ */
+void     gegl_parallel_pop_cancellable  (void);
+
+/**
+ * gegl_parallel_is_cancelled:
+ *
+ * Checks whether the processing done on the current thread has been
+ * cancelled.  Long running operations should call this between chunks of
+ * work, and return early if it returns %TRUE.  The check is cheap when no
+ * cancellation scope is active.
+ *
+ * Returns: %TRUE if processing has been cancelled.
+ */
+gboolean gegl_parallel_is_cancelled     (void);
+
 
 #ifdef __cplusplus
 #if __cplusplus >= 201103
@@ -192,6 +296,45 @@ gegl_parallel_distribute_area (const GeglRectangle        *area,
                                  func);
 }
 
+template <class ParallelReduceAreaFunc,
+          class ParallelMergeFunc>
+inline void
+gegl_parallel_reduce_area (const GeglRectangle    *area,
+                           GeglBuffer             *buffer,
+                           gdouble                 thread_cost,
+                           gsize                   partial_size,
+                           ParallelReduceAreaFunc  func,
+                           ParallelMergeFunc       merge,
+                           gpointer                result)
+{
+  struct
+  {
+    ParallelReduceAreaFunc func;
+    ParallelMergeFunc      merge;
+  } funcs = {func, merge};
+
+  gegl_parallel_reduce_area (area, buffer, thread_cost, partial_size,
+                             [] (const GeglRectangle *area,
+                                 gpointer             partial,
+                                 gpointer             user_data)
+                             {
+                               ParallelReduceAreaFunc func_copy (
+                                 ((const decltype (funcs) *) user_data)->func);
+
+                               func_copy (area, partial);
+                             },
+                             [] (gpointer      result,
+                                 gconstpointer partial,
+                                 gpointer      user_data)
+                             {
+                               ParallelMergeFunc merge_copy (
+                                 ((const decltype (funcs) *) user_data)->merge);
+
+                               merge_copy (result, partial);
+                             },
+                             result, &funcs);
+}
+
 }
 
 #endif /* __cplusplus >= 201103 */
@@ -33,6 +33,8 @@
 #include <gegl-types.h>
 #include <gegl-paramspecs.h>
 #include <gegl-audio-fragment.h>
+#include <gegl-convolution.h>
+#include <gegl-summed-area-table.h>
 
 G_BEGIN_DECLS
 
@@ -23,9 +23,12 @@
 #include "gegl.h"
 #include "gegl-types-internal.h"
 #include "buffer/gegl-buffer-types.h"
+#include "buffer/gegl-buffer-private.h"
+#include "buffer/gegl-buffer-iterator-private.h"
 #include "buffer/gegl-scratch-private.h"
 #include "buffer/gegl-tile-alloc.h"
 #include "buffer/gegl-tile-handler-cache.h"
+#include "buffer/gegl-tile-backend-file.h"
 #include "buffer/gegl-tile-backend-swap.h"
 #include "buffer/gegl-tile-handler-zoom.h"
 #include "gegl-parallel-private.h"
@@ -40,6 +43,9 @@ enum
   PROP_TILE_CACHE_TOTAL_UNCOMPRESSED,
   PROP_TILE_CACHE_HITS,
   PROP_TILE_CACHE_MISSES,
+  PROP_TILE_CACHE_HIT_RATE,
+  PROP_TILE_CACHE_SPARED,
+  PROP_TILE_CACHE_TIME_SAVED,
   PROP_SWAP_TOTAL,
   PROP_SWAP_TOTAL_UNCOMPRESSED,
   PROP_SWAP_FILE_SIZE,
@@ -51,9 +57,20 @@ enum
   PROP_SWAP_READ_TOTAL,
   PROP_SWAP_WRITING,
   PROP_SWAP_WRITE_TOTAL,
+  PROP_SWAP_DEDUP_HITS,
+  PROP_SWAP_DEDUP_TOTAL,
+  PROP_SWAP_RAM_TOTAL,
+  PROP_SWAP_RAM_HITS,
+  PROP_SWAP_DISK_HITS,
+  PROP_FILE_DEDUP_TOTAL,
   PROP_ZOOM_TOTAL,
   PROP_TILE_ALLOC_TOTAL,
+  PROP_TILE_ALLOC_HUGE_PAGES_TOTAL,
+  PROP_TILE_ALLOC_NUMA_NODES,
   PROP_SCRATCH_TOTAL,
+  PROP_ITERATOR_CONVERSIONS,
+  PROP_ITERATOR_CONVERSIONS_CACHED,
+  PROP_TILE_VIEW_TOTAL,
   PROP_ASSIGNED_THREADS,
   PROP_ACTIVE_THREADS
 };
@@ -115,6 +132,27 @@ gegl_stats_class_init (GeglStatsClass *klass)
                                                      0, G_MAXINT, 0,
                                                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_TILE_CACHE_HIT_RATE,
+                                   g_param_spec_double ("tile-cache-hit-rate",
+                                                        "Tile Cache hit rate",
+                                                        "Ratio of tile cache hits to tile cache lookups",
+                                                        0.0, 1.0, 0.0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_TILE_CACHE_SPARED,
+                                   g_param_spec_int ("tile-cache-spared",
+                                                     "Tile Cache spared tiles",
+                                                     "Number of times a tile was kept in the tile cache because of its compute cost",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_TILE_CACHE_TIME_SAVED,
+                                   g_param_spec_double ("tile-cache-time-saved",
+                                                        "Tile Cache time saved",
+                                                        "Estimated compute time of the tiles found in the tile cache, in seconds",
+                                                        0.0, G_MAXDOUBLE, 0.0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_SWAP_TOTAL,
                                    g_param_spec_uint64 ("swap-total",
                                                         "Swap total size",
@@ -197,6 +235,48 @@ gegl_stats_class_init (GeglStatsClass *klass)
                                                         0, G_MAXUINT64, 0,
                                                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_SWAP_DEDUP_HITS,
+                                   g_param_spec_int ("swap-dedup-hits",
+                                                     "Swap deduplication hits",
+                                                     "Number of tiles stored in the swap by sharing identical data",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SWAP_DEDUP_TOTAL,
+                                   g_param_spec_uint64 ("swap-dedup-total",
+                                                        "Swap deduplication total",
+                                                        "Total size of the tile data currently shared in the swap",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SWAP_RAM_TOTAL,
+                                   g_param_spec_uint64 ("swap-ram-total",
+                                                        "Swap RAM total",
+                                                        "Total size of the compressed data the swap holds in memory",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SWAP_RAM_HITS,
+                                   g_param_spec_int ("swap-ram-hits",
+                                                     "Swap RAM hits",
+                                                     "Number of tiles read from the compressed data the swap holds in memory",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SWAP_DISK_HITS,
+                                   g_param_spec_int ("swap-disk-hits",
+                                                     "Swap disk hits",
+                                                     "Number of tiles read from the swap file",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_FILE_DEDUP_TOTAL,
+                                   g_param_spec_uint64 ("file-dedup-total",
+                                                        "File deduplication total",
+                                                        "Total size of the tile data currently shared in buffer files",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_ZOOM_TOTAL,
                                    g_param_spec_uint64 ("zoom-total",
                                                         "Zoom total",
@@ -211,6 +291,20 @@ gegl_stats_class_init (GeglStatsClass *klass)
                                                         0, G_MAXUINT64, 0,
                                                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_TILE_ALLOC_HUGE_PAGES_TOTAL,
+                                   g_param_spec_uint64 ("tile-alloc-huge-pages-total",
+                                                        "Tile allocator huge pages total",
+                                                        "Total size of tile-allocator memory backed by huge pages",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_TILE_ALLOC_NUMA_NODES,
+                                   g_param_spec_int ("tile-alloc-numa-nodes",
+                                                     "Tile allocator NUMA nodes",
+                                                     "Number of NUMA nodes the tile allocator keeps separate pools for",
+                                                     1, G_MAXINT, 1,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_SCRATCH_TOTAL,
                                    g_param_spec_uint64 ("scratch-total",
                                                         "Scratch total",
@@ -218,6 +312,28 @@ gegl_stats_class_init (GeglStatsClass *klass)
                                                         0, G_MAXUINT64, 0,
                                                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_ITERATOR_CONVERSIONS,
+                                   g_param_spec_int ("iterator-conversions",
+                                                     "Iterator conversions",
+                                                     "Number of format conversions performed by buffer iterators",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_ITERATOR_CONVERSIONS_CACHED,
+                                   g_param_spec_int ("iterator-conversions-cached",
+                                                     "Iterator cached conversions",
+                                                     "Number of format conversions avoided by buffer iterators, "
+                                                     "by reusing previously converted tile data",
+                                                     0, G_MAXINT, 0,
+                                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_TILE_VIEW_TOTAL,
+                                   g_param_spec_uint64 ("tile-view-total",
+                                                        "Tile view total",
+                                                        "Total size of converted tile data kept for reuse",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_ASSIGNED_THREADS,
                                    g_param_spec_int ("assigned-threads",
                                                      "Assigned threads",
@@ -280,6 +396,25 @@ gegl_stats_get_property (GObject    *object,
         g_value_set_int (value, gegl_tile_handler_cache_get_misses ());
         break;
 
+      case PROP_TILE_CACHE_HIT_RATE:
+        {
+          gint hits   = gegl_tile_handler_cache_get_hits ();
+          gint misses = gegl_tile_handler_cache_get_misses ();
+
+          g_value_set_double (value,
+                              hits + misses ?
+                                (gdouble) hits / (hits + misses) : 0.0);
+        }
+        break;
+
+      case PROP_TILE_CACHE_SPARED:
+        g_value_set_int (value, gegl_tile_handler_cache_get_spared ());
+        break;
+
+      case PROP_TILE_CACHE_TIME_SAVED:
+        g_value_set_double (value, gegl_tile_handler_cache_get_time_saved ());
+        break;
+
       case PROP_SWAP_TOTAL:
         g_value_set_uint64 (value, gegl_tile_backend_swap_get_total ());
         break;
@@ -324,6 +459,30 @@ gegl_stats_get_property (GObject    *object,
         g_value_set_uint64 (value, gegl_tile_backend_swap_get_write_total ());
         break;
 
+      case PROP_SWAP_DEDUP_HITS:
+        g_value_set_int (value, gegl_tile_backend_swap_get_dedup_hits ());
+        break;
+
+      case PROP_SWAP_DEDUP_TOTAL:
+        g_value_set_uint64 (value, gegl_tile_backend_swap_get_dedup_total ());
+        break;
+
+      case PROP_SWAP_RAM_TOTAL:
+        g_value_set_uint64 (value, gegl_tile_backend_swap_get_ram_total ());
+        break;
+
+      case PROP_SWAP_RAM_HITS:
+        g_value_set_int (value, gegl_tile_backend_swap_get_ram_hits ());
+        break;
+
+      case PROP_SWAP_DISK_HITS:
+        g_value_set_int (value, gegl_tile_backend_swap_get_disk_hits ());
+        break;
+
+      case PROP_FILE_DEDUP_TOTAL:
+        g_value_set_uint64 (value, gegl_tile_backend_file_get_dedup_total ());
+        break;
+
       case PROP_ZOOM_TOTAL:
         g_value_set_uint64 (value, gegl_tile_handler_zoom_get_total ());
         break;
@@ -332,10 +491,30 @@ gegl_stats_get_property (GObject    *object,
         g_value_set_uint64 (value, gegl_tile_alloc_get_total ());
         break;
 
+      case PROP_TILE_ALLOC_HUGE_PAGES_TOTAL:
+        g_value_set_uint64 (value, gegl_tile_alloc_get_huge_pages_total ());
+        break;
+
+      case PROP_TILE_ALLOC_NUMA_NODES:
+        g_value_set_int (value, gegl_tile_alloc_get_n_nodes ());
+        break;
+
       case PROP_SCRATCH_TOTAL:
         g_value_set_uint64 (value, gegl_scratch_get_total ());
         break;
 
+      case PROP_ITERATOR_CONVERSIONS:
+        g_value_set_int (value, gegl_buffer_iterator_get_conversions ());
+        break;
+
+      case PROP_ITERATOR_CONVERSIONS_CACHED:
+        g_value_set_int (value, gegl_buffer_iterator_get_conversions_cached ());
+        break;
+
+      case PROP_TILE_VIEW_TOTAL:
+        g_value_set_uint64 (value, gegl_tile_view_get_total ());
+        break;
+
       case PROP_ASSIGNED_THREADS:
         g_value_set_int (value, gegl_parallel_get_n_assigned_worker_threads ());
         break;
@@ -356,4 +535,5 @@ gegl_stats_reset (GeglStats *stats)
   gegl_tile_handler_cache_reset_stats ();
   gegl_tile_backend_swap_reset_stats ();
   gegl_tile_handler_zoom_reset_stats ();
+  gegl_buffer_iterator_reset_stats ();
 }
@@ -0,0 +1,517 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-summed-area-table.h"
+
+#define TILE_SHIFT    7
+#define TILE_SIZE     (1 << TILE_SHIFT)
+#define TILE_MASK     (TILE_SIZE - 1)
+
+/* the cost of a thread, relative to computing a tile */
+#define THREAD_COST   0.25
+
+#define CACHE_KEY     "gegl-summed-area-table"
+#define CONNECTED_KEY "gegl-summed-area-table-connected"
+
+/* the tile at column i and row j of the table holds, for every pixel
+ * (x, y) it covers, the sums of the pixels of the area left of and above it
+ * (inclusively), that is S (x + 1, y + 1), with
+ *
+ *   S (X, Y) = sum of the pixels in [area.x, X) x [area.y, Y)
+ *
+ * tiles are computed from their left, upper and upper-left neighbors, so
+ * computing a tile computes the tiles up and left of it first, one
+ * anti-diagonal at a time, and the tiles of a diagonal in parallel.
+ */
+struct _GeglSummedAreaTable
+{
+  gint            ref_count;
+
+  GeglBuffer     *buffer;
+  GeglRectangle   area;
+  const Babl     *format;
+  gint            n_components;
+  gint            n_sums;       /* n_components, twice with squares */
+
+  gint            n_tiles_x;
+  gint            n_tiles_y;
+  gdouble       **tiles;
+
+  GMutex          mutex;
+};
+
+typedef struct
+{
+  GeglSummedAreaTable *table;
+  gint                 diagonal;
+  gint                 first;    /* the column of the first tile */
+} DiagonalData;
+
+static GMutex cache_mutex;
+
+
+GeglSummedAreaTable *
+gegl_summed_area_table_new (GeglBuffer          *buffer,
+                            const GeglRectangle *area,
+                            const Babl          *format,
+                            gboolean             with_squares)
+{
+  GeglSummedAreaTable *table;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (babl_format_get_type (format, 0) == babl_type ("float"),
+                        NULL);
+
+  table = g_slice_new0 (GeglSummedAreaTable);
+
+  table->ref_count    = 1;
+  table->area         = area ? *area : *gegl_buffer_get_extent (buffer);
+  table->format       = format;
+  table->n_components = babl_format_get_n_components (format);
+  table->n_sums       = table->n_components * (with_squares ? 2 : 1);
+
+  if (gegl_rectangle_is_empty (&table->area))
+    table->area.width = table->area.height = 0;
+
+  /* the tiles are computed lazily, from a snapshot of the area, whose tiles
+   * are copy-on-write clones of the tiles of @buffer when they are aligned.
+   */
+  table->buffer = gegl_buffer_new (&table->area,
+                                   gegl_buffer_get_format (buffer));
+  gegl_buffer_copy (buffer, &table->area, GEGL_ABYSS_NONE,
+                    table->buffer, &table->area);
+
+  table->n_tiles_x = (table->area.width  + TILE_MASK) >> TILE_SHIFT;
+  table->n_tiles_y = (table->area.height + TILE_MASK) >> TILE_SHIFT;
+  table->tiles     = g_new0 (gdouble *, table->n_tiles_x * table->n_tiles_y);
+
+  g_mutex_init (&table->mutex);
+
+  return table;
+}
+
+GeglSummedAreaTable *
+gegl_summed_area_table_ref (GeglSummedAreaTable *table)
+{
+  g_return_val_if_fail (table != NULL, NULL);
+
+  g_atomic_int_inc (&table->ref_count);
+
+  return table;
+}
+
+void
+gegl_summed_area_table_unref (GeglSummedAreaTable *table)
+{
+  gint i;
+
+  g_return_if_fail (table != NULL);
+
+  if (! g_atomic_int_dec_and_test (&table->ref_count))
+    return;
+
+  for (i = 0; i < table->n_tiles_x * table->n_tiles_y; i++)
+    g_free (table->tiles[i]);
+
+  g_free (table->tiles);
+  g_object_unref (table->buffer);
+  g_mutex_clear (&table->mutex);
+
+  g_slice_free (GeglSummedAreaTable, table);
+}
+
+const GeglRectangle *
+gegl_summed_area_table_get_area (GeglSummedAreaTable *table)
+{
+  g_return_val_if_fail (table != NULL, NULL);
+
+  return &table->area;
+}
+
+gint
+gegl_summed_area_table_get_n_components (GeglSummedAreaTable *table)
+{
+  g_return_val_if_fail (table != NULL, 0);
+
+  return table->n_components;
+}
+
+static void
+buffer_changed (GeglBuffer          *buffer,
+                const GeglRectangle *rect,
+                gpointer             data)
+{
+  GeglSummedAreaTable *table;
+
+  g_mutex_lock (&cache_mutex);
+  table = g_object_steal_data (G_OBJECT (buffer), CACHE_KEY);
+  g_mutex_unlock (&cache_mutex);
+
+  if (table)
+    gegl_summed_area_table_unref (table);
+}
+
+GeglSummedAreaTable *
+gegl_buffer_get_summed_area_table (GeglBuffer *buffer,
+                                   const Babl *format,
+                                   gboolean    with_squares)
+{
+  GeglSummedAreaTable *table;
+  GeglSummedAreaTable *old_table = NULL;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+
+  g_mutex_lock (&cache_mutex);
+
+  if (! g_object_get_data (G_OBJECT (buffer), CONNECTED_KEY))
+    {
+      gegl_buffer_signal_connect (buffer, "changed",
+                                  G_CALLBACK (buffer_changed), NULL);
+      g_object_set_data (G_OBJECT (buffer), CONNECTED_KEY,
+                         GINT_TO_POINTER (TRUE));
+    }
+
+  table = g_object_get_data (G_OBJECT (buffer), CACHE_KEY);
+
+  if (table &&
+      (table->format != format ||
+       (with_squares && table->n_sums == table->n_components) ||
+       ! gegl_rectangle_equal (&table->area,
+                               gegl_buffer_get_extent (buffer))))
+    {
+      old_table = g_object_steal_data (G_OBJECT (buffer), CACHE_KEY);
+      table     = NULL;
+    }
+
+  if (! table)
+    {
+      table = gegl_summed_area_table_new (buffer, NULL, format, with_squares);
+
+      if (table)
+        g_object_set_data_full (G_OBJECT (buffer), CACHE_KEY, table,
+                                (GDestroyNotify) gegl_summed_area_table_unref);
+    }
+
+  if (table)
+    gegl_summed_area_table_ref (table);
+
+  g_mutex_unlock (&cache_mutex);
+
+  if (old_table)
+    gegl_summed_area_table_unref (old_table);
+
+  return table;
+}
+
+static inline gint
+tile_width (GeglSummedAreaTable *table,
+            gint                 i)
+{
+  return MIN (TILE_SIZE, table->area.width - (i << TILE_SHIFT));
+}
+
+static inline gint
+tile_height (GeglSummedAreaTable *table,
+             gint                 j)
+{
+  return MIN (TILE_SIZE, table->area.height - (j << TILE_SHIFT));
+}
+
+static void
+compute_tile (GeglSummedAreaTable *table,
+              gint                 i,
+              gint                 j)
+{
+  gint           n_components = table->n_components;
+  gint           n_sums       = table->n_sums;
+  gint           width        = tile_width (table, i);
+  gint           height       = tile_height (table, j);
+  gdouble      **tiles        = table->tiles;
+  const gdouble *left         = NULL;
+  const gdouble *up           = NULL;
+  const gdouble *corner       = NULL;
+  GeglRectangle  rect;
+  gfloat        *pixels;
+  gdouble       *tile;
+  gdouble       *row_sum      = g_newa (gdouble, n_sums);
+  gint           x, y, k;
+
+  /* the last column of the left tile, the last row of the upper tile, and
+   * the last pixel of the upper-left tile, all of which are full tiles.
+   */
+  if (i > 0)
+    left = tiles[j * table->n_tiles_x + i - 1] + (TILE_SIZE - 1) * n_sums;
+  if (j > 0)
+    up = tiles[(j - 1) * table->n_tiles_x + i] +
+         (TILE_SIZE - 1) * width * n_sums;
+  if (i > 0 && j > 0)
+    corner = tiles[(j - 1) * table->n_tiles_x + i - 1] +
+             (TILE_SIZE * TILE_SIZE - 1) * n_sums;
+
+  rect.x      = table->area.x + (i << TILE_SHIFT);
+  rect.y      = table->area.y + (j << TILE_SHIFT);
+  rect.width  = width;
+  rect.height = height;
+
+  pixels = g_new (gfloat, width * height * n_components);
+  tile   = g_new (gdouble, width * height * n_sums);
+
+  gegl_buffer_get (table->buffer, &rect, 1.0, table->format, pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (y = 0; y < height; y++)
+    {
+      const gfloat  *src   = pixels + y * width * n_components;
+      gdouble       *dst   = tile + y * width * n_sums;
+      const gdouble *above = y ? dst - width * n_sums : up;
+
+      /* start the row with the sums of the pixels of the row left of the
+       * tile, S (x0, y + 1) - S (x0, y)
+       */
+      for (k = 0; k < n_sums; k++)
+        {
+          if (left)
+            row_sum[k] = left[y * TILE_SIZE * n_sums + k] -
+                         (y ? left[(y - 1) * TILE_SIZE * n_sums + k] :
+                              (corner ? corner[k] : 0.0));
+          else
+            row_sum[k] = 0.0;
+        }
+
+      for (x = 0; x < width; x++)
+        {
+          for (k = 0; k < n_components; k++)
+            row_sum[k] += src[k];
+
+          if (n_sums > n_components)
+            {
+              for (k = 0; k < n_components; k++)
+                row_sum[n_components + k] += (gdouble) src[k] * src[k];
+            }
+
+          for (k = 0; k < n_sums; k++)
+            dst[k] = row_sum[k] + (above ? above[k] : 0.0);
+
+          src += n_components;
+          dst += n_sums;
+
+          if (above)
+            above += n_sums;
+        }
+    }
+
+  g_free (pixels);
+
+  g_atomic_pointer_set (&tiles[j * table->n_tiles_x + i], tile);
+}
+
+static void
+compute_diagonal (gsize         offset,
+                  gsize         size,
+                  DiagonalData *data)
+{
+  gint i;
+
+  for (i = data->first + offset; i < data->first + (gint) (offset + size); i++)
+    {
+      gint j = data->diagonal - i;
+
+      if (! data->table->tiles[j * data->table->n_tiles_x + i])
+        compute_tile (data->table, i, j);
+    }
+}
+
+static const gdouble *
+get_tile (GeglSummedAreaTable *table,
+          gint                 i,
+          gint                 j)
+{
+  gdouble *tile;
+
+  tile = g_atomic_pointer_get (&table->tiles[j * table->n_tiles_x + i]);
+
+  if (G_UNLIKELY (! tile))
+    {
+      g_mutex_lock (&table->mutex);
+
+      if (! table->tiles[j * table->n_tiles_x + i])
+        {
+          DiagonalData data;
+
+          data.table = table;
+
+          for (data.diagonal = 0; data.diagonal <= i + j; data.diagonal++)
+            {
+              gint first = MAX (0, data.diagonal - j);
+              gint last  = MIN (i, data.diagonal);
+
+              data.first = first;
+
+              gegl_parallel_distribute_range (
+                last - first + 1, THREAD_COST,
+                (GeglParallelDistributeRangeFunc) compute_diagonal,
+                &data);
+            }
+        }
+
+      tile = table->tiles[j * table->n_tiles_x + i];
+
+      g_mutex_unlock (&table->mutex);
+    }
+
+  return tile;
+}
+
+/* returns S (x, y), or NULL where it is 0 */
+static inline const gdouble *
+get_corner (GeglSummedAreaTable *table,
+            gint                 x,
+            gint                 y)
+{
+  const gdouble *tile;
+  gint           i, j;
+
+  x -= table->area.x + 1;
+  y -= table->area.y + 1;
+
+  if (x < 0 || y < 0)
+    return NULL;
+
+  i = x >> TILE_SHIFT;
+  j = y >> TILE_SHIFT;
+
+  tile = get_tile (table, i, j);
+
+  return tile + (((y & TILE_MASK) * tile_width (table, i)) + (x & TILE_MASK)) *
+                table->n_sums;
+}
+
+static gint64
+get_sums (GeglSummedAreaTable *table,
+          const GeglRectangle *rect,
+          gint                 n,
+          gdouble             *sum)
+{
+  GeglRectangle  r;
+  const gdouble *a, *b, *c, *d;
+  gint           k;
+
+  if (! gegl_rectangle_intersect (&r, rect, &table->area))
+    {
+      memset (sum, 0, n * sizeof (gdouble));
+
+      return 0;
+    }
+
+  a = get_corner (table, r.x + r.width, r.y + r.height);
+  b = get_corner (table, r.x,           r.y + r.height);
+  c = get_corner (table, r.x + r.width, r.y);
+  d = get_corner (table, r.x,           r.y);
+
+  for (k = 0; k < n; k++)
+    {
+      gdouble value = a[k];
+
+      if (b)
+        value -= b[k];
+      if (c)
+        value -= c[k];
+      if (d)
+        value += d[k];
+
+      sum[k] = value;
+    }
+
+  return (gint64) r.width * r.height;
+}
+
+gint64
+gegl_summed_area_table_get_sum (GeglSummedAreaTable *table,
+                                const GeglRectangle *rect,
+                                gdouble             *sum)
+{
+  g_return_val_if_fail (table != NULL, 0);
+  g_return_val_if_fail (rect != NULL, 0);
+  g_return_val_if_fail (sum != NULL, 0);
+
+  return get_sums (table, rect, table->n_sums, sum);
+}
+
+gint64
+gegl_summed_area_table_get_mean (GeglSummedAreaTable *table,
+                                 const GeglRectangle *rect,
+                                 gdouble             *mean)
+{
+  gint64 n_pixels;
+  gint   k;
+
+  g_return_val_if_fail (table != NULL, 0);
+  g_return_val_if_fail (rect != NULL, 0);
+  g_return_val_if_fail (mean != NULL, 0);
+
+  n_pixels = get_sums (table, rect, table->n_components, mean);
+
+  if (n_pixels)
+    {
+      for (k = 0; k < table->n_components; k++)
+        mean[k] /= n_pixels;
+    }
+
+  return n_pixels;
+}
+
+gint64
+gegl_summed_area_table_get_variance (GeglSummedAreaTable *table,
+                                     const GeglRectangle *rect,
+                                     gdouble             *mean,
+                                     gdouble             *variance)
+{
+  gint     n_components;
+  gdouble *sums;
+  gint64   n_pixels;
+  gint     k;
+
+  g_return_val_if_fail (table != NULL, 0);
+  g_return_val_if_fail (table->n_sums > table->n_components, 0);
+  g_return_val_if_fail (rect != NULL, 0);
+  g_return_val_if_fail (variance != NULL, 0);
+
+  n_components = table->n_components;
+  sums         = g_newa (gdouble, 2 * n_components);
+  n_pixels     = get_sums (table, rect, 2 * n_components, sums);
+
+  for (k = 0; k < n_components; k++)
+    {
+      gdouble m = n_pixels ? sums[k] / n_pixels : 0.0;
+      gdouble v = n_pixels ? sums[n_components + k] / n_pixels - m * m : 0.0;
+
+      if (mean)
+        mean[k] = m;
+
+      variance[k] = MAX (v, 0.0);
+    }
+
+  return n_pixels;
+}
@@ -0,0 +1,145 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_SUMMED_AREA_TABLE_H__
+#define __GEGL_SUMMED_AREA_TABLE_H__
+
+G_BEGIN_DECLS
+
+/***
+ * GeglSummedAreaTable:
+ *
+ * A #GeglSummedAreaTable (integral image) of an area of a buffer gives the
+ * sum, mean and variance of the pixels of any rectangle in constant time,
+ * independently of the size of the rectangle, for use by operations
+ * computing box statistics.
+ *
+ * The sums are kept in double precision, in tiles which are computed the
+ * first time a rectangle touching them is queried; querying is thread-safe.
+ * The table reads a copy-on-write snapshot of the buffer, and isn't
+ * affected by later changes to it.
+ */
+
+typedef struct _GeglSummedAreaTable GeglSummedAreaTable;
+
+/**
+ * gegl_summed_area_table_new: (skip)
+ * @buffer: the buffer to sum
+ * @area: the area of @buffer covered by the table, or %NULL for its extent
+ * @format: a format with float components, used for reading @buffer; every
+ * component is summed separately
+ * @with_squares: whether to sum the squares of the components as well,
+ * which gegl_summed_area_table_get_variance() needs
+ *
+ * Return value: a new #GeglSummedAreaTable, free with
+ * gegl_summed_area_table_unref().
+ */
+GeglSummedAreaTable * gegl_summed_area_table_new            (GeglBuffer          *buffer,
+                                                             const GeglRectangle *area,
+                                                             const Babl          *format,
+                                                             gboolean             with_squares);
+
+/**
+ * gegl_buffer_get_summed_area_table: (skip)
+ * @buffer: a #GeglBuffer
+ * @format: a format with float components
+ * @with_squares: whether the squares of the components are needed
+ *
+ * Returns the summed area table of the extent of @buffer attached to it,
+ * creating it if needed.  The attached table is dropped whenever @buffer
+ * is changed, so that the next call returns a table of the new content,
+ * and its tiles are shared by every user of @buffer in the meantime.
+ *
+ * Return value: a reference to the #GeglSummedAreaTable, release it with
+ * gegl_summed_area_table_unref().
+ */
+GeglSummedAreaTable * gegl_buffer_get_summed_area_table     (GeglBuffer          *buffer,
+                                                             const Babl          *format,
+                                                             gboolean             with_squares);
+
+/**
+ * gegl_summed_area_table_ref: (skip)
+ * @table: a #GeglSummedAreaTable
+ *
+ * Return value: @table
+ */
+GeglSummedAreaTable * gegl_summed_area_table_ref            (GeglSummedAreaTable *table);
+
+/**
+ * gegl_summed_area_table_unref: (skip)
+ * @table: a #GeglSummedAreaTable
+ */
+void                  gegl_summed_area_table_unref          (GeglSummedAreaTable *table);
+
+/**
+ * gegl_summed_area_table_get_area: (skip)
+ * @table: a #GeglSummedAreaTable
+ *
+ * Return value: the area of the buffer covered by @table
+ */
+const GeglRectangle * gegl_summed_area_table_get_area       (GeglSummedAreaTable *table);
+
+/**
+ * gegl_summed_area_table_get_n_components: (skip)
+ * @table: a #GeglSummedAreaTable
+ *
+ * Return value: the number of components of the format of @table, which is
+ * the number of means and variances returned by the queries
+ */
+gint                  gegl_summed_area_table_get_n_components (GeglSummedAreaTable *table);
+
+/**
+ * gegl_summed_area_table_get_sum: (skip)
+ * @table: a #GeglSummedAreaTable
+ * @rect: the rectangle to sum, it is clipped to the area of @table
+ * @sum: (out): the sums of the components, followed by the sums of their
+ * squares when @table was created with squares
+ *
+ * Return value: the number of pixels summed
+ */
+gint64                gegl_summed_area_table_get_sum        (GeglSummedAreaTable *table,
+                                                             const GeglRectangle *rect,
+                                                             gdouble             *sum);
+
+/**
+ * gegl_summed_area_table_get_mean: (skip)
+ * @table: a #GeglSummedAreaTable
+ * @rect: the rectangle to average, it is clipped to the area of @table
+ * @mean: (out): the means of the components, 0 when no pixel is averaged
+ *
+ * Return value: the number of pixels averaged
+ */
+gint64                gegl_summed_area_table_get_mean       (GeglSummedAreaTable *table,
+                                                             const GeglRectangle *rect,
+                                                             gdouble             *mean);
+
+/**
+ * gegl_summed_area_table_get_variance: (skip)
+ * @table: a #GeglSummedAreaTable, created with squares
+ * @rect: the rectangle, it is clipped to the area of @table
+ * @mean: (out) (optional): the means of the components
+ * @variance: (out): the (population) variances of the components
+ *
+ * Return value: the number of pixels the statistics are computed from
+ */
+gint64                gegl_summed_area_table_get_variance   (GeglSummedAreaTable *table,
+                                                             const GeglRectangle *rect,
+                                                             gdouble             *mean,
+                                                             gdouble             *variance);
+
+G_END_DECLS
+
+#endif  /* __GEGL_SUMMED_AREA_TABLE_H__ */
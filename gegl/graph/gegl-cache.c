@@ -27,7 +27,7 @@
 
 #include "gegl-types-internal.h"
 #include "gegl-cache.h"
-#include "gegl-region.h"
+#include "gegl-tile-mask.h"
 #include "gegl-buffer.h" /* for GeglRectangle XXX ... */
 
 enum
@@ -70,40 +70,7 @@ gegl_cache_constructed (GObject *object)
   G_OBJECT_CLASS (gegl_cache_parent_class)->constructed (object);
 
   for (i = 0; i < GEGL_CACHE_VALID_MIPMAPS; i++)
-    self->valid_region[i] = gegl_region_new ();
-}
-
-/* expand invalidated regions to be align with coordinates divisible by 8 in both
- * directions. This improves improves the performance of GeglProcessor when it
- * iterates the resulting dirtied rectangles in the GeglRegion.
- */
-static GeglRectangle gegl_rectangle_expand (const GeglRectangle *rectangle)
-{
-  gint align = 8;
-  GeglRectangle expanded = *rectangle;
-  gint xdiff;
-  gint ydiff;
-
-  if (gegl_rectangle_is_infinite_plane (rectangle))
-    return *rectangle;
-
-  xdiff = expanded.x % align;
-  if (xdiff < 0)
-    xdiff = align + xdiff;
-  expanded.width += xdiff;
-  expanded.x -= xdiff;
-  xdiff = align -(expanded.width % align);
-  expanded.width += xdiff;
-
-  ydiff = expanded.y % align;
-  if (ydiff < 0)
-    ydiff = align + ydiff;
-  expanded.height += ydiff;
-  expanded.y -= ydiff;
-  ydiff = align -(expanded.height % align);
-  expanded.height += ydiff;
-
-  return expanded;
+    self->valid_mask[i] = gegl_tile_mask_new ();
 }
 
 static void
@@ -190,8 +157,8 @@ finalize (GObject *gobject)
 
   g_mutex_clear (&self->mutex);
   for (i = 0; i < GEGL_CACHE_VALID_MIPMAPS; i++)
-    if (self->valid_region[i])
-      gegl_region_destroy (self->valid_region[i]);
+    if (self->valid_mask[i])
+      gegl_tile_mask_free (self->valid_mask[i]);
   G_OBJECT_CLASS (gegl_cache_parent_class)->finalize (gobject);
 }
 
@@ -256,6 +223,11 @@ get_property (GObject    *gobject,
     }
 }
 
+/* the valid masks are tile-granular, invalidating a rectangle clears all
+ * the cells it touches, and is proportional to the number of cells (or the
+ * number of stored blocks, for huge rectangles), regardless of how
+ * fragmented the valid area has become.
+ */
 void
 gegl_cache_invalidate (GeglCache           *self,
                        const GeglRectangle *roi)
@@ -264,16 +236,10 @@ gegl_cache_invalidate (GeglCache           *self,
 
   if (roi)
     {
-      GeglRectangle expanded = gegl_rectangle_expand (roi);
-
-      GeglRegion *temp_region;
-      temp_region = gegl_region_rectangle (&expanded);
-
       g_mutex_lock (&self->mutex);
       for (i = 0; i < GEGL_CACHE_VALID_MIPMAPS; i++)
-        gegl_region_subtract (self->valid_region[i], temp_region);
+        gegl_tile_mask_remove_rect (self->valid_mask[i], roi);
       g_mutex_unlock (&self->mutex);
-      gegl_region_destroy (temp_region);
       g_signal_emit (self, gegl_cache_signals[INVALIDATED], 0,
                      roi, NULL);
     }
@@ -282,33 +248,200 @@ gegl_cache_invalidate (GeglCache           *self,
       GeglRectangle rect = { 0, 0, 0, 0 }; /* should probably be the extent of the cache */
       g_mutex_lock (&self->mutex);
       for (i = 0; i < GEGL_CACHE_VALID_MIPMAPS; i++)
-      {
-        if (self->valid_region[i])
-          gegl_region_destroy (self->valid_region[i]);
-        self->valid_region[i] = gegl_region_new ();
-      }
+        gegl_tile_mask_clear (self->valid_mask[i]);
       g_mutex_unlock (&self->mutex);
       g_signal_emit (self, gegl_cache_signals[INVALIDATED], 0,
                      &rect, NULL);
     }
 }
 
+/* the extent of the cache at @level, which covers every pixel of the
+ * level depending on a pixel of the extent
+ */
+static void
+gegl_cache_get_level_extent (GeglCache     *self,
+                             gint           level,
+                             GeglRectangle *level_extent)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (GEGL_BUFFER (self));
+  gint64               scale  = (gint64) 1 << level;
+  gint64               x0, y0, x1, y1;
+
+  x0 = extent->x;
+  y0 = extent->y;
+  x1 = (gint64) extent->x + extent->width;
+  y1 = (gint64) extent->y + extent->height;
+
+  /* round outwards */
+  x0 = x0 >= 0 ? x0 / scale : -((-x0 + scale - 1) / scale);
+  y0 = y0 >= 0 ? y0 / scale : -((-y0 + scale - 1) / scale);
+  x1 = x1 >= 0 ? (x1 + scale - 1) / scale : -(-x1 / scale);
+  y1 = y1 >= 0 ? (y1 + scale - 1) / scale : -(-y1 / scale);
+
+  level_extent->x      = x0;
+  level_extent->y      = y0;
+  level_extent->width  = x1 - x0;
+  level_extent->height = y1 - y0;
+}
+
+/* pixels outside the extent of the cache are never computed, and always
+ * read as abyss; @rect is clipped to the extent, and its edges lying on the
+ * extent are moved out to the cell grid, so that cells straddling the
+ * extent can become valid.  returns FALSE if @rect is outside the extent.
+ */
+static gboolean
+gegl_cache_snap_to_extent (GeglCache           *self,
+                           const GeglRectangle *rect,
+                           gint                 level,
+                           GeglRectangle       *snapped)
+{
+  GeglRectangle extent;
+  GeglRectangle clipped;
+  GeglRectangle aligned;
+  gint          x0, y0, x1, y1;
+
+  gegl_cache_get_level_extent (self, level, &extent);
+
+  /* never let a huge, or infinite, rectangle populate the mask beyond
+   * the extent
+   */
+  if (! gegl_rectangle_intersect (&clipped, rect, &extent))
+    return FALSE;
+
+  rect = &clipped;
+
+  gegl_tile_mask_align_rect (rect, &aligned);
+
+  x0 = rect->x;
+  y0 = rect->y;
+  x1 = rect->x + rect->width;
+  y1 = rect->y + rect->height;
+
+  if (x0 <= extent.x)
+    x0 = aligned.x;
+  if (y0 <= extent.y)
+    y0 = aligned.y;
+  if (x1 >= extent.x + extent.width)
+    x1 = aligned.x + aligned.width;
+  if (y1 >= extent.y + extent.height)
+    y1 = aligned.y + aligned.height;
+
+  snapped->x      = x0;
+  snapped->y      = y0;
+  snapped->width  = x1 - x0;
+  snapped->height = y1 - y0;
+
+  return TRUE;
+}
+
 void
 gegl_cache_computed (GeglCache           *self,
                      const GeglRectangle *rect,
                      gint                 level)
 {
+  GeglRectangle snapped;
+
+  g_return_if_fail (GEGL_IS_CACHE (self));
+  g_return_if_fail (rect != NULL);
+
+  if (level >= 0 && level < GEGL_CACHE_VALID_MIPMAPS &&
+      gegl_cache_snap_to_extent (self, rect, level, &snapped))
+    {
+      g_mutex_lock (&self->mutex);
+      gegl_tile_mask_add_rect (self->valid_mask[level], &snapped);
+      g_mutex_unlock (&self->mutex);
+    }
+
+  g_signal_emit (self, gegl_cache_signals[COMPUTED], 0, rect, NULL);
+}
+
+void
+gegl_cache_discard (GeglCache           *self,
+                    const GeglRectangle *rect)
+{
+  gint i;
+
   g_return_if_fail (GEGL_IS_CACHE (self));
   g_return_if_fail (rect != NULL);
 
   g_mutex_lock (&self->mutex);
+  for (i = 0; i < GEGL_CACHE_VALID_MIPMAPS; i++)
+    gegl_tile_mask_remove_rect (self->valid_mask[i], rect);
+  g_mutex_unlock (&self->mutex);
+}
+
+gboolean
+gegl_cache_is_valid (GeglCache           *self,
+                     const GeglRectangle *rect,
+                     gint                 level)
+{
+  GeglRectangle extent;
+  GeglRectangle clipped;
+  gboolean      valid;
+
+  g_return_val_if_fail (GEGL_IS_CACHE (self), FALSE);
+  g_return_val_if_fail (rect != NULL, FALSE);
 
-  if (level < GEGL_CACHE_VALID_MIPMAPS)
-    gegl_region_union_with_rect (self->valid_region[level], rect);
+  if (level < 0 || level >= GEGL_CACHE_VALID_MIPMAPS)
+    return FALSE;
 
+  /* only the part of @rect inside the extent can ever be computed */
+  gegl_cache_get_level_extent (self, level, &extent);
+
+  if (! gegl_rectangle_intersect (&clipped, rect, &extent))
+    return FALSE;
+
+  g_mutex_lock (&self->mutex);
+  valid = gegl_tile_mask_rect_in (self->valid_mask[level], &clipped) ==
+          GEGL_OVERLAP_RECTANGLE_IN;
   g_mutex_unlock (&self->mutex);
 
-  g_signal_emit (self, gegl_cache_signals[COMPUTED], 0, rect, NULL);
+  return valid;
+}
+
+gint64
+gegl_cache_get_valid_area (GeglCache           *self,
+                           const GeglRectangle *rect,
+                           gint                 level)
+{
+  gint64 area;
+
+  g_return_val_if_fail (GEGL_IS_CACHE (self), 0);
+  g_return_val_if_fail (rect != NULL, 0);
+
+  if (level < 0 || level >= GEGL_CACHE_VALID_MIPMAPS)
+    return 0;
+
+  g_mutex_lock (&self->mutex);
+  area = gegl_tile_mask_get_area (self->valid_mask[level], rect);
+  g_mutex_unlock (&self->mutex);
+
+  return area;
+}
+
+/* stores a cell-aligned rectangle of coalesced invalid cells of @rect in
+ * @invalid_rect, returns FALSE if all of @rect is valid.
+ */
+gboolean
+gegl_cache_get_invalid_rect (GeglCache           *self,
+                             const GeglRectangle *rect,
+                             gint                 level,
+                             GeglRectangle       *invalid_rect)
+{
+  gboolean found;
+
+  g_return_val_if_fail (GEGL_IS_CACHE (self), FALSE);
+  g_return_val_if_fail (rect != NULL, FALSE);
+  g_return_val_if_fail (invalid_rect != NULL, FALSE);
+
+  level = CLAMP (level, 0, GEGL_CACHE_VALID_MIPMAPS - 1);
+
+  g_mutex_lock (&self->mutex);
+  found = gegl_tile_mask_get_unset_rect (self->valid_mask[level],
+                                         rect, invalid_rect);
+  g_mutex_unlock (&self->mutex);
+
+  return found;
 }
 
 gboolean
@@ -331,8 +464,10 @@ gegl_buffer_list_valid_rectangles (GeglBuffer     *buffer,
   if (level >= GEGL_CACHE_VALID_MIPMAPS)
     level = GEGL_CACHE_VALID_MIPMAPS-1;
 
-  gegl_region_get_rectangles (cache->valid_region[level],
-                              rectangles, n_rectangles);
+  g_mutex_lock (&cache->mutex);
+  gegl_tile_mask_get_rectangles (cache->valid_mask[level],
+                                 rectangles, n_rectangles);
+  g_mutex_unlock (&cache->mutex);
 
   return TRUE;
 }
@@ -23,6 +23,7 @@
 #include "gegl-types-internal.h"
 #include "gegl-buffer.h"
 #include "gegl-buffer-private.h"
+#include "gegl-tile-mask.h"
 
 G_BEGIN_DECLS
 
@@ -41,7 +42,7 @@ struct _GeglCache
 {
   GeglBuffer    parent_instance;
 
-  GeglRegion   *valid_region[GEGL_CACHE_VALID_MIPMAPS];
+  GeglTileMask *valid_mask[GEGL_CACHE_VALID_MIPMAPS];
   GMutex        mutex;
 };
 
@@ -56,6 +57,25 @@ void     gegl_cache_invalidate  (GeglCache           *self,
 void     gegl_cache_computed    (GeglCache           *self,
                                  const GeglRectangle *rect,
                                  gint                 level);
+/* drops the area of a cancelled computation from the valid masks, without
+ * signalling an invalidation; the graph itself didn't change.
+ */
+void     gegl_cache_discard     (GeglCache           *self,
+                                 const GeglRectangle *rect);
+
+/* queries of the valid parts of the cache at a given mipmap level */
+gboolean gegl_cache_is_valid    (GeglCache           *self,
+                                 const GeglRectangle *rect,
+                                 gint                 level);
+gint64   gegl_cache_get_valid_area
+                                (GeglCache           *self,
+                                 const GeglRectangle *rect,
+                                 gint                 level);
+gboolean gegl_cache_get_invalid_rect
+                                (GeglCache           *self,
+                                 const GeglRectangle *rect,
+                                 gint                 level,
+                                 GeglRectangle       *invalid_rect);
 
 G_END_DECLS
 
@@ -1273,12 +1273,18 @@ gegl_node_blit (GeglNode            *self,
               gint  level = gegl_mipmap_rendering_enabled()?gegl_level_from_scale (scale):0;
 
               gegl_node_blit_buffer (self, buffer, &unscaled_roi, level, GEGL_ABYSS_NONE);
-              gegl_cache_computed (cache, &unscaled_roi, level);
+              if (gegl_parallel_is_cancelled ())
+                gegl_cache_discard (cache, &unscaled_roi);
+              else
+                gegl_cache_computed (cache, &unscaled_roi, level);
             }
           else
             {
               gegl_node_blit_buffer (self, buffer, roi, 0, GEGL_ABYSS_NONE);
-              gegl_cache_computed (cache, roi, 0);
+              if (gegl_parallel_is_cancelled ())
+                gegl_cache_discard (cache, roi);
+              else
+                gegl_cache_computed (cache, roi, 0);
             }
         }
 
@@ -0,0 +1,699 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl-types-internal.h"
+#include "gegl-buffer.h"
+#include "gegl-tile-mask.h"
+
+#define BLOCK_SHIFT 6
+#define BLOCK_SIZE  (1 << BLOCK_SHIFT) /* in cells, and in bits per row */
+
+/* upper bound, in cells, for the size of rectangles returned by
+ * gegl_tile_mask_get_unset_rect(), this keeps the cost of a query bounded
+ * even for huge, mostly unset, rectangles.
+ */
+#define MAX_UNSET_SPAN (8 * BLOCK_SIZE)
+
+typedef struct
+{
+  gint64  key;
+  gint    n_set;
+  guint64 rows[BLOCK_SIZE];
+} GeglTileMaskBlock;
+
+struct _GeglTileMask
+{
+  GHashTable *blocks;
+};
+
+/* returns TRUE if the block should be removed from the mask */
+typedef gboolean (* GeglTileMaskBlockFunc) (GeglTileMaskBlock *block,
+                                            gint64             bx,
+                                            gint64             by,
+                                            gint               lx0,
+                                            gint               ly0,
+                                            gint               lx1,
+                                            gint               ly1,
+                                            gpointer           data);
+
+static inline gint64
+floor_shift (gint64 value,
+             gint   shift)
+{
+  return value >= 0 ? value >> shift : -((-value - 1) >> shift) - 1;
+}
+
+static inline gint64
+ceil_shift (gint64 value,
+            gint   shift)
+{
+  return -floor_shift (-value, shift);
+}
+
+static inline gint64
+block_key (gint64 bx,
+           gint64 by)
+{
+  return (gint64) (((guint64) (guint32) bx << 32) | (guint32) by);
+}
+
+/* bits [first, last) set, with 0 <= first < last <= 64 */
+static inline guint64
+range_mask (gint first,
+            gint last)
+{
+  guint64 mask;
+
+  if (last - first == BLOCK_SIZE)
+    mask = ~(guint64) 0;
+  else
+    mask = ((guint64) 1 << (last - first)) - 1;
+
+  return mask << first;
+}
+
+static inline gint
+popcount64 (guint64 value)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll (value);
+#else
+  gint count = 0;
+
+  while (value)
+    {
+      value &= value - 1;
+      count++;
+    }
+
+  return count;
+#endif
+}
+
+static inline gint
+ctz64 (guint64 value)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll (value);
+#else
+  gint n = 0;
+
+  while (! (value & 1))
+    {
+      value >>= 1;
+      n++;
+    }
+
+  return n;
+#endif
+}
+
+static inline GeglTileMaskBlock *
+lookup_block (GeglTileMask *mask,
+              gint64        bx,
+              gint64        by)
+{
+  gint64 key = block_key (bx, by);
+
+  return g_hash_table_lookup (mask->blocks, &key);
+}
+
+/* the cells touched by a rectangle */
+static gboolean
+rect_to_cells_outer (const GeglRectangle *rect,
+                     gint64              *cx0,
+                     gint64              *cy0,
+                     gint64              *cx1,
+                     gint64              *cy1)
+{
+  if (rect->width <= 0 || rect->height <= 0)
+    return FALSE;
+
+  *cx0 = floor_shift (rect->x, GEGL_TILE_MASK_CELL_SHIFT);
+  *cy0 = floor_shift (rect->y, GEGL_TILE_MASK_CELL_SHIFT);
+  *cx1 = ceil_shift ((gint64) rect->x + rect->width,  GEGL_TILE_MASK_CELL_SHIFT);
+  *cy1 = ceil_shift ((gint64) rect->y + rect->height, GEGL_TILE_MASK_CELL_SHIFT);
+
+  return TRUE;
+}
+
+/* the cells entirely contained in a rectangle */
+static gboolean
+rect_to_cells_inner (const GeglRectangle *rect,
+                     gint64              *cx0,
+                     gint64              *cy0,
+                     gint64              *cx1,
+                     gint64              *cy1)
+{
+  if (rect->width <= 0 || rect->height <= 0)
+    return FALSE;
+
+  *cx0 = ceil_shift (rect->x, GEGL_TILE_MASK_CELL_SHIFT);
+  *cy0 = ceil_shift (rect->y, GEGL_TILE_MASK_CELL_SHIFT);
+  *cx1 = floor_shift ((gint64) rect->x + rect->width,  GEGL_TILE_MASK_CELL_SHIFT);
+  *cy1 = floor_shift ((gint64) rect->y + rect->height, GEGL_TILE_MASK_CELL_SHIFT);
+
+  return *cx1 > *cx0 && *cy1 > *cy0;
+}
+
+static void
+gegl_tile_mask_foreach_block (GeglTileMask          *mask,
+                              gint64                 cx0,
+                              gint64                 cy0,
+                              gint64                 cx1,
+                              gint64                 cy1,
+                              gboolean               create,
+                              GeglTileMaskBlockFunc  func,
+                              gpointer               data)
+{
+  gint64 bx0 = floor_shift (cx0,     BLOCK_SHIFT);
+  gint64 by0 = floor_shift (cy0,     BLOCK_SHIFT);
+  gint64 bx1 = floor_shift (cx1 - 1, BLOCK_SHIFT);
+  gint64 by1 = floor_shift (cy1 - 1, BLOCK_SHIFT);
+  gint64 bx;
+  gint64 by;
+
+  if (! create &&
+      (bx1 - bx0 + 1) * (by1 - by0 + 1) > g_hash_table_size (mask->blocks))
+    {
+      /* the range covers more blocks than are stored, visit the stored
+       * blocks instead, this keeps huge (or infinite) rectangles cheap.
+       */
+      GHashTableIter     iter;
+      GeglTileMaskBlock *block;
+
+      g_hash_table_iter_init (&iter, mask->blocks);
+
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &block))
+        {
+          gint64 kbx = (gint32) (((guint64) block->key) >> 32);
+          gint64 kby = (gint32) (((guint64) block->key) & 0xffffffff);
+          gint64 ox  = kbx * BLOCK_SIZE;
+          gint64 oy  = kby * BLOCK_SIZE;
+
+          if (kbx < bx0 || kbx > bx1 || kby < by0 || kby > by1)
+            continue;
+
+          if (func (block, kbx, kby,
+                    MAX (cx0 - ox, 0),          MAX (cy0 - oy, 0),
+                    MIN (cx1 - ox, BLOCK_SIZE), MIN (cy1 - oy, BLOCK_SIZE),
+                    data))
+            {
+              g_hash_table_iter_remove (&iter);
+            }
+        }
+
+      return;
+    }
+
+  for (by = by0; by <= by1; by++)
+    for (bx = bx0; bx <= bx1; bx++)
+      {
+        gint64             ox    = bx * BLOCK_SIZE;
+        gint64             oy    = by * BLOCK_SIZE;
+        GeglTileMaskBlock *block = lookup_block (mask, bx, by);
+
+        if (! block)
+          {
+            if (! create)
+              continue;
+
+            block      = g_new0 (GeglTileMaskBlock, 1);
+            block->key = block_key (bx, by);
+
+            g_hash_table_insert (mask->blocks, &block->key, block);
+          }
+
+        if (func (block, bx, by,
+                  MAX (cx0 - ox, 0),          MAX (cy0 - oy, 0),
+                  MIN (cx1 - ox, BLOCK_SIZE), MIN (cy1 - oy, BLOCK_SIZE),
+                  data))
+          {
+            g_hash_table_remove (mask->blocks, &block->key);
+          }
+      }
+}
+
+GeglTileMask *
+gegl_tile_mask_new (void)
+{
+  GeglTileMask *mask = g_slice_new (GeglTileMask);
+
+  mask->blocks = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                        NULL, g_free);
+
+  return mask;
+}
+
+void
+gegl_tile_mask_free (GeglTileMask *mask)
+{
+  g_return_if_fail (mask != NULL);
+
+  g_hash_table_unref (mask->blocks);
+
+  g_slice_free (GeglTileMask, mask);
+}
+
+void
+gegl_tile_mask_clear (GeglTileMask *mask)
+{
+  g_return_if_fail (mask != NULL);
+
+  g_hash_table_remove_all (mask->blocks);
+}
+
+gboolean
+gegl_tile_mask_is_empty (GeglTileMask *mask)
+{
+  g_return_val_if_fail (mask != NULL, TRUE);
+
+  return g_hash_table_size (mask->blocks) == 0;
+}
+
+static gboolean
+set_block_cells (GeglTileMaskBlock *block,
+                 gint64             bx,
+                 gint64             by,
+                 gint               lx0,
+                 gint               ly0,
+                 gint               lx1,
+                 gint               ly1,
+                 gpointer           data)
+{
+  guint64 bits = range_mask (lx0, lx1);
+  gint    ly;
+
+  for (ly = ly0; ly < ly1; ly++)
+    {
+      guint64 old_row = block->rows[ly];
+      guint64 new_row = old_row | bits;
+
+      block->n_set   += popcount64 (new_row) - popcount64 (old_row);
+      block->rows[ly] = new_row;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+clear_block_cells (GeglTileMaskBlock *block,
+                   gint64             bx,
+                   gint64             by,
+                   gint               lx0,
+                   gint               ly0,
+                   gint               lx1,
+                   gint               ly1,
+                   gpointer           data)
+{
+  guint64 bits = range_mask (lx0, lx1);
+  gint    ly;
+
+  if (lx0 == 0 && ly0 == 0 && lx1 == BLOCK_SIZE && ly1 == BLOCK_SIZE)
+    return TRUE;
+
+  for (ly = ly0; ly < ly1 && block->n_set; ly++)
+    {
+      guint64 old_row = block->rows[ly];
+      guint64 new_row = old_row & ~bits;
+
+      block->n_set   -= popcount64 (old_row) - popcount64 (new_row);
+      block->rows[ly] = new_row;
+    }
+
+  return block->n_set == 0;
+}
+
+void
+gegl_tile_mask_add_rect (GeglTileMask        *mask,
+                         const GeglRectangle *rect)
+{
+  gint64 cx0, cy0, cx1, cy1;
+
+  g_return_if_fail (mask != NULL);
+  g_return_if_fail (rect != NULL);
+
+  if (! rect_to_cells_inner (rect, &cx0, &cy0, &cx1, &cy1))
+    return;
+
+  gegl_tile_mask_foreach_block (mask, cx0, cy0, cx1, cy1, TRUE,
+                                set_block_cells, NULL);
+}
+
+void
+gegl_tile_mask_remove_rect (GeglTileMask        *mask,
+                            const GeglRectangle *rect)
+{
+  gint64 cx0, cy0, cx1, cy1;
+
+  g_return_if_fail (mask != NULL);
+  g_return_if_fail (rect != NULL);
+
+  if (! rect_to_cells_outer (rect, &cx0, &cy0, &cx1, &cy1))
+    return;
+
+  gegl_tile_mask_foreach_block (mask, cx0, cy0, cx1, cy1, FALSE,
+                                clear_block_cells, NULL);
+}
+
+static gboolean
+count_block_cells (GeglTileMaskBlock *block,
+                   gint64             bx,
+                   gint64             by,
+                   gint               lx0,
+                   gint               ly0,
+                   gint               lx1,
+                   gint               ly1,
+                   gpointer           data)
+{
+  gint64 *count = data;
+
+  if (lx0 == 0 && ly0 == 0 && lx1 == BLOCK_SIZE && ly1 == BLOCK_SIZE)
+    {
+      *count += block->n_set;
+    }
+  else
+    {
+      guint64 bits = range_mask (lx0, lx1);
+      gint    ly;
+
+      for (ly = ly0; ly < ly1; ly++)
+        *count += popcount64 (block->rows[ly] & bits);
+    }
+
+  return FALSE;
+}
+
+GeglOverlapType
+gegl_tile_mask_rect_in (GeglTileMask        *mask,
+                        const GeglRectangle *rect)
+{
+  gint64 cx0, cy0, cx1, cy1;
+  gint64 count = 0;
+
+  g_return_val_if_fail (mask != NULL, GEGL_OVERLAP_RECTANGLE_OUT);
+  g_return_val_if_fail (rect != NULL, GEGL_OVERLAP_RECTANGLE_OUT);
+
+  if (! rect_to_cells_outer (rect, &cx0, &cy0, &cx1, &cy1))
+    return GEGL_OVERLAP_RECTANGLE_OUT;
+
+  gegl_tile_mask_foreach_block (mask, cx0, cy0, cx1, cy1, FALSE,
+                                count_block_cells, &count);
+
+  if (count == 0)
+    return GEGL_OVERLAP_RECTANGLE_OUT;
+  else if (count == (cx1 - cx0) * (cy1 - cy0))
+    return GEGL_OVERLAP_RECTANGLE_IN;
+  else
+    return GEGL_OVERLAP_RECTANGLE_PART;
+}
+
+typedef struct
+{
+  gint64 x0, y0, x1, y1; /* pixel bounds */
+  gint64 cx0, cx1;       /* cell bounds  */
+  gint64 area;
+} AreaData;
+
+static gboolean
+area_block_cells (GeglTileMaskBlock *block,
+                  gint64             bx,
+                  gint64             by,
+                  gint               lx0,
+                  gint               ly0,
+                  gint               lx1,
+                  gint               ly1,
+                  gpointer           data)
+{
+  AreaData *area_data = data;
+  guint64   bits      = range_mask (lx0, lx1);
+  gint64    ox        = bx * BLOCK_SIZE;
+  gint64    oy        = by * BLOCK_SIZE;
+  gint      ly;
+
+  for (ly = ly0; ly < ly1; ly++)
+    {
+      guint64 row = block->rows[ly] & bits;
+      gint64  cell_y0;
+      gint64  width;
+
+      if (! row)
+        continue;
+
+      width = (gint64) popcount64 (row) * GEGL_TILE_MASK_CELL_SIZE;
+
+      /* partially covered cells at the left and right edge */
+      if (area_data->cx0 >= ox && area_data->cx0 < ox + BLOCK_SIZE &&
+          (row >> (area_data->cx0 - ox)) & 1)
+        {
+          width -= area_data->x0 -
+                   area_data->cx0 * GEGL_TILE_MASK_CELL_SIZE;
+        }
+      if (area_data->cx1 - 1 >= ox && area_data->cx1 - 1 < ox + BLOCK_SIZE &&
+          (row >> (area_data->cx1 - 1 - ox)) & 1)
+        {
+          width -= area_data->cx1 * GEGL_TILE_MASK_CELL_SIZE -
+                   area_data->x1;
+        }
+
+      cell_y0 = (oy + ly) * GEGL_TILE_MASK_CELL_SIZE;
+
+      area_data->area += width *
+                         (MIN (cell_y0 + GEGL_TILE_MASK_CELL_SIZE,
+                               area_data->y1) -
+                          MAX (cell_y0, area_data->y0));
+    }
+
+  return FALSE;
+}
+
+gint64
+gegl_tile_mask_get_area (GeglTileMask        *mask,
+                         const GeglRectangle *rect)
+{
+  AreaData area_data;
+  gint64   cy0, cy1;
+
+  g_return_val_if_fail (mask != NULL, 0);
+  g_return_val_if_fail (rect != NULL, 0);
+
+  if (! rect_to_cells_outer (rect, &area_data.cx0, &cy0, &area_data.cx1, &cy1))
+    return 0;
+
+  area_data.x0   = rect->x;
+  area_data.y0   = rect->y;
+  area_data.x1   = (gint64) rect->x + rect->width;
+  area_data.y1   = (gint64) rect->y + rect->height;
+  area_data.area = 0;
+
+  gegl_tile_mask_foreach_block (mask, area_data.cx0, cy0, area_data.cx1, cy1,
+                                FALSE, area_block_cells, &area_data);
+
+  return area_data.area;
+}
+
+/* returns the first cell in [cx0, cx1) of row cy which is set (or unset),
+ * or cx1 if there is none.
+ */
+static gint64
+find_in_row (GeglTileMask *mask,
+             gint64        cy,
+             gint64        cx0,
+             gint64        cx1,
+             gboolean      set)
+{
+  gint64 by = floor_shift (cy, BLOCK_SHIFT);
+  gint   ly = cy - by * BLOCK_SIZE;
+  gint64 cx = cx0;
+
+  while (cx < cx1)
+    {
+      gint64             bx    = floor_shift (cx, BLOCK_SHIFT);
+      gint64             ox    = bx * BLOCK_SIZE;
+      gint               lx0   = cx - ox;
+      gint               lx1   = MIN (cx1 - ox, BLOCK_SIZE);
+      GeglTileMaskBlock *block = lookup_block (mask, bx, by);
+      guint64            bits  = block ? block->rows[ly] : 0;
+
+      if (! set)
+        bits = ~bits;
+
+      bits &= range_mask (lx0, lx1);
+
+      if (bits)
+        return ox + ctz64 (bits);
+
+      cx = ox + lx1;
+    }
+
+  return cx1;
+}
+
+gboolean
+gegl_tile_mask_get_unset_rect (GeglTileMask        *mask,
+                               const GeglRectangle *rect,
+                               GeglRectangle       *unset_rect)
+{
+  gint64 cx0, cy0, cx1, cy1;
+  gint64 cy;
+
+  g_return_val_if_fail (mask != NULL, FALSE);
+  g_return_val_if_fail (rect != NULL, FALSE);
+  g_return_val_if_fail (unset_rect != NULL, FALSE);
+
+  if (! rect_to_cells_outer (rect, &cx0, &cy0, &cx1, &cy1))
+    return FALSE;
+
+  for (cy = cy0; cy < cy1; cy++)
+    {
+      gint64 ux0 = find_in_row (mask, cy, cx0, cx1, FALSE);
+      gint64 ux1;
+      gint64 uy1;
+
+      if (ux0 == cx1)
+        continue;
+
+      /* grow to the right, as long as cells are unset ... */
+      ux1 = find_in_row (mask, cy, ux0, MIN (cx1, ux0 + MAX_UNSET_SPAN), TRUE);
+
+      /* ... and then downwards, as long as the whole span is unset */
+      for (uy1 = cy + 1;
+           uy1 < MIN (cy1, cy + MAX_UNSET_SPAN) &&
+           find_in_row (mask, uy1, ux0, ux1, TRUE) == ux1;
+           uy1++);
+
+      unset_rect->x      = ux0 * GEGL_TILE_MASK_CELL_SIZE;
+      unset_rect->y      = cy  * GEGL_TILE_MASK_CELL_SIZE;
+      unset_rect->width  = (ux1 - ux0) * GEGL_TILE_MASK_CELL_SIZE;
+      unset_rect->height = (uy1 - cy)  * GEGL_TILE_MASK_CELL_SIZE;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gint
+compare_rectangles (gconstpointer a,
+                    gconstpointer b)
+{
+  const GeglRectangle *ra = a;
+  const GeglRectangle *rb = b;
+
+  if (ra->y != rb->y)
+    return ra->y < rb->y ? -1 : 1;
+  if (ra->x != rb->x)
+    return ra->x < rb->x ? -1 : 1;
+  return 0;
+}
+
+void
+gegl_tile_mask_get_rectangles (GeglTileMask   *mask,
+                               GeglRectangle **rectangles,
+                               gint           *n_rectangles)
+{
+  GArray            *array;
+  GHashTableIter     iter;
+  GeglTileMaskBlock *block;
+
+  g_return_if_fail (mask != NULL);
+  g_return_if_fail (rectangles != NULL);
+  g_return_if_fail (n_rectangles != NULL);
+
+  array = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
+
+  g_hash_table_iter_init (&iter, mask->blocks);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &block))
+    {
+      gint64 ox    = (gint64) (gint32) (((guint64) block->key) >> 32) * BLOCK_SIZE;
+      gint64 oy    = (gint64) (gint32) (((guint64) block->key) & 0xffffffff) * BLOCK_SIZE;
+      guint  first = array->len;
+      gint   ly;
+
+      for (ly = 0; ly < BLOCK_SIZE; ly++)
+        {
+          guint64 row = block->rows[ly];
+
+          while (row)
+            {
+              GeglRectangle run;
+              gint          lx0 = ctz64 (row);
+              gint          lx1;
+              guint         i;
+
+              /* find the end of the run of set bits starting at lx0 */
+              for (lx1 = lx0; lx1 < BLOCK_SIZE && (row >> lx1) & 1; lx1++);
+
+              row &= ~range_mask (lx0, lx1);
+
+              run.x      = (ox + lx0) * GEGL_TILE_MASK_CELL_SIZE;
+              run.y      = (oy + ly)  * GEGL_TILE_MASK_CELL_SIZE;
+              run.width  = (lx1 - lx0) * GEGL_TILE_MASK_CELL_SIZE;
+              run.height = GEGL_TILE_MASK_CELL_SIZE;
+
+              /* coalesce with an identical span in the row above */
+              for (i = first; i < array->len; i++)
+                {
+                  GeglRectangle *prev = &g_array_index (array, GeglRectangle, i);
+
+                  if (prev->x == run.x && prev->width == run.width &&
+                      prev->y + prev->height == run.y)
+                    {
+                      prev->height += run.height;
+                      break;
+                    }
+                }
+
+              if (i == array->len)
+                g_array_append_val (array, run);
+            }
+        }
+    }
+
+  g_array_sort (array, compare_rectangles);
+
+  *n_rectangles = array->len;
+  *rectangles   = (GeglRectangle *) g_array_free (array, FALSE);
+}
+
+void
+gegl_tile_mask_align_rect (const GeglRectangle *rect,
+                           GeglRectangle       *aligned)
+{
+  gint64 cx0, cy0, cx1, cy1;
+
+  g_return_if_fail (rect != NULL);
+  g_return_if_fail (aligned != NULL);
+
+  if (gegl_rectangle_is_infinite_plane (rect) ||
+      ! rect_to_cells_outer (rect, &cx0, &cy0, &cx1, &cy1))
+    {
+      *aligned = *rect;
+      return;
+    }
+
+  aligned->x      = cx0 * GEGL_TILE_MASK_CELL_SIZE;
+  aligned->y      = cy0 * GEGL_TILE_MASK_CELL_SIZE;
+  aligned->width  = (cx1 - cx0) * GEGL_TILE_MASK_CELL_SIZE;
+  aligned->height = (cy1 - cy0) * GEGL_TILE_MASK_CELL_SIZE;
+}
@@ -0,0 +1,77 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_TILE_MASK_H__
+#define __GEGL_TILE_MASK_H__
+
+#include <gegl/gegl-types.h>
+#include <gegl/gegl-types-internal.h>
+
+#include "gegl-region.h"
+
+G_BEGIN_DECLS
+
+/* A GeglTileMask is a sparse bitmap of fixed size cells, used for tracking
+ * which parts of a cache are valid.  Unlike GeglRegion, the cost of updates
+ * and queries is proportional to the number of cells touched, and does not
+ * grow as the covered area fragments into many small rectangles.
+ *
+ * Cells are grouped in square blocks of 64x64 cells, where every row of a
+ * block is a single 64 bit word; blocks without any set cells are not
+ * stored.
+ */
+
+#define GEGL_TILE_MASK_CELL_SHIFT  3
+#define GEGL_TILE_MASK_CELL_SIZE   (1 << GEGL_TILE_MASK_CELL_SHIFT)
+
+typedef struct _GeglTileMask GeglTileMask;
+
+GeglTileMask    * gegl_tile_mask_new             (void);
+void              gegl_tile_mask_free            (GeglTileMask        *mask);
+void              gegl_tile_mask_clear           (GeglTileMask        *mask);
+
+gboolean          gegl_tile_mask_is_empty        (GeglTileMask        *mask);
+
+/* marks the cells that are entirely contained in @rect */
+void              gegl_tile_mask_add_rect        (GeglTileMask        *mask,
+                                                  const GeglRectangle *rect);
+/* clears all cells touched by @rect */
+void              gegl_tile_mask_remove_rect     (GeglTileMask        *mask,
+                                                  const GeglRectangle *rect);
+
+GeglOverlapType   gegl_tile_mask_rect_in         (GeglTileMask        *mask,
+                                                  const GeglRectangle *rect);
+/* number of pixels of @rect covered by set cells */
+gint64            gegl_tile_mask_get_area        (GeglTileMask        *mask,
+                                                  const GeglRectangle *rect);
+/* finds the first, in scanline order, cell of @rect that is not set, and
+ * grows it into a cell aligned rectangle of unset cells, coalescing as many
+ * neighbouring unset cells as possible.  the result is not clipped to @rect.
+ */
+gboolean          gegl_tile_mask_get_unset_rect  (GeglTileMask        *mask,
+                                                  const GeglRectangle *rect,
+                                                  GeglRectangle       *unset_rect);
+void              gegl_tile_mask_get_rectangles  (GeglTileMask        *mask,
+                                                  GeglRectangle      **rectangles,
+                                                  gint                *n_rectangles);
+
+/* expands @rect outwards to the cell grid */
+void              gegl_tile_mask_align_rect      (const GeglRectangle *rect,
+                                                  GeglRectangle       *aligned);
+
+G_END_DECLS
+
+#endif /* __GEGL_TILE_MASK_H__ */
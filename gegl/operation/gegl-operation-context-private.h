@@ -64,6 +64,11 @@ struct _GeglOperationContext
   GHashTable    *contexts;      /* to be able to look up the context of
                                    other nodes/ops in the graph we store the
                                    hashtable we will be stored in */
+
+  GCancellable  *cancellable;   /* cancellation scope of the thread that set
+                                   up the evaluation, see
+                                   gegl_parallel_push_cancellable() */
+  gint64         deadline;
 };
 
 GeglOperationContext *gegl_operation_context_new       (GeglOperation        *operation,
@@ -34,8 +34,10 @@
 #include "gegl-buffer-private.h"
 #include "gegl-tile-backend-buffer.h"
 #include "gegl-config.h"
+#include "gegl-parallel-private.h"
 
 #include "operation/gegl-operation.h"
+#include "operation/gegl-operation-filter.h"
 
 static GValue *
 gegl_operation_context_add_value (GeglOperationContext *self,
@@ -205,8 +207,15 @@ gegl_operation_context_new (GeglOperation *operation,
                             GHashTable    *hashtable)
 {
   GeglOperationContext *self = g_slice_new0 (GeglOperationContext);
+  GCancellable         *cancellable;
+
   self->operation = operation;
   self->contexts = hashtable;
+
+  cancellable = gegl_parallel_get_cancellable (&self->deadline);
+  if (cancellable)
+    self->cancellable = g_object_ref (cancellable);
+
   return self;
 }
 
@@ -225,6 +234,7 @@ void
 gegl_operation_context_destroy (GeglOperationContext *self)
 {
   gegl_operation_context_purge (self);
+  g_clear_object (&self->cancellable);
   g_slice_free (GeglOperationContext, self);
 }
 
@@ -299,6 +309,65 @@ gegl_operation_context_get_source (GeglOperationContext *context,
   return input;
 }
 
+/* when the tile size of buffers is picked per format, stretch the tiles of
+ * the output of filters splitting their work into strips along the strips,
+ * so that each thread touches fewer tiles.  -1 leaves the choice to the
+ * buffer.
+ */
+static void
+gegl_operation_context_get_target_tile_size (GeglOperationContext *context,
+                                             const gchar          *padname,
+                                             const Babl           *format,
+                                             gint                 *tile_width,
+                                             gint                 *tile_height)
+{
+  GeglOperation     *operation = context->operation;
+  GeglConfig        *config    = gegl_config ();
+  GeglSplitStrategy  split_strategy = GEGL_SPLIT_STRATEGY_AUTO;
+  gdouble            aspect;
+
+  *tile_width  = -1;
+  *tile_height = -1;
+
+  if (config->tile_size_target <= 0)
+    return;
+
+  if (GEGL_IS_OPERATION_FILTER (operation))
+    {
+      GeglOperationFilterClass *klass;
+
+      klass = GEGL_OPERATION_FILTER_GET_CLASS (operation);
+
+      if (klass->get_split_strategy)
+        {
+          split_strategy = klass->get_split_strategy (operation, context,
+                                                      padname,
+                                                      &context->result_rect,
+                                                      context->level);
+        }
+    }
+
+  aspect = (gdouble) MAX (config->tile_width,  1) /
+                     MAX (config->tile_height, 1);
+
+  switch (split_strategy)
+    {
+    case GEGL_SPLIT_STRATEGY_HORIZONTAL:
+      aspect *= 4.0;
+      break;
+
+    case GEGL_SPLIT_STRATEGY_VERTICAL:
+      aspect /= 4.0;
+      break;
+
+    default:
+      return;
+    }
+
+  gegl_buffer_get_tile_size_for_format (format, aspect,
+                                        tile_width, tile_height);
+}
+
 GeglBuffer *
 gegl_operation_context_get_target (GeglOperationContext *context,
                                    const gchar          *padname)
@@ -314,7 +383,7 @@ gegl_operation_context_get_target (GeglOperationContext *context,
   g_return_val_if_fail (GEGL_IS_OPERATION_CONTEXT (context), NULL);
 #endif
 
-  g_return_val_if_fail (g_strcmp0 (padname, "output") == 0, NULL);
+  g_return_val_if_fail (padname != NULL, NULL);
 
   if (linear_buffers == -1)
     linear_buffers = g_getenv ("GEGL_LINEAR_BUFFERS")?1:0;
@@ -334,7 +403,10 @@ gegl_operation_context_get_target (GeglOperationContext *context,
       else
         output = gegl_buffer_new (GEGL_RECTANGLE (0, 0, 0, 0), format);
     }
-  else if (gegl_node_use_cache (node))
+  /* the cache only holds the "output" pad, the other output pads of
+   * operations with several outputs always get a fresh buffer
+   */
+  else if (! strcmp (padname, "output") && gegl_node_use_cache (node))
     {
       GeglBuffer    *cache;
       cache = GEGL_BUFFER (gegl_node_get_cache (node));
@@ -355,6 +427,14 @@ gegl_operation_context_get_target (GeglOperationContext *context,
         }
       else
         {
+          gint tile_width;
+          gint tile_height;
+
+          gegl_operation_context_get_target_tile_size (context, padname,
+                                                       format,
+                                                       &tile_width,
+                                                       &tile_height);
+
           output = g_object_new (
             GEGL_TYPE_BUFFER,
             "x",           result->x,
@@ -362,6 +442,8 @@ gegl_operation_context_get_target (GeglOperationContext *context,
             "width",       result->width,
             "height",      result->height,
             "format",      format,
+            "tile-width",  tile_width,
+            "tile-height", tile_height,
             "initialized", gegl_operation_context_get_init_output (),
             NULL);
         }
@@ -378,6 +460,21 @@ gegl_operation_context_get_level (GeglOperationContext *ctxt)
   return ctxt->level;
 }
 
+/* whether the evaluation this context is part of has been cancelled, or has
+ * run past its deadline; operations can check this between chunks of work.
+ */
+gboolean
+gegl_operation_context_is_cancelled (GeglOperationContext *self)
+{
+  if (self->cancellable && g_cancellable_is_cancelled (self->cancellable))
+    return TRUE;
+
+  if (self->deadline && g_get_monotonic_time () >= self->deadline)
+    return TRUE;
+
+  return gegl_parallel_is_cancelled ();
+}
+
 
 GeglBuffer *
 gegl_operation_context_get_output_maybe_in_place (GeglOperation *operation,
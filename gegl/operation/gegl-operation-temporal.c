@@ -24,19 +24,39 @@
 #include "gegl.h"
 #include "gegl-operation-temporal.h"
 #include "gegl-operation-context.h"
+#include "graph/gegl-node-private.h"
+#include "graph/gegl-pad.h"
+
+/* The frames are kept in a ring attached to the output pad that feeds the
+ * temporal operations, so that the nodes reading the same stream share the
+ * frames.  A frame is a copy of the input buffer, which shares its tiles with
+ * the input until either is written to.
+ */
+typedef struct
+{
+  gint         ref_count;
+  GMutex       mutex;
+
+  GeglBuffer **frames;    /* from the oldest to the newest, starting at first */
+  gint         capacity;
+  gint         n_frames;
+  gint         first;
+
+  gboolean     pending;   /* the input changed since the newest frame */
+} FrameRing;
 
 struct _GeglOperationTemporalPrivate
 {
-  gint                count;
-  gint                history_length;
+  gint       history_length;
+  gint       lookahead;
 
-  gint                width;
-  gint                height;
-  gint                next_to_write;
-  GeglBuffer         *frame_store;
+  FrameRing *ring;
+  GeglPad   *ring_pad;
 };
 
-static void gegl_operation_temporal_prepare (GeglOperation *operation);
+static GMutex ring_mutex;
+
+static void     gegl_operation_temporal_prepare (GeglOperation *operation);
 
 G_DEFINE_TYPE_WITH_PRIVATE (GeglOperationTemporal, gegl_operation_temporal,
                             GEGL_TYPE_OPERATION_FILTER)
@@ -45,109 +65,343 @@ G_DEFINE_TYPE_WITH_PRIVATE (GeglOperationTemporal, gegl_operation_temporal,
   ((GeglOperationTemporalPrivate *) gegl_operation_temporal_get_instance_private ((GeglOperationTemporal *) (obj)))
 
 
+static FrameRing *
+frame_ring_new (void)
+{
+  FrameRing *ring = g_slice_new0 (FrameRing);
+
+  ring->ref_count = 1;
+  g_mutex_init (&ring->mutex);
+
+  return ring;
+}
+
+static FrameRing *
+frame_ring_ref (FrameRing *ring)
+{
+  g_atomic_int_inc (&ring->ref_count);
+
+  return ring;
+}
+
+static void
+frame_ring_unref (FrameRing *ring)
+{
+  gint i;
+
+  if (! g_atomic_int_dec_and_test (&ring->ref_count))
+    return;
+
+  for (i = 0; i < ring->n_frames; i++)
+    g_object_unref (ring->frames[(ring->first + i) % ring->capacity]);
+
+  g_free (ring->frames);
+  g_mutex_clear (&ring->mutex);
+  g_slice_free (FrameRing, ring);
+}
+
+/* called with the ring locked */
+static void
+frame_ring_reserve (FrameRing *ring,
+                    gint       capacity)
+{
+  GeglBuffer **frames;
+  gint         i;
+
+  if (capacity <= ring->capacity)
+    return;
+
+  frames = g_new0 (GeglBuffer *, capacity);
+
+  for (i = 0; i < ring->n_frames; i++)
+    frames[i] = ring->frames[(ring->first + i) % ring->capacity];
+
+  g_free (ring->frames);
+
+  ring->frames   = frames;
+  ring->capacity = capacity;
+  ring->first    = 0;
+}
+
+/* called with the ring locked, takes the reference of frame */
+static void
+frame_ring_push (FrameRing  *ring,
+                 GeglBuffer *frame)
+{
+  if (ring->n_frames == ring->capacity)
+    {
+      g_object_unref (ring->frames[ring->first]);
+
+      ring->first = (ring->first + 1) % ring->capacity;
+      ring->n_frames--;
+    }
+
+  ring->frames[(ring->first + ring->n_frames) % ring->capacity] = frame;
+  ring->n_frames++;
+}
+
+/* called with the ring locked, age 0 is the newest frame */
+static GeglBuffer *
+frame_ring_get (FrameRing *ring,
+                gint       age)
+{
+  age = CLAMP (age, 0, ring->n_frames - 1);
+
+  return ring->frames[(ring->first + ring->n_frames - 1 - age) %
+                      ring->capacity];
+}
+
+/* find the ring of the pad connected to the input, and make sure it holds
+ * enough frames for this operation
+ */
+static FrameRing *
+gegl_operation_temporal_get_ring (GeglOperation *operation)
+{
+  GeglOperationTemporalPrivate *priv = GEGL_OPERATION_TEMPORAL (operation)->priv;
+  GeglNode                     *node = operation->node;
+  GeglPad                      *pad  = NULL;
+  FrameRing                    *ring;
+
+  if (node)
+    {
+      const gchar *pad_name = "input";
+
+      if (node->is_graph)
+        node = gegl_node_get_input_proxy (node, pad_name);
+
+      pad = gegl_node_get_pad (node, pad_name);
+
+      if (pad)
+        pad = gegl_pad_get_connected_to (pad);
+    }
+
+  g_mutex_lock (&ring_mutex);
+
+  if (priv->ring && priv->ring_pad != pad)
+    {
+      frame_ring_unref (priv->ring);
+      priv->ring = NULL;
+    }
+
+  if (! priv->ring)
+    {
+      if (pad)
+        {
+          ring = g_object_get_data (G_OBJECT (pad), "gegl-temporal-frames");
+
+          if (! ring)
+            {
+              ring = frame_ring_new ();
+              g_object_set_data_full (G_OBJECT (pad), "gegl-temporal-frames",
+                                      ring, (GDestroyNotify) frame_ring_unref);
+            }
+
+          priv->ring = frame_ring_ref (ring);
+        }
+      else
+        {
+          priv->ring = frame_ring_new ();
+        }
+
+      priv->ring_pad = pad;
+    }
+
+  ring = priv->ring;
+
+  g_mutex_unlock (&ring_mutex);
+
+  g_mutex_lock (&ring->mutex);
+  frame_ring_reserve (ring, priv->history_length + priv->lookahead);
+  g_mutex_unlock (&ring->mutex);
+
+  return ring;
+}
 
 GeglBuffer *
 gegl_operation_temporal_get_frame (GeglOperation *op,
                                    gint           frame)
 {
-  GeglOperationTemporal *temporal= GEGL_OPERATION_TEMPORAL (op);
-  GeglOperationTemporalPrivate *priv = temporal->priv;
-  GeglBuffer   *buffer;
-
-   if (frame > priv->count)
-     {
-       frame = (priv->count-1);
-       if (frame<0)
-         frame=0;
-       g_print ("%i > priv->count(%i), using frame %i", frame, priv->count,
-        frame);
-     }
-   else
-     {
-       frame = (priv->next_to_write - 1 + priv->history_length + frame) % priv->history_length;
-       g_print ("using frame %i", frame);
-     }
-  /* build in shift */
-  buffer = g_object_new (GEGL_TYPE_BUFFER,
-                         "source",  priv->frame_store,
-                         "shift-y", frame * priv->height,
-                         "width", priv->width,
-                         "height", priv->height,
-                         "x", 0,
-                         "y", 0,
-                         NULL);
+  GeglOperationTemporal        *temporal = GEGL_OPERATION_TEMPORAL (op);
+  GeglOperationTemporalPrivate *priv     = temporal->priv;
+  FrameRing                    *ring     = priv->ring;
+  GeglBuffer                   *buffer;
+
+  if (! ring)
+    return NULL;
+
+  frame = CLAMP (frame, -(priv->history_length - 1), priv->lookahead);
+
+  g_mutex_lock (&ring->mutex);
+
+  if (ring->n_frames > 0)
+    {
+      /* the current frame is lookahead frames older than the newest one */
+      buffer = g_object_ref (frame_ring_get (ring,
+                                             MIN (priv->lookahead,
+                                                  ring->n_frames - 1) -
+                                             frame));
+    }
+  else
+    {
+      buffer = NULL;
+    }
+
+  g_mutex_unlock (&ring->mutex);
+
   return buffer;
 }
 
-static gboolean gegl_operation_temporal_process (GeglOperation       *self,
-                                                 GeglBuffer          *input,
-                                                 GeglBuffer          *output,
-                                                 const GeglRectangle *result,
-                                                 gint                 level)
+static gboolean
+gegl_operation_temporal_operation_process (GeglOperation        *operation,
+                                           GeglOperationContext *context,
+                                           const gchar          *output_prop,
+                                           const GeglRectangle  *result,
+                                           gint                  level)
+{
+  GeglOperationClass *parent_class;
+  GeglBuffer         *input;
+
+  parent_class = GEGL_OPERATION_CLASS (gegl_operation_temporal_parent_class);
+
+  /* take the new frame from the whole input here, the threads of the
+   * filter only get the part of the input they process
+   */
+  input = GEGL_BUFFER (gegl_operation_context_dup_object (context, "input"));
+
+  if (input)
+    {
+      FrameRing *ring = gegl_operation_temporal_get_ring (operation);
+
+      g_mutex_lock (&ring->mutex);
+
+      if (ring->pending || ring->n_frames == 0)
+        {
+          const GeglRectangle *rect;
+          GeglBuffer          *frame;
+
+          rect  = gegl_operation_source_get_bounding_box (operation, "input");
+          if (! rect)
+            rect = gegl_buffer_get_extent (input);
+
+          frame = gegl_buffer_new (rect, gegl_buffer_get_format (input));
+
+          gegl_buffer_copy (input, rect, GEGL_ABYSS_NONE, frame, rect);
+
+          frame_ring_push (ring, frame);
+          ring->pending = FALSE;
+        }
+
+      g_mutex_unlock (&ring->mutex);
+
+      g_object_unref (input);
+    }
+
+  return parent_class->process (operation, context, output_prop, result,
+                                level);
+}
+
+static gboolean
+gegl_operation_temporal_process (GeglOperation       *self,
+                                 GeglBuffer          *input,
+                                 GeglBuffer          *output,
+                                 const GeglRectangle *result,
+                                 gint                 level)
 {
-  GeglOperationTemporal *temporal = GEGL_OPERATION_TEMPORAL (self);
-  GeglOperationTemporalPrivate *priv = temporal->priv;
   GeglOperationTemporalClass *temporal_class;
+  GeglBuffer                 *current;
+  gboolean                    success = FALSE;
 
   temporal_class = GEGL_OPERATION_TEMPORAL_GET_CLASS (self);
 
-  priv->width  = result->width;
-  priv->height = result->height;
+  current = gegl_operation_temporal_get_frame (self, 0);
 
-  {
-   GeglRectangle write_rect = *result;
-   write_rect.y = priv->next_to_write * priv->height;
+  if (temporal_class->process)
+    success = temporal_class->process (self, current ? current : input,
+                                       output, result, level);
 
-   gegl_buffer_copy (input, result, GEGL_ABYSS_NONE, priv->frame_store, &write_rect);
-   priv->count++;
-   priv->next_to_write++;
-   if (priv->next_to_write >= priv->history_length)
-     priv->next_to_write=0;
-  }
+  g_clear_object (&current);
 
- if (temporal_class->process)
-   return temporal_class->process (self, input, output, result, level);
- return FALSE;
+  return success;
+}
+
+/* a frame is complete on its own, and which frame is current changes the
+ * whole output
+ */
+static GeglRectangle
+gegl_operation_temporal_get_required_for_output (GeglOperation       *operation,
+                                                 const gchar         *input_pad,
+                                                 const GeglRectangle *roi)
+{
+  const GeglRectangle *in_rect;
+
+  in_rect = gegl_operation_source_get_bounding_box (operation, input_pad);
+
+  if (in_rect && ! gegl_rectangle_is_infinite_plane (in_rect))
+    return *in_rect;
+
+  return *roi;
+}
+
+static GeglRectangle
+gegl_operation_temporal_get_invalidated_by_change (GeglOperation       *operation,
+                                                   const gchar         *input_pad,
+                                                   const GeglRectangle *input_region)
+{
+  GeglOperationTemporalPrivate *priv = GEGL_OPERATION_TEMPORAL (operation)->priv;
+
+  if (priv->ring && ! strcmp (input_pad, "input"))
+    {
+      g_mutex_lock (&priv->ring->mutex);
+      priv->ring->pending = TRUE;
+      g_mutex_unlock (&priv->ring->mutex);
+    }
+
+  return gegl_rectangle_infinite_plane ();
 }
 
 static void gegl_operation_temporal_prepare (GeglOperation *operation)
 {
   const Babl *space = gegl_operation_get_source_space (operation, "input");
-  const Babl *format = babl_format_with_space ("RGB u8", space);
+  const Babl *format = babl_format_with_space ("RGBA float", space);
   gegl_operation_set_format (operation, "output", format);
   gegl_operation_set_format (operation, "input", format);
 }
 
+static void
+gegl_operation_temporal_finalize (GObject *object)
+{
+  GeglOperationTemporalPrivate *priv = GEGL_OPERATION_TEMPORAL (object)->priv;
+
+  g_clear_pointer (&priv->ring, frame_ring_unref);
+
+  G_OBJECT_CLASS (gegl_operation_temporal_parent_class)->finalize (object);
+}
+
 static void
 gegl_operation_temporal_class_init (GeglOperationTemporalClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GeglOperationClass *operation_class = GEGL_OPERATION_CLASS (klass);
   GeglOperationFilterClass *operation_filter_class = GEGL_OPERATION_FILTER_CLASS (klass);
 
-  operation_class->prepare = gegl_operation_temporal_prepare;
-  operation_filter_class->process = gegl_operation_temporal_process;
+  object_class->finalize = gegl_operation_temporal_finalize;
+
+  operation_class->prepare                   = gegl_operation_temporal_prepare;
+  operation_class->process                   = gegl_operation_temporal_operation_process;
+  operation_class->get_required_for_output   = gegl_operation_temporal_get_required_for_output;
+  operation_class->get_invalidated_by_change = gegl_operation_temporal_get_invalidated_by_change;
+  operation_filter_class->process            = gegl_operation_temporal_process;
 }
 
 static void
 gegl_operation_temporal_init (GeglOperationTemporal *self)
 {
   GeglOperationTemporalPrivate *priv;
-  GeglRectangle rect = { 0, 0, 4096, 4096*600 };
 
   self->priv = GEGL_OPERATION_TEMPORAL_GET_PRIVATE(self);
   priv=self->priv;
-  priv->count          = 0;
-  priv->history_length = 500;
-  priv->width          = 1024;
-  priv->height         = 1024;
-  priv->next_to_write  = 0;
-
-  /* FIXME: the format used for the frame_store should be autodetected from
-   * input
-   */
-  priv->frame_store    =
-      gegl_buffer_new (&rect, babl_format ("RGB u8"));
-;
+  priv->history_length = 1;
+  priv->lookahead      = 0;
 }
 
 void gegl_operation_temporal_set_history_length (GeglOperation *op,
@@ -155,7 +409,7 @@ void gegl_operation_temporal_set_history_length (GeglOperation *op,
 {
   GeglOperationTemporal *self = GEGL_OPERATION_TEMPORAL (op);
   GeglOperationTemporalPrivate *priv = self->priv;
-  priv->history_length = history_length;
+  priv->history_length = MAX (history_length, 1);
 }
 
 guint gegl_operation_temporal_get_history_length (GeglOperation *op)
@@ -164,3 +418,18 @@ guint gegl_operation_temporal_get_history_length (GeglOperation *op)
   GeglOperationTemporalPrivate *priv = self->priv;
   return priv->history_length;
 }
+
+void gegl_operation_temporal_set_lookahead (GeglOperation *op,
+                                            gint           lookahead)
+{
+  GeglOperationTemporal *self = GEGL_OPERATION_TEMPORAL (op);
+  GeglOperationTemporalPrivate *priv = self->priv;
+  priv->lookahead = MAX (lookahead, 0);
+}
+
+guint gegl_operation_temporal_get_lookahead (GeglOperation *op)
+{
+  GeglOperationTemporal *self = GEGL_OPERATION_TEMPORAL (op);
+  GeglOperationTemporalPrivate *priv = self->priv;
+  return priv->lookahead;
+}
@@ -20,6 +20,14 @@
  * Base class for operations that want access to previous frames in a video sequence,
  * it contains API to configure the amounts of frames to store as well as getting a
  * GeglBuffer pointing to any of the previously stored frames.
+ *
+ * A new frame is taken from the input whenever the input was invalidated since the
+ * previous one.  The frames are shared with the other temporal operations reading
+ * the same output pad, and share their tiles with the input buffer they were taken
+ * from.  With a lookahead, the frame processed lags that many frames behind the
+ * newest input, which makes the following frames available.  The process function
+ * gets the current frame as input, and may be called from several threads for
+ * parts of the same frame.
  */
 
 #ifndef __GEGL_OPERATION_TEMPORAL_H__
@@ -58,12 +66,24 @@ struct _GeglOperationTemporalClass
 
 GType gegl_operation_temporal_get_type (void);
 
+/* the number of frames kept, the current frame included */
 void gegl_operation_temporal_set_history_length (GeglOperation *op,
                                                  gint           history_length);
 
 guint gegl_operation_temporal_get_history_length (GeglOperation *op);
 
-/* you need to unref the buffer when you're done with it */
+/* the number of frames following the current frame that are kept */
+void gegl_operation_temporal_set_lookahead (GeglOperation *op,
+                                            gint           lookahead);
+
+guint gegl_operation_temporal_get_lookahead (GeglOperation *op);
+
+/* frame is relative to the current frame, 0 for the current frame, negative
+ * for previous frames and positive for following frames. Frames before the
+ * first one or after the newest one are clamped to these. Returns NULL before
+ * the first frame was taken, you need to unref the buffer when you're done with
+ * it, and not write to it.
+ */
 GeglBuffer *gegl_operation_temporal_get_frame (GeglOperation *op,
                                                gint           frame);
 
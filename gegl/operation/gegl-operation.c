@@ -173,9 +173,26 @@ gegl_operation_process (GeglOperation        *operation,
   if (update_pixel_time)
     t = g_get_monotonic_time ();
 
-  success = klass->process (operation, context, output_pad, result, level);
+  /* make the evaluation's cancellation scope visible to the operation, and
+   * to any work it distributes to other threads
+   */
+  if (context && (context->cancellable || context->deadline))
+    {
+      gegl_parallel_push_cancellable (context->cancellable, context->deadline);
+
+      success = klass->process (operation, context, output_pad, result, level);
+
+      gegl_parallel_pop_cancellable ();
+    }
+  else
+    {
+      success = klass->process (operation, context, output_pad, result, level);
+    }
 
-  if (success && update_pixel_time)
+  /* a cancelled process doesn't tell us much about the operation's speed */
+  if (success && update_pixel_time &&
+      ! (context ? gegl_operation_context_is_cancelled (context) :
+                   gegl_parallel_is_cancelled ()))
     {
       t = g_get_monotonic_time () - t;
 
@@ -935,6 +952,14 @@ gegl_operation_get_pixels_per_thread (GeglOperation *operation)
               GEGL_OPERATION_MAX_PIXELS_PER_THREAD);
 }
 
+gdouble
+gegl_operation_get_pixel_time (GeglOperation *operation)
+{
+  GeglOperationPrivate *priv = gegl_operation_get_instance_private (operation);
+
+  return priv->pixel_time;
+}
+
 static void
 gegl_operation_update_pixel_time (GeglOperation       *self,
                                   const GeglRectangle *roi,
@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <glib-object.h>
+#include <string.h>
 
 #include "gegl-types-internal.h"
 #include "gegl.h"
@@ -27,6 +28,7 @@
 #include "gegl-instrument.h"
 
 #include "gegl-region.h"
+#include "gegl-buffer-private.h"
 
 #include "graph/gegl-node-private.h"
 #include "graph/gegl-pad.h"
@@ -34,6 +36,7 @@
 #include "graph/gegl-callback-visitor.h"
 #include "graph/gegl-visitable.h"
 #include "graph/gegl-connection.h"
+#include "graph/gegl-tile-mask.h"
 
 #include "process/gegl-graph-traversal.h"
 #include "process/gegl-graph-traversal-private.h"
@@ -41,6 +44,7 @@
 #include "operation/gegl-operation.h"
 #include "operation/gegl-operation-context.h"
 #include "operation/gegl-operation-context-private.h"
+#include "operation/gegl-operation-private.h"
 
 typedef struct
 {
@@ -54,6 +58,8 @@ static GList *gegl_graph_get_connected_output_contexts (GeglGraphTraversal *path
 static void   _gegl_graph_do_build                     (GeglGraphTraversal *path,
                                                         GeglNode           *node);
 static GeglBuffer *gegl_graph_get_shared_empty         (GeglGraphTraversal *path);
+static gboolean    gegl_graph_has_extra_outputs        (GeglGraphTraversal *path,
+                                                        GeglNode           *node);
 
 static gboolean
 _gegl_graph_do_build_add_node (GeglNode *node,
@@ -310,12 +316,25 @@ gegl_graph_prepare_request (GeglGraphTraversal  *path,
           continue;
         }
       
-      if (node->cache)
+      /* the cache only holds the "output" pad, we have to process the node
+       * if any of its other output pads is consumed.
+       */
+      if (node->cache && ! gegl_graph_has_extra_outputs (path, node))
         {
           gint i;
           for (i = level; i >=0 && !context->cached; i--)
           {
-            if (gegl_region_rect_in (node->cache->valid_region[level], request) == GEGL_OVERLAP_RECTANGLE_IN)
+            GeglRectangle level_request;
+
+            /* a level is twice as large as the level above it, the pixels
+             * of the request at a lower level have to be valid.
+             */
+            level_request.x      = request->x      * (1 << (level - i));
+            level_request.y      = request->y      * (1 << (level - i));
+            level_request.width  = request->width  * (1 << (level - i));
+            level_request.height = request->height * (1 << (level - i));
+
+            if (gegl_cache_is_valid (node->cache, &level_request, i))
             {
               /* This node is cached and the cache fulfills our need rect */
               context->cached = TRUE;
@@ -330,6 +349,16 @@ gegl_graph_prepare_request (GeglGraphTraversal  *path,
         /* Expand request if the operation has a minimum processing requirement */
         GeglRectangle full_request = gegl_operation_get_cached_region (operation, request);
 
+        /* the cache tracks its valid area in whole cells, compute whole
+         * cells so that the result can be found in the cache next time.
+         */
+        if (node->cache)
+          {
+            gegl_tile_mask_align_rect (&full_request, &full_request);
+            gegl_rectangle_intersect (&full_request,
+                                      &node->have_rect, &full_request);
+          }
+
         gegl_operation_context_set_need_rect (context, &full_request);
 
         /* FIXME: We could trim this down based on the cache, instead of being all or nothing */
@@ -396,6 +425,37 @@ gegl_graph_get_connected_output_contexts (GeglGraphTraversal *path,
   return result;
 }
 
+/* whether an output pad of @node other than "output" is connected to a node
+ * of the traversal.
+ */
+static gboolean
+gegl_graph_has_extra_outputs (GeglGraphTraversal *path,
+                              GeglNode           *node)
+{
+  GSList *pads;
+
+  for (pads = node->output_pads; pads; pads = pads->next)
+    {
+      GeglPad *pad = pads->data;
+      GSList  *connections;
+
+      if (! strcmp (gegl_pad_get_name (pad), "output"))
+        continue;
+
+      for (connections = gegl_pad_get_connections (pad);
+           connections;
+           connections = connections->next)
+        {
+          GeglNode *sink_node = gegl_connection_get_sink_node (connections->data);
+
+          if (g_hash_table_contains (path->contexts, sink_node))
+            return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
 GeglBuffer *
 gegl_graph_get_shared_empty (GeglGraphTraversal *path)
 {
@@ -480,14 +540,30 @@ gegl_graph_process (GeglGraphTraversal *path,
 
               context->level = level;
 
-              /* note: this hard-coding of "output" makes some more custom
-               * graph topologies harder than necessary.
+              /* operations with several output pads compute all of them in
+               * the same call, the results of the pads other than "output"
+               * are picked up from the context below.
                */
               gegl_operation_process (operation, context, "output", &context->need_rect, context->level);
               operation_result = GEGL_BUFFER (gegl_operation_context_get_object (context, "output"));
 
               if (operation_result && operation_result == (GeglBuffer *)operation->node->cache)
-                gegl_cache_computed (operation->node->cache, &context->need_rect, level);
+                {
+                  /* a cancelled operation may have left a partial result
+                   * in the cache, make sure it isn't used
+                   */
+                  if (gegl_operation_context_is_cancelled (context))
+                    gegl_cache_discard (operation->node->cache, &context->need_rect);
+                  else
+                    {
+                      gegl_cache_computed (operation->node->cache, &context->need_rect, level);
+
+                      /* let the tile cache weigh the result by its cost */
+                      gegl_buffer_set_pixel_cost (
+                        GEGL_BUFFER (operation->node->cache),
+                        gegl_operation_get_pixel_time (operation));
+                    }
+                }
             }
         }
       else
@@ -495,27 +571,46 @@ gegl_graph_process (GeglGraphTraversal *path,
           operation_result = NULL;
         }
 
-      if (operation_result)
+      if (context->need_rect.width > 0 && context->need_rect.height > 0)
         {
-          GeglPad *output_pad = gegl_node_get_pad (node, "output");
-          GList   *targets = gegl_graph_get_connected_output_contexts (path, output_pad);
-          GList   *targets_iter;
+          GSList *pads;
 
-          GEGL_NOTE (GEGL_DEBUG_PROCESS,
-                     "Will deliver the results of %s:%s to %d targets",
-                     gegl_node_get_debug_name (node),
-                     "output",
-                     g_list_length (targets));
+          for (pads = node->output_pads; pads; pads = pads->next)
+            {
+              GeglPad     *output_pad = pads->data;
+              const gchar *pad_name   = gegl_pad_get_name (output_pad);
+              GeglBuffer  *pad_result;
+              GList       *targets;
+              GList       *targets_iter;
 
-          if (g_list_length (targets) > 1)
-            gegl_object_set_has_forked (G_OBJECT (operation_result));
+              if (! strcmp (pad_name, "output"))
+                pad_result = operation_result;
+              else if (! context->cached)
+                pad_result = GEGL_BUFFER (gegl_operation_context_get_object (context, pad_name));
+              else
+                pad_result = NULL;
 
-          for (targets_iter = targets; targets_iter; targets_iter = g_list_next (targets_iter))
-            {
-              ContextConnection *target_con = targets_iter->data;
-              gegl_operation_context_set_object (target_con->context, target_con->name, G_OBJECT (operation_result));
+              if (! pad_result)
+                continue;
+
+              targets = gegl_graph_get_connected_output_contexts (path, output_pad);
+
+              GEGL_NOTE (GEGL_DEBUG_PROCESS,
+                         "Will deliver the results of %s:%s to %d targets",
+                         gegl_node_get_debug_name (node),
+                         pad_name,
+                         g_list_length (targets));
+
+              if (g_list_length (targets) > 1)
+                gegl_object_set_has_forked (G_OBJECT (pad_result));
+
+              for (targets_iter = targets; targets_iter; targets_iter = g_list_next (targets_iter))
+                {
+                  ContextConnection *target_con = targets_iter->data;
+                  gegl_operation_context_set_object (target_con->context, target_con->name, G_OBJECT (pad_result));
+                }
+              g_list_free_full (targets, free_context_connection);
             }
-          g_list_free_full (targets, free_context_connection);
         }
       last_context = context;
 
@@ -26,6 +26,7 @@
 #include "gegl-debug.h"
 #include "gegl-region.h"
 #include "graph/gegl-node-private.h"
+#include "graph/gegl-tile-mask.h"
 
 #include "operation/gegl-operation-context.h"
 #include "operation/gegl-operation-context-private.h"
@@ -50,6 +51,16 @@ enum
   PROP_RECTANGLE
 };
 
+enum
+{
+  COMPUTED,
+  LAST_SIGNAL
+};
+
+/* share of the reported progress that is spent on the coarse pass of
+ * progressive rendering */
+#define GEGL_PROCESSOR_COARSE_SHARE 0.25
+
 
 static void      gegl_processor_class_init   (GeglProcessorClass    *klass);
 static void      gegl_processor_init         (GeglProcessor         *self);
@@ -80,14 +91,31 @@ struct _GeglProcessor
   gint             level;
   GeglOperationContext *context;
 
-  GeglRegion      *valid_region;     /* used when doing unbuffered rendering */
+  GeglTileMask    *valid_mask;       /* used when doing unbuffered rendering */
   GeglRegion      *queued_region;
   GSList          *dirty_rectangles;
   gint             chunk_size;
 
   gdouble          progress;
+
+  gint             progressive_level; /* coarse level of progressive rendering,
+                                         or 0 when rendering directly */
+  gboolean         refining;
+  gboolean         have_priority_center;
+  GeglPoint        priority_center;
+  GArray          *refine_tiles;      /* tiles at the final level, ordered by
+                                         distance to the priority center */
+  guint            refine_next;
+  GeglCache       *refine_cache;      /* cache whose invalidations requeue
+                                         refined tiles */
+  gulong           refine_invalidated_handler;
+
+  GCancellable    *cancellable;
+  gint64           deadline;
 };
 
+static guint gegl_processor_signals[LAST_SIGNAL] = { 0 };
+
 
 G_DEFINE_TYPE (GeglProcessor, gegl_processor, G_TYPE_OBJECT)
 
@@ -134,6 +162,24 @@ gegl_processor_class_init (GeglProcessorClass *klass)
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_STATIC_STRINGS |
                                                      G_PARAM_CONSTRUCT_ONLY));
+
+  /**
+   * GeglProcessor::computed:
+   * @processor: the #GeglProcessor
+   * @rectangle: the computed area, in level 0 coordinates
+   * @level: the mipmap level the area was computed at
+   *
+   * Emitted by progressive processors, once when the coarse pass over the
+   * whole rectangle is done, and then for every refined tile.
+   */
+  gegl_processor_signals[COMPUTED] =
+    g_signal_new ("computed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 2,
+                  GEGL_TYPE_RECTANGLE,
+                  G_TYPE_INT);
 }
 
 static void
@@ -146,6 +192,7 @@ gegl_processor_init (GeglProcessor *processor)
   processor->context          = NULL;
   processor->queued_region    = NULL;
   processor->dirty_rectangles = NULL;
+  processor->refine_tiles     = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
   //processor->chunk_size       = 128 * 128;
 }
 
@@ -172,7 +219,17 @@ gegl_processor_finalize (GObject *self_object)
   g_clear_object (&processor->input);
 
   g_clear_pointer (&processor->queued_region, gegl_region_destroy);
-  g_clear_pointer (&processor->valid_region, gegl_region_destroy);
+  g_clear_pointer (&processor->valid_mask, gegl_tile_mask_free);
+  g_clear_pointer (&processor->refine_tiles, g_array_unref);
+
+  if (processor->refine_cache)
+    {
+      g_signal_handler_disconnect (processor->refine_cache,
+                                   processor->refine_invalidated_handler);
+      g_clear_object (&processor->refine_cache);
+    }
+
+  g_clear_object (&processor->cancellable);
 
   G_OBJECT_CLASS (gegl_processor_parent_class)->finalize (self_object);
 }
@@ -271,13 +328,11 @@ gegl_processor_set_node (GeglProcessor *processor,
           return;
         }
 
+      g_clear_pointer (&processor->valid_mask, gegl_tile_mask_free);
+
       if (!gegl_operation_sink_needs_full (processor->real_node->operation))
         {
-          processor->valid_region = gegl_region_new ();
-        }
-      else
-        {
-          processor->valid_region = NULL;
+          processor->valid_mask = gegl_tile_mask_new ();
         }
     }
   /* If the processor's node is not a sink operation, then just use it as
@@ -285,7 +340,7 @@ gegl_processor_set_node (GeglProcessor *processor,
   else
     {
       processor->input = processor->real_node;
-      processor->valid_region = NULL;
+      g_clear_pointer (&processor->valid_mask, gegl_tile_mask_free);
     }
 
   g_return_if_fail (processor->input != NULL);
@@ -298,6 +353,14 @@ gegl_processor_set_node (GeglProcessor *processor,
   g_object_notify (G_OBJECT (processor), "node");
 }
 
+static void
+gegl_processor_reset_refinement (GeglProcessor *processor)
+{
+  processor->refining    = FALSE;
+  processor->refine_next = 0;
+  g_array_set_size (processor->refine_tiles, 0);
+}
+
 static void
 set_scaled_rectangle (GeglProcessor *processor)
 {
@@ -383,11 +446,10 @@ gegl_processor_set_rectangle (GeglProcessor       *processor,
                                               &processor->rectangle_unscaled);
     }
 
-  if (processor->valid_region)
-    {
-      gegl_region_destroy (processor->valid_region);
-      processor->valid_region = gegl_region_new ();
-    }
+  if (processor->valid_mask)
+    gegl_tile_mask_clear (processor->valid_mask);
+
+  gegl_processor_reset_refinement (processor);
 
   g_object_notify (G_OBJECT (processor), "rectangle");
 }
@@ -418,8 +480,12 @@ gegl_processor_get_band_size (gint size)
                                           hoping to hit tiles */
     }
 
-  if (band_size < 1)
-    band_size = 1;
+  /* keep the bands aligned to the cells of the valid masks, so that the
+   * rendered fragments are tracked exactly */
+  if (band_size > GEGL_TILE_MASK_CELL_SIZE)
+    band_size -= band_size % GEGL_TILE_MASK_CELL_SIZE;
+  else
+    band_size = GEGL_TILE_MASK_CELL_SIZE;
 
   return band_size;
 }
@@ -452,7 +518,8 @@ render_rectangle (GeglProcessor *processor)
 
       /* If a dirty rectangle is bigger than the max area, then cut it
        * to smaller pieces */
-      if (dr->height * dr->width > max_area && 1)
+      if (dr->height * dr->width > max_area &&
+          MAX (dr->width, dr->height) > GEGL_TILE_MASK_CELL_SIZE)
         {
           gint band_size;
 
@@ -497,7 +564,7 @@ render_rectangle (GeglProcessor *processor)
           gboolean found_full = FALSE;
           for (gint level = processor->level; level >= 0; level--)
           {
-            if (gegl_region_rect_in (cache->valid_region[level], dr) == GEGL_OVERLAP_RECTANGLE_IN)
+            if (gegl_cache_is_valid (cache, dr, level))
             {
               found_full = TRUE;
               break;
@@ -514,6 +581,17 @@ render_rectangle (GeglProcessor *processor)
                               dr, format, NULL,
                               GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_CACHE);
 
+              /* keep a cancelled rectangle queued, so that rendering resumes
+               * where it left off the next time we are asked to work
+               */
+              if (gegl_parallel_is_cancelled ())
+                {
+                  processor->dirty_rectangles =
+                    g_slist_prepend (processor->dirty_rectangles, dr);
+
+                  return TRUE;
+                }
+
               /* tells the cache that the rectangle (dr) has been computed */
               gegl_cache_computed (cache, dr, processor->level);
             }
@@ -521,10 +599,28 @@ render_rectangle (GeglProcessor *processor)
         }
       else
         {
-           gegl_node_blit (processor->real_node, 1.0/(1<<processor->level),
-                           dr, NULL, NULL,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
-           gegl_region_union_with_rect (processor->valid_region, dr);
+           GeglRectangle clipped;
+
+           /* dirty rectangles are aligned to the cells of the valid mask,
+            * only render the part we were asked for, but mark the whole
+            * cells as done.
+            */
+           if (gegl_rectangle_intersect (&clipped, dr, &processor->rectangle))
+             {
+               gegl_node_blit (processor->real_node, 1.0/(1<<processor->level),
+                               &clipped, NULL, NULL,
+                               GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+             }
+
+           if (gegl_parallel_is_cancelled ())
+             {
+               processor->dirty_rectangles =
+                 g_slist_prepend (processor->dirty_rectangles, dr);
+
+               return TRUE;
+             }
+
+           gegl_tile_mask_add_rect (processor->valid_mask, dr);
            g_slice_free (GeglRectangle, dr);
         }
     }
@@ -533,45 +629,37 @@ render_rectangle (GeglProcessor *processor)
 }
 
 
-static gint
+static gint64
 rect_area (GeglRectangle *rectangle)
 {
-  return rectangle->width * rectangle->height;
+  return (gint64) rectangle->width * rectangle->height;
 }
 
-/* returns the total area covered by a region */
-static gint
-region_area (GeglRegion *region)
+/* returns the area of the rectangle that is already rendered */
+static gint64
+valid_area (GeglProcessor *processor,
+            GeglRectangle *rectangle)
 {
-  GeglRectangle *rectangles;
-  gint           n_rectangles;
-  gint           i;
-  gint           sum = 0;
+  if (processor->valid_mask)
+    return gegl_tile_mask_get_area (processor->valid_mask, rectangle);
 
-  gegl_region_get_rectangles (region, &rectangles, &n_rectangles);
-
-  for (i = 0; i < n_rectangles; i++)
-    {
-      sum += rect_area (&rectangles[i]);
-    }
-  g_free (rectangles);
-
-  return sum;
+  return gegl_cache_get_valid_area (gegl_node_get_cache (processor->input),
+                                    rectangle, processor->level);
 }
 
-/* returns the area not covered by the rectangle */
-static gint
-area_left (GeglRegion    *area,
-           GeglRectangle *rectangle)
+/* finds a coalesced, cell aligned, rectangle of not yet rendered area */
+static gboolean
+get_invalid_rect (GeglProcessor *processor,
+                  GeglRectangle *rectangle,
+                  GeglRectangle *invalid_rect)
 {
-  GeglRegion *region;
-  gint        sum = 0;
+  if (processor->valid_mask)
+    return gegl_tile_mask_get_unset_rect (processor->valid_mask,
+                                          rectangle, invalid_rect);
 
-  region = gegl_region_rectangle (rectangle);
-  gegl_region_subtract (region, area);
-  sum += region_area (region);
-  gegl_region_destroy (region);
-  return sum;
+  return gegl_cache_get_invalid_rect (gegl_node_get_cache (processor->input),
+                                      rectangle, processor->level,
+                                      invalid_rect);
 }
 
 /* returns true if everything is rendered */
@@ -587,30 +675,20 @@ gegl_processor_is_rendered (GeglProcessor *processor)
 static gdouble
 gegl_processor_progress (GeglProcessor *processor)
 {
-  GeglRegion *valid_region;
-  gint        valid;
-  gint        wanted;
+  gint64      valid;
+  gint64      wanted;
   gdouble     ret;
 
   g_return_val_if_fail (processor->input != NULL, 1);
 
-  if (processor->valid_region)
-    {
-      valid_region = processor->valid_region;
-    }
-  else
-    {
-      valid_region = gegl_node_get_cache (processor->input)->valid_region[processor->level];
-    }
-
   wanted = rect_area (&(processor->rectangle));
-  valid  = wanted - area_left (valid_region, &(processor->rectangle));
   if (wanted == 0)
     {
       if (gegl_processor_is_rendered (processor))
         return 1.0;
       return 0.999;
     }
+  valid  = valid_area (processor, &(processor->rectangle));
 
   ret = (double) valid / wanted;
   if (ret>=1.0)
@@ -631,17 +709,7 @@ gegl_processor_render (GeglProcessor *processor,
                        GeglRectangle *rectangle,
                        gdouble       *progress)
 {
-  GeglRegion *valid_region;
-
-  if (processor->valid_region)
-    {
-      valid_region = processor->valid_region;
-    }
-  else
-    {
-      g_return_val_if_fail (processor->input != NULL, FALSE);
-      valid_region = gegl_node_get_cache (processor->input)->valid_region[processor->level];
-    }
+  g_return_val_if_fail (processor->input != NULL, FALSE);
 
   {
     gboolean more_work = render_rectangle (processor);
@@ -650,25 +718,18 @@ gegl_processor_render (GeglProcessor *processor,
       {
         if (progress)
           {
-            gint valid;
-            gint wanted;
-            if (rectangle)
-              {
-                wanted = rect_area (rectangle);
-                valid  = wanted - area_left (valid_region, rectangle);
-              }
-            else
-              {
-                valid  = region_area (valid_region);
-                wanted = region_area (processor->queued_region);
-              }
+            GeglRectangle *wanted_rect = rectangle ? rectangle
+                                                   : &processor->rectangle;
+            gint64         wanted      = rect_area (wanted_rect);
+
             if (wanted == 0)
               {
                 *progress = 1.0;
               }
             else
               {
-                *progress = (double) valid / wanted;
+                *progress = (double) valid_area (processor, wanted_rect) /
+                            wanted;
               }
           }
 
@@ -678,34 +739,17 @@ gegl_processor_render (GeglProcessor *processor,
 
   if (rectangle)
     { /* we're asked to work on a specific rectangle thus we only focus
-         on it */
-      GeglRegion    *region = gegl_region_rectangle (rectangle);
-      GeglRectangle *rectangles;
-      gint           n_rectangles;
-      gint           i;
-
-      gegl_region_subtract (region, valid_region);
-      gegl_region_get_rectangles (region, &rectangles, &n_rectangles);
-      gegl_region_destroy (region);
+         on it, queueing the next coalesced run of invalid cells */
+      GeglRectangle roi;
 
-      for (i = 0; i < n_rectangles && i < 1; i++)
+      if (get_invalid_rect (processor, rectangle, &roi))
         {
-          GeglRectangle  roi = rectangles[i];
-          GeglRegion    *tr = gegl_region_rectangle (&roi);
-          gegl_region_subtract (processor->queued_region, tr);
-          gegl_region_destroy (tr);
-
           processor->dirty_rectangles = g_slist_prepend (processor->dirty_rectangles,
                                                          g_slice_dup (GeglRectangle, &roi));
-        }
 
-      g_free (rectangles);
-
-      if (n_rectangles != 0)
-        {
           if (progress)
-            *progress = 1.0 - ((double) area_left (valid_region, rectangle) /
-                               rect_area (rectangle));
+            *progress = (double) valid_area (processor, rectangle) /
+                        MAX (rect_area (rectangle), 1);
           return TRUE;
         }
 
@@ -745,6 +789,262 @@ gegl_processor_render (GeglProcessor *processor,
   return !gegl_processor_is_rendered (processor);
 }
 
+static gboolean
+gegl_processor_is_progressive (GeglProcessor *processor)
+{
+  return processor->progressive_level > processor->level &&
+         ! GEGL_IS_OPERATION_SINK (processor->real_node->operation);
+}
+
+static gint
+compare_refine_tiles (gconstpointer a,
+                      gconstpointer b,
+                      gpointer      data)
+{
+  const GeglRectangle *ra     = a;
+  const GeglRectangle *rb     = b;
+  const GeglPoint     *center = data;
+  gint64               dxa    = ra->x * 2 + ra->width  - center->x * 2;
+  gint64               dya    = ra->y * 2 + ra->height - center->y * 2;
+  gint64               dxb    = rb->x * 2 + rb->width  - center->x * 2;
+  gint64               dyb    = rb->y * 2 + rb->height - center->y * 2;
+  gint64               da     = dxa * dxa + dya * dya;
+  gint64               db     = dxb * dxb + dyb * dyb;
+
+  return (da > db) - (da < db);
+}
+
+static void
+gegl_processor_sort_refinement (GeglProcessor *processor)
+{
+  GeglRectangle *rect = &processor->rectangle;
+  GeglPoint      center;
+
+  if (processor->have_priority_center)
+    {
+      center.x = processor->priority_center.x >> processor->level;
+      center.y = processor->priority_center.y >> processor->level;
+    }
+  else
+    {
+      center.x = rect->x + rect->width  / 2;
+      center.y = rect->y + rect->height / 2;
+    }
+
+  g_array_sort_with_data (processor->refine_tiles,
+                          compare_refine_tiles, &center);
+}
+
+/* appends the tiles of the cache's tile grid that intersect @roi, clipped
+ * to the rectangle, skipping the ones that are already pending.
+ */
+static void
+gegl_processor_append_refinement (GeglProcessor       *processor,
+                                  GeglBuffer          *buffer,
+                                  const GeglRectangle *roi)
+{
+  GeglRectangle *rect        = &processor->rectangle;
+  gint           tile_width  = buffer->tile_width;
+  gint           tile_height = buffer->tile_height;
+  guint          n_pending   = processor->refine_tiles->len;
+  gint           x, y;
+
+  for (y = gegl_tile_indice (roi->y, tile_height) * tile_height;
+       y < roi->y + roi->height;
+       y += tile_height)
+    {
+      for (x = gegl_tile_indice (roi->x, tile_width) * tile_width;
+           x < roi->x + roi->width;
+           x += tile_width)
+        {
+          GeglRectangle tile = { x, y, tile_width, tile_height };
+          guint         i;
+
+          if (! gegl_rectangle_intersect (&tile, &tile, rect))
+            continue;
+
+          for (i = processor->refine_next; i < n_pending; i++)
+            {
+              if (gegl_rectangle_equal (&tile,
+                                        &g_array_index (processor->refine_tiles,
+                                                        GeglRectangle, i)))
+                break;
+            }
+
+          if (i == n_pending)
+            g_array_append_val (processor->refine_tiles, tile);
+        }
+    }
+}
+
+/* requeues the refined tiles that intersect a region invalidated in the
+ * cache, so that edits are rendered again, also once the refinement is
+ * done.  @rect is at level 0, and an empty one invalidates the whole
+ * cache.
+ */
+static void
+gegl_processor_cache_invalidated (GeglCache           *cache,
+                                  const GeglRectangle *rect,
+                                  GeglProcessor       *processor)
+{
+  GeglRectangle roi;
+  gint          level = processor->level;
+
+  if (! processor->refining)
+    return;
+
+  if (gegl_rectangle_is_empty (rect))
+    {
+      roi = processor->rectangle;
+    }
+  else
+    {
+      gint64 x0 = (gint64) rect->x >> level;
+      gint64 y0 = (gint64) rect->y >> level;
+      gint64 x1 = -(-((gint64) rect->x + rect->width)  >> level);
+      gint64 y1 = -(-((gint64) rect->y + rect->height) >> level);
+
+      x0 = MAX (x0, processor->rectangle.x);
+      y0 = MAX (y0, processor->rectangle.y);
+      x1 = MIN (x1, (gint64) processor->rectangle.x + processor->rectangle.width);
+      y1 = MIN (y1, (gint64) processor->rectangle.y + processor->rectangle.height);
+
+      if (x1 <= x0 || y1 <= y0)
+        return;
+
+      gegl_rectangle_set (&roi, x0, y0, x1 - x0, y1 - y0);
+    }
+
+  g_array_remove_range (processor->refine_tiles, 0, processor->refine_next);
+  processor->refine_next = 0;
+
+  gegl_processor_append_refinement (processor, GEGL_BUFFER (cache), &roi);
+  gegl_processor_sort_refinement (processor);
+}
+
+/* splits the rectangle, at the final level, along the tile grid of the
+ * cache, ordered by the distance of the tiles to the priority center.
+ */
+static void
+gegl_processor_queue_refinement (GeglProcessor *processor)
+{
+  GeglCache *cache = gegl_node_get_cache (processor->input);
+
+  gegl_processor_reset_refinement (processor);
+  processor->refining = TRUE;
+
+  if (processor->refine_cache != cache)
+    {
+      if (processor->refine_cache)
+        {
+          g_signal_handler_disconnect (processor->refine_cache,
+                                       processor->refine_invalidated_handler);
+        }
+
+      g_set_object (&processor->refine_cache, cache);
+
+      processor->refine_invalidated_handler =
+        g_signal_connect (cache, "invalidated",
+                          G_CALLBACK (gegl_processor_cache_invalidated),
+                          processor);
+    }
+
+  if (gegl_rectangle_is_empty (&processor->rectangle))
+    return;
+
+  gegl_processor_append_refinement (processor, GEGL_BUFFER (cache),
+                                    &processor->rectangle);
+  gegl_processor_sort_refinement (processor);
+}
+
+/* progressive rendering first renders the whole rectangle at the coarse
+ * level, using the regular chunked rendering, and then refines it one tile
+ * at a time at the processor's level.
+ */
+static gboolean
+gegl_processor_work_progressive (GeglProcessor *processor,
+                                 gdouble       *progress)
+{
+  GeglCache  *cache  = gegl_node_get_cache (processor->input);
+  const Babl *format = gegl_buffer_get_format (GEGL_BUFFER (cache));
+  guint       n_tiles;
+
+  if (! processor->refining)
+    {
+      gint     level           = processor->level;
+      gdouble  coarse_progress = 0.0;
+      gboolean more_work;
+
+      processor->level = processor->progressive_level;
+      set_scaled_rectangle (processor);
+
+      more_work = gegl_processor_render (processor, &processor->rectangle,
+                                         &coarse_progress);
+
+      processor->level = level;
+      set_scaled_rectangle (processor);
+
+      if (more_work)
+        {
+          if (progress)
+            *progress = coarse_progress * GEGL_PROCESSOR_COARSE_SHARE;
+          return TRUE;
+        }
+
+      g_signal_emit (processor, gegl_processor_signals[COMPUTED], 0,
+                     &processor->rectangle_unscaled,
+                     processor->progressive_level);
+
+      gegl_processor_queue_refinement (processor);
+    }
+
+  n_tiles = processor->refine_tiles->len;
+
+  while (processor->refine_next < n_tiles)
+    {
+      GeglRectangle tile = g_array_index (processor->refine_tiles,
+                                          GeglRectangle,
+                                          processor->refine_next++);
+
+      if (! gegl_cache_is_valid (cache, &tile, processor->level))
+        {
+          GeglRectangle unscaled = { tile.x      << processor->level,
+                                     tile.y      << processor->level,
+                                     tile.width  << processor->level,
+                                     tile.height << processor->level };
+
+          gegl_node_blit (processor->input, 1.0 / (1 << processor->level),
+                          &tile, format, NULL,
+                          GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_CACHE);
+
+          /* retry the tile on the next call */
+          if (gegl_parallel_is_cancelled ())
+            {
+              processor->refine_next--;
+              break;
+            }
+
+          gegl_cache_computed (cache, &tile, processor->level);
+
+          g_signal_emit (processor, gegl_processor_signals[COMPUTED], 0,
+                         &unscaled, processor->level);
+          break;
+        }
+    }
+
+  /* the cache's invalidated handler may have requeued tiles */
+  n_tiles = processor->refine_tiles->len;
+
+  if (progress)
+    {
+      *progress = GEGL_PROCESSOR_COARSE_SHARE +
+                  (1.0 - GEGL_PROCESSOR_COARSE_SHARE) *
+                  (n_tiles ? (gdouble) processor->refine_next / n_tiles : 1.0);
+    }
+
+  return processor->refine_next < n_tiles;
+}
+
 static gboolean
 gegl_processor_work_is_opencl_node (GeglNode *node,
                                     gpointer  data)
@@ -755,9 +1055,9 @@ gegl_processor_work_is_opencl_node (GeglNode *node,
 
 /* Will call gegl_processor_render and when there is no more work to be done,
  * it will write the result to the destination */
-gboolean
-gegl_processor_work (GeglProcessor *processor,
-                     gdouble       *progress)
+static gboolean
+gegl_processor_work_internal (GeglProcessor *processor,
+                              gdouble       *progress)
 {
   gboolean   more_work = FALSE;
 
@@ -778,6 +1078,9 @@ gegl_processor_work (GeglProcessor *processor,
         }
     }
 
+  if (gegl_processor_is_progressive (processor))
+    return gegl_processor_work_progressive (processor, progress);
+
   more_work = gegl_processor_render (processor, &processor->rectangle, progress);
   if (more_work)
     {
@@ -796,6 +1099,11 @@ gegl_processor_work (GeglProcessor *processor,
                               processor->context,
                               "output"  /* ignored output_pad */,
                               &processor->context->result_rect, processor->context->level);
+
+      /* the sink is written again when work resumes */
+      if (gegl_parallel_is_cancelled ())
+        return TRUE;
+
       gegl_operation_context_destroy (processor->context);
       processor->context = NULL;
 
@@ -805,6 +1113,50 @@ gegl_processor_work (GeglProcessor *processor,
   return FALSE;
 }
 
+gboolean
+gegl_processor_work (GeglProcessor *processor,
+                     gdouble       *progress)
+{
+  gboolean more_work;
+
+  if (! processor->cancellable && ! processor->deadline)
+    return gegl_processor_work_internal (processor, progress);
+
+  gegl_parallel_push_cancellable (processor->cancellable,
+                                  processor->deadline);
+
+  more_work = gegl_processor_work_internal (processor, progress);
+
+  /* a cancelled processor has no more work to do, until it is given a new
+   * cancellable or deadline
+   */
+  if (gegl_parallel_is_cancelled ())
+    more_work = FALSE;
+
+  gegl_parallel_pop_cancellable ();
+
+  return more_work;
+}
+
+void
+gegl_processor_set_cancellable (GeglProcessor *processor,
+                                GCancellable  *cancellable)
+{
+  g_return_if_fail (GEGL_IS_PROCESSOR (processor));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  g_set_object (&processor->cancellable, cancellable);
+}
+
+void
+gegl_processor_set_deadline (GeglProcessor *processor,
+                             gint64         deadline)
+{
+  g_return_if_fail (GEGL_IS_PROCESSOR (processor));
+
+  processor->deadline = deadline;
+}
+
 GeglProcessor *
 gegl_node_new_processor (GeglNode            *node,
                          const GeglRectangle *rectangle)
@@ -822,6 +1174,7 @@ void gegl_processor_set_level (GeglProcessor *processor,
 {
   processor->level = level;
   set_scaled_rectangle (processor);
+  gegl_processor_reset_refinement (processor);
 }
 
 GeglBuffer *gegl_processor_get_buffer (GeglProcessor *processor)
@@ -835,4 +1188,52 @@ void gegl_processor_set_scale (GeglProcessor *processor,
 {
   processor->level = gegl_level_from_scale (scale);
   set_scaled_rectangle (processor);
+  gegl_processor_reset_refinement (processor);
+}
+
+void
+gegl_processor_set_progressive (GeglProcessor *processor,
+                                gint           coarse_level)
+{
+  g_return_if_fail (GEGL_IS_PROCESSOR (processor));
+
+  processor->progressive_level = CLAMP (coarse_level, 0,
+                                        GEGL_CACHE_VALID_MIPMAPS - 1);
+  gegl_processor_reset_refinement (processor);
+}
+
+void
+gegl_processor_set_priority_center (GeglProcessor *processor,
+                                    gint           x,
+                                    gint           y)
+{
+  g_return_if_fail (GEGL_IS_PROCESSOR (processor));
+
+  processor->have_priority_center = TRUE;
+  processor->priority_center.x    = x;
+  processor->priority_center.y    = y;
+
+  /* reorder the pending tiles around the new center */
+  if (processor->refining && processor->refine_next < processor->refine_tiles->len)
+    {
+      GeglPoint center = { x >> processor->level, y >> processor->level };
+
+      g_array_remove_range (processor->refine_tiles, 0, processor->refine_next);
+      processor->refine_next = 0;
+
+      g_array_sort_with_data (processor->refine_tiles,
+                              compare_refine_tiles, &center);
+    }
+}
+
+void
+gegl_processor_cancel_refinement (GeglProcessor *processor)
+{
+  g_return_if_fail (GEGL_IS_PROCESSOR (processor));
+
+  if (processor->refining)
+    {
+      g_array_set_size (processor->refine_tiles, 0);
+      processor->refine_next = 0;
+    }
 }
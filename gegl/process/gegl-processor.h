@@ -78,6 +78,76 @@ void           gegl_processor_set_rectangle (GeglProcessor       *processor,
  */
 gboolean       gegl_processor_work          (GeglProcessor *processor,
                                              gdouble       *progress);
+/**
+ * gegl_processor_set_progressive:
+ * @processor: a #GeglProcessor
+ * @coarse_level: the mipmap level of the preview pass, or 0 to disable
+ * progressive rendering.
+ *
+ * Make the processor render progressively: gegl_processor_work() first
+ * renders the whole rectangle at @coarse_level, and then refines it tile by
+ * tile at the processor's own level, starting with the tiles closest to the
+ * priority center. The #GeglProcessor::computed signal is emitted when the
+ * coarse pass is done, and for every refined tile. Once the coarse pass is
+ * done, tiles invalidated in the node's cache are queued for refinement
+ * again, also after the refinement is complete. Progressive rendering is
+ * ignored for sink nodes, and only saves work when mipmap rendering is
+ * enabled in #GeglConfig.
+ */
+void           gegl_processor_set_progressive (GeglProcessor *processor,
+                                               gint           coarse_level);
+
+/**
+ * gegl_processor_set_priority_center:
+ * @processor: a #GeglProcessor
+ * @x: x coordinate, in the coordinate system of gegl_processor_set_rectangle()
+ * @y: y coordinate
+ *
+ * Set the point that progressive refinement is ordered around, like the
+ * cursor position or the center of the viewport. Pending refinement is
+ * reordered. Defaults to the center of the processor's rectangle.
+ */
+void           gegl_processor_set_priority_center (GeglProcessor *processor,
+                                                   gint           x,
+                                                   gint           y);
+
+/**
+ * gegl_processor_cancel_refinement:
+ * @processor: a #GeglProcessor
+ *
+ * Drop the pending refinement tiles of a progressive processor, the coarse
+ * result stays available in the cache. gegl_processor_work() returns FALSE
+ * until the rectangle or level is changed, which restarts rendering, or
+ * until tiles are invalidated in the cache, which are refined again.
+ */
+void           gegl_processor_cancel_refinement (GeglProcessor *processor);
+
+/**
+ * gegl_processor_set_cancellable:
+ * @processor: a #GeglProcessor
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ *
+ * Make gegl_processor_work() stop rendering once @cancellable is cancelled.
+ * The operations in flight return at their next chunk boundary, the
+ * partially rendered area is not marked as valid, and gegl_processor_work()
+ * returns FALSE. Setting a new cancellable, or %NULL, resumes rendering
+ * where it was cancelled.
+ */
+void           gegl_processor_set_cancellable (GeglProcessor *processor,
+                                               GCancellable  *cancellable);
+
+/**
+ * gegl_processor_set_deadline:
+ * @processor: a #GeglProcessor
+ * @deadline: a g_get_monotonic_time() timestamp, or 0 for no deadline
+ *
+ * Make gegl_processor_work() stop rendering once @deadline has passed, in
+ * the same way as when its cancellable is cancelled. Setting a later
+ * deadline, or 0, resumes rendering.
+ */
+void           gegl_processor_set_deadline    (GeglProcessor *processor,
+                                               gint64         deadline);
+
 /**
  * gegl_processor_get_buffer:
  * @processor: a #GeglProcessor
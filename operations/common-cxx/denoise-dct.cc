@@ -41,222 +41,254 @@ property_double (sigma, _("Strength"), 5.0)
 
 #else
 
-#define GEGL_OP_FILTER
+#define GEGL_OP_AREA_FILTER
 #define GEGL_OP_NAME     denoise_dct
 #define GEGL_OP_C_SOURCE denoise-dct.cc
 #include "gegl-op.h"
 #include "dct-basis.inc"
 
-/* 1 dimensional Discret Cosine Transform of a signal of size 8x1. */
+/* The output is computed by blocks of at most BLOCK_SIZE x BLOCK_SIZE pixels,
+ * each denoised separately from the input around it, so that the memory used
+ * only depends on the size of the blocks.
+ */
+#define BLOCK_SIZE 128
 
-static void
-dct_1d_8x8 (gfloat  *in,
-            gfloat  *out,
-            gboolean forward)
+/* The image is denoised by transforming every patch of N x N pixels fully
+ * inside the input, thresholding its coefficients, transforming it back, and
+ * averaging the results for each pixel over all the patches containing it.
+ *
+ * The channels are stored in separate planes, and the 2 dimensional DCT is
+ * written as products with the basis matrix whose inner loops run along
+ * contiguous rows of N floats, which lets the compiler vectorize them in the
+ * SIMD variants of the module.
+ */
+
+template <gint N>
+struct DctBasis
 {
-  gint  i, j;
+  gfloat basis[N][N];            /* basis[j][i], each row is a basis vector */
+  gfloat basis_t[N][N];          /* the transposed basis                    */
 
-  if (forward)
-    {
-      for (j = 0; j < 8; j++)
+  DctBasis (const gfloat (*b)[N])
+  {
+    for (gint j = 0; j < N; j++)
+      for (gint i = 0; i < N; i++)
         {
-          for (i = 0; i < 8; i++)
-            {
-              out[0] += in[i*3]   * DCTbasis8x8[j][i];
-              out[1] += in[i*3+1] * DCTbasis8x8[j][i];
-              out[2] += in[i*3+2] * DCTbasis8x8[j][i];
-            }
-
-          out += 3;
+          basis[j][i]   = b[j][i];
+          basis_t[i][j] = b[j][i];
         }
-    }
-  else
+  }
+};
+
+/* out = a * b, for N x N matrices */
+template <gint N>
+static inline void
+matrix_multiply (const gfloat (*a)[N],
+                 const gfloat (*b)[N],
+                 gfloat       (*out)[N])
+{
+  for (gint j = 0; j < N; j++)
     {
-      for (j = 0; j < 8; j++)
-        {
-          for (i = 0; i < 8; i ++)
-            {
-              out[0] += in[i*3]   * DCTbasis8x8[i][j];
-              out[1] += in[i*3+1] * DCTbasis8x8[i][j];
-              out[2] += in[i*3+2] * DCTbasis8x8[i][j];
-            }
-
-          out += 3;
-        }
-    }
-}
-
-/* 1 dimensional Discret Cosine Transform of a signal of size 16x1. */
+      gfloat row[N];
 
-static void
-dct_1d_16x16 (gfloat  *in,
-              gfloat  *out,
-              gboolean forward)
-{
-  gint  i, j;
+      for (gint k = 0; k < N; k++)
+        row[k] = a[j][0] * b[0][k];
 
-  if (forward)
-    {
-      for (j = 0; j < 16; j++)
-        {
-          for (i = 0; i < 16; i++)
-            {
-              out[0] += in[i*3]   * DCTbasis16x16[j][i];
-              out[1] += in[i*3+1] * DCTbasis16x16[j][i];
-              out[2] += in[i*3+2] * DCTbasis16x16[j][i];
-            }
-
-          out += 3;
-        }
-    }
-  else
-    {
-      for (j = 0; j < 16; j++)
+      for (gint i = 1; i < N; i++)
         {
-          for (i = 0; i < 16; i ++)
-            {
-              out[0] += in[i*3]   * DCTbasis16x16[i][j];
-              out[1] += in[i*3+1] * DCTbasis16x16[i][j];
-              out[2] += in[i*3+2] * DCTbasis16x16[i][j];
-            }
-
-          out += 3;
+          const gfloat a_ji = a[j][i];
+
+          /* keep the loop along the row, rather than having it unrolled
+           * and the loop over i vectorized, which is a lot slower
+           */
+#pragma GCC unroll 1
+          for (gint k = 0; k < N; k++)
+            row[k] += a_ji * b[i][k];
         }
+
+      for (gint k = 0; k < N; k++)
+        out[j][k] = row[k];
     }
 }
 
-/* 2 dimensional DCT of a 8x8 (or 16x16) patch */
-
-static void
-dct_2d (gfloat   *patch,
-        gint      patch_size,
-        gboolean  forward)
+/* denoise one channel of a patch, in place */
+template <gint N>
+static inline void
+denoise_patch (const DctBasis<N> *dct,
+               gfloat            (*patch)[N],
+               gfloat              threshold)
 {
-  gfloat  *tmp1;
-  gfloat  *tmp2;
-  gint     x, y;
+  gfloat tmp[N][N];
 
-  tmp1 = g_new0 (gfloat, patch_size * patch_size * 3);
-  tmp2 = g_new (gfloat, patch_size * patch_size * 3);
+  /* forward transform, basis * patch * basis_t */
+  matrix_multiply<N> (dct->basis, patch, tmp);
+  matrix_multiply<N> (tmp, dct->basis_t, patch);
 
-  /* transform row by row */
+  for (gint j = 0; j < N; j++)
+    for (gint i = 0; i < N; i++)
+      patch[j][i] = fabsf (patch[j][i]) < threshold ? 0.f : patch[j][i];
 
-  if (patch_size == 8)
-    {
-      for (y = 0; y < 8; y++)
-        {
-          dct_1d_8x8 (patch + y * 8 * 3,
-                      tmp1 + y * 8 * 3,
-                      forward);
-        }
-    }
-  else
-    {
-      for (y = 0; y < 16; y++)
-        {
-          dct_1d_16x16 (patch + y * 16 * 3,
-                        tmp1 + y * 16 * 3,
-                        forward);
-        }
-    }
-
-  /* transform column by column (by transposing the matrix, transforming row by
-   * row, and transposing again the matrix.)
-   */
-
-  for (y = 0; y < patch_size; y++)
-    {
-      for (x = 0; x < patch_size; x++)
-        {
-          tmp2[(y + x * patch_size) * 3]   = tmp1[(x + y * patch_size) * 3];
-          tmp2[(y + x * patch_size) * 3+1] = tmp1[(x + y * patch_size) * 3+1];
-          tmp2[(y + x * patch_size) * 3+2] = tmp1[(x + y * patch_size) * 3+2];
-        }
-    }
-
-  memset (tmp1, 0.f, patch_size * patch_size * 3 * sizeof(gfloat));
-
-  if (patch_size == 8)
-    {
-      for (y = 0; y < 8; y++)
-        {
-          dct_1d_8x8 (tmp2 + y * 8 * 3,
-                      tmp1 + y * 8 * 3,
-                      forward);
-        }
-    }
-  else
-    {
-      for (y = 0; y < 16; y++)
-        {
-          dct_1d_16x16 (tmp2 + y * 16 * 3,
-                        tmp1 + y * 16 * 3,
-                        forward);
-        }
-    }
-
-  for (y = 0; y < patch_size; y++)
-    {
-      for (x = 0; x < patch_size; x++)
-        {
-          patch[(y + x * patch_size) * 3]   = tmp1[(x + y * patch_size) * 3];
-          patch[(y + x * patch_size) * 3+1] = tmp1[(x + y * patch_size) * 3+1];
-          patch[(y + x * patch_size) * 3+2] = tmp1[(x + y * patch_size) * 3+2];
-        }
-    }
+  /* inverse transform, basis_t * patch * basis */
+  matrix_multiply<N> (dct->basis_t, patch, tmp);
+  matrix_multiply<N> (tmp, dct->basis, patch);
+}
 
-  g_free (tmp1);
-  g_free (tmp2);
+/* the number of the patches starting in [first, last] that contain x */
+static inline gint
+count_patches (gint x,
+               gint patch_size,
+               gint first,
+               gint last)
+{
+  return MIN (x, last) - MAX (x - patch_size + 1, first) + 1;
 }
 
+template <gint N>
 static void
-threshold_patch_coefficients (gfloat  *patch,
-                              gint     patch_n_pixels,
-                              gfloat   threshold)
+denoise_area (GeglBuffer          *input,
+              GeglBuffer          *output,
+              const GeglRectangle *area,
+              const GeglRectangle *in_rect,
+              const Babl          *format,
+              const gfloat       (*basis)[N],
+              gfloat               threshold)
 {
-  gint     i;
-  gfloat  *p = patch;
+  const DctBasis<N> dct (basis);
+  const gint  max_size  = BLOCK_SIZE + 2 * (N - 1);
+  gfloat     *in_buf    = g_new (gfloat, max_size * max_size * 4);
+  gfloat     *planes    = g_new (gfloat, max_size * max_size * 3);
+  gfloat     *sums      = g_new (gfloat, max_size * max_size * 3);
+  gfloat     *out_buf   = g_new (gfloat, BLOCK_SIZE * BLOCK_SIZE * 4);
+  /* the first and last positions of the patches in the input */
+  const gint  first_x   = in_rect->x;
+  const gint  first_y   = in_rect->y;
+  const gint  last_x    = in_rect->x + in_rect->width  - N;
+  const gint  last_y    = in_rect->y + in_rect->height - N;
+  gint        block_x, block_y;
+
+  for (block_y = area->y;
+       block_y < area->y + area->height;
+       block_y += BLOCK_SIZE)
+    for (block_x = area->x;
+         block_x < area->x + area->width;
+         block_x += BLOCK_SIZE)
+      {
+        GeglRectangle block = {
+          block_x,
+          block_y,
+          MIN (BLOCK_SIZE, area->x + area->width  - block_x),
+          MIN (BLOCK_SIZE, area->y + area->height - block_y)
+        };
+        /* the patches containing pixels of the block */
+        const gint    x0 = MAX (block.x - N + 1, first_x);
+        const gint    y0 = MAX (block.y - N + 1, first_y);
+        const gint    x1 = MIN (block.x + block.width  - 1, last_x);
+        const gint    y1 = MIN (block.y + block.height - 1, last_y);
+        GeglRectangle src;
+        gint          plane_size;
+        gint          x, y, c, j, i;
+
+        src.x      = x0;
+        src.y      = y0;
+        src.width  = x1 + N - x0;
+        src.height = y1 + N - y0;
+        plane_size = src.width * src.height;
+
+        gegl_buffer_get (input, &src, 1.0, format, in_buf,
+                         GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+        for (i = 0; i < plane_size; i++)
+          for (c = 0; c < 3; c++)
+            planes[c * plane_size + i] = in_buf[4 * i + c];
+
+        memset (sums, 0, 3 * plane_size * sizeof (gfloat));
+
+        for (c = 0; c < 3; c++)
+          {
+            const gfloat *plane = planes + c * plane_size;
+            gfloat       *sum   = sums   + c * plane_size;
+
+            for (y = 0; y <= y1 - y0; y++)
+              for (x = 0; x <= x1 - x0; x++)
+                {
+                  gfloat patch[N][N];
 
-  for (i = 0; i < patch_n_pixels; i++)
-    {
-      p[0] = ABS (p[0]) < threshold ? 0.f : p[0];
-      p[1] = ABS (p[1]) < threshold ? 0.f : p[1];
-      p[2] = ABS (p[2]) < threshold ? 0.f : p[2];
-      p += 3;
-    }
+                  for (j = 0; j < N; j++)
+                    for (i = 0; i < N; i++)
+                      patch[j][i] = plane[(y + j) * src.width + x + i];
+
+                  denoise_patch<N> (&dct, patch, threshold);
+
+                  for (j = 0; j < N; j++)
+                    for (i = 0; i < N; i++)
+                      sum[(y + j) * src.width + x + i] += patch[j][i];
+                }
+          }
+
+        /* average the sums over the patches each pixel belongs to, and keep
+         * the original alpha
+         */
+        for (y = 0; y < block.height; y++)
+          {
+            const gint n_y = count_patches (block.y + y, N, y0, y1);
+            const gint row = (block.y + y - src.y) * src.width +
+                             block.x - src.x;
+
+            for (x = 0; x < block.width; x++)
+              {
+                const gint   n_x = count_patches (block.x + x, N, x0, x1);
+                const gfloat n   = 1.f / (gfloat) (n_x * n_y);
+                gfloat      *out = out_buf + 4 * (y * block.width + x);
+
+                for (c = 0; c < 3; c++)
+                  out[c] = sums[c * plane_size + row + x] * n;
+                out[3] = in_buf[4 * (row + x) + 3];
+              }
+          }
+
+        gegl_buffer_set (output, &block, 0, format, out_buf,
+                         GEGL_AUTO_ROWSTRIDE);
+      }
+
+  g_free (in_buf);
+  g_free (planes);
+  g_free (sums);
+  g_free (out_buf);
 }
 
 static void
 prepare (GeglOperation *operation)
 {
-  const Babl *space  = gegl_operation_get_source_space (operation, "input");
-  const Babl *format = babl_format_with_space ("R'G'B'A float", space);
+  GeglProperties          *o       = GEGL_PROPERTIES (operation);
+  GeglOperationAreaFilter *op_area = GEGL_OPERATION_AREA_FILTER (operation);
+  const Babl              *space   = gegl_operation_get_source_space (operation, "input");
+  const Babl              *format  = babl_format_with_space ("R'G'B'A float", space);
+  gint                     patch_size;
+
+  patch_size = o->patch_size == GEGL_DENOISE_DCT_8X8 ? 8 : 16;
+
+  /* the patches containing a pixel reach patch_size - 1 pixels around it */
+  op_area->left   =
+  op_area->right  =
+  op_area->top    =
+  op_area->bottom = patch_size - 1;
 
   gegl_operation_set_format (operation, "input", format);
   gegl_operation_set_format (operation, "output", format);
 }
 
 static GeglRectangle
-get_cached_region (GeglOperation       *operation,
-                   const GeglRectangle *roi)
+get_bounding_box (GeglOperation *operation)
 {
   const GeglRectangle *in_rect =
       gegl_operation_source_get_bounding_box (operation, "input");
 
-  if (! in_rect || gegl_rectangle_is_infinite_plane (in_rect))
-    return *roi;
+  if (! in_rect)
+    return *GEGL_RECTANGLE (0, 0, 0, 0);
 
   return *in_rect;
 }
 
-static GeglRectangle
-get_required_for_output (GeglOperation       *operation,
-                         const gchar         *input_pad,
-                         const GeglRectangle *roi)
-{
-  return get_cached_region (operation, roi);
-}
-
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *input,
@@ -264,171 +296,32 @@ process (GeglOperation       *operation,
          const GeglRectangle *result,
          gint                 level)
 {
-  GeglProperties *o  = GEGL_PROPERTIES (operation);
-  const Babl *space  = gegl_operation_get_source_space (operation, "input");
-  const Babl *rgb_f  = babl_format_with_space ("R'G'B' float", space);
-  const Babl *rgba_f = babl_format_with_space ("R'G'B'A float", space);
-
-  GeglBuffer  *sum;
-  gint    width, height;
-  gint    patch_size;
-  gint    patch_len;
-  gfloat  threshold;
-  gdouble progress;
-  gint   *patch_n_x;
-  gint   *patch_n_y;
-  gint    i;
-
-  width  = gegl_buffer_get_width (input);
-  height = gegl_buffer_get_height (input);
-  patch_size = o->patch_size == GEGL_DENOISE_DCT_8X8 ? 8 : 16;
-  patch_len = patch_size * patch_size;
-  threshold = 3.f * (gfloat) o->sigma / 255.;
-
-  sum = gegl_buffer_new (GEGL_RECTANGLE(0, 0, width, height), rgb_f);
-
-  patch_n_x = g_new (gint, width);
-  patch_n_y = g_new (gint, height);
+  GeglProperties      *o      = GEGL_PROPERTIES (operation);
+  const Babl          *format = gegl_operation_get_format (operation, "output");
+  const GeglRectangle *in_rect;
+  gint                 patch_size;
+  gfloat               threshold;
 
-  GeglBufferIterator  *iter;
-  gint                 x_offset;
-
-  gegl_operation_progress (operation, 0.0, (gchar *) "");
-
-  for (x_offset = 0; x_offset < patch_size; x_offset++)
-    {
-      /* Input buffer is split into vertical non-overlapping regions.
-       * Regions are distributed among threads.
-       */
-
-      gint n_regions = (width - x_offset) / patch_size;
-
-      gegl_parallel_distribute_range (
-        n_regions, gegl_operation_get_pixels_per_thread (operation)
-           / (height * patch_size),
-        [=] (gint region0, gint n)
-        {
-          gint     x, y, j;
-          gfloat  *in_buf;
-          gfloat  *sum_buf;
-          gfloat  *patch_buf;
-
-          in_buf    = g_new (gfloat, patch_size * height * 3);
-          sum_buf   = g_new (gfloat, patch_size * height * 3);
-          patch_buf = g_new (gfloat, patch_len * 3);
-
-          for (x = region0; x < region0 + n; x++)
-            {
-              /* Threads manage one region at a time:
-               * for each overlapping patch from top to bottom:
-               *    1. extract patch
-               *    2. dc transform, thresholding, inverse transform
-               *    3. sum the patch result into the sum memory buffer
-               * set the gegl buffer with the sum memory buffer
-               */
-
-              GeglRectangle  roi = {x * patch_size + x_offset,
-                                    0,
-                                    patch_size,
-                                    height};
-              gint patch_offset  = 0;
-
-              gegl_buffer_get (input, &roi, 1.0, rgb_f, in_buf,
-                               GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-              gegl_buffer_get (sum, &roi, 1.0, rgb_f, sum_buf,
-                               GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-              for (y = 0; y < height - patch_size + 1; y++)
-                {
-                  gfloat  *sum_p   = sum_buf + patch_offset;
-                  gfloat  *patch_p = patch_buf;
-
-                  memcpy (patch_buf, in_buf + patch_offset,
-                          patch_len * 3 * sizeof(gfloat));
-                  dct_2d (patch_buf, patch_size, TRUE);
-                  threshold_patch_coefficients (patch_buf, patch_len, threshold);
-                  dct_2d (patch_buf, patch_size, FALSE);
-
-                  for (j = 0; j < patch_len * 3; j++)
-                    {
-                      *sum_p++ += *patch_p++;
-                    }
-
-                  patch_offset += patch_size * 3;
-                }
-
-              gegl_buffer_set (sum, &roi, 0, rgb_f, sum_buf,
-                               GEGL_AUTO_ROWSTRIDE);
-            }
-
-          g_free (in_buf);
-          g_free (sum_buf);
-          g_free (patch_buf);
-        });
-
-      progress = (gdouble) (x_offset + 1) / (gdouble) patch_size;
-      gegl_operation_progress (operation, progress, (gchar *) "");
-    }
+  in_rect    = gegl_operation_source_get_bounding_box (operation, "input");
+  patch_size = o->patch_size == GEGL_DENOISE_DCT_8X8 ? 8 : 16;
+  threshold  = 3.f * (gfloat) o->sigma / 255.;
 
-  /* Finally, average the accumulated values of the sum buffer, given the
-   *  appropriate number of patches a pixel belongs to.
-   *  Put the result in the ouput buffer with the original alpha value.
+  /* every pixel costs about 4 * patch_size multiply-adds per pixel of a
+   * patch, for each of the patch_size * patch_size patches containing it
    */
-
-  for (i = 0; i < patch_size; i++)
+  gegl_parallel_distribute_area (
+    result,
+    gegl_operation_get_pixels_per_thread (operation) /
+      (patch_size * patch_size * patch_size),
+    [=] (const GeglRectangle *area)
     {
-      patch_n_x[i] = patch_n_x[width -1 - i] = i+1;
-      patch_n_y[i] = patch_n_y[height -1 -i] = i+1;
-    }
-
-  for (i = patch_size; i <= width - patch_size; i++)
-    patch_n_x[i] = patch_size;
-
-  for (i = patch_size; i <= height - patch_size; i++)
-    patch_n_y[i] = patch_size;
-
-  iter = gegl_buffer_iterator_new (input, NULL, 0, rgba_f,
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 3);
-
-  gegl_buffer_iterator_add (iter, sum, NULL, 0, rgb_f,
-                            GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, output, NULL, 0, rgba_f,
-                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
-    {
-      gfloat  *in   = (gfloat *) iter->items[0].data;
-      gfloat  *sum  = (gfloat *) iter->items[1].data;
-      gfloat  *out  = (gfloat *) iter->items[2].data;
-      GeglRectangle *roi = &iter->items[0].roi;
-      gint     x, y;
-
-      for (y = roi->y; y < roi->y + roi->height; y++)
-        {
-          for (x = roi->x; x < roi->x + roi->width; x++)
-            {
-              gint   n_patches = patch_n_x[x] * patch_n_y[y];
-              gfloat n = 1.f / (gfloat) n_patches;
-
-              out[0] = sum[0] * n;
-              out[1] = sum[1] * n;
-              out[2] = sum[2] * n;
-              out[3] = in[3];
-
-              in  += 4;
-              sum += 3;
-              out += 4;
-            }
-        }
-    }
-
-  gegl_operation_progress (operation, 1.0, (gchar *) "");
-
-  g_object_unref (sum);
-  g_free (patch_n_x);
-  g_free (patch_n_y);
+      if (patch_size == 8)
+        denoise_area<8>  (input, output, area, in_rect, format,
+                          DCTbasis8x8, threshold);
+      else
+        denoise_area<16> (input, output, area, in_rect, format,
+                          DCTbasis16x16, threshold);
+    });
 
   return TRUE;
 }
@@ -474,12 +367,11 @@ gegl_op_class_init (GeglOpClass *klass)
   operation_class = GEGL_OPERATION_CLASS (klass);
   filter_class    = GEGL_OPERATION_FILTER_CLASS (klass);
 
-  operation_class->threaded                = FALSE;
-  operation_class->prepare                 = prepare;
-  operation_class->process                 = operation_process;
-  operation_class->get_cached_region       = get_cached_region;
-  operation_class->get_required_for_output = get_required_for_output;
-  filter_class->process                    = process;
+  operation_class->threaded         = FALSE;
+  operation_class->prepare          = prepare;
+  operation_class->process          = operation_process;
+  operation_class->get_bounding_box = get_bounding_box;
+  filter_class->process             = process;
 
   gegl_operation_class_set_keys (operation_class,
     "name",        "gegl:denoise-dct",
@@ -300,6 +300,10 @@ process (GeglOperation       *operation,
       gint r1, r2;
       gint x;
 
+      /* the result of a cancelled render is discarded, stop early */
+      if (gegl_parallel_is_cancelled ())
+        break;
+
       memset (out,   0, 4 * sizeof (gfloat) * roi->width);
       memset (out_w, 0,     sizeof (gfloat) * roi->width);
 
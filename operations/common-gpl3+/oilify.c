@@ -22,6 +22,7 @@
 
 #include "config.h"
 #include <glib/gi18n-lib.h>
+#include <string.h>
 
 #ifdef GEGL_PROPERTIES
 
@@ -54,6 +55,35 @@ property_boolean (use_inten, _("Intensity mode"), TRUE)
 
 #define NUM_INTENSITIES       256
 
+/* in intensity mode, the colors accumulated for each intensity are kept in
+ * fixed point, so that pixels can be removed from the histogram exactly as
+ * they were added when the window slides.  values are rounded to the
+ * nearest step, so the sums carry no bias, and stay well within a float ulp
+ * of the float sums of the per-pixel histograms.
+ */
+#define FIXED_ONE             ((gdouble) (G_GINT64_CONSTANT (1) << 38))
+#define TO_FIXED(value)       ((gint64) floor ((gdouble) (value) * FIXED_ONE + 0.5))
+
+typedef struct
+{
+  gint   hist[NUM_INTENSITIES][4];
+  gint   hist_inten[NUM_INTENSITIES];
+  gint64 cumulative_rgb[NUM_INTENSITIES][4];
+} Histogram;
+
+typedef struct
+{
+  GeglProperties      *o;
+  const GeglRectangle *result;
+  gint                 src_width;
+  const gfloat        *src_buf;
+  const guint8        *bins;       /* per component intensities       */
+  const guint8        *inten_bins; /* pixel intensities, or NULL      */
+  const gfloat        *mask_radius_buf;
+  const gfloat        *exponent_buf;
+  gfloat              *dst_buf;
+} ThreadData;
+
 static void
 clamp_buffer_values (gfloat  *buf,
                      gint     n_components,
@@ -65,101 +95,86 @@ clamp_buffer_values (gfloat  *buf,
     buf[i] = CLAMP (buf[i], 0.f, 1.f);
 }
 
-/* Get the pixel from x, y offset from the center pixel src_pix */
+static void
+compute_bins (const gfloat *buf,
+              guint8       *bins,
+              gint          n_values,
+              gint          intensities)
+{
+  gint i;
+
+  for (i = 0; i < n_values; i++)
+    bins[i] = buf[i] * (intensities - 1);
+}
 
 static void
-get_pixel (gint    x,
-           gint    y,
-           gint    buf_width,
-           gfloat *src_begin,
-           gfloat *dst)
+histogram_clear (Histogram        *hist,
+                 const ThreadData *data)
 {
-  gint    b;
-  gfloat *src = src_begin + 4 * (x + buf_width * y);
+  gint intensities = data->o->intensities;
 
-  for (b = 0; b < 4; b++)
+  if (data->inten_bins)
     {
-      dst[b] = src[b];
+      memset (hist->hist_inten, 0, intensities * sizeof (hist->hist_inten[0]));
+      memset (hist->cumulative_rgb, 0,
+              intensities * sizeof (hist->cumulative_rgb[0]));
+    }
+  else
+    {
+      memset (hist->hist, 0, intensities * sizeof (hist->hist[0]));
     }
 }
 
-static void
-get_pixel_inten (gint    x,
-                 gint    y,
-                 gint    buf_width,
-                 gfloat *inten_begin,
-                 gfloat *dst)
+/* add (delta = 1) or remove (delta = -1) the pixel at offset in the source
+ * buffer
+ */
+static inline void
+histogram_update (Histogram        *hist,
+                  const ThreadData *data,
+                  gint              offset,
+                  gint              delta)
 {
-  *dst = *(inten_begin + (x + buf_width*y));
+  gint b;
+
+  if (data->inten_bins)
+    {
+      const gfloat *pixel     = data->src_buf + 4 * offset;
+      gint          intensity = data->inten_bins[offset];
+
+      hist->hist_inten[intensity] += delta;
+
+      for (b = 0; b < 4; b++)
+        hist->cumulative_rgb[intensity][b] += delta * TO_FIXED (pixel[b]);
+    }
+  else
+    {
+      const guint8 *bins = data->bins + 4 * offset;
+
+      for (b = 0; b < 4; b++)
+        hist->hist[bins[b]][b] += delta;
+    }
 }
 
 static void
-oilify_pixel_inten (gint     x,
-                    gint     y,
-                    gdouble  radius,
-                    gint     exponent,
-                    gint     intensities,
-                    gint     buf_width,
-                    gfloat  *src_buf,
-                    gfloat  *inten_buf,
-                    gfloat  *dst_pixel)
+oilify_pixel_inten (const Histogram *hist,
+                    gint             exponent,
+                    gint             intensities,
+                    gfloat          *dst_pixel)
 {
-  gfloat cumulative_rgb[4][NUM_INTENSITIES];
-  gint   hist_inten[NUM_INTENSITIES];
   gfloat mult_inten;
-  gfloat temp_pixel[4];
-  gint   ceil_radius = ceil (radius);
-  gdouble radius_sq = radius * radius;
   gint i, j, b;
   gint inten_max;
-  gint intensity;
-  gfloat ratio, temp_inten_pixel;
+  gfloat ratio;
   gfloat weight;
   gfloat color[4];
   gfloat div;
 
-  for (i = 0; i < intensities; i++)
-    {
-      hist_inten[i] = 0;
-
-      for (b = 0; b < 4; b++)
-          cumulative_rgb[b][i] = 0.f;
-    }
-
-  /* calculate histograms */
-  for (i = -ceil_radius; i <= ceil_radius; i++)
-    {
-      for (j = -ceil_radius; j <= ceil_radius; j++)
-        {
-          if (i*i + j*j <= radius_sq)
-            {
-              get_pixel (x + i,
-                         y + j,
-                         buf_width,
-                         src_buf,
-                         temp_pixel);
-              get_pixel_inten (x + i,
-                               y + j,
-                               buf_width,
-                               inten_buf,
-                               &temp_inten_pixel);
-              intensity = temp_inten_pixel * (intensities - 1);
-              hist_inten[intensity]++;
-
-              for (b = 0; b < 4; b++)
-                {
-                  cumulative_rgb[b][intensity] += temp_pixel[b];
-                }
-            }
-        }
-    }
-
   inten_max = 1;
 
   /* calculated maximums */
 
   for (i = 0; i < intensities; i++)
-    inten_max = MAX (inten_max, hist_inten[i]);
+    inten_max = MAX (inten_max, hist->hist_inten[i]);
 
   /* calculate weight and use it to set the pixel */
 
@@ -170,9 +185,9 @@ oilify_pixel_inten (gint     x,
 
   for (i = 0; i < intensities; i++)
     {
-      if (hist_inten[i] > 0)
+      if (hist->hist_inten[i] > 0)
         {
-          ratio = (gfloat) hist_inten[i] / (gfloat) inten_max;
+          ratio = (gfloat) hist->hist_inten[i] / (gfloat) inten_max;
 
           /* using this instead of pow function gives HUGE performance
              improvement but we cannot use floating point exponent... */
@@ -183,12 +198,13 @@ oilify_pixel_inten (gint     x,
             weight *= ratio;
 
           /* weight = powf(ratio, exponent); */
-          mult_inten = weight / (gfloat) hist_inten[i];
+          mult_inten = weight / (gfloat) hist->hist_inten[i];
 
           div += weight;
 
           for (b = 0; b < 4; b++)
-            color[b] += mult_inten * cumulative_rgb[b][i];
+            color[b] += mult_inten *
+                        (gfloat) (hist->cumulative_rgb[i][b] / FIXED_ONE);
         }
     }
 
@@ -197,106 +213,199 @@ oilify_pixel_inten (gint     x,
 }
 
 static void
-oilify_pixel (gint     x,
-              gint     y,
-              gdouble  radius,
-              gint     exponent,
-              gint     intensities,
-              gint     buf_width,
-              gfloat  *src_buf,
-              gfloat  *dst_pixel)
+oilify_pixel (const Histogram *hist,
+              gint             exponent,
+              gint             intensities,
+              gfloat          *dst_pixel)
 {
-  gint   hist[4][NUM_INTENSITIES];
-  gfloat temp_pixel[4];
-  gint   ceil_radius = ceil (radius);
-  gdouble radius_sq = radius * radius;
   gint i, j, b;
   gint hist_max[4];
-  gint intensity;
   gfloat sum[4];
-  gfloat ratio;
-  gfloat weight;
-  gfloat result[4];
+  gfloat ratio[4];
+  gfloat weight[4];
   gfloat div[4];
 
+  for (b = 0; b < 4; b++)
+    hist_max[b] = 1;
+
   for (i = 0; i < intensities; i++)
     {
       for (b = 0; b < 4; b++)
         {
-          hist[b][i] = 0;
+          if (hist_max[b] < hist->hist[i][b]) /* MAX macros too slow here */
+            hist_max[b] = hist->hist[i][b];
         }
     }
 
-  /* calculate histograms */
+  /* calculate weight and use it to set the pixel, the components are
+   * interleaved so that this bottleneck loop is vectorized, empty bins
+   * are given a zero weight rather than skipped.
+   */
 
-  for (i = -ceil_radius; i <= ceil_radius; i++)
+  for (b = 0; b < 4; b++)
     {
-      for (j = -ceil_radius; j <= ceil_radius; j++)
-        {
-          if (i*i + j*j <= radius_sq)
-            {
-              get_pixel (x + i,
-                         y + j,
-                         buf_width,
-                         src_buf,
-                         temp_pixel);
-
-              for (b = 0; b < 4; b++)
-                {
-                  intensity = temp_pixel[b] * (intensities - 1);
-                  hist[b][intensity]++;
-                }
-            }
-        }
+      sum[b] = 0.f;
+      div[b] = 0.f;
     }
 
-  for (b = 0; b < 4; b++)
-    hist_max[b] = 1;
-
   for (i = 0; i < intensities; i++)
     {
       for (b = 0; b < 4; b++)
         {
-          if (hist_max[b] < hist[b][i]) /* MAX macros too slow here */
-            hist_max[b] = hist[b][i];
+          ratio[b]  = (gfloat) hist->hist[i][b] / (gfloat) hist_max[b];
+          weight[b] = 1.f;
         }
-    }
 
-  /* calculate weight and use it to set the pixel */
+      for (j = 0; j < exponent; j++)
+        for (b = 0; b < 4; b++)
+          weight[b] *= ratio[b];
+
+      for (b = 0; b < 4; b++)
+        {
+          weight[b] = hist->hist[i][b] > 0 ? weight[b] : 0.f;
+
+          sum[b] += weight[b] * (gfloat) i;
+          div[b] += weight[b];
+        }
+    }
 
   for (b = 0; b < 4; b++)
+    dst_pixel[b] = sum[b] / (gfloat) (intensities - 1) / div[b];
+}
+
+static void
+oilify_histogram_pixel (const Histogram  *hist,
+                        const ThreadData *data,
+                        gint              exponent,
+                        gfloat           *dst_pixel)
+{
+  if (data->inten_bins)
+    oilify_pixel_inten (hist, exponent, data->o->intensities, dst_pixel);
+  else
+    oilify_pixel (hist, exponent, data->o->intensities, dst_pixel);
+}
+
+/* build the histogram of the disc around each pixel separately, used when
+ * the radius is modulated per pixel
+ */
+static void
+oilify_area_variable_radius (const GeglRectangle *area,
+                             const ThreadData    *data)
+{
+  const GeglRectangle *result = data->result;
+  GeglProperties      *o      = data->o;
+  Histogram           *hist   = g_new (Histogram, 1);
+  gint                 x, y, i, j;
+
+  for (y = area->y - result->y; y < area->y - result->y + area->height; y++)
+    for (x = area->x - result->x; x < area->x - result->x + area->width; x++)
+      {
+        gint    offset      = y * result->width + x;
+        gfloat  mask_radius = o->mask_radius;
+        gfloat  exponent    = o->exponent;
+        gint    ceil_radius;
+        gdouble radius_sq;
+
+        if (data->exponent_buf)
+          exponent *= CLAMP (data->exponent_buf[offset], 0.0, 1.0);
+
+        mask_radius *= CLAMP (data->mask_radius_buf[offset], 0.0, 1.0);
+
+        ceil_radius = ceil (mask_radius);
+        radius_sq   = mask_radius * mask_radius;
+
+        histogram_clear (hist, data);
+
+        for (j = -ceil_radius; j <= ceil_radius; j++)
+          for (i = -ceil_radius; i <= ceil_radius; i++)
+            if (i*i + j*j <= radius_sq)
+              histogram_update (hist, data,
+                                (y + o->mask_radius + j) * data->src_width +
+                                x + o->mask_radius + i,
+                                1);
+
+        oilify_histogram_pixel (hist, data, exponent,
+                                data->dst_buf + 4 * offset);
+      }
+
+  g_free (hist);
+}
+
+/* with a constant radius, the histogram is built once per row and then
+ * updated as the disc slides right, removing the leftmost pixel of each of
+ * its rows and adding the next one on the right.
+ */
+static void
+oilify_area (const GeglRectangle *area,
+             const ThreadData    *data)
+{
+  const GeglRectangle *result = data->result;
+  GeglProperties      *o      = data->o;
+  gint                 radius = o->mask_radius;
+  gint                 stride = data->src_width;
+  Histogram           *hist;
+  gint                *half_width;
+  gint                 x, y, i, j;
+
+  if (data->mask_radius_buf)
     {
-      sum[b] = 0.f;
-      div[b] = 0.f;
+      oilify_area_variable_radius (area, data);
+      return;
     }
 
-  for (i = 0; i < intensities; i++)
+  hist       = g_new (Histogram, 1);
+  half_width = g_new (gint, 2 * radius + 1);
+
+  /* the disc is the pixels with i*i + j*j <= radius*radius */
+  for (j = -radius; j <= radius; j++)
     {
-      /* UNROLL this bottleneck loop, up to 50% faster */
-      #define DO_HIST_STEP(b) if(hist[b][i] > 0)                          \
-        {                                                                 \
-          ratio = (gfloat) hist[b][i] / (gfloat) hist_max[b];             \
-          weight = 1.f;                                                   \
-                                                                          \
-          for (j = 0; j < exponent; j++)                                  \
-            weight *= ratio;                                              \
-                                                                          \
-          sum[b] += weight * (gfloat) i;                                  \
-          div[b] += weight;                                               \
-        }
+      i = 0;
+
+      while ((i + 1) * (i + 1) + j * j <= radius * radius)
+        i++;
 
-      DO_HIST_STEP(0)
-      DO_HIST_STEP(1)
-      DO_HIST_STEP(2)
-      DO_HIST_STEP(3)
-      #undef DO_HIST_STEP
+      half_width[j + radius] = i;
     }
 
-  for (b = 0; b < 4; b++)
+  for (y = area->y - result->y; y < area->y - result->y + area->height; y++)
     {
-      result[b] = sum[b] / (gfloat) (intensities - 1);
-      dst_pixel[b] = result[b] / div[b];
+      gint x0     = area->x - result->x;
+      gint width  = area->width;
+      gint center = (y + radius) * stride + x0 + radius;
+
+      histogram_clear (hist, data);
+
+      for (j = -radius; j <= radius; j++)
+        for (i = -half_width[j + radius]; i <= half_width[j + radius]; i++)
+          histogram_update (hist, data, center + j * stride + i, 1);
+
+      for (x = x0; x < x0 + width; x++, center++)
+        {
+          gint   offset   = y * result->width + x;
+          gfloat exponent = o->exponent;
+
+          if (data->exponent_buf)
+            exponent *= CLAMP (data->exponent_buf[offset], 0.0, 1.0);
+
+          oilify_histogram_pixel (hist, data, exponent,
+                                  data->dst_buf + 4 * offset);
+
+          if (x + 1 == x0 + width)
+            break;
+
+          for (j = -radius; j <= radius; j++)
+            {
+              gint row = center + j * stride;
+              gint w   = half_width[j + radius];
+
+              histogram_update (hist, data, row - w,         -1);
+              histogram_update (hist, data, row + w + 1,      1);
+            }
+        }
     }
+
+  g_free (half_width);
+  g_free (hist);
 }
 
 static void
@@ -480,17 +589,15 @@ process (GeglOperation       *operation,
   const Babl *format   = gegl_operation_get_format (operation, "output");
   const Babl *y_format = babl_format_with_space ("Y float", format);
 
-  gint x = o->mask_radius; /* initial x                   */
-  gint y = o->mask_radius; /*           and y coordinates */
+  ThreadData data;
   gfloat *src_buf;
   gfloat *dst_buf;
-  gfloat *out_pixel;
 
-  gfloat *mask_radius_pixel = NULL;
-  gfloat *exponent_pixel    = NULL;
   gfloat *mask_radius_buf   = NULL;
   gfloat *exponent_buf      = NULL;
   gfloat *inten_buf         = NULL;
+  guint8 *bins              = NULL;
+  guint8 *inten_bins        = NULL;
 
   gint n_pixels = result->width * result->height;
   GeglRectangle src_rect;
@@ -519,17 +626,24 @@ process (GeglOperation       *operation,
 
   if (o->use_inten)
     {
-      inten_buf = gegl_malloc (total_pixels * sizeof (gfloat));
+      inten_buf  = gegl_malloc (total_pixels * sizeof (gfloat));
+      inten_bins = gegl_malloc (total_pixels);
 
       gegl_buffer_get (input, &src_rect, 1.0, y_format, inten_buf,
                        GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
       clamp_buffer_values (inten_buf, 1, total_pixels);
+      compute_bins (inten_buf, inten_bins, total_pixels, o->intensities);
+    }
+  else
+    {
+      bins = gegl_malloc (4 * total_pixels);
+
+      compute_bins (src_buf, bins, 4 * total_pixels, o->intensities);
     }
 
   if (aux)
     {
-      mask_radius_buf   =
-      mask_radius_pixel = gegl_malloc (n_pixels * sizeof (gfloat));
+      mask_radius_buf = gegl_malloc (n_pixels * sizeof (gfloat));
 
       gegl_buffer_get (aux, result, 1.0, y_format, mask_radius_buf,
                        GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
@@ -537,48 +651,31 @@ process (GeglOperation       *operation,
 
   if (aux2)
     {
-      exponent_buf   =
-      exponent_pixel = gegl_malloc (n_pixels * sizeof (gfloat));
+      exponent_buf = gegl_malloc (n_pixels * sizeof (gfloat));
 
       gegl_buffer_get (aux2, result, 1.0, y_format, exponent_buf,
                        GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
     }
 
-  out_pixel = dst_buf;
-
-  while (n_pixels--)
-    {
-      gfloat mask_radius = o->mask_radius;
-      gfloat exponent    = o->exponent;
-
-      if (exponent_pixel)
-        {
-          exponent *= CLAMP(*exponent_pixel, 0.0, 1.0);
-          exponent_pixel++;
-        }
-
-      if (mask_radius_pixel)
-        {
-          mask_radius *= CLAMP(*mask_radius_pixel, 0.0, 1.0);
-          mask_radius_pixel++;
-        }
-
-      if (inten_buf)
-        oilify_pixel_inten (x, y, mask_radius, exponent, o->intensities,
-                            src_rect.width, src_buf, inten_buf, out_pixel);
-      else
-        oilify_pixel (x, y, mask_radius, exponent, o->intensities,
-                      src_rect.width, src_buf, out_pixel);
-      out_pixel += 4;
-
-      /* update x and y coordinates */
-      x++;
-      if (x >= result->width + o->mask_radius)
-        {
-          x = o->mask_radius;
-          y++;
-        }
-    }
+  data.o               = o;
+  data.result          = result;
+  data.src_width       = src_rect.width;
+  data.src_buf         = src_buf;
+  data.bins            = bins;
+  data.inten_bins      = inten_bins;
+  data.mask_radius_buf = mask_radius_buf;
+  data.exponent_buf    = exponent_buf;
+  data.dst_buf         = dst_buf;
+
+  /* the histogram slides along rows, so split the result into bands of
+   * rows, every pixel costs a pass over the histogram
+   */
+  gegl_parallel_distribute_area (
+    result,
+    gegl_operation_get_pixels_per_thread (operation) / o->intensities,
+    GEGL_SPLIT_STRATEGY_HORIZONTAL,
+    (GeglParallelDistributeAreaFunc) oilify_area,
+    &data);
 
   gegl_buffer_set (output, result, 0,
                    babl_format_with_space ("RGBA float", format),
@@ -590,6 +687,12 @@ process (GeglOperation       *operation,
   if (inten_buf)
     gegl_free (inten_buf);
 
+  if (inten_bins)
+    gegl_free (inten_bins);
+
+  if (bins)
+    gegl_free (bins);
+
   if (mask_radius_buf)
     gegl_free (mask_radius_buf);
 
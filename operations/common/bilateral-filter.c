@@ -18,6 +18,7 @@
  */
 
 #include "config.h"
+#include <string.h>
 #include <glib/gi18n-lib.h>
 
 
@@ -41,6 +42,16 @@ property_double (edge_preservation, _("Edge preservation"), 8.0)
 
 #include "gegl-op.h"
 
+/* above this radius, the filter is computed using a permutohedral lattice,
+ * whose cost doesn't depend on the radius, instead of the exact filter.
+ */
+#define APPROXIMATE_MIN_RADIUS  10.0
+
+/* the approximate filter processes the result in blocks of at most this
+ * size, to bound its memory use.
+ */
+#define APPROXIMATE_BLOCK_SIZE  512
+
 static void
 bilateral_filter (GeglBuffer          *src,
                   const GeglRectangle *src_rect,
@@ -50,6 +61,14 @@ bilateral_filter (GeglBuffer          *src,
                   gdouble              preserve,
                   const Babl          *format);
 
+static void
+bilateral_filter_approximate (GeglBuffer          *src,
+                              GeglBuffer          *dst,
+                              const GeglRectangle *dst_rect,
+                              gdouble              radius,
+                              gdouble              preserve,
+                              const Babl          *format);
+
 #include <stdio.h>
 
 static void prepare (GeglOperation *operation)
@@ -181,6 +200,10 @@ process (GeglOperation       *operation,
       gegl_buffer_copy (input, result, GEGL_ABYSS_NONE,
                         output, result);
     }
+  else if (o->blur_radius >= APPROXIMATE_MIN_RADIUS)
+    {
+      bilateral_filter_approximate (input, output, result, o->blur_radius, o->edge_preservation, format);
+    }
   else
     {
       bilateral_filter (input, &compute, output, result, o->blur_radius, o->edge_preservation, format);
@@ -274,6 +297,421 @@ bilateral_filter (GeglBuffer          *src,
   g_free (dst_buf);
 }
 
+/* The approximate filter is the permutohedral lattice of Adams, Baek and
+ * Davis, "Fast High-Dimensional Filtering Using the Permutohedral Lattice"
+ * (Eurographics 2010).  Every pixel is placed in a 5 dimensional space of
+ * its position and color, scaled such that the filter's weights become a
+ * unit gaussian; pixels are splatted onto the vertices of the enclosing
+ * simplex of the lattice, the lattice is blurred along each of its axes, and
+ * the result is sliced back at the pixel positions.
+ */
+
+#define LATTICE_D   5  /* x, y, r, g, b    */
+#define LATTICE_VD  5  /* r, g, b, a, weight */
+
+typedef struct
+{
+  gint   *keys;     /* LATTICE_D coordinates per vertex */
+  gfloat *values;   /* LATTICE_VD values per vertex     */
+  gint   *table;    /* vertex index + 1, or 0 for empty slots */
+  gint    n_vertices;
+  guint   mask;
+} Lattice;
+
+static void
+lattice_init (Lattice *lattice)
+{
+  gint size = 1 << 12;
+
+  lattice->keys       = g_new (gint,   size / 2 * LATTICE_D);
+  lattice->values     = g_new (gfloat, size / 2 * LATTICE_VD);
+  lattice->table      = g_new0 (gint,  size);
+  lattice->n_vertices = 0;
+  lattice->mask       = size - 1;
+}
+
+static void
+lattice_free (Lattice *lattice)
+{
+  g_free (lattice->keys);
+  g_free (lattice->values);
+  g_free (lattice->table);
+}
+
+static inline guint
+lattice_hash (const gint *key)
+{
+  guint hash = 0;
+  gint  i;
+
+  for (i = 0; i < LATTICE_D; i++)
+    {
+      hash += key[i];
+      hash *= 2531011;
+    }
+
+  return hash;
+}
+
+static void
+lattice_grow (Lattice *lattice)
+{
+  gint size = (lattice->mask + 1) * 2;
+  gint i;
+
+  lattice->keys   = g_renew (gint,   lattice->keys,   size / 2 * LATTICE_D);
+  lattice->values = g_renew (gfloat, lattice->values, size / 2 * LATTICE_VD);
+
+  g_free (lattice->table);
+  lattice->table = g_new0 (gint, size);
+  lattice->mask  = size - 1;
+
+  for (i = 0; i < lattice->n_vertices; i++)
+    {
+      guint h = lattice_hash (lattice->keys + i * LATTICE_D) & lattice->mask;
+
+      while (lattice->table[h])
+        h = (h + 1) & lattice->mask;
+
+      lattice->table[h] = i + 1;
+    }
+}
+
+/* returns the index of the vertex at @key, adding it if @create is TRUE, or
+ * -1 if there is no such vertex.
+ */
+static gint
+lattice_lookup (Lattice    *lattice,
+                const gint *key,
+                gboolean    create)
+{
+  guint h;
+
+  if (create && (lattice->n_vertices + 1) * 2 > lattice->mask + 1)
+    lattice_grow (lattice);
+
+  h = lattice_hash (key) & lattice->mask;
+
+  while (lattice->table[h])
+    {
+      gint i = lattice->table[h] - 1;
+
+      if (! memcmp (lattice->keys + i * LATTICE_D, key,
+                    LATTICE_D * sizeof (gint)))
+        return i;
+
+      h = (h + 1) & lattice->mask;
+    }
+
+  if (! create)
+    return -1;
+
+  memcpy (lattice->keys + lattice->n_vertices * LATTICE_D, key,
+          LATTICE_D * sizeof (gint));
+  memset (lattice->values + lattice->n_vertices * LATTICE_VD, 0,
+          LATTICE_VD * sizeof (gfloat));
+  lattice->table[h] = lattice->n_vertices + 1;
+
+  return lattice->n_vertices++;
+}
+
+/* finds the vertices of the simplex enclosing @position, and the
+ * barycentric weights of @position within it.
+ */
+static void
+lattice_embed (const gfloat *position,
+               const gfloat *scale,
+               gint         *keys,
+               gfloat       *weights)
+{
+  gfloat elevated[LATTICE_D + 1];
+  gint   greedy[LATTICE_D + 1];
+  gint   rank[LATTICE_D + 1];
+  gfloat sum_elevated = 0.0f;
+  gint   sum          = 0;
+  gint   i, j, r;
+
+  /* project onto the plane of the lattice */
+  for (i = LATTICE_D; i > 0; i--)
+    {
+      gfloat cf = position[i - 1] * scale[i - 1];
+
+      elevated[i]   = sum_elevated - i * cf;
+      sum_elevated += cf;
+    }
+  elevated[0] = sum_elevated;
+
+  /* find the closest remainder-0 point */
+  for (i = 0; i <= LATTICE_D; i++)
+    {
+      gfloat v    = elevated[i] * (1.0f / (LATTICE_D + 1));
+      gint   up   = ceilf (v)  * (LATTICE_D + 1);
+      gint   down = floorf (v) * (LATTICE_D + 1);
+
+      if (up - elevated[i] < elevated[i] - down)
+        greedy[i] = up;
+      else
+        greedy[i] = down;
+
+      sum    += greedy[i];
+      rank[i] = 0;
+    }
+  sum /= LATTICE_D + 1;
+
+  /* rank the differential, and walk back onto the plane */
+  for (i = 0; i < LATTICE_D; i++)
+    for (j = i + 1; j <= LATTICE_D; j++)
+      {
+        if (elevated[i] - greedy[i] < elevated[j] - greedy[j])
+          rank[i]++;
+        else
+          rank[j]++;
+      }
+
+  if (sum > 0)
+    {
+      for (i = 0; i <= LATTICE_D; i++)
+        {
+          if (rank[i] >= LATTICE_D + 1 - sum)
+            {
+              greedy[i] -= LATTICE_D + 1;
+              rank[i]   += sum - (LATTICE_D + 1);
+            }
+          else
+            {
+              rank[i] += sum;
+            }
+        }
+    }
+  else if (sum < 0)
+    {
+      for (i = 0; i <= LATTICE_D; i++)
+        {
+          if (rank[i] < -sum)
+            {
+              greedy[i] += LATTICE_D + 1;
+              rank[i]   += LATTICE_D + 1 + sum;
+            }
+          else
+            {
+              rank[i] += sum;
+            }
+        }
+    }
+
+  /* barycentric weights */
+  for (i = 0; i <= LATTICE_D + 1; i++)
+    weights[i] = 0.0f;
+
+  for (i = 0; i <= LATTICE_D; i++)
+    {
+      gfloat delta = (elevated[i] - greedy[i]) * (1.0f / (LATTICE_D + 1));
+
+      weights[LATTICE_D - rank[i]]     += delta;
+      weights[LATTICE_D + 1 - rank[i]] -= delta;
+    }
+  weights[0] += 1.0f + weights[LATTICE_D + 1];
+
+  /* simplex vertices */
+  for (r = 0; r <= LATTICE_D; r++)
+    for (i = 0; i < LATTICE_D; i++)
+      {
+        keys[r * LATTICE_D + i] = greedy[i] +
+                                  (rank[i] <= LATTICE_D - r ?
+                                   r : r - (LATTICE_D + 1));
+      }
+}
+
+static void
+lattice_blur (Lattice *lattice)
+{
+  gfloat *values = lattice->values;
+  gfloat *blurred;
+  gint    j;
+
+  blurred = g_new (gfloat, (lattice->mask + 1) / 2 * LATTICE_VD);
+
+  for (j = 0; j <= LATTICE_D; j++)
+    {
+      gint i;
+
+      for (i = 0; i < lattice->n_vertices; i++)
+        {
+          const gint *key = lattice->keys + i * LATTICE_D;
+          gint        neighbor1[LATTICE_D];
+          gint        neighbor2[LATTICE_D];
+          gint        n1, n2;
+          gint        k;
+
+          for (k = 0; k < LATTICE_D; k++)
+            {
+              neighbor1[k] = key[k] + 1;
+              neighbor2[k] = key[k] - 1;
+            }
+
+          if (j < LATTICE_D)
+            {
+              neighbor1[j] = key[j] - LATTICE_D;
+              neighbor2[j] = key[j] + LATTICE_D;
+            }
+
+          n1 = lattice_lookup (lattice, neighbor1, FALSE);
+          n2 = lattice_lookup (lattice, neighbor2, FALSE);
+
+          for (k = 0; k < LATTICE_VD; k++)
+            {
+              gfloat v = 0.5f * values[i * LATTICE_VD + k];
+
+              if (n1 >= 0)
+                v += 0.25f * values[n1 * LATTICE_VD + k];
+              if (n2 >= 0)
+                v += 0.25f * values[n2 * LATTICE_VD + k];
+
+              blurred[i * LATTICE_VD + k] = v;
+            }
+        }
+
+      memcpy (values, blurred, lattice->n_vertices * LATTICE_VD * sizeof (gfloat));
+    }
+
+  g_free (blurred);
+}
+
+static void
+bilateral_filter_block (GeglBuffer          *src,
+                        GeglBuffer          *dst,
+                        const GeglRectangle *dst_rect,
+                        gint                 iradius,
+                        const gfloat        *scale,
+                        gfloat               spatial_scale,
+                        gfloat               range_scale,
+                        const Babl          *format)
+{
+  GeglRectangle  src_rect = { dst_rect->x - iradius,
+                              dst_rect->y - iradius,
+                              dst_rect->width  + 2 * iradius,
+                              dst_rect->height + 2 * iradius };
+  Lattice        lattice;
+  gfloat        *src_buf;
+  gfloat        *dst_buf;
+  gint           keys[(LATTICE_D + 1) * LATTICE_D];
+  gfloat         weights[LATTICE_D + 2];
+  gfloat         position[LATTICE_D];
+  gint           x, y, r, c;
+
+  src_buf = g_new (gfloat, src_rect.width * src_rect.height * 4);
+  dst_buf = g_new (gfloat, dst_rect->width * dst_rect->height * 4);
+
+  gegl_buffer_get (src, &src_rect, 1.0, format, src_buf, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+
+  lattice_init (&lattice);
+
+  /* splat */
+  for (y = 0; y < src_rect.height; y++)
+    for (x = 0; x < src_rect.width; x++)
+      {
+        const gfloat *pix = src_buf + (y * src_rect.width + x) * 4;
+
+        position[0] = x * spatial_scale;
+        position[1] = y * spatial_scale;
+        position[2] = pix[0] * range_scale;
+        position[3] = pix[1] * range_scale;
+        position[4] = pix[2] * range_scale;
+
+        lattice_embed (position, scale, keys, weights);
+
+        for (r = 0; r <= LATTICE_D; r++)
+          {
+            gint    i     = lattice_lookup (&lattice, keys + r * LATTICE_D, TRUE);
+            gfloat *value = lattice.values + i * LATTICE_VD;
+
+            for (c = 0; c < 4; c++)
+              value[c] += weights[r] * pix[c];
+            value[4] += weights[r];
+          }
+      }
+
+  lattice_blur (&lattice);
+
+  /* slice */
+  for (y = 0; y < dst_rect->height; y++)
+    for (x = 0; x < dst_rect->width; x++)
+      {
+        const gfloat *pix = src_buf + ((y + iradius) * src_rect.width +
+                                       x + iradius) * 4;
+        gfloat       *out = dst_buf + (y * dst_rect->width + x) * 4;
+        gfloat        accumulated[LATTICE_VD] = { 0, };
+
+        position[0] = (x + iradius) * spatial_scale;
+        position[1] = (y + iradius) * spatial_scale;
+        position[2] = pix[0] * range_scale;
+        position[3] = pix[1] * range_scale;
+        position[4] = pix[2] * range_scale;
+
+        lattice_embed (position, scale, keys, weights);
+
+        for (r = 0; r <= LATTICE_D; r++)
+          {
+            gint          i     = lattice_lookup (&lattice, keys + r * LATTICE_D, FALSE);
+            const gfloat *value = lattice.values + i * LATTICE_VD;
+
+            for (c = 0; c < LATTICE_VD; c++)
+              accumulated[c] += weights[r] * value[c];
+          }
+
+        for (c = 0; c < 4; c++)
+          out[c] = accumulated[c] / accumulated[4];
+      }
+
+  gegl_buffer_set (dst, dst_rect, 0, format, dst_buf, GEGL_AUTO_ROWSTRIDE);
+
+  lattice_free (&lattice);
+  g_free (src_buf);
+  g_free (dst_buf);
+}
+
+static void
+bilateral_filter_approximate (GeglBuffer          *src,
+                              GeglBuffer          *dst,
+                              const GeglRectangle *dst_rect,
+                              gdouble              radius,
+                              gdouble              preserve,
+                              const Babl          *format)
+{
+  gfloat scale[LATTICE_D];
+  gfloat spatial_scale;
+  gfloat range_scale;
+  gint   iradius = radius;
+  gint   x, y, i;
+
+  /* the spatial weight of the exact filter is exp (-0.5 * d^2 / radius), and
+   * the range weight is exp (-preserve * d^2); scale both to a unit gaussian.
+   */
+  spatial_scale = 1.0 / sqrt (radius);
+  range_scale   = sqrt (2.0 * preserve);
+
+  for (i = 0; i < LATTICE_D; i++)
+    {
+      scale[i] = sqrt (2.0 / 3.0) * (LATTICE_D + 1) /
+                 sqrt ((i + 1.0) * (i + 2.0));
+    }
+
+  for (y = 0; y < dst_rect->height; y += APPROXIMATE_BLOCK_SIZE)
+    for (x = 0; x < dst_rect->width; x += APPROXIMATE_BLOCK_SIZE)
+      {
+        GeglRectangle block;
+
+        block.x      = dst_rect->x + x;
+        block.y      = dst_rect->y + y;
+        block.width  = MIN (APPROXIMATE_BLOCK_SIZE, dst_rect->width  - x);
+        block.height = MIN (APPROXIMATE_BLOCK_SIZE, dst_rect->height - y);
+
+        bilateral_filter_block (src, dst, &block, iradius, scale,
+                                spatial_scale, range_scale, format);
+      }
+}
+
 
 static void
 gegl_op_class_init (GeglOpClass *klass)
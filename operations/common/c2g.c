@@ -64,144 +64,89 @@ property_double (rgamma, _("Radial gamma"), 0.0, 8.0, 2.0,
 
 #define RGAMMA 2.0
 
-static void c2g (GeglOperation       *op,
-                 GeglBuffer          *src,
-                 const GeglRectangle *src_rect,
-                 GeglBuffer          *dst,
-                 const GeglRectangle *dst_rect,
-                 gint                 radius,
-                 gint                 samples,
-                 gint                 iterations,
-                 gdouble              rgamma,
-                 gint                 level)
+typedef struct
 {
-  const Babl *space = babl_format_get_space (gegl_operation_get_format (op, "output"));
-  const Babl *format = babl_format_with_space ("RGBA float", space);
+  Envelopes  *envelopes;
+  GeglBuffer *dst;
+  const Babl *format;
+  gboolean    enhance_shadows;
+} ThreadData;
+
+static void c2g (const GeglRectangle *dst_rect,
+                 ThreadData          *data)
+{
+  EnvelopesWorker     worker;
+  GeglBufferIterator *i = gegl_buffer_iterator_new (data->dst, dst_rect, 0,
+                                                    data->format,
+                                                    GEGL_ACCESS_WRITE,
+                                                    GEGL_ABYSS_NONE, 1);
 
-  if (dst_rect->width > 0 && dst_rect->height > 0)
-  {
-    /* XXX: compute total pixels and progress by consumption
-     */
-    GeglBufferIterator *i = gegl_buffer_iterator_new (dst, dst_rect, 0, babl_format_with_space ("YA float", space),
-                                                      GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 1);
-    GeglSampler *sampler = gegl_buffer_sampler_new_at_level (src, format, GEGL_SAMPLER_NEAREST, level);
-    GeglSamplerGetFun getfun = gegl_sampler_get_fun (sampler);
-#if 0
-    float total_pix = dst_rect->width * dst_rect->height;
-#endif
+  envelopes_worker_init (&worker, data->envelopes);
 
-    while (gegl_buffer_iterator_next (i))
+  while (gegl_buffer_iterator_next (i))
     {
       gint x,y;
       gint    dst_offset=0;
       gfloat *dst_buf = i->items[0].data;
+      GeglRectangle roi = i->items[0].roi;
 
-      if (GEGL_PROPERTIES(op)->enhance_shadows)
-      {
-         GeglRectangle roi = i->items[0].roi;
       for (y=roi.y; y < roi.y + roi.height; y++)
-        {
-          for (x=roi.x; x < roi.x + roi.width; x++)
-            {
-              gfloat  min[4];
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 min, max, pixel, format);
+        for (x=roi.x; x < roi.x + roi.width; x++)
+          {
+            gfloat  min[4];
+            gfloat  max[4];
+            gfloat  pixel[4];
+
+            /* this should be replaced with a better/faster projection of
+             * pixel onto the vector spanned by min -> max, currently
+             * computed by comparing the distance to min with the sum
+             * of the distance to min/max.
+             */
+
+            gfloat nominator = 0;
+            gfloat denominator = 0;
+            gint c;
+
+            if (data->enhance_shadows)
               {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-                gfloat nominator = 0;
-                gfloat denominator = 0;
-                gint c;
+                compute_envelopes (&worker, x, y, min, max, pixel);
+
                 for (c=0; c<3; c++)
                   {
                     nominator   += (pixel[c] - min[c]) * (pixel[c] - min[c]);
                     denominator += (pixel[c] - max[c]) * (pixel[c] - max[c]);
                   }
-
-                nominator = sqrtf (nominator);
-                denominator = sqrtf (denominator);
-                denominator = nominator + denominator;
-
-                if (denominator>0.000)
-                  {
-                    dst_buf[dst_offset+0] = nominator/denominator;
-                  }
-                else
-                  {
-                    /* shouldn't happen */
-                    dst_buf[dst_offset+0] = 0.5;
-                  }
-                dst_buf[dst_offset+1] = pixel[3];
-                dst_offset+=2;
               }
-            }
-          }
-      }
-      else
-      {
-         GeglRectangle roi = i->items[0].roi;
-        for (y=roi.y; y < roi.y + roi.height; y++)
-          for (x=roi.x; x < roi.x + roi.width; x++)
-            {
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 NULL, max, pixel, format);
+            else
               {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-                gfloat nominator = 0;
-                gfloat denominator = 0;
-                gint c;
+                compute_envelopes (&worker, x, y, NULL, max, pixel);
+
                 for (c=0; c<3; c++)
                   {
                     nominator   += pixel[c] * pixel[c];
                     denominator += (pixel[c] - max[c]) * (pixel[c] - max[c]);
                   }
+              }
 
-                nominator = sqrtf (nominator);
-                denominator = sqrtf (denominator);
-                denominator = nominator + denominator;
+            nominator = sqrtf (nominator);
+            denominator = sqrtf (denominator);
+            denominator = nominator + denominator;
 
-                if (denominator>0.000)
-                  {
-                    dst_buf[dst_offset+0] = nominator/denominator;
-                  }
-                else
-                  {
-                    /* shouldn't happen */
-                    dst_buf[dst_offset+0] = 0.5;
-                  }
-                dst_buf[dst_offset+1] = pixel[3];
-                dst_offset+=2;
+            if (denominator>0.000)
+              {
+                dst_buf[dst_offset+0] = nominator/denominator;
               }
-            }
+            else
+              {
+                /* shouldn't happen */
+                dst_buf[dst_offset+0] = 0.5;
+              }
+            dst_buf[dst_offset+1] = pixel[3];
+            dst_offset+=2;
           }
-      }
-    g_object_unref (sampler);
-  }
+    }
+
+  envelopes_worker_clear (&worker);
 }
 
 static void prepare (GeglOperation *operation)
@@ -236,6 +181,42 @@ get_bounding_box (GeglOperation *operation)
 
 static GeglClRunData *cl_data = NULL;
 
+/* the opencl kernel keeps using random sprays */
+#define ANGLE_PRIME  95273 /* the lookuptables are sized as primes to ensure */
+#define RADIUS_PRIME 29537 /* as good as possible variation when using both */
+
+static gfloat   lut_cos[ANGLE_PRIME];
+static gfloat   lut_sin[ANGLE_PRIME];
+static gfloat   radiuses[RADIUS_PRIME];
+static gint     luts_computed = 0;
+
+static void compute_luts(gint rgamma)
+{
+  gint i;
+  GRand *rand;
+  gfloat golden_angle = G_PI * (3-sqrt(5.0)); /* http://en.wikipedia.org/wiki/Golden_angle */
+  gfloat angle = 0.0;
+
+  if (g_atomic_int_get (&luts_computed)==rgamma)
+    return;
+  rand = g_rand_new();
+
+  for (i=0;i<ANGLE_PRIME;i++)
+    {
+      lut_cos[i] = cos(angle);
+      lut_sin[i] = sin(angle);
+      angle += golden_angle;
+    }
+  for (i=0;i<RADIUS_PRIME;i++)
+    {
+      radiuses[i] = pow(g_rand_double_range (rand, 0.0, 1.0), rgamma);
+    }
+
+  g_rand_free(rand);
+  g_atomic_int_set (&luts_computed, rgamma);
+
+}
+
 static gboolean
 cl_c2g (cl_mem                in_tex,
         cl_mem                out_tex,
@@ -391,18 +372,31 @@ process (GeglOperation       *operation,
 {
   GeglProperties *o = GEGL_PROPERTIES (operation);
   GeglRectangle compute;
+  ThreadData data;
   compute = gegl_operation_get_required_for_output (operation, "input",result);
 
   if (o->radius < 500 && gegl_operation_use_opencl (operation))
     if(cl_process(operation, input, output, result))
       return TRUE;
 
-  c2g (operation, input, &compute, output, result,
-       o->radius,
-       o->samples,
-       o->iterations,
-       /*o->rgamma*/RGAMMA,
-       level);
+  data.envelopes       = envelopes_new (input, &compute, level,
+                                        o->radius, o->samples, o->iterations,
+                                        RGAMMA /*o->rgamma*/,
+                                        gegl_operation_get_format (operation,
+                                                                   "input"));
+  data.dst             = output;
+  data.format          = gegl_operation_get_format (operation, "output");
+  data.enhance_shadows = o->enhance_shadows;
+
+  gegl_parallel_distribute_area (
+    result,
+    gegl_operation_get_pixels_per_thread (operation) /
+    (o->samples * o->iterations),
+    GEGL_SPLIT_STRATEGY_AUTO,
+    (GeglParallelDistributeAreaFunc) c2g,
+    &data);
+
+  envelopes_free (data.envelopes);
 
   return  TRUE;
 }
@@ -438,6 +432,8 @@ gegl_op_class_init (GeglOpClass *klass)
 
   filter_class->process    = process;
   operation_class->prepare = prepare;
+  /* the envelopes share the source among threads */
+  operation_class->threaded = FALSE;
 
   /* we override defined region to avoid growing the size of what is defined
    * by the filter. This also allows the tricks used to treat alpha==0 pixels
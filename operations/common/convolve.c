@@ -0,0 +1,268 @@
+/* This file is an image processing operation for GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#ifdef GEGL_PROPERTIES
+
+enum_start (gegl_convolve_method)
+  enum_value (GEGL_CONVOLVE_METHOD_AUTO,      "auto",      N_("Auto"))
+  enum_value (GEGL_CONVOLVE_METHOD_DIRECT,    "direct",    N_("Direct"))
+  enum_value (GEGL_CONVOLVE_METHOD_SEPARABLE, "separable", N_("Separable"))
+  enum_value (GEGL_CONVOLVE_METHOD_FFT,       "fft",       N_("FFT"))
+enum_end (GeglConvolveMethod)
+
+property_boolean (normalize, _("Normalize"), TRUE)
+  description (_("Scale the kernel so that its coefficients sum to 1"))
+
+property_enum (method, _("Method"),
+               GeglConvolveMethod, gegl_convolve_method,
+               GEGL_CONVOLVE_METHOD_AUTO)
+  description (_("How the convolution is computed, by default the method "
+                 "estimated to be the fastest for the kernel is used"))
+
+property_enum (border, _("Border"),
+               GeglAbyssPolicy, gegl_abyss_policy,
+               GEGL_ABYSS_CLAMP)
+  description (_("How the input is extended beyond its edges"))
+
+#else
+
+#define GEGL_OP_COMPOSER
+#define GEGL_OP_NAME     convolve
+#define GEGL_OP_C_SOURCE convolve.c
+
+#include "gegl-op.h"
+
+/* the kernel is centered on the middle of the aux extent, like
+ * gegl_convolution_new_from_buffer() does.
+ */
+static void
+get_margins (GeglOperation *operation,
+             gint          *left,
+             gint          *right,
+             gint          *top,
+             gint          *bottom)
+{
+  const GeglRectangle *kernel;
+
+  kernel = gegl_operation_source_get_bounding_box (operation, "aux");
+
+  if (kernel && ! gegl_rectangle_is_empty (kernel))
+    {
+      *left   = kernel->width  / 2;
+      *right  = kernel->width  - 1 - *left;
+      *top    = kernel->height / 2;
+      *bottom = kernel->height - 1 - *top;
+    }
+  else
+    {
+      *left = *right = *top = *bottom = 0;
+    }
+}
+
+/* the convolution is built from the kernel on aux once per render, in
+ * operation_process(), and shared by the threads processing the result.
+ * prepare() drops it, since it is called again whenever the graph
+ * upstream, aux included, or the properties change.
+ */
+static void
+prepare (GeglOperation *operation)
+{
+  GeglProperties *o = GEGL_PROPERTIES (operation);
+  const Babl *space  = gegl_operation_get_source_space (operation, "input");
+  const Babl *format = babl_format_with_space ("RaGaBaA float", space);
+
+  gegl_operation_set_format (operation, "input",  format);
+  gegl_operation_set_format (operation, "aux",    babl_format ("Y float"));
+  gegl_operation_set_format (operation, "output", format);
+
+  g_clear_pointer (&o->user_data, gegl_convolution_free);
+}
+
+static void
+finalize (GObject *object)
+{
+  GeglProperties *o = GEGL_PROPERTIES (object);
+
+  g_clear_pointer (&o->user_data, gegl_convolution_free);
+
+  G_OBJECT_CLASS (gegl_op_parent_class)->finalize (object);
+}
+
+static GeglRectangle
+get_bounding_box (GeglOperation *operation)
+{
+  const GeglRectangle *in_rect;
+
+  in_rect = gegl_operation_source_get_bounding_box (operation, "input");
+
+  if (! in_rect)
+    return *GEGL_RECTANGLE (0, 0, 0, 0);
+
+  return *in_rect;
+}
+
+static GeglRectangle
+get_required_for_output (GeglOperation       *operation,
+                         const gchar         *input_pad,
+                         const GeglRectangle *roi)
+{
+  GeglRectangle result = *roi;
+
+  if (! strcmp (input_pad, "aux"))
+    {
+      const GeglRectangle *kernel;
+
+      kernel = gegl_operation_source_get_bounding_box (operation, "aux");
+
+      if (kernel)
+        return *kernel;
+
+      return *GEGL_RECTANGLE (0, 0, 0, 0);
+    }
+  else
+    {
+      gint left, right, top, bottom;
+
+      get_margins (operation, &left, &right, &top, &bottom);
+
+      result.x      -= left;
+      result.y      -= top;
+      result.width  += left + right;
+      result.height += top + bottom;
+    }
+
+  return result;
+}
+
+static GeglRectangle
+get_invalidated_by_change (GeglOperation       *operation,
+                           const gchar         *input_pad,
+                           const GeglRectangle *input_region)
+{
+  GeglRectangle result = *input_region;
+
+  if (! strcmp (input_pad, "aux"))
+    {
+      return get_bounding_box (operation);
+    }
+  else
+    {
+      gint left, right, top, bottom;
+
+      get_margins (operation, &left, &right, &top, &bottom);
+
+      /* the output at x depends on the input from x - left to x + right */
+      result.x      -= right;
+      result.y      -= bottom;
+      result.width  += left + right;
+      result.height += top + bottom;
+    }
+
+  return result;
+}
+
+static gboolean
+process (GeglOperation       *operation,
+         GeglBuffer          *input,
+         GeglBuffer          *aux,
+         GeglBuffer          *output,
+         const GeglRectangle *result,
+         gint                 level)
+{
+  GeglProperties  *o           = GEGL_PROPERTIES (operation);
+  GeglConvolution *convolution = o->user_data;
+
+  if (! convolution)
+    {
+      gegl_buffer_copy (input, result, GEGL_ABYSS_NONE, output, result);
+
+      return TRUE;
+    }
+
+  /* the enum values match GeglConvolutionMethod */
+  gegl_convolution_process (convolution, input, output, result,
+                            gegl_operation_get_format (operation, "output"),
+                            o->border,
+                            (GeglConvolutionMethod) o->method);
+
+  return TRUE;
+}
+
+static gboolean
+operation_process (GeglOperation        *operation,
+                   GeglOperationContext *context,
+                   const gchar          *output_prop,
+                   const GeglRectangle  *result,
+                   gint                  level)
+{
+  GeglOperationClass  *operation_class;
+  GeglProperties      *o = GEGL_PROPERTIES (operation);
+  const GeglRectangle *kernel_rect;
+  GeglBuffer          *aux;
+
+  operation_class = GEGL_OPERATION_CLASS (gegl_op_parent_class);
+
+  kernel_rect = gegl_operation_source_get_bounding_box (operation, "aux");
+  aux         = GEGL_BUFFER (gegl_operation_context_get_object (context,
+                                                                "aux"));
+
+  if (! o->user_data                           &&
+      aux && kernel_rect                       &&
+      ! gegl_rectangle_is_empty (kernel_rect))
+    {
+      o->user_data = gegl_convolution_new_from_buffer (aux, kernel_rect,
+                                                       o->normalize);
+    }
+
+  return operation_class->process (operation, context, output_prop, result,
+                                   gegl_operation_context_get_level (context));
+}
+
+static void
+gegl_op_class_init (GeglOpClass *klass)
+{
+  GObjectClass               *object_class;
+  GeglOperationClass         *operation_class;
+  GeglOperationComposerClass *composer_class;
+
+  object_class    = G_OBJECT_CLASS (klass);
+  operation_class = GEGL_OPERATION_CLASS (klass);
+  composer_class  = GEGL_OPERATION_COMPOSER_CLASS (klass);
+
+  object_class->finalize                     = finalize;
+
+  operation_class->prepare                   = prepare;
+  operation_class->process                   = operation_process;
+  operation_class->get_bounding_box          = get_bounding_box;
+  operation_class->get_required_for_output   = get_required_for_output;
+  operation_class->get_invalidated_by_change = get_invalidated_by_change;
+  composer_class->process                    = process;
+
+  gegl_operation_class_set_keys (operation_class,
+    "name",        "gegl:convolve",
+    "title",       _("Convolve"),
+    "categories",  "generic",
+    "description", _("Convolve the input with a kernel of any size, given "
+                     "by the luminance of the aux input and centered on its "
+                     "middle. Separable kernels and large kernels are "
+                     "computed efficiently."),
+    NULL);
+}
+
+#endif
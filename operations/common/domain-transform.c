@@ -54,7 +54,7 @@ property_double (edge_preservation, _("Edge preservation"),  0.8)
 #define RF_TABLE_SIZE 768
 #define SQRT3 1.7320508075f
 #define SQRT2 1.4142135623f
-#define BLOCK_STRIDE 1
+#define STRIP_WIDTH 16  /* columns filtered together in the vertical pass */
 #define REPORT_PROGRESS_TIME 0.5  /* time to report gegl_operation_progress */
 
 static gint16
@@ -83,11 +83,212 @@ report_progress (GeglOperation  *operation,
     gegl_operation_progress (operation, progress, "");
 }
 
+typedef struct
+{
+  GeglBuffer   *input;
+  GeglBuffer   *output;
+  const Babl   *format;
+  const Babl   *formatu8;
+  gint          width;
+  gint          height;
+  const gfloat *rf_table;
+  gboolean      first_iteration;
+} PassData;
+
+/* the domain transform between consecutive pixels of a row or a column, as
+ * the sum of the channel differences, which is the index of the RF table.
+ *
+ * @NOTE: 'd' should be 1.0f + s_s / s_r * sum_diff
+ * However, we will store just sum_diff.
+ * 1.0f + s_s / s_r will be calculated later when calculating
+ * the RF table. This is done this way because the sum_diff is
+ * perfect to be used as the index of the RF table.
+ */
+static inline guint16
+transform (const guint8 *current,
+           const guint8 *last)
+{
+  return absolute (current[0] - last[0]) +
+         absolute (current[1] - last[1]) +
+         absolute (current[2] - last[2]);
+}
+
+/* filter rows [offset, offset + size) of the image */
+static void
+horizontal_pass (gsize     offset,
+                 gsize     size,
+                 PassData *data)
+{
+  gint          width    = data->width;
+  const gfloat *rf_table = data->rf_table;
+  guint8       *bufferu8;
+  guint16      *transforms;
+  gfloat       *buffer;
+  gint          i, k;
+
+  bufferu8   = g_new (guint8, width * 3);
+  transforms = g_new (guint16, width);
+  buffer     = g_new (gfloat, width * 4);
+
+  for (i = offset; i < (gint) (offset + size); i++)
+    {
+      GeglRectangle rect = { 0, i, width, 1 };
+      gfloat        lastf[4];
+      gint          c;
+
+      gegl_buffer_get (data->input, &rect, 1.0, data->formatu8, bufferu8,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+      /* Domain Transform */
+      transforms[0] = 0;
+      for (k = 1; k < width; ++k)
+        transforms[k] = transform (bufferu8 + k * 3, bufferu8 + (k - 1) * 3);
+
+      gegl_buffer_get (data->first_iteration ? data->input : data->output,
+                       &rect, 1.0, data->format, buffer,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+      /* Horizontal Filter (Left-Right) */
+      for (c = 0; c < 4; c++)
+        lastf[c] = buffer[c];
+
+      for (k = 0; k < width; ++k)
+        {
+          gfloat w = rf_table[transforms[k]];
+
+          for (c = 0; c < 4; c++)
+            {
+              lastf[c] = ((1 - w) * buffer[k * 4 + c] + w * lastf[c]);
+              buffer[k * 4 + c] = lastf[c];
+            }
+        }
+
+      /* Horizontal Filter (Right-Left) */
+      for (c = 0; c < 4; c++)
+        lastf[c] = buffer[(width - 1) * 4 + c];
+
+      for (k = width - 1; k >= 0; --k)
+        {
+          gfloat w = rf_table[transforms[(k < width - 1) ? k + 1 : k]];
+
+          for (c = 0; c < 4; c++)
+            {
+              lastf[c] = ((1 - w) * buffer[k * 4 + c] + w * lastf[c]);
+              buffer[k * 4 + c] = lastf[c];
+            }
+        }
+
+      gegl_buffer_set (data->output, &rect, 0, data->format, buffer,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (bufferu8);
+  g_free (transforms);
+  g_free (buffer);
+}
+
+/* filter strips [offset, offset + size) of STRIP_WIDTH columns.  The
+ * recursion runs down the rows of a strip, with all of its columns filtered
+ * together, which makes the inner loops contiguous and vectorizable.
+ */
+static void
+vertical_pass (gsize     offset,
+               gsize     size,
+               PassData *data)
+{
+  gint          height   = data->height;
+  const gfloat *rf_table = data->rf_table;
+  guint8       *bufferu8;
+  guint16      *transforms;
+  gfloat       *buffer;
+  gfloat        lastf[STRIP_WIDTH * 4];
+  gfloat        w[STRIP_WIDTH * 4];
+  gint          i, j, k;
+
+  bufferu8   = g_new (guint8, height * STRIP_WIDTH * 3);
+  transforms = g_new (guint16, height * STRIP_WIDTH);
+  buffer     = g_new (gfloat, height * STRIP_WIDTH * 4);
+
+  for (i = offset; i < (gint) (offset + size); i++)
+    {
+      GeglRectangle rect;
+      gint          n;
+
+      rect.x      = i * STRIP_WIDTH;
+      rect.y      = 0;
+      rect.width  = MIN (STRIP_WIDTH, data->width - rect.x);
+      rect.height = height;
+
+      n = rect.width * 4;
+
+      gegl_buffer_get (data->input, &rect, 1.0, data->formatu8, bufferu8,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+      /* Domain Transform */
+      for (j = 0; j < rect.width; ++j)
+        transforms[j] = 0;
+
+      for (k = 1; k < height; ++k)
+        for (j = 0; j < rect.width; ++j)
+          {
+            transforms[k * rect.width + j] =
+              transform (bufferu8 + (k * rect.width + j) * 3,
+                         bufferu8 + ((k - 1) * rect.width + j) * 3);
+          }
+
+      gegl_buffer_get (data->output, &rect, 1.0, data->format, buffer,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+      /* Vertical Filter (Top-Down) */
+      for (j = 0; j < n; ++j)
+        lastf[j] = buffer[j];
+
+      for (k = 0; k < height; ++k)
+        {
+          gfloat *row = buffer + k * n;
+
+          for (j = 0; j < n; ++j)
+            w[j] = rf_table[transforms[k * rect.width + j / 4]];
+
+          for (j = 0; j < n; ++j)
+            {
+              lastf[j] = ((1 - w[j]) * row[j] + w[j] * lastf[j]);
+              row[j] = lastf[j];
+            }
+        }
+
+      /* Vertical Filter (Bottom-Up) */
+      for (j = 0; j < n; ++j)
+        lastf[j] = buffer[(height - 1) * n + j];
+
+      for (k = height - 1; k >= 0; --k)
+        {
+          gfloat *row = buffer + k * n;
+          gint    d_y = (k < height - 1) ? k + 1 : k;
+
+          for (j = 0; j < n; ++j)
+            w[j] = rf_table[transforms[d_y * rect.width + j / 4]];
+
+          for (j = 0; j < n; ++j)
+            {
+              lastf[j] = ((1 - w[j]) * row[j] + w[j] * lastf[j]);
+              row[j] = lastf[j];
+            }
+        }
+
+      gegl_buffer_set (data->output, &rect, 0, data->format, buffer,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (bufferu8);
+  g_free (transforms);
+  g_free (buffer);
+}
+
 static gint
 domain_transform (GeglOperation  *operation,
                   gint            width,
                   gint            height,
-                  gint            n_chan,
                   gfloat          spatial_factor,
                   gfloat          range_factor,
                   gint            n_iterations,
@@ -95,37 +296,22 @@ domain_transform (GeglOperation  *operation,
                   GeglBuffer     *output)
 {
   const Babl *space    = gegl_operation_get_source_space (operation, "input");
-  const Babl *formatu8 = babl_format_with_space ("R'G'B' u8", space);
-  const Babl *format   = babl_format_with_space ("R'G'B'A float", space);
-  gfloat  **rf_table;
-  guint16  *transforms_buffer;
-  gfloat   *buffer;
-
-  gint16    last[3];
-  gint16    current[3];
-  gfloat    lastf[4];
-  gfloat    currentf[4];
-  gfloat    sum_channels_difference, a, w, sdt_dev;
-  gint      i, j, k, n;
-  gint      real_stride, d_x_position, d_y_position, biggest_dimension;
-  guint16   d;
-  GeglRectangle rect;
-  GTimer  *timer;
+  gdouble     pixels_per_thread;
+  gfloat    **rf_table;
+  gfloat      a, sdt_dev;
+  gint        i, j, n;
+  PassData    data;
+  GTimer     *timer;
 
   timer = g_timer_new ();
 
-  /* PRE-ALLOC MEMORY */
-  biggest_dimension = (width > height) ? width : height;
-  buffer            = g_new (gfloat, BLOCK_STRIDE * biggest_dimension * n_chan);
-  transforms_buffer = g_new (guint16, BLOCK_STRIDE * biggest_dimension);
+  pixels_per_thread = gegl_operation_get_pixels_per_thread (operation);
 
   rf_table = g_new (gfloat *, n_iterations);
 
   for (i = 0; i < n_iterations; ++i)
     rf_table[i] = g_new (gfloat, RF_TABLE_SIZE);
 
-  /* ************************ */
-
   report_progress (operation, 0.0, timer);
 
   /* Pre-calculate RF table */
@@ -148,249 +334,39 @@ domain_transform (GeglOperation  *operation,
         }
     }
 
-  /* Filter Iterations */
+  data.input    = input;
+  data.output   = output;
+  data.format   = babl_format_with_space ("R'G'B'A float", space);
+  data.formatu8 = babl_format_with_space ("R'G'B' u8", space);
+  data.width    = width;
+  data.height   = height;
+
+  /* Filter Iterations, the rows and the strips of columns are filtered
+   * independently of each other
+   */
   for (n = 0; n < n_iterations; ++n)
     {
+      data.rf_table        = rf_table[n];
+      data.first_iteration = n == 0;
+
       /* Horizontal Pass */
-      for (i = 0; i < height; i += BLOCK_STRIDE)
-        {
-          real_stride = (i + BLOCK_STRIDE > height) ? height - i : BLOCK_STRIDE;
-    
-          rect.x = 0;
-          rect.y = i;
-          rect.width = width;
-          rect.height = real_stride;
-    
-          gegl_buffer_get (input, &rect, 1.0, formatu8, buffer,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Domain Transform */
-          for (j = 0; j < rect.height; ++j)
-            {
-              last[0] = ((guint8*) buffer)[j * rect.width * 3];
-              last[1] = ((guint8*) buffer)[j * rect.width * 3 + 1];
-              last[2] = ((guint8*) buffer)[j * rect.width * 3 + 2];
-      
-              for (k = 0; k < rect.width; ++k)
-                {
-                  current[0] = ((guint8*) buffer)[j * rect.width * 3 + k * 3];
-                  current[1] = ((guint8*) buffer)[j * rect.width * 3 + k * 3 + 1];
-                  current[2] = ((guint8*) buffer)[j * rect.width * 3 + k * 3 + 2];
-        
-                  sum_channels_difference = absolute (current[0] - last[0]) +
-                                            absolute (current[1] - last[1]) +
-                                            absolute (current[2] - last[2]);
-        
-                  /* @NOTE: 'd' should be 1.0f + s_s / s_r * sum_diff
-                   * However, we will store just sum_diff.
-                   * 1.0f + s_s / s_r will be calculated later when calculating
-                   * the RF table. This is done this way because the sum_diff is
-                   * perfect to be used as the index of the RF table.
-                   * d = 1.0f + (vdt_information->spatial_factor /
-                   *   vdt_information->range_factor) * sum_channels_difference;
-                   */
-                  transforms_buffer[j * rect.width + k] = sum_channels_difference;
-        
-                  last[0] = current[0];
-                  last[1] = current[1];
-                  last[2] = current[2];
-                }
-            }
-    
-          if (n == 0)
-            gegl_buffer_get (input, &rect, 1.0, format, buffer,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-          else
-            gegl_buffer_get (output, &rect, 1.0, format, buffer,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Horizontal Filter (Left-Right) */
-          for (j = 0; j < rect.height; ++j)
-            {
-              lastf[0] = buffer[j * rect.width * n_chan];
-              lastf[1] = buffer[j * rect.width * n_chan + 1];
-              lastf[2] = buffer[j * rect.width * n_chan + 2];
-              lastf[3] = buffer[j * rect.width * n_chan + 3];
-      
-              for (k = 0; k < rect.width; ++k)
-                {
-                  d = transforms_buffer[j * rect.width + k];
-                  w = rf_table[n][d];
-        
-                  currentf[0] = buffer[j * rect.width * n_chan + k * n_chan];
-                  currentf[1] = buffer[j * rect.width * n_chan + k * n_chan + 1];
-                  currentf[2] = buffer[j * rect.width * n_chan + k * n_chan + 2];
-                  currentf[3] = buffer[j * rect.width * n_chan + k * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[j * rect.width * n_chan + k * n_chan]     = lastf[0];
-                  buffer[j * rect.width * n_chan + k * n_chan + 1] = lastf[1];
-                  buffer[j * rect.width * n_chan + k * n_chan + 2] = lastf[2];
-                  buffer[j * rect.width * n_chan + k * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          /* Horizontal Filter (Right-Left) */
-          for (j = 0; j < rect.height; ++j)
-            {
-              lastf[0] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan];
-              lastf[1] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan + 1];
-              lastf[2] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan + 2];
-              lastf[3] = buffer[j * rect.width * n_chan + (rect.width - 1) * n_chan + 3];
-              
-              for (k = rect.width - 1; k >= 0; --k)
-                {
-                  d_x_position = (k < rect.width - 1) ? k + 1 : k;
-                  d = transforms_buffer[j * rect.width + d_x_position];
-                  w = rf_table[n][d];
-        
-                  currentf[0] = buffer[j * rect.width * n_chan + k * n_chan];
-                  currentf[1] = buffer[j * rect.width * n_chan + k * n_chan + 1];
-                  currentf[2] = buffer[j * rect.width * n_chan + k * n_chan + 2];
-                  currentf[3] = buffer[j * rect.width * n_chan + k * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[j * rect.width * n_chan + k * n_chan] = lastf[0];
-                  buffer[j * rect.width * n_chan + k * n_chan + 1] = lastf[1];
-                  buffer[j * rect.width * n_chan + k * n_chan + 2] = lastf[2];
-                  buffer[j * rect.width * n_chan + k * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          gegl_buffer_set (output, &rect, 0, format, buffer,
-                           GEGL_AUTO_ROWSTRIDE);
-        }
-  
+      gegl_parallel_distribute_range (
+        height, pixels_per_thread / width,
+        (GeglParallelDistributeRangeFunc) horizontal_pass,
+        &data);
+
       report_progress (operation, (2.0 * n + 1.0) / (2.0 * n_iterations), timer);
-  
+
       /* Vertical Pass */
-      for (i = 0; i < width; i += BLOCK_STRIDE)
-        {
-          real_stride = (i + BLOCK_STRIDE > width) ? width - i : BLOCK_STRIDE;
-    
-          rect.x = i;
-          rect.y = 0;
-          rect.width = real_stride;
-          rect.height = height;
-    
-          gegl_buffer_get (input, &rect, 1.0, formatu8, buffer,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Domain Transform */
-          for (j = 0; j < rect.width; ++j)
-            {
-              last[0] = ((guint8*) buffer)[j * 3];
-              last[1] = ((guint8*) buffer)[j * 3 + 1];
-              last[2] = ((guint8*) buffer)[j * 3 + 2];
-      
-              for (k = 0; k < rect.height; ++k)
-                {
-                  current[0] = ((guint8*) buffer)[k * rect.width * 3 + j * 3];
-                  current[1] = ((guint8*) buffer)[k * rect.width * 3 + j * 3 + 1];
-                  current[2] = ((guint8*) buffer)[k * rect.width * 3 + j * 3 + 2];
-        
-                  sum_channels_difference = absolute (current[0] - last[0]) +
-                                            absolute (current[1] - last[1]) +
-                                            absolute (current[2] - last[2]);
-        
-                  /* @NOTE: 'd' should be 1.0f + s_s / s_r * sum_diff
-                   * However, we will store just sum_diff.
-                   * 1.0f + s_s / s_r will be calculated later when calculating
-                   * the RF table. This is done this way because the sum_diff is
-                   * perfect to be used as the index of the RF table.
-                   * d = 1.0f + (vdt_information->spatial_factor /
-                   *   vdt_information->range_factor) * sum_channels_difference;
-                   */
-                  transforms_buffer[k * rect.width + j] = sum_channels_difference;
-        
-                  last[0] = current[0];
-                  last[1] = current[1];
-                  last[2] = current[2];
-                }
-            }
-    
-          gegl_buffer_get (output, &rect, 1.0, format, buffer,
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
-    
-          /* Vertical Filter (Top-Down) */
-          for (j = 0; j < rect.width; ++j)
-            {
-              lastf[0] = buffer[j * n_chan];
-              lastf[1] = buffer[j * n_chan + 1];
-              lastf[2] = buffer[j * n_chan + 2];
-              lastf[3] = buffer[j * n_chan + 3];
-      
-              for (k = 0; k < rect.height; ++k)
-                {
-                  d = transforms_buffer[k * rect.width + j];
-                  w = rf_table[n][d];
-                  
-                  currentf[0] = buffer[k * rect.width * n_chan + j * n_chan];
-                  currentf[1] = buffer[k * rect.width * n_chan + j * n_chan + 1];
-                  currentf[2] = buffer[k * rect.width * n_chan + j * n_chan + 2];
-                  currentf[3] = buffer[k * rect.width * n_chan + j * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[k * rect.width * n_chan + j * n_chan]     = lastf[0];
-                  buffer[k * rect.width * n_chan + j * n_chan + 1] = lastf[1];
-                  buffer[k * rect.width * n_chan + j * n_chan + 2] = lastf[2];
-                  buffer[k * rect.width * n_chan + j * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          /* Vertical Filter (Bottom-Up) */
-          for (j = 0; j < rect.width; ++j)
-            {
-              lastf[0] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan];
-              lastf[1] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan + 1];
-              lastf[2] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan + 2];
-              lastf[3] = buffer[(rect.height - 1) * rect.width * n_chan + j * n_chan + 3];
-              
-              for (k = rect.height - 1; k >= 0; --k)
-                {
-                  d_y_position = (k < rect.height - 1) ? k + 1 : k;
-                  d = transforms_buffer[d_y_position * rect.width + j];
-                  w = rf_table[n][d];
-        
-                  currentf[0] = buffer[k * rect.width * n_chan + j * n_chan];
-                  currentf[1] = buffer[k * rect.width * n_chan + j * n_chan + 1];
-                  currentf[2] = buffer[k * rect.width * n_chan + j * n_chan + 2];
-                  currentf[3] = buffer[k * rect.width * n_chan + j * n_chan + 3];
-        
-                  lastf[0] = ((1 - w) * currentf[0] + w * lastf[0]);
-                  lastf[1] = ((1 - w) * currentf[1] + w * lastf[1]);
-                  lastf[2] = ((1 - w) * currentf[2] + w * lastf[2]);
-                  lastf[3] = ((1 - w) * currentf[3] + w * lastf[3]);
-        
-                  buffer[k * rect.width * n_chan + j * n_chan]     = lastf[0];
-                  buffer[k * rect.width * n_chan + j * n_chan + 1] = lastf[1];
-                  buffer[k * rect.width * n_chan + j * n_chan + 2] = lastf[2];
-                  buffer[k * rect.width * n_chan + j * n_chan + 3] = lastf[3];
-                }
-            }
-    
-          gegl_buffer_set (output, &rect, 0, format, buffer,
-                           GEGL_AUTO_ROWSTRIDE);
-        }
-  
+      gegl_parallel_distribute_range (
+        (width + STRIP_WIDTH - 1) / STRIP_WIDTH,
+        pixels_per_thread / (height * STRIP_WIDTH),
+        (GeglParallelDistributeRangeFunc) vertical_pass,
+        &data);
+
       report_progress (operation, (2.0 * n + 2.0) / (2.0 * n_iterations), timer);
     }
 
-  g_free (transforms_buffer);
-  g_free (buffer);
-
   for (i = 0; i < n_iterations; ++i)
     g_free (rf_table[i]);
 
@@ -457,7 +433,6 @@ process (GeglOperation       *operation,
   domain_transform (operation,
                     result->width,
                     result->height,
-                    4,
                     o->spatial_factor,
                     range_factor,
                     o->n_iterations,
@@ -14,178 +14,287 @@
  * Copyright 2007, 2009 Øyvind Kolås     <pippin@gimp.org>
  */
 
-#define ANGLE_PRIME  95273 /* the lookuptables are sized as primes to ensure */
-#define RADIUS_PRIME 29537 /* as good as possible variation when using both */
+/* The probes of the spray are taken from a table of offsets within the
+ * radius, made from the first points of a (0,2)-sequence (the first two
+ * Sobol dimensions) rather than from random numbers.  Every pixel uses an
+ * aligned window of the table, which keeps its probes stratified over the
+ * disc, and the window is picked with an R2 dither of the pixel position,
+ * so that the remaining noise is spread like blue noise and is the same
+ * from run to run, independent of the number of threads.
+ */
+
+#define PROBE_TABLE_SIZE        (1 << 14)
+#define MAX_LINEAR_SOURCE       (8 * 1024 * 1024) /* pixels */
+
+typedef struct
+{
+  gint           radius;
+  gint           samples;
+  gint           iterations;
+
+  gint          *offsets;     /* dx, dy pairs                                */
+  gint           window_size; /* power of two covering samples * iterations  */
+  gint           n_windows;
 
-static gfloat   lut_cos[ANGLE_PRIME];
-static gfloat   lut_sin[ANGLE_PRIME];
-static gfloat   radiuses[RADIUS_PRIME];
-static gint     luts_computed = 0;
-static gint     angle_no=0;
-static gint     radius_no=0;
+  GeglRectangle  bounds;      /* probes outside of it are taken again        */
+
+  /* the source pixels, when they fit in memory, otherwise probes are taken
+   * with a sampler
+   */
+  gfloat        *data;
+  GeglRectangle  data_rect;
+
+  GeglBuffer    *buffer;
+  gint           level;
+  const Babl    *format;
+} Envelopes;
+
+/* the per thread state for computing envelopes */
+typedef struct
+{
+  Envelopes         *envelopes;
+  GeglSampler       *sampler;
+  GeglSamplerGetFun  getfun;
+  gfloat            *probes;
+} EnvelopesWorker;
 
-static void compute_luts(gint rgamma)
+static guint32
+probe_sequence_x (guint32 i)
 {
-  gint i;
-  GRand *rand;
-  gfloat golden_angle = G_PI * (3-sqrt(5.0)); /* http://en.wikipedia.org/wiki/Golden_angle */
-  gfloat angle = 0.0;
+  /* the radical inverse in base 2 */
+  i = (i << 16) | (i >> 16);
+  i = ((i & 0x00ff00ff) << 8) | ((i & 0xff00ff00) >> 8);
+  i = ((i & 0x0f0f0f0f) << 4) | ((i & 0xf0f0f0f0) >> 4);
+  i = ((i & 0x33333333) << 2) | ((i & 0xcccccccc) >> 2);
+  i = ((i & 0x55555555) << 1) | ((i & 0xaaaaaaaa) >> 1);
 
-  if (g_atomic_int_get (&luts_computed)==rgamma)
-    return;
-  rand = g_rand_new();
+  return i;
+}
+
+static guint32
+probe_sequence_y (guint32 i)
+{
+  /* the second Sobol dimension */
+  guint32 v      = 1u << 31;
+  guint32 result = 0;
+
+  for (; i; i >>= 1, v ^= v >> 1)
+    if (i & 1)
+      result ^= v;
+
+  return result;
+}
+
+/* area is the region the envelopes are computed for, grown by the radius */
+static Envelopes *
+envelopes_new (GeglBuffer          *buffer,
+               const GeglRectangle *area,
+               gint                 level,
+               gint                 radius,
+               gint                 samples,
+               gint                 iterations,
+               gdouble              rgamma,
+               const Babl          *format)
+{
+  Envelopes           *envelopes = g_slice_new0 (Envelopes);
+  const GeglRectangle *extent    = gegl_buffer_get_extent (buffer);
+  gint                 n_probes  = samples * iterations;
+  gint                 i;
 
-  for (i=0;i<ANGLE_PRIME;i++)
+  envelopes->radius     = radius;
+  envelopes->samples    = samples;
+  envelopes->iterations = iterations;
+  envelopes->buffer     = buffer;
+  envelopes->level      = level;
+  envelopes->format     = format;
+
+  envelopes->window_size = 1;
+  while (envelopes->window_size < n_probes &&
+         envelopes->window_size < PROBE_TABLE_SIZE)
+    envelopes->window_size *= 2;
+  envelopes->n_windows = PROBE_TABLE_SIZE / envelopes->window_size;
+
+  envelopes->offsets = g_new (gint, 2 * PROBE_TABLE_SIZE);
+
+  for (i = 0; i < PROBE_TABLE_SIZE; i++)
     {
-      lut_cos[i] = cos(angle);
-      lut_sin[i] = sin(angle);
-      angle += golden_angle;
+      gdouble rmag  = pow (probe_sequence_x (i) / 4294967296.0, rgamma) *
+                      radius;
+      gdouble angle = probe_sequence_y (i) / 4294967296.0 * 2.0 * G_PI;
+
+      envelopes->offsets[i * 2 + 0] = rmag * cos (angle);
+      envelopes->offsets[i * 2 + 1] = rmag * sin (angle);
     }
-  for (i=0;i<RADIUS_PRIME;i++)
+
+  envelopes->bounds.x      = extent->x >> level;
+  envelopes->bounds.y      = extent->y >> level;
+  envelopes->bounds.width  = extent->width >> level;
+  envelopes->bounds.height = extent->height >> level;
+
+  if ((gint64) area->width * area->height <= MAX_LINEAR_SOURCE)
     {
-      radiuses[i] = pow(g_rand_double_range (rand, 0.0, 1.0), rgamma);
+      envelopes->data_rect = *area;
+
+      envelopes->data = gegl_malloc ((gsize) envelopes->data_rect.width *
+                                     envelopes->data_rect.height *
+                                     4 * sizeof (gfloat));
+
+      gegl_buffer_get (buffer, &envelopes->data_rect, 1.0 / (1 << level),
+                       format, envelopes->data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+      /* the probes can't reach out of area anyway */
+      gegl_rectangle_intersect (&envelopes->bounds,
+                                &envelopes->bounds, area);
     }
 
-  g_rand_free(rand);
-  g_atomic_int_set (&luts_computed, rgamma);
+  return envelopes;
+}
+
+static void
+envelopes_free (Envelopes *envelopes)
+{
+  if (envelopes->data)
+    gegl_free (envelopes->data);
 
+  g_free (envelopes->offsets);
+  g_slice_free (Envelopes, envelopes);
 }
 
-static inline void
-sample_min_max (GeglBuffer  *buffer,
-                GeglSampler *sampler,
-                GeglSamplerGetFun getfun,
-                gint         x,
-                gint         y,
-                gint         radius,
-                gint         samples,
-                gfloat      *min,
-                gfloat      *max,
-                gfloat      *pixel,
-                const Babl  *format)
+static void
+envelopes_worker_init (EnvelopesWorker *worker,
+                       Envelopes       *envelopes)
 {
-  gfloat best_min[3];
-  gfloat best_max[3];
-  gint width = gegl_buffer_get_width (buffer);
-  gint height = gegl_buffer_get_height (buffer);
-  
-  gint i, c;
-
-  for (c=0;c<3;c++)
+  worker->envelopes = envelopes;
+  worker->sampler   = NULL;
+  worker->getfun    = NULL;
+  worker->probes    = g_new (gfloat, 4 * envelopes->samples);
+
+  if (! envelopes->data)
     {
-      best_min[c]=pixel[c];
-      best_max[c]=pixel[c];
+      worker->sampler = gegl_buffer_sampler_new_at_level (envelopes->buffer,
+                                                          envelopes->format,
+                                                          GEGL_SAMPLER_NEAREST,
+                                                          envelopes->level);
+      worker->getfun  = gegl_sampler_get_fun (worker->sampler);
     }
+}
 
-  for (i=0; i<samples; i++)
-    {
-      gint u, v;
-      gfloat rmag;
-      gint angle;
-      gint rad_no;
-      gint max_retries = samples;
-
-retry:                      /* if we've sampled outside the valid image
-                               area, we grab another sample instead, this
-                               should potentially work better than mirroring
-                               or extending with an abyss policy
-                             */
-      angle = angle_no++;
-      rad_no = radius_no ++;
-
-      if (angle_no>=ANGLE_PRIME)
-        angle_no=0;
-      if (angle>=ANGLE_PRIME)
-        angle=0;
-      if (radius_no>=RADIUS_PRIME)
-        radius_no=0;
-      if (rad_no>=RADIUS_PRIME)
-        rad_no=0;
-
-      rmag = radiuses[rad_no] * radius;
-      u = x + rmag * lut_cos[angle];
-      v = y + rmag * lut_sin[angle];
-
-      if (u>=width ||
-          u<0 ||
-          v>=height ||
-          v<0)
-      {
-        goto retry;
-      }
+static void
+envelopes_worker_clear (EnvelopesWorker *worker)
+{
+  g_clear_object (&worker->sampler);
+  g_free (worker->probes);
+}
 
-      {
-        gfloat pixel[4];
-        getfun (sampler, u, v, NULL, (void*)(&pixel[0]), GEGL_ABYSS_CLAMP);
+static inline void
+envelopes_get_pixel (EnvelopesWorker *worker,
+                     gint             x,
+                     gint             y,
+                     gfloat          *pixel)
+{
+  Envelopes *envelopes = worker->envelopes;
 
-        if (pixel[3]>0.0) /* ignore fully transparent pixels */
-          {
-            for (c=0;c<3;c++)
-              {
-                if (pixel[c]<best_min[c])
-                  best_min[c]=pixel[c];
-
-                if (pixel[c]>best_max[c])
-                  best_max[c]=pixel[c];
-              }
-          }
-        else
-          {
-            max_retries--;
-            if (max_retries>0)
-              goto retry;
-          }
-      }
+  if (envelopes->data)
+    {
+      const gfloat *src = envelopes->data +
+                          4 * ((y - envelopes->data_rect.y) *
+                               envelopes->data_rect.width +
+                               x - envelopes->data_rect.x);
+      gint          c;
+
+      for (c = 0; c < 4; c++)
+        pixel[c] = src[c];
     }
-  for (c=0;c<3;c++)
+  else
     {
-      min[c]=best_min[c];
-      max[c]=best_max[c];
+      worker->getfun (worker->sampler, x, y, NULL, (void*)(&pixel[0]),
+                      GEGL_ABYSS_CLAMP);
     }
 }
 
-static inline void compute_envelopes (GeglBuffer       *buffer,
-                                      GeglSampler      *sampler,
-                                      GeglSamplerGetFun getfun,
-                                      gint     x,
-                                      gint     y,
-                                      gint     radius,
-                                      gint     samples,
-                                      gint     iterations,
-                                      gboolean same_spray,
-                                      gdouble  rgamma,
-                                      gfloat  *min_envelope,
-                                      gfloat  *max_envelope,
-                                      gfloat  *pixel,
-                                      const Babl *format)
+static inline void
+compute_envelopes (EnvelopesWorker *worker,
+                   gint             x,
+                   gint             y,
+                   gfloat          *min_envelope,
+                   gfloat          *max_envelope,
+                   gfloat          *pixel)
 {
+  Envelopes           *envelopes = worker->envelopes;
+  const GeglRectangle *bounds    = &envelopes->bounds;
+  const gint          *offsets   = envelopes->offsets;
+  gint    samples = envelopes->samples;
   gint    i;
   gint    c;
   gfloat  range_sum[4]               = {0,0,0,0};
   gfloat  relative_brightness_sum[4] = {0,0,0,0};
+  gfloat *probes = worker->probes;
+  gdouble dither;
+  gint    index;
+  gint    flip_x = (x & 1) ? -1 : 1;
+  gint    flip_y = (y & 1) ? -1 : 1;
 
-  getfun (sampler, x, y, NULL, (void*)(&pixel[0]), GEGL_ABYSS_CLAMP);
+  envelopes_get_pixel (worker, x, y, pixel);
 
-  /* compute lookuptables for the gamma, currently not used/exposed
-   * as a tweakable property */
-  compute_luts(rgamma);
+  /* an R2 dither of the pixel position picks the window of the table */
+  dither = x * 0.75487766624669276 + y * 0.56984029099805327;
+  dither -= floor (dither);
+  index = (gint) (dither * envelopes->n_windows) * envelopes->window_size;
 
-  if (same_spray)
+  for (i=0;i<envelopes->iterations;i++)
     {
-      angle_no = 0;
-      radius_no = 0;
-    }
+      gfloat min[4], max[4];
+      gint   n_probes    = 0;
+      gint   max_retries = samples;
+      gint   max_misses  = 16 * samples;
+      gint   j;
 
-  for (i=0;i<iterations;i++)
-    {
-      gfloat min[3], max[3];
+      /* collect the probes of the iteration, if we've sampled outside the
+       * valid image area, we grab another sample instead, this should
+       * potentially work better than mirroring or extending with an abyss
+       * policy, fully transparent pixels are skipped as well.
+       */
+      while (n_probes < samples)
+        {
+          gint u = x + flip_x * offsets[index * 2 + 0];
+          gint v = y + flip_y * offsets[index * 2 + 1];
+
+          index = (index + 1) & (PROBE_TABLE_SIZE - 1);
+
+          if (u <  bounds->x                 ||
+              v <  bounds->y                 ||
+              u >= bounds->x + bounds->width ||
+              v >= bounds->y + bounds->height)
+            {
+              if (--max_misses > 0)
+                continue;
+              break;
+            }
+
+          envelopes_get_pixel (worker, u, v, probes + 4 * n_probes);
+
+          /* ignore fully transparent pixels */
+          if (probes[4 * n_probes + 3] > 0.0)
+            n_probes++;
+          else if (--max_retries <= 0)
+            break;
+        }
+
+      for (c=0;c<4;c++)
+        {
+          min[c]=pixel[c];
+          max[c]=pixel[c];
+        }
 
-      sample_min_max (buffer,
-                      sampler,
-                      getfun,
-                      x, y,
-                      radius, samples,
-                      min, max, pixel, format);
+      for (j=0;j<n_probes;j++)
+        for (c=0;c<4;c++)
+          {
+            gfloat value = probes[4 * j + c];
+
+            min[c] = value < min[c] ? value : min[c];
+            max[c] = value > max[c] ? value : max[c];
+          }
 
       for (c=0;c<3;c++)
         {
@@ -209,9 +318,10 @@ static inline void compute_envelopes (GeglBuffer       *buffer,
 
     for (c=0;c<3;c++)
       {
-        gfloat relative_brightness = relative_brightness_sum[c] / iterations;
-        gfloat range               = range_sum[c] / iterations;
-        
+        gfloat relative_brightness = relative_brightness_sum[c] /
+                                     envelopes->iterations;
+        gfloat range               = range_sum[c] / envelopes->iterations;
+
         if (max_envelope)
           max_envelope[c] = pixel[c] + (1.0 - relative_brightness) * range;
         if (min_envelope)
@@ -372,6 +372,12 @@ fattal02_solve_pde_multigrid (gfloat              *F,
     {
       guint cycle;
 
+      /* the solution is discarded when processing is cancelled, so stop
+       * refining it between levels
+       */
+      if (gegl_parallel_is_cancelled ())
+        break;
+
       /* 4. interpolate sollution from last coarse-grid to finer-grid
        * interpolate from level k+1 to level k (finer-grid)
        */
@@ -1298,6 +1304,9 @@ fattal02_process (GeglOperation       *operation,
 
   fattal02_tonemap (lum_in, result, lum_out, o->alpha, o->beta, noise);
 
+  if (gegl_parallel_is_cancelled ())
+    goto cleanup;
+
   for (i = 0; i < result->width * result->height * pix_stride; ++i)
     {
       pix[i] = (powf (pix[i] / lum_in[i / pix_stride],
@@ -1307,6 +1316,8 @@ fattal02_process (GeglOperation       *operation,
 
   gegl_buffer_set (output, result, 0, out_format, pix,
                    GEGL_AUTO_ROWSTRIDE);
+
+cleanup:
   g_free (pix);
   g_free (lum_out);
   g_free (lum_in);
@@ -157,23 +157,193 @@ init_clusters (GeglBuffer     *input,
   return clusters;
 }
 
+/* the clusters whose search window intersects each cell of a grid over the
+ * image, in increasing order
+ */
+typedef struct
+{
+  GeglRectangle  extent;
+  gint           cell_size;
+  gint           n_columns;
+  gint           n_rows;
+  guint         *offsets;
+  guint         *indices;
+} ClustersGrid;
+
+static void
+clusters_grid_get_cells (ClustersGrid        *grid,
+                         const GeglRectangle *rect,
+                         gint                *x0,
+                         gint                *y0,
+                         gint                *x1,
+                         gint                *y1)
+{
+  GeglRectangle area;
+
+  if (! gegl_rectangle_intersect (&area, rect, &grid->extent))
+    {
+      *x0 = *y0 = 0;
+      *x1 = *y1 = -1;
+      return;
+    }
+
+  *x0 = (area.x - grid->extent.x) / grid->cell_size;
+  *y0 = (area.y - grid->extent.y) / grid->cell_size;
+  *x1 = (area.x + area.width  - 1 - grid->extent.x) / grid->cell_size;
+  *y1 = (area.y + area.height - 1 - grid->extent.y) / grid->cell_size;
+}
+
+static void
+clusters_grid_init (ClustersGrid        *grid,
+                    GArray              *clusters,
+                    const GeglRectangle *extent,
+                    gint                 cell_size)
+{
+  guint *counts;
+  guint  i;
+  guint  n_cells;
+  gint   x, y, x0, y0, x1, y1;
+
+  grid->extent    = *extent;
+  grid->cell_size = cell_size;
+  grid->n_columns = (extent->width  + cell_size - 1) / cell_size;
+  grid->n_rows    = (extent->height + cell_size - 1) / cell_size;
+
+  n_cells = grid->n_columns * grid->n_rows;
+
+  counts        = g_new0 (guint, n_cells);
+  grid->offsets = g_new (guint, n_cells + 1);
+
+  for (i = 0; i < clusters->len; i++)
+    {
+      Cluster *c = &g_array_index (clusters, Cluster, i);
+
+      clusters_grid_get_cells (grid, &c->search_window, &x0, &y0, &x1, &y1);
+
+      for (y = y0; y <= y1; y++)
+        for (x = x0; x <= x1; x++)
+          counts[y * grid->n_columns + x]++;
+    }
+
+  grid->offsets[0] = 0;
+  for (i = 0; i < n_cells; i++)
+    grid->offsets[i + 1] = grid->offsets[i] + counts[i];
+
+  grid->indices = g_new (guint, grid->offsets[n_cells]);
+
+  memset (counts, 0, n_cells * sizeof (guint));
+
+  for (i = 0; i < clusters->len; i++)
+    {
+      Cluster *c = &g_array_index (clusters, Cluster, i);
+
+      clusters_grid_get_cells (grid, &c->search_window, &x0, &y0, &x1, &y1);
+
+      for (y = y0; y <= y1; y++)
+        for (x = x0; x <= x1; x++)
+          {
+            gint cell = y * grid->n_columns + x;
+
+            grid->indices[grid->offsets[cell] + counts[cell]++] = i;
+          }
+    }
+
+  g_free (counts);
+}
+
+static void
+clusters_grid_clear (ClustersGrid *grid)
+{
+  g_free (grid->offsets);
+  g_free (grid->indices);
+}
+
+static gint
+compare_indices (gconstpointer a,
+                 gconstpointer b)
+{
+  guint index_a = *(const guint *) a;
+  guint index_b = *(const guint *) b;
+
+  return index_a < index_b ? -1 : index_a > index_b;
+}
+
+/* construct the array of the indices of the clusters whose search window
+ * intersects roi, in increasing order
+ */
+static void
+clusters_grid_find (ClustersGrid        *grid,
+                    GArray              *clusters,
+                    const GeglRectangle *roi,
+                    GArray              *clusters_index)
+{
+  gint x, y, x0, y0, x1, y1;
+  guint i, j;
+
+  clusters_index->len = 0;
+
+  clusters_grid_get_cells (grid, roi, &x0, &y0, &x1, &y1);
+
+  for (y = y0; y <= y1; y++)
+    for (x = x0; x <= x1; x++)
+      {
+        gint cell = y * grid->n_columns + x;
+
+        for (i = grid->offsets[cell]; i < grid->offsets[cell + 1]; i++)
+          {
+            Cluster *c = &g_array_index (clusters, Cluster,
+                                         grid->indices[i]);
+
+            if (gegl_rectangle_intersect (NULL, &c->search_window, roi))
+              g_array_append_val (clusters_index, grid->indices[i]);
+          }
+      }
+
+  if (clusters_index->len < 2)
+    return;
+
+  g_array_sort (clusters_index, compare_indices);
+
+  /* remove the clusters found in several cells */
+  for (i = 1, j = 1; i < clusters_index->len; i++)
+    {
+      if (g_array_index (clusters_index, guint, i) !=
+          g_array_index (clusters_index, guint, j - 1))
+        {
+          g_array_index (clusters_index, guint, j++) =
+            g_array_index (clusters_index, guint, i);
+        }
+    }
+
+  clusters_index->len = j;
+}
+
+typedef struct
+{
+  GeglBuffer   *input;
+  GeglBuffer   *labels;
+  GArray       *clusters;
+  ClustersGrid *grid;
+  gint          cluster_size;
+  gint          compactness;
+  const Babl   *format;
+} AssignData;
+
+/* label every pixel of area with its nearest cluster */
 static void
-assign_labels (GeglBuffer *labels,
-               GeglBuffer *input,
-               GArray     *clusters,
-               gint        cluster_size,
-               gint        compactness,
-               const Babl *format)
+assign_labels (const GeglRectangle *area,
+               AssignData          *data)
 {
   GeglBufferIterator *iter;
+  GArray  *clusters = data->clusters;
   GArray  *clusters_index;
 
   clusters_index = g_array_sized_new (FALSE, FALSE, sizeof (guint), 9);
 
-  iter = gegl_buffer_iterator_new (input, NULL, 0, format,
+  iter = gegl_buffer_iterator_new (data->input, area, 0, data->format,
                                    GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
 
-  gegl_buffer_iterator_add (iter, labels, NULL, 0,
+  gegl_buffer_iterator_add (iter, data->labels, area, 0,
                             babl_format_n (babl_type ("u32"), 1),
                             GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
 
@@ -189,27 +359,10 @@ assign_labels (GeglBuffer *labels,
       x = roi->x;
       y = roi->y;
 
-      /* construct an array of clusters index for which search_window
-       * intersect with the current roi
-       */
-
-      for (i = 0; i < clusters->len ; i++)
-        {
-          Cluster *c = &g_array_index (clusters, Cluster, i);
-
-          if (gegl_rectangle_intersect (NULL, &c->search_window, roi))
-            g_array_append_val (clusters_index, i);
-        }
-
-      if (!clusters_index->len)
-        {
-          g_printerr ("no clusters for roi %d,%d,%d,%d\n", roi->x, roi->y, roi->width, roi->height);
-          continue;
-        }
+      clusters_grid_find (data->grid, clusters, roi, clusters_index);
 
       while (n_pixels--)
         {
-          Cluster *c;
           gfloat feature[5] = {pixel[0], pixel[1], pixel[2],
                                (gfloat) x, (gfloat) y};
 
@@ -231,7 +384,7 @@ assign_labels (GeglBuffer *labels,
                 continue;
 
               distance = get_distance (tmp->center, feature,
-                                       cluster_size, compactness);
+                                       data->cluster_size, data->compactness);
 
               if (distance < min_distance)
                 {
@@ -240,14 +393,6 @@ assign_labels (GeglBuffer *labels,
                 }
             }
 
-          c = &g_array_index (clusters, Cluster, best_cluster);
-          c->sum[0] += pixel[0];
-          c->sum[1] += pixel[1];
-          c->sum[2] += pixel[2];
-          c->sum[3] += (gfloat) x;
-          c->sum[4] += (gfloat) y;
-          c->n_pixels++;
-
           *label = best_cluster;
 
           pixel += 3;
@@ -260,13 +405,54 @@ assign_labels (GeglBuffer *labels,
               x = roi->x;
             }
         }
-
-      clusters_index->len = 0;
    }
 
   g_array_free (clusters_index, TRUE);
 }
 
+/* the sums are accumulated in a fixed order, so that the clusters don't
+ * depend on how the labelling was split among threads
+ */
+static void
+accumulate_clusters (GeglBuffer *labels,
+                     GeglBuffer *input,
+                     GArray     *clusters,
+                     const Babl *format)
+{
+  GeglBufferIterator *iter;
+
+  iter = gegl_buffer_iterator_new (input, NULL, 0, format,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
+
+  gegl_buffer_iterator_add (iter, labels, NULL, 0,
+                            babl_format_n (babl_type ("u32"), 1),
+                            GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+   {
+      GeglRectangle *roi = &iter->items[0].roi;
+      gfloat  *pixel = iter->items[0].data;
+      guint32 *label = iter->items[1].data;
+      gint     x, y;
+
+      for (y = roi->y; y < roi->y + roi->height; y++)
+        for (x = roi->x; x < roi->x + roi->width; x++)
+          {
+            Cluster *c = &g_array_index (clusters, Cluster, *label);
+
+            c->sum[0] += pixel[0];
+            c->sum[1] += pixel[1];
+            c->sum[2] += pixel[2];
+            c->sum[3] += (gfloat) x;
+            c->sum[4] += (gfloat) y;
+            c->n_pixels++;
+
+            pixel += 3;
+            label++;
+          }
+   }
+}
+
 static gboolean
 update_clusters (GArray *clusters,
                  gint    cluster_size)
@@ -298,19 +484,25 @@ update_clusters (GArray *clusters,
   return TRUE;
 }
 
+typedef struct
+{
+  GeglBuffer *output;
+  GeglBuffer *labels;
+  GArray     *clusters;
+  const Babl *format;
+} OutputData;
+
 static void
-set_output (GeglBuffer *output,
-            GeglBuffer *labels,
-            GArray     *clusters,
-            const Babl *format)
+set_output (const GeglRectangle *area,
+            OutputData          *data)
 {
   GeglBufferIterator *iter;
 
-  iter = gegl_buffer_iterator_new (output, NULL, 0,
-                                   format,
+  iter = gegl_buffer_iterator_new (data->output, area, 0,
+                                   data->format,
                                    GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 2);
 
-  gegl_buffer_iterator_add (iter, labels, NULL, 0,
+  gegl_buffer_iterator_add (iter, data->labels, area, 0,
                             babl_format_n (babl_type ("u32"), 1),
                             GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
 
@@ -322,7 +514,7 @@ set_output (GeglBuffer *output,
 
       while (n_pixels--)
         {
-          Cluster *c = &g_array_index (clusters, Cluster, *label);
+          Cluster *c = &g_array_index (data->clusters, Cluster, *label);
 
           pixel[0] = c->center[0];
           pixel[1] = c->center[1];
@@ -382,6 +574,7 @@ process (GeglOperation       *operation,
   const GeglRectangle *src_region = gegl_buffer_get_extent (input);
   GeglBuffer *labels;
   GArray     *clusters;
+  OutputData  output_data;
   gint        max_dim;
   gint        cluster_size;
   gint        n_iterations;
@@ -406,12 +599,29 @@ process (GeglOperation       *operation,
 
   for (i = 0; i < n_iterations; i++)
     {
-      assign_labels (labels,
-                     input,
-                     clusters,
-                     cluster_size,
-                     o->compactness,
-                     format);
+      AssignData   data;
+      ClustersGrid grid;
+
+      clusters_grid_init (&grid, clusters, src_region, cluster_size);
+
+      data.input        = input;
+      data.labels       = labels;
+      data.clusters     = clusters;
+      data.grid         = &grid;
+      data.cluster_size = cluster_size;
+      data.compactness  = o->compactness;
+      data.format       = format;
+
+      gegl_parallel_distribute_area (
+        src_region,
+        gegl_operation_get_pixels_per_thread (operation) / 16,
+        GEGL_SPLIT_STRATEGY_AUTO,
+        (GeglParallelDistributeAreaFunc) assign_labels,
+        &data);
+
+      clusters_grid_clear (&grid);
+
+      accumulate_clusters (labels, input, clusters, format);
 
       update_clusters (clusters, cluster_size);
 
@@ -422,7 +632,17 @@ process (GeglOperation       *operation,
 
   /* apply clusters colors to output */
 
-  set_output (output, labels, clusters, format);
+  output_data.output   = output;
+  output_data.labels   = labels;
+  output_data.clusters = clusters;
+  output_data.format   = format;
+
+  gegl_parallel_distribute_area (
+    gegl_buffer_get_extent (output),
+    gegl_operation_get_pixels_per_thread (operation),
+    GEGL_SPLIT_STRATEGY_AUTO,
+    (GeglParallelDistributeAreaFunc) set_output,
+    &output_data);
 
   gegl_operation_progress (operation, 1.0, "");
 
@@ -0,0 +1,157 @@
+/* This file is an image processing operation for GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#ifdef GEGL_PROPERTIES
+
+#else
+
+#define GEGL_OP_FILTER
+#define GEGL_OP_NAME     split_alpha
+#define GEGL_OP_C_SOURCE split-alpha.c
+
+#include "gegl-op.h"
+
+/* gegl:split-alpha has two output pads, which are both computed by a single
+ * process call: "output" carries the (unassociated) color of the input, and
+ * "alpha" its alpha channel, as a grayscale image.
+ */
+
+static void
+attach (GeglOperation *operation)
+{
+  GParamSpec *pspec;
+
+  GEGL_OPERATION_CLASS (gegl_op_parent_class)->attach (operation);
+
+  pspec = g_param_spec_object ("alpha",
+                               "Alpha",
+                               "Output pad for the alpha channel of the input.",
+                               GEGL_TYPE_BUFFER,
+                               G_PARAM_READABLE |
+                               GEGL_PARAM_PAD_OUTPUT);
+  gegl_operation_create_pad (operation, pspec);
+  g_param_spec_sink (pspec);
+}
+
+static void
+prepare (GeglOperation *operation)
+{
+  const Babl *space = gegl_operation_get_source_space (operation, "input");
+
+  gegl_operation_set_format (operation, "input",
+                             babl_format_with_space ("RGBA float", space));
+  gegl_operation_set_format (operation, "output",
+                             babl_format_with_space ("RGB float", space));
+  gegl_operation_set_format (operation, "alpha",
+                             babl_format ("Y float"));
+}
+
+typedef struct
+{
+  GeglBuffer *input;
+  GeglBuffer *output;
+  GeglBuffer *alpha;
+} ThreadData;
+
+static void
+split_area (const GeglRectangle *area,
+            ThreadData          *data)
+{
+  GeglBufferIterator *iter;
+
+  iter = gegl_buffer_iterator_new (data->output, area, 0,
+                                   gegl_buffer_get_format (data->output),
+                                   GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 3);
+  gegl_buffer_iterator_add (iter, data->alpha, area, 0,
+                            gegl_buffer_get_format (data->alpha),
+                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_add (iter, data->input, area, 0,
+                            babl_format_with_space ("RGBA float",
+                                                    gegl_buffer_get_format (data->output)),
+                            GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      gfloat       *out   = iter->items[0].data;
+      gfloat       *alpha = iter->items[1].data;
+      const gfloat *in    = iter->items[2].data;
+      gint          n     = iter->length;
+
+      while (n--)
+        {
+          out[0]   = in[0];
+          out[1]   = in[1];
+          out[2]   = in[2];
+          alpha[0] = in[3];
+
+          out   += 3;
+          alpha += 1;
+          in    += 4;
+        }
+    }
+}
+
+static gboolean
+operation_process (GeglOperation        *operation,
+                   GeglOperationContext *context,
+                   const gchar          *output_prop,
+                   const GeglRectangle  *result,
+                   gint                  level)
+{
+  ThreadData data;
+
+  data.input  = GEGL_BUFFER (gegl_operation_context_dup_object (context,
+                                                                "input"));
+  data.output = gegl_operation_context_get_target (context, "output");
+  data.alpha  = gegl_operation_context_get_target (context, "alpha");
+
+  if (data.input)
+    {
+      gegl_parallel_distribute_area (
+        result,
+        gegl_operation_get_pixels_per_thread (operation),
+        GEGL_SPLIT_STRATEGY_AUTO,
+        (GeglParallelDistributeAreaFunc) split_area,
+        &data);
+
+      g_object_unref (data.input);
+    }
+
+  return TRUE;
+}
+
+static void
+gegl_op_class_init (GeglOpClass *klass)
+{
+  GeglOperationClass *operation_class = GEGL_OPERATION_CLASS (klass);
+
+  operation_class->attach  = attach;
+  operation_class->prepare = prepare;
+  operation_class->process = operation_process;
+
+  gegl_operation_class_set_keys (operation_class,
+    "name",        "gegl:split-alpha",
+    "title",       _("Split Alpha"),
+    "categories",  "color",
+    "description", _("Separate the color of the input from its alpha "
+                     "channel, computing both outputs in a single pass"),
+    NULL);
+}
+
+#endif
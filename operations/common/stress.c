@@ -67,119 +67,81 @@ property_double (rgamma, _("Radial gamma"), 0.0, 8.0, 2.0,
 #include <stdlib.h>
 #include "envelopes.h"
 
-static void stress (GeglBuffer          *src,
-                    const GeglRectangle *src_rect,
-                    GeglBuffer          *dst,
-                    const GeglRectangle *dst_rect,
-                    gint                 radius,
-                    gint                 samples,
-                    gint                 iterations,
-                    gdouble              rgamma,
-                    gboolean             enhance_shadows,
-                    gint                 level,
-                    const Babl          *space)
+typedef struct
 {
-  const Babl *format = babl_format_with_space ("RGBA float", space);
+  Envelopes  *envelopes;
+  GeglBuffer *dst;
+  const Babl *format;
+  gboolean    enhance_shadows;
+} ThreadData;
+
+static void stress (const GeglRectangle *dst_rect,
+                    ThreadData          *data)
+{
+  EnvelopesWorker     worker;
+  GeglBufferIterator *i = gegl_buffer_iterator_new (data->dst, dst_rect, 0,
+                                                    data->format,
+                                                    GEGL_ACCESS_WRITE,
+                                                    GEGL_ABYSS_NONE, 1);
 
-  if (dst_rect->width > 0 && dst_rect->height > 0)
-  {
-    GeglBufferIterator *i = gegl_buffer_iterator_new (dst, dst_rect, 0, babl_format_with_space ("RaGaBaA float", space),
-                                                      GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 1);
-    GeglSampler *sampler = gegl_buffer_sampler_new_at_level (src, format, GEGL_SAMPLER_NEAREST, level);
-    GeglSamplerGetFun getfun = gegl_sampler_get_fun (sampler);
+  envelopes_worker_init (&worker, data->envelopes);
 
-    while (gegl_buffer_iterator_next (i))
+  while (gegl_buffer_iterator_next (i))
     {
       gint x,y;
       gint    dst_offset=0;
       gfloat *dst_buf = i->items[0].data;
       GeglRectangle *roi = &i->items[0].roi;
 
-      if (enhance_shadows)
-      {
-        for (y=roi->y; y < roi->y + roi->height; y++)
-          for (x=roi->x; x < roi->x + roi->width; x++)
-            {
-              gfloat  min[4];
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 min, max, pixel, format);
+      for (y=roi->y; y < roi->y + roi->height; y++)
+        for (x=roi->x; x < roi->x + roi->width; x++)
+          {
+            gfloat  min[4];
+            gfloat  max[4];
+            gfloat  pixel[4];
+            gint    c;
+
+            if (data->enhance_shadows)
               {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-              gint c;
-              for (c=0;c<3;c++)
-                {
-                  gfloat delta = max[c]-min[c];
-                  if (delta != 0)
-                    {
-                      dst_buf[dst_offset+c] = (pixel[c]-min[c])/delta;
-                    }
-                  else
-                    {
-                      dst_buf[dst_offset+c] = 0.5;
-                    }
-                }
-
-                dst_buf[dst_offset+3] = pixel[3];
-                dst_offset+=4;
+                compute_envelopes (&worker, x, y, min, max, pixel);
+
+                for (c=0;c<3;c++)
+                  {
+                    gfloat delta = max[c]-min[c];
+                    if (delta != 0)
+                      {
+                        dst_buf[dst_offset+c] = (pixel[c]-min[c])/delta;
+                      }
+                    else
+                      {
+                        dst_buf[dst_offset+c] = 0.5;
+                      }
+                  }
               }
-            }
-      }
-      else
-      {
-        for (y=roi->y; y < roi->y + roi->height; y++)
-          for (x=roi->x; x < roi->x + roi->width; x++)
-            {
-              gfloat  max[4];
-              gfloat  pixel[4];
-
-              compute_envelopes (src, sampler, getfun,
-                                 x, y,
-                                 radius, samples,
-                                 iterations,
-                                 FALSE, /* same spray */
-                                 rgamma,
-                                 NULL, max, pixel, format);
+            else
               {
-                /* this should be replaced with a better/faster projection of
-                 * pixel onto the vector spanned by min -> max, currently
-                 * computed by comparing the distance to min with the sum
-                 * of the distance to min/max.
-                 */
-
-              gint c;
-              for (c=0;c<3;c++)
-                {
-                  gfloat delta = max[c];
-                  if (delta != 0)
-                    {
-                      dst_buf[dst_offset+c] = (pixel[c])/delta;
-                    }
-                  else
-                    {
-                      dst_buf[dst_offset+c] = 0.5;
-                    }
-                }
-                dst_buf[dst_offset+3] = pixel[3];
-                dst_offset+=4;
+                compute_envelopes (&worker, x, y, NULL, max, pixel);
+
+                for (c=0;c<3;c++)
+                  {
+                    gfloat delta = max[c];
+                    if (delta != 0)
+                      {
+                        dst_buf[dst_offset+c] = (pixel[c])/delta;
+                      }
+                    else
+                      {
+                        dst_buf[dst_offset+c] = 0.5;
+                      }
+                  }
               }
-            }
-      }
+
+            dst_buf[dst_offset+3] = pixel[3];
+            dst_offset+=4;
+          }
     }
-    g_object_unref (sampler);
-  }
+
+  envelopes_worker_clear (&worker);
 }
 
 static void prepare (GeglOperation *operation)
@@ -214,16 +176,27 @@ process (GeglOperation       *operation,
   GeglProperties *o = GEGL_PROPERTIES (operation);
   const Babl *space = babl_format_get_space (gegl_operation_get_format (operation, "output"));
   GeglRectangle compute;
+  ThreadData data;
   compute = gegl_operation_get_required_for_output (operation, "input",result);
 
-  stress (input, &compute, output, result,
-          o->radius,
-          o->samples,
-          o->iterations,
-          RGAMMA /*o->rgamma,*/,
-          o->enhance_shadows,
-          level,
-          space);
+  data.envelopes       = envelopes_new (input, &compute, level,
+                                        o->radius, o->samples, o->iterations,
+                                        RGAMMA /*o->rgamma,*/,
+                                        babl_format_with_space ("RGBA float",
+                                                                space));
+  data.dst             = output;
+  data.format          = babl_format_with_space ("RaGaBaA float", space);
+  data.enhance_shadows = o->enhance_shadows;
+
+  gegl_parallel_distribute_area (
+    result,
+    gegl_operation_get_pixels_per_thread (operation) /
+    (o->samples * o->iterations),
+    GEGL_SPLIT_STRATEGY_AUTO,
+    (GeglParallelDistributeAreaFunc) stress,
+    &data);
+
+  envelopes_free (data.envelopes);
 
   return  TRUE;
 }
@@ -255,6 +228,8 @@ gegl_op_class_init (GeglOpClass *klass)
 
   filter_class->process = process;
   operation_class->prepare  = prepare;
+  /* the envelopes share the source among threads */
+  operation_class->threaded = FALSE;
   /* we override get_bounding_box to avoid growing the size of what is defined
    * by the filter. This also allows the tricks used to treat alpha==0 pixels
    * in the image as source data not to be skipped by the stochastic sampling
@@ -36,21 +36,31 @@ property_boolean (perceptual, _("Non-linear components"), FALSE)
 
 #include "gegl-op.h"
 
+typedef struct
+{
+  gfloat min[3];
+  gfloat max[3];
+} MinMax;
+
+typedef struct
+{
+  GeglBuffer *input;
+  GeglBuffer *output;
+  const Babl *format;
+  gfloat      min[3];
+  gfloat      diff[3];
+} ThreadData;
+
 static void
-buffer_get_min_max (GeglBuffer *buffer,
-                    const Babl *format,
-                    gfloat     *min,
-                    gfloat     *max)
+min_max_area (const GeglRectangle *area,
+              MinMax              *partial,
+              ThreadData          *data)
 {
   GeglBufferIterator *gi;
   gint c;
-  gi = gegl_buffer_iterator_new (buffer, NULL, 0, format,
+
+  gi = gegl_buffer_iterator_new (data->input, area, 0, data->format,
                                  GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
-  for (c = 0; c < 3; c++)
-    {
-      min[c] =  G_MAXFLOAT;
-      max[c] = -G_MAXFLOAT;
-    }
 
   while (gegl_buffer_iterator_next (gi))
     {
@@ -61,13 +71,93 @@ buffer_get_min_max (GeglBuffer *buffer,
         {
           for (c = 0; c < 3; c++)
             {
-              min[c] = MIN (buf [i * 4 + c], min[c]);
-              max[c] = MAX (buf [i * 4 + c], max[c]);
+              partial->min[c] = MIN (buf [i * 4 + c], partial->min[c]);
+              partial->max[c] = MAX (buf [i * 4 + c], partial->max[c]);
             }
         }
     }
 }
 
+static void
+min_max_merge (MinMax       *result,
+               const MinMax *partial,
+               ThreadData   *data)
+{
+  gint c;
+
+  for (c = 0; c < 3; c++)
+    {
+      result->min[c] = MIN (partial->min[c], result->min[c]);
+      result->max[c] = MAX (partial->max[c], result->max[c]);
+    }
+}
+
+static void
+buffer_get_min_max (GeglOperation *operation,
+                    GeglBuffer    *buffer,
+                    const Babl    *format,
+                    gfloat        *min,
+                    gfloat        *max)
+{
+  ThreadData data;
+  MinMax     min_max;
+  gint       c;
+
+  for (c = 0; c < 3; c++)
+    {
+      min_max.min[c] =  G_MAXFLOAT;
+      min_max.max[c] = -G_MAXFLOAT;
+    }
+
+  data.input  = buffer;
+  data.format = format;
+
+  gegl_parallel_reduce_area (gegl_buffer_get_extent (buffer), buffer,
+                             gegl_operation_get_pixels_per_thread (operation),
+                             sizeof (MinMax),
+                             (GeglParallelReduceAreaFunc) min_max_area,
+                             (GeglParallelMergeFunc) min_max_merge,
+                             &min_max, &data);
+
+  for (c = 0; c < 3; c++)
+    {
+      min[c] = min_max.min[c];
+      max[c] = min_max.max[c];
+    }
+}
+
+static void
+stretch_area (const GeglRectangle *area,
+              ThreadData          *data)
+{
+  GeglBufferIterator *gi;
+  gint                c;
+
+  gi = gegl_buffer_iterator_new (data->input, area, 0, data->format,
+                                 GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
+
+  gegl_buffer_iterator_add (gi, data->output, area, 0, data->format,
+                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (gi))
+    {
+      gfloat *in  = gi->items[0].data;
+      gfloat *out = gi->items[1].data;
+
+      gint o;
+      for (o = 0; o < gi->length; o++)
+        {
+          for (c = 0; c < 3; c++)
+            out[c] = (in[c] - data->min[c]) / data->diff[c];
+
+          out[3] = in[3];
+
+          in  += 4;
+          out += 4;
+        }
+    }
+}
+
 static void
 reduce_min_max_global (gfloat *min,
                        gfloat *max)
@@ -469,10 +559,10 @@ process (GeglOperation       *operation,
          gint                 level)
 {
   const Babl *out_format = gegl_operation_get_format (operation, "output");
-  gfloat  min[3], max[3], diff[3];
-  GeglBufferIterator *gi;
-  GeglProperties         *o;
-  gint                c;
+  gfloat      min[3], max[3];
+  ThreadData  data;
+  GeglProperties *o;
+  gint        c;
 
   if (gegl_cl_is_accelerated ())
     if (cl_process (operation, input, output, result))
@@ -480,46 +570,34 @@ process (GeglOperation       *operation,
 
   o = GEGL_PROPERTIES (operation);
 
-  buffer_get_min_max (input, out_format, min, max);
+  buffer_get_min_max (operation, input, out_format, min, max);
 
   if (o->keep_colors)
     reduce_min_max_global (min, max);
 
   for (c = 0; c < 3; c++)
     {
-      diff[c] = max[c] - min[c];
+      data.min[c]  = min[c];
+      data.diff[c] = max[c] - min[c];
 
       /* Avoid a divide by zero error if the image is a solid color */
-      if (diff[c] < 1e-3)
+      if (data.diff[c] < 1e-3)
         {
-          min[c]  = 0.0;
-          diff[c] = 1.0;
+          data.min[c]  = 0.0;
+          data.diff[c] = 1.0;
         }
     }
 
-  gi = gegl_buffer_iterator_new (input, result, 0, out_format,
-                                 GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
-
-  gegl_buffer_iterator_add (gi, output, result, 0, out_format,
-                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (gi))
-    {
-      gfloat *in  = gi->items[0].data;
-      gfloat *out = gi->items[1].data;
-
-      gint o;
-      for (o = 0; o < gi->length; o++)
-        {
-          for (c = 0; c < 3; c++)
-            out[c] = (in[c] - min[c]) / diff[c];
-
-          out[3] = in[3];
+  data.input  = input;
+  data.output = output;
+  data.format = out_format;
 
-          in  += 4;
-          out += 4;
-        }
-    }
+  gegl_parallel_distribute_area (
+    result,
+    gegl_operation_get_pixels_per_thread (operation),
+    GEGL_SPLIT_STRATEGY_AUTO,
+    (GeglParallelDistributeAreaFunc) stretch_area,
+    &data);
 
   return TRUE;
 }
@@ -0,0 +1,172 @@
+/* This file is an image processing operation for GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#ifdef GEGL_PROPERTIES
+
+property_int (frames, _("Previous frames"), 3)
+    description (_("Number of previous frames averaged with the current one"))
+    value_range (0, 16)
+
+property_int (lookahead, _("Following frames"), 0)
+    description (_("Number of following frames averaged with the current "
+                   "one, the output lags that many frames behind the input"))
+    value_range (0, 8)
+
+property_double (noise, _("Noise level"), 0.05)
+    description (_("Expected standard deviation of the noise, larger "
+                   "differences between frames are treated as motion and "
+                   "are not averaged"))
+    value_range (0.001, 1.0)
+    ui_range    (0.001, 0.3)
+
+#else
+
+#define GEGL_OP_TEMPORAL
+#define GEGL_OP_NAME     temporal_denoise
+#define GEGL_OP_C_SOURCE temporal-denoise.c
+
+#include "gegl-op.h"
+
+#define MAX_FRAMES (16 + 1 + 8)
+
+static void
+prepare (GeglOperation *operation)
+{
+  GeglProperties *o      = GEGL_PROPERTIES (operation);
+  const Babl     *space  = gegl_operation_get_source_space (operation, "input");
+  const Babl     *format = babl_format_with_space ("RGBA float", space);
+
+  gegl_operation_temporal_set_history_length (operation, o->frames + 1);
+  gegl_operation_temporal_set_lookahead (operation, o->lookahead);
+
+  gegl_operation_set_format (operation, "input",  format);
+  gegl_operation_set_format (operation, "output", format);
+}
+
+/* every pixel is a weighted average of the pixels at the same position in the
+ * neighbouring frames, the weight falling off with the difference to the
+ * current frame, so that static areas are averaged and moving areas are kept
+ */
+static gboolean
+process (GeglOperation       *operation,
+         GeglBuffer          *input,
+         GeglBuffer          *output,
+         const GeglRectangle *result,
+         gint                 level)
+{
+  GeglProperties *o        = GEGL_PROPERTIES (operation);
+  const Babl     *format   = gegl_operation_get_format (operation, "output");
+  gint            n_pixels = result->width * result->height;
+  gfloat         *frames[MAX_FRAMES];
+  GeglBuffer     *previous = NULL;
+  gfloat         *current  = NULL;
+  gfloat         *out;
+  gfloat          scale;
+  gint            n_frames = 0;
+  gint            f, i, c;
+
+  for (f = -o->frames; f <= o->lookahead; f++)
+    {
+      GeglBuffer *frame = gegl_operation_temporal_get_frame (operation, f);
+
+      if (! frame)
+        frame = g_object_ref (input);
+
+      /* frames before the first one or after the newest one are the
+       * same buffer, only use them once
+       */
+      if (frame != previous)
+        {
+          frames[n_frames] = gegl_malloc (4 * n_pixels * sizeof (gfloat));
+
+          gegl_buffer_get (frame, result, 1.0, format, frames[n_frames],
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+          n_frames++;
+        }
+
+      if (f == 0)
+        current = frames[n_frames - 1];
+
+      previous = frame;
+      g_object_unref (frame);
+    }
+
+  out   = gegl_malloc (4 * n_pixels * sizeof (gfloat));
+  scale = -1.0 / (2.0 * 3.0 * o->noise * o->noise);
+
+  for (i = 0; i < n_pixels; i++)
+    {
+      const gfloat *pixel = current + 4 * i;
+      gfloat        sum[4] = { 0.0f, };
+      gfloat        total  = 0.0f;
+
+      for (f = 0; f < n_frames; f++)
+        {
+          const gfloat *other = frames[f] + 4 * i;
+          gfloat        diff  = 0.0f;
+          gfloat        weight;
+
+          for (c = 0; c < 3; c++)
+            diff += (other[c] - pixel[c]) * (other[c] - pixel[c]);
+
+          weight = expf (diff * scale);
+
+          for (c = 0; c < 4; c++)
+            sum[c] += other[c] * weight;
+          total += weight;
+        }
+
+      for (c = 0; c < 4; c++)
+        out[4 * i + c] = sum[c] / total;
+    }
+
+  gegl_buffer_set (output, result, 0, format, out, GEGL_AUTO_ROWSTRIDE);
+
+  for (f = 0; f < n_frames; f++)
+    gegl_free (frames[f]);
+  gegl_free (out);
+
+  return TRUE;
+}
+
+static void
+gegl_op_class_init (GeglOpClass *klass)
+{
+  GeglOperationClass         *operation_class;
+  GeglOperationTemporalClass *temporal_class;
+
+  operation_class = GEGL_OPERATION_CLASS (klass);
+  temporal_class  = GEGL_OPERATION_TEMPORAL_CLASS (klass);
+
+  operation_class->prepare = prepare;
+  temporal_class->process  = process;
+
+  gegl_operation_class_set_keys (operation_class,
+    "name",        "gegl:temporal-denoise",
+    "title",       _("Temporal Denoise"),
+    "categories",  "enhance:noise-reduction:video",
+    "reference-hash", "unstable",
+    "description", _("Reduce noise in video by averaging every pixel with "
+                     "the same pixel in neighbouring frames, where it "
+                     "doesn't move"),
+    NULL);
+}
+
+#endif
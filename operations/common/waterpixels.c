@@ -170,15 +170,24 @@ generate_gradient (GeglBuffer *input,
   return gradient;
 }
 
+typedef struct
+{
+  GeglBuffer *gradient;
+  GeglBuffer *labels;
+  gint32      regularization;
+  CellsGrid  *grid;
+} ThreadData;
+
 static void
-regularize_gradient  (GeglBuffer *gradient,
-                      gint32      regularization,
-                      CellsGrid  *grid)
+regularize_gradient (const GeglRectangle *area,
+                     ThreadData          *data)
 {
   GeglBufferIterator *iter;
+  CellsGrid          *grid = data->grid;
   gint x, y;
 
-  iter = gegl_buffer_iterator_new (gradient, NULL, 0, babl_format ("Y float"),
+  iter = gegl_buffer_iterator_new (data->gradient, area, 0,
+                                   babl_format ("Y float"),
                                    GEGL_ACCESS_READWRITE, GEGL_ABYSS_NONE, 1);
 
   while (gegl_buffer_iterator_next (iter))
@@ -199,26 +208,27 @@ regularize_gradient  (GeglBuffer *gradient,
                                      + POW2(y - cell->center_y))
                                 / (gdouble) grid->cell_size;
 
-           *pixel = *pixel + regularization * 2.0 * distance / (gdouble) grid->cell_size;
+           *pixel = *pixel + data->regularization * 2.0 * distance / (gdouble) grid->cell_size;
 
             pixel++;
           }
     }
 }
 
-static GeglBuffer *
-generate_labels (GeglBuffer *gradient,
-                 CellsGrid  *grid)
+/* mark the pixel of minimal gradient in the area of each cell */
+static void
+find_cells_minimum (gsize       offset,
+                    gsize       size,
+                    ThreadData *data)
 {
-  GeglBuffer  *labels;
+  CellsGrid   *grid = data->grid;
   gfloat      *buff;
   guint32      i;
   guint32      label[2];
 
-  labels = gegl_buffer_new (gegl_buffer_get_extent (gradient),
-                            babl_format ("YA u32"));
+  buff = g_new (gfloat, grid->cell_size * grid->cell_size);
 
-  for (i = 0; i < grid->n_cells; i++)
+  for (i = offset; i < offset + size; i++)
     {
       Cell *cell   = grid->cells + i;
       GeglRectangle min_pixel = {0, 0, 1, 1};
@@ -228,9 +238,8 @@ generate_labels (GeglBuffer *gradient,
       gint y = cell->area.y;
       gint n_pixels = cell->area.width * cell->area.height;
 
-      buff = g_new (gfloat, n_pixels);
-
-      gegl_buffer_get (gradient, &cell->area, 1.0, babl_format ("Y float"),
+      gegl_buffer_get (data->gradient, &cell->area, 1.0,
+                       babl_format ("Y float"),
                        buff, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
       pixel = buff;
@@ -256,13 +265,33 @@ generate_labels (GeglBuffer *gradient,
 
       label[0] = i;
       label[1] = 1;
-      gegl_buffer_set (labels, &min_pixel, 0, babl_format ("YA u32"),
+      gegl_buffer_set (data->labels, &min_pixel, 0, babl_format ("YA u32"),
                        label, GEGL_AUTO_ROWSTRIDE);
-
-      g_free (buff);
     }
 
-  return labels;
+  g_free (buff);
+}
+
+static GeglBuffer *
+generate_labels (GeglOperation *operation,
+                 GeglBuffer    *gradient,
+                 CellsGrid     *grid)
+{
+  ThreadData data;
+
+  data.gradient = gradient;
+  data.grid     = grid;
+  data.labels   = gegl_buffer_new (gegl_buffer_get_extent (gradient),
+                                   babl_format ("YA u32"));
+
+  gegl_parallel_distribute_range (
+    grid->n_cells,
+    gegl_operation_get_pixels_per_thread (operation) /
+      POW2 (grid->cell_size),
+    (GeglParallelDistributeRangeFunc) find_cells_minimum,
+    &data);
+
+  return data.labels;
 }
 
 
@@ -383,19 +412,25 @@ get_average_colors (GeglBuffer *input,
     }
 }
 
+typedef struct
+{
+  GeglBuffer *output;
+  GeglBuffer *labels;
+  CellsGrid  *grid;
+  const Babl *format;
+} FillData;
+
 static void
-fill_output (GeglBuffer *output,
-             GeglBuffer *labels,
-             CellsGrid  *grid,
-             const Babl *space)
+fill_output (const GeglRectangle *area,
+             FillData            *data)
 {
   GeglBufferIterator *iter;
 
-  iter = gegl_buffer_iterator_new (labels, NULL, 0, babl_format ("YA u32"),
+  iter = gegl_buffer_iterator_new (data->labels, area, 0,
+                                   babl_format ("YA u32"),
                                    GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 2);
 
-  gegl_buffer_iterator_add (iter, output, NULL, 0,
-                            babl_format_with_space ("R'G'B' float", space),
+  gegl_buffer_iterator_add (iter, data->output, area, 0, data->format,
                             GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -406,7 +441,7 @@ fill_output (GeglBuffer *output,
 
       while (n_pixels--)
         {
-          Cell *cell = grid->cells + label[0];
+          Cell *cell = data->grid->cells + label[0];
 
           pixel[0] = cell->color[0];
           pixel[1] = cell->color[1];
@@ -468,14 +503,28 @@ process (GeglOperation       *operation,
   GeglBuffer *initial_labels;
   GeglBuffer *propagated_labels;
   CellsGrid   grid;
+  FillData    fill_data;
 
   initiliaze_cellsgrid (&grid, gegl_buffer_get_extent (input), o->size);
 
   gradient       = generate_gradient (input, o->smoothness);
-  initial_labels = generate_labels (gradient, &grid);
+  initial_labels = generate_labels (operation, gradient, &grid);
 
   if (o->regularization)
-    regularize_gradient (gradient, o->regularization, &grid);
+    {
+      ThreadData data;
+
+      data.gradient       = gradient;
+      data.regularization = o->regularization;
+      data.grid           = &grid;
+
+      gegl_parallel_distribute_area (
+        gegl_buffer_get_extent (gradient),
+        gegl_operation_get_pixels_per_thread (operation),
+        GEGL_SPLIT_STRATEGY_AUTO,
+        (GeglParallelDistributeAreaFunc) regularize_gradient,
+        &data);
+    }
 
   propagated_labels = propagate_labels (initial_labels, gradient);
 
@@ -484,7 +533,17 @@ process (GeglOperation       *operation,
   else
     get_average_colors (input, propagated_labels, &grid, space);
 
-  fill_output (output, propagated_labels, &grid, space);
+  fill_data.output = output;
+  fill_data.labels = propagated_labels;
+  fill_data.grid   = &grid;
+  fill_data.format = babl_format_with_space ("R'G'B' float", space);
+
+  gegl_parallel_distribute_area (
+    gegl_buffer_get_extent (propagated_labels),
+    gegl_operation_get_pixels_per_thread (operation),
+    GEGL_SPLIT_STRATEGY_AUTO,
+    (GeglParallelDistributeAreaFunc) fill_output,
+    &fill_data);
 
   g_object_unref (gradient);
   g_object_unref (initial_labels);
@@ -38,95 +38,89 @@ property_format (flag, _("flag"), NULL)
 
 #include "gegl-op.h"
 
-typedef struct _PixelCoords
-{
-  gint x;
-  gint y;
-} PixelCoords;
+static const gint neighbors_coords[8][2] = {{-1, -1},{0, -1},{1, -1},
+                                            {-1, 0},         {1, 0},
+                                            {-1, 1}, {0, 1}, {1, 1}};
+
+/* The hierarchical queues hold pixel indices, and are linked lists threaded
+ * through an array of the size of the image, every pixel being queued at most
+ * once.  Each level is a FIFO queue.
+ */
+
+#define HQ_END G_MAXUINT32
 
 typedef struct _HQ
 {
-  GQueue  *queues[256];
-  GQueue  *lowest_non_empty;
+  guint32 *next;
+  guint32  head[256];
+  guint32  tail[256];
   gint     lowest_non_empty_level;
 } HQ;
 
 static void
-HQ_init (HQ *hq)
+HQ_init (HQ    *hq,
+         gsize  n_pixels)
 {
   gint i;
 
+  hq->next = g_new (guint32, n_pixels);
+
   for (i = 0; i < 256; i++)
-    hq->queues[i] = g_queue_new ();
+    hq->head[i] = hq->tail[i] = HQ_END;
 
-  hq->lowest_non_empty       = NULL;
-  hq->lowest_non_empty_level = 255;
+  hq->lowest_non_empty_level = 256;
 }
 
-static gboolean
+static inline gboolean
 HQ_is_empty (HQ *hq)
 {
-  if (hq->lowest_non_empty == NULL)
-    return TRUE;
-
-  return FALSE;
+  return hq->lowest_non_empty_level > 255;
 }
 
 static inline void
 HQ_push (HQ      *hq,
          guint8   level,
-         gpointer data)
+         guint32  index)
 {
-  g_queue_push_head (hq->queues[level], data);
+  hq->next[index] = HQ_END;
 
-  if (level <= hq->lowest_non_empty_level)
-    {
-      hq->lowest_non_empty_level = level;
-      hq->lowest_non_empty       = hq->queues[level];
-    }
+  if (hq->head[level] == HQ_END)
+    hq->head[level] = index;
+  else
+    hq->next[hq->tail[level]] = index;
+
+  hq->tail[level] = index;
+
+  if (level < hq->lowest_non_empty_level)
+    hq->lowest_non_empty_level = level;
 }
 
-static inline gpointer
+static inline guint32
 HQ_pop (HQ *hq)
 {
-  gint i, level;
-  gpointer data = NULL;
+  gint    level = hq->lowest_non_empty_level;
+  guint32 index = hq->head[level];
+
+  hq->head[level] = hq->next[index];
 
-  if (hq->lowest_non_empty != NULL)
+  if (hq->head[level] == HQ_END)
     {
-      data = g_queue_pop_tail (hq->lowest_non_empty);
+      hq->tail[level] = HQ_END;
 
-      if (g_queue_is_empty (hq->lowest_non_empty))
-        {
-          level = hq->lowest_non_empty_level;
-          hq->lowest_non_empty_level = 255;
-          hq->lowest_non_empty       = NULL;
-
-          for (i = level + 1; i < 256; i++)
-            if (!g_queue_is_empty (hq->queues[i]))
-              {
-                hq->lowest_non_empty_level = i;
-                hq->lowest_non_empty       = hq->queues[i];
-                break;
-              }
-        }
+      for (level++; level < 256; level++)
+        if (hq->head[level] != HQ_END)
+          break;
+
+      hq->lowest_non_empty_level = level;
     }
 
-  return data;
+  return index;
 }
 
 static void
 HQ_clean (HQ *hq)
 {
-  gint i;
-
-  for (i = 0; i < 256; i++)
-    {
-      if (!g_queue_is_empty (hq->queues[i]))
-        g_printerr ("queue %u is not empty!\n", i);
-      else
-        g_queue_free (hq->queues[i]);
-    }
+  g_free (hq->next);
 }
 
 static void
@@ -209,6 +203,72 @@ get_cached_region (GeglOperation       *operation,
   return get_bounding_box (operation);
 }
 
+typedef struct
+{
+  guint8              *labels;
+  guint8              *seeds;
+  const GeglRectangle *extent;
+  gint                 bpp;
+  gint                 bpc;
+  const guint8        *flag;
+  gint                 flag_idx;
+} SeedData;
+
+static inline gboolean
+is_flagged (const guint8 *label,
+            gint          bpc,
+            const guint8 *flag,
+            gint          flag_idx)
+{
+  gint i;
+
+  for (i = 0; i < bpc; i++)
+    if (label[flag_idx * bpc + i] != (flag ? flag[i] : 0))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* mark the labelled pixels having at least one unlabelled neighbour */
+static void
+find_seeds (gsize     offset,
+            gsize     size,
+            SeedData *data)
+{
+  const GeglRectangle *extent = data->extent;
+  gint                 width  = extent->width;
+  gint                 height = extent->height;
+  gint                 x, y, j;
+
+  for (y = offset; y < (gint) (offset + size); y++)
+    for (x = 0; x < width; x++)
+      {
+        gsize    index   = (gsize) y * width + x;
+        gboolean flagged = FALSE;
+
+        data->seeds[index] = FALSE;
+
+        if (is_flagged (data->labels + index * data->bpp,
+                        data->bpc, data->flag, data->flag_idx))
+          continue;
+
+        for (j = 0; j < 8 && ! flagged; j++)
+          {
+            gint nx = x + neighbors_coords[j][0];
+            gint ny = y + neighbors_coords[j][1];
+
+            if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+              continue;
+
+            flagged = is_flagged (data->labels +
+                                  ((gsize) ny * width + nx) * data->bpp,
+                                  data->bpc, data->flag, data->flag_idx);
+          }
+
+        data->seeds[index] = flagged;
+      }
+}
+
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *input,
@@ -219,214 +279,119 @@ process (GeglOperation       *operation,
          guint8              *flag,
          gint                 flag_idx)
 {
-  HQ      hq;
-  guint8  square3x3[72];
-  gint    i;
-  gint    j;
-  gint    x, y;
+  HQ                   hq;
+  SeedData             data;
   GeglBufferIterator  *iter;
-  GeglSampler         *gradient_sampler = NULL;
   const GeglRectangle *extent = gegl_buffer_get_extent (input);
+  gsize                n_pixels = (gsize) extent->width * extent->height;
 
   const Babl  *gradient_format = babl_format ("Y u8");
   const Babl  *labels_format   = gegl_buffer_get_format (input);
   gint         bpp             = babl_format_get_bytes_per_pixel (labels_format);
   gint         bpc             = bpp / babl_format_get_n_components (labels_format);
-  guint8      *label           = NULL;
+  guint8      *labels;
+  guint8      *seeds;
+  guint8      *priorities      = NULL;
+  gint         width           = extent->width;
+  gint         x, y, j;
 
-  gint neighbors_coords[8][2] = {{-1, -1},{0, -1},{1, -1},
-                                 {-1, 0},         {1, 0},
-                                 {-1, 1}, {0, 1}, {1, 1}};
+  if (n_pixels >= HQ_END)
+    {
+      g_warning ("watershed-transform: the input is too large");
+      return FALSE;
+    }
 
-  /* initialize hierarchical queues */
+  /* the whole image is processed in memory */
 
-  HQ_init (&hq);
+  labels = gegl_malloc (n_pixels * bpp);
+  seeds  = g_new (guint8, n_pixels);
+
+  gegl_buffer_get (input, extent, 1.0, labels_format, labels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  iter = gegl_buffer_iterator_new (input, extent, 0, labels_format,
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE,
-                                   aux ? 11 : 10);
-
-  gegl_buffer_iterator_add (iter, output, extent, 0, labels_format,
-                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
-
-  /* Add 8 neighbours. */
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x - 1, extent->y - 1, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x, extent->y - 1, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x + 1, extent->y - 1, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x - 1, extent->y, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x + 1, extent->y, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x -1, extent->y + 1, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x, extent->y + 1, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-  gegl_buffer_iterator_add (iter, input,
-                            GEGL_RECTANGLE (extent->x + 1, extent->y + 1, extent->width, extent->height),
-                            0, labels_format, GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
   /* Priority map: lower is higher priority. */
   if (aux)
-    gegl_buffer_iterator_add (iter, aux, extent, 0, gradient_format,
-                              GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+    {
+      priorities = g_new (guint8, n_pixels);
+
+      gegl_buffer_get (aux, extent, 1.0, gradient_format, priorities,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+    }
+
+  data.labels   = labels;
+  data.seeds    = seeds;
+  data.extent   = extent;
+  data.bpp      = bpp;
+  data.bpc      = bpc;
+  data.flag     = flag;
+  data.flag_idx = flag_idx;
+
+  gegl_parallel_distribute_range (
+    extent->height,
+    gegl_operation_get_pixels_per_thread (operation) / width,
+    (GeglParallelDistributeRangeFunc) find_seeds,
+    &data);
+
+  /* initialize hierarchical queues, with the seeds queued in the order of the
+   * tiles of the input, then of the rows of each tile
+   */
+
+  HQ_init (&hq, n_pixels);
+
+  iter = gegl_buffer_iterator_new (input, extent, 0, labels_format,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
 
   while (gegl_buffer_iterator_next (iter))
     {
-      GeglRectangle *roi      = &iter->items[0].roi;
-      guint8        *label    = iter->items[0].data;
-      guint8        *outlabel = iter->items[1].data;
-      guint8        *n[8]     =
-        {
-          iter->items[2].data,
-          iter->items[3].data,
-          iter->items[4].data,
-          iter->items[5].data,
-          iter->items[6].data,
-          iter->items[7].data,
-          iter->items[8].data,
-          iter->items[9].data
-        };
-      guint8        *prio    = aux ? iter->items[10].data : NULL;
-
-      for (y = roi->y; y < roi->y + roi->height; y++)
-        for (x = roi->x; x < roi->x + roi->width; x++)
+      GeglRectangle *roi = &iter->items[0].roi;
+
+      for (y = roi->y - extent->y; y < roi->y - extent->y + roi->height; y++)
+        for (x = roi->x - extent->x; x < roi->x - extent->x + roi->width; x++)
           {
-            gboolean flagged = TRUE;
-
-            for (i = 0; i < bpc; i++)
-              if (label[flag_idx * bpc + i] != (flag ? flag[i] : 0))
-                {
-                  flagged = FALSE;
-                  break;
-                }
-            if (! flagged)
-              {
-                for (j = 0; j < 8; j++)
-                  {
-                    if (x == extent->x && (j == 0 || j == 3 || j == 5))
-                      continue;
-                    if (y == extent->y && (j == 0 || j == 1 || j == 2))
-                      continue;
-                    if (x == extent->x + extent->width - 1 && (j == 2 || j == 4 || j == 7))
-                      continue;
-                    if (y == extent->y + extent->height - 1 && (j == 5 || j == 6 || j == 7))
-                      continue;
-
-                    flagged = TRUE;
-                    for (i = 0; i < bpc; i++)
-                      if (n[j][flag_idx * bpc + i] != (flag ? flag[i] : 0))
-                        {
-                          flagged = FALSE;
-                          break;
-                        }
-                    if (flagged)
-                      break;
-                  }
-                if (flagged)
-                  {
-                    /* This pixel is not flagged and has at least one flagged
-                     * neighbour.
-                     */
-                    PixelCoords *p = g_new (PixelCoords, 1);
-                    p->x = x;
-                    p->y = y;
-
-                    HQ_push (&hq, prio ? *prio : 0, p);
-                  }
-              }
-
-            for (i = 0; i < bpp; i++)
-              outlabel[i] = label[i];
-
-            if (prio)
-              prio++;
-            label    += bpp;
-            outlabel += bpp;
-            for (j = 0; j < 8; j++)
-              n[j] += bpp;
+            guint32 index = (guint32) y * width + x;
+
+            if (seeds[index])
+              HQ_push (&hq, priorities ? priorities[index] : 0, index);
           }
     }
 
-  if (aux)
-    gradient_sampler = gegl_buffer_sampler_new_at_level (aux,
-                                                         gradient_format,
-                                                         GEGL_SAMPLER_NEAREST,
-                                                         level);
-  label = g_newa (guint8, bpp);
+  g_free (seeds);
 
-  while (!HQ_is_empty (&hq))
+  while (! HQ_is_empty (&hq))
     {
-      PixelCoords *p = (PixelCoords *) HQ_pop (&hq);
+      guint32       index = HQ_pop (&hq);
+      const guint8 *label = labels + (gsize) index * bpp;
+      gint          px    = index % width;
+      gint          py    = index / width;
 
-      GeglRectangle square_rect = {p->x - 1, p->y - 1, 3, 3};
-
-      gegl_buffer_get (output, &square_rect, 1.0, labels_format,
-                       square3x3,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      for (i = 0; i < bpp; i++)
-        label[i] = square3x3[4 * bpp + i];
-
-      /* compute neighbors coordinate */
       for (j = 0; j < 8; j++)
         {
-          guint8   *neighbor_label;
-          gint      nx = p->x + neighbors_coords[j][0];
-          gint      ny = p->y + neighbors_coords[j][1];
-          gboolean  flagged = TRUE;
+          gint    nx = px + neighbors_coords[j][0];
+          gint    ny = py + neighbors_coords[j][1];
+          guint32 n;
 
-          if (nx < extent->x || nx >= extent->x + extent->width ||
-              ny < extent->y || ny >= extent->y + extent->height)
+          if (nx < 0 || nx >= width ||
+              ny < 0 || ny >= extent->height)
             continue;
 
-          neighbor_label = square3x3 + ((neighbors_coords[j][0] + 1) + (neighbors_coords[j][1] + 1) * 3) * bpp;
+          n = (guint32) ny * width + nx;
 
-          for (i = 0; i < bpc; i++)
-            if (neighbor_label[flag_idx * bpc + i] != (flag ? flag[i] : 0))
-              {
-                flagged = FALSE;
-                break;
-              }
-          if (flagged)
+          if (is_flagged (labels + (gsize) n * bpp, bpc, flag, flag_idx))
             {
-              guint8 gradient_value = 0;
-              GeglRectangle n_rect = {nx, ny, 1, 1};
-              PixelCoords *n = g_new (PixelCoords, 1);
-              n->x = nx;
-              n->y = ny;
-
-              if (gradient_sampler)
-                gegl_sampler_get (gradient_sampler,
-                                  (gdouble) nx,
-                                  (gdouble) ny,
-                                  NULL, &gradient_value, GEGL_ABYSS_NONE);
-
-              HQ_push (&hq, gradient_value, n);
-
-              for (i = 0; i < bpp; i++)
-                neighbor_label[i] = label[i];
-
-              gegl_buffer_set (output, &n_rect,
-                               0, labels_format,
-                               neighbor_label, GEGL_AUTO_ROWSTRIDE);
+              HQ_push (&hq, priorities ? priorities[n] : 0, n);
+
+              memcpy (labels + (gsize) n * bpp, label, bpp);
             }
         }
-
-      g_free (p);
     }
-  if (gradient_sampler)
-    g_object_unref (gradient_sampler);
+
+  gegl_buffer_set (output, extent, 0, labels_format, labels,
+                   GEGL_AUTO_ROWSTRIDE);
 
   HQ_clean (&hq);
+  gegl_free (labels);
+  g_free (priorities);
+
   return  TRUE;
 }
 
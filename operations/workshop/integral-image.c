@@ -33,63 +33,12 @@ property_boolean (squared, _("squared integral"), FALSE)
 
 #include "gegl-op.h"
 
-#define SQR(x) ((x) * (x))
-
-static inline void
-compute_row_integral (gdouble  *src_row,
-                      gdouble  *top_row,
-                      gdouble  *dst_row,
-                      gint      width,
-                      gint      n_components,
-                      gboolean  squared)
-{
-  gint b;
-
-  if (squared)
-    {
-      while (width--)
-        {
-          for (b = 0; b < n_components; b++)
-            {
-              dst_row[b] = src_row[b] +
-                           dst_row[b - n_components] +
-                           top_row[b] -
-                           top_row[b - n_components];
-
-              dst_row[b + n_components] =   SQR(src_row[b])
-                                          + dst_row[b - n_components * 2]
-                                          + top_row[b + n_components]
-                                          - top_row[b - n_components * 2];
-            }
-
-          src_row += n_components;
-          top_row += n_components * 2;
-          dst_row += n_components * 2;
-        }
-    }
-  else
-    {
-      while (width--)
-        {
-          for (b = 0; b < n_components; b++)
-            dst_row[b] =   src_row[b]
-                         + dst_row[b - n_components]
-                         + top_row[b]
-                         - top_row[b - n_components];
-
-          src_row += n_components;
-          top_row += n_components;
-          dst_row += n_components;
-        }
-    }
-}
-
 static void
 prepare (GeglOperation *operation)
 {
   GeglProperties *o = GEGL_PROPERTIES (operation);
   const Babl *src_format   = gegl_operation_get_source_format (operation, "input");
-  const Babl *input_format = babl_format ("RGB double");
+  const Babl *input_format = babl_format ("RGB float");
   gint        n_components = 3;
   const Babl *output_format;
 
@@ -100,13 +49,13 @@ prepare (GeglOperation *operation)
       if (model == babl_model ("RGB") || model == babl_model ("R'G'B'") ||
           model == babl_model ("RGBA") || model == babl_model ("R'G'B'A"))
         {
-          input_format = babl_format ("RGB double");
+          input_format = babl_format ("RGB float");
           n_components = 3;
         }
       else if (model == babl_model ("Y") || model == babl_model ("Y'") ||
                model == babl_model ("YA") || model == babl_model ("Y'A"))
         {
-          input_format = babl_format ("Y double");
+          input_format = babl_format ("Y float");
           n_components = 1;
         }
     }
@@ -127,60 +76,44 @@ process (GeglOperation       *operation,
          const GeglRectangle *result,
          gint                 level)
 {
-  GeglProperties *o        = GEGL_PROPERTIES (operation);
-  const Babl *src_format   = gegl_operation_get_source_format (operation, "input");
-  const Babl *dst_format   = gegl_operation_get_format (operation, "output");
-  gint        src_components = babl_format_get_n_components (src_format);
-  gint        dst_components = babl_format_get_n_components (dst_format);
-
-  gint     width, height;
-  gint     row_size;
-  gint     y;
-  gdouble *top_row  = NULL;
-  gdouble *dst_row  = NULL;
-  gdouble *src_row  = NULL;
-  gdouble *p_top    = NULL;
-  gdouble *p_dst    = NULL;
-
-  width = gegl_buffer_get_width (input);
-  height = gegl_buffer_get_height (input);
-  row_size = width + 1;
-
-  top_row = g_new0 (gdouble, row_size * dst_components);
-  dst_row = g_new0 (gdouble, row_size * dst_components);
-  src_row = g_new  (gdouble, row_size * src_components);
-
-  p_top = top_row;
-  p_dst = dst_row;
-
-  for (y = 0; y < height; y++)
+  GeglProperties      *o          = GEGL_PROPERTIES (operation);
+  const Babl          *src_format = gegl_operation_get_format (operation, "input");
+  const Babl          *dst_format = gegl_operation_get_format (operation, "output");
+  gint                 dst_components = babl_format_get_n_components (dst_format);
+  GeglSummedAreaTable *table;
+  GeglRectangle        area;
+  gdouble             *dst_row;
+  gint                 x, y;
+
+  area.x      = 0;
+  area.y      = 0;
+  area.width  = result->x + result->width;
+  area.height = result->y + result->height;
+
+  table   = gegl_summed_area_table_new (input, &area, src_format, o->squared);
+  dst_row = g_new (gdouble, result->width * dst_components);
+
+  for (y = result->y; y < result->y + result->height; y++)
     {
-      GeglRectangle row_rect = {-1, y, width + 1, 1};
+      GeglRectangle row_rect = {result->x, y, result->width, 1};
 
-      gegl_buffer_get (input, &row_rect, 1.0, src_format, src_row,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      /* the sums (and squared sums) of the pixels above and left of each
+       * pixel, inclusively
+       */
+      for (x = 0; x < result->width; x++)
+        {
+          GeglRectangle rect = {0, 0, result->x + x + 1, y + 1};
 
-      compute_row_integral (src_row + src_components,
-                            p_top + dst_components,
-                            p_dst + dst_components,
-                            width,
-                            src_components,
-                            o->squared);
+          gegl_summed_area_table_get_sum (table, &rect,
+                                          dst_row + x * dst_components);
+        }
 
-      gegl_buffer_set (output, &row_rect, 0, dst_format, p_dst,
+      gegl_buffer_set (output, &row_rect, 0, dst_format, dst_row,
                        GEGL_AUTO_ROWSTRIDE);
-
-      p_top = p_dst;
-
-      if (p_dst == top_row)
-        p_dst = dst_row;
-      else
-        p_dst = top_row;
     }
 
-  g_free (top_row);
   g_free (dst_row);
-  g_free (src_row);
+  gegl_summed_area_table_unref (table);
 
   return TRUE;
 }
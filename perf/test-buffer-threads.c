@@ -0,0 +1,139 @@
+#include "test-common.h"
+
+/* reads disjoint areas of a single buffer from a varying number of threads,
+ * to measure how tile fetching scales.
+ */
+
+#define WIDTH  4096
+#define HEIGHT 4096
+#define RUNS   20
+
+typedef void (*ReadFunc) (GeglBuffer          *buffer,
+                          const GeglRectangle *area);
+
+typedef struct
+{
+  GeglBuffer *buffer;
+  ReadFunc    read;
+} ReadData;
+
+static void
+read_iterator (GeglBuffer          *buffer,
+               const GeglRectangle *area)
+{
+  GeglBufferIterator *iter;
+  volatile gfloat     sum = 0.0f;
+
+  iter = gegl_buffer_iterator_new (buffer, area, 0,
+                                   gegl_buffer_get_format (buffer),
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data = iter->items[0].data;
+
+      sum += data[0];
+    }
+}
+
+static void
+read_get (GeglBuffer          *buffer,
+          const GeglRectangle *area)
+{
+  GeglRectangle  row = { area->x, area->y, area->width, 1 };
+  gfloat        *data;
+
+  data = g_new (gfloat, area->width * 4);
+
+  for (; row.y < area->y + area->height; row.y++)
+    {
+      gegl_buffer_get (buffer, &row, 1.0, gegl_buffer_get_format (buffer),
+                       data, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+    }
+
+  g_free (data);
+}
+
+static void
+read_area (const GeglRectangle *area,
+           ReadData            *data)
+{
+  data->read (data->buffer, area);
+}
+
+static gfloat
+bench_threads (const gchar *name,
+               GeglBuffer  *buffer,
+               ReadFunc     read,
+               gint         n_threads)
+{
+  ReadData  data = { buffer, read };
+  gchar    *id;
+  gint      i;
+
+  g_object_set (gegl_config (), "threads", n_threads, NULL);
+
+  id = g_strdup_printf ("%s (%d threads)", name, n_threads);
+
+  /* warm up */
+  read (buffer, gegl_buffer_get_extent (buffer));
+
+  test_start ();
+  for (i = 0; i < RUNS; i++)
+    {
+      test_start_iter ();
+      gegl_parallel_distribute_area (gegl_buffer_get_extent (buffer), 0.0,
+                                     GEGL_SPLIT_STRATEGY_AUTO,
+                                     (GeglParallelDistributeAreaFunc) read_area,
+                                     &data);
+      test_end_iter ();
+    }
+  test_end (id, (gdouble) WIDTH * HEIGHT * 16 * ITERATIONS);
+
+  g_free (id);
+
+  return compute_median ();
+}
+
+static void
+bench_scaling (const gchar *name,
+               GeglBuffer  *buffer,
+               ReadFunc     read)
+{
+  gint   max_threads = MIN (g_get_num_processors (), 64); /* GEGL_MAX_THREADS */
+  gfloat single      = 0.0f;
+  gint   n_threads;
+
+  for (n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+    {
+      gfloat median = bench_threads (name, buffer, read, n_threads);
+
+      if (n_threads == 1)
+        single = median;
+
+      g_print ("@ %s (%d threads) speedup: %.2f\n",
+               name, n_threads, single / median);
+
+      if (n_threads < max_threads && n_threads * 2 > max_threads)
+        n_threads = max_threads / 2;
+    }
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (WIDTH, HEIGHT, babl_format ("RGBA float"));
+
+  bench_scaling ("iterator read", buffer, read_iterator);
+  bench_scaling ("gegl_buffer_get", buffer, read_get);
+
+  g_object_unref (buffer);
+
+  gegl_exit ();
+  return 0;
+}
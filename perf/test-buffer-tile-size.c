@@ -0,0 +1,131 @@
+#include <string.h>
+#include "test-common.h"
+
+/* measures buffer access for a matrix of pixel formats and tile size targets,
+ * a target of 0 using the fixed tile size of the configuration.
+ */
+
+#define WIDTH  2048
+#define HEIGHT 2048
+#define RUNS   20
+
+static const gchar *formats[] =
+{
+  "Y u8",
+  "R'G'B'A u8",
+  "RGBA float",
+  "RGBA double"
+};
+
+static const gint targets[] =
+{
+  0,
+  32 * 1024,
+  128 * 1024,
+  512 * 1024
+};
+
+static void
+iterate (GeglBuffer *src,
+         GeglBuffer *dst)
+{
+  GeglBufferIterator *iter;
+  const Babl         *format = gegl_buffer_get_format (src);
+  gint                bpp    = babl_format_get_bytes_per_pixel (format);
+
+  iter = gegl_buffer_iterator_new (dst, NULL, 0, format,
+                                   GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 2);
+  gegl_buffer_iterator_add (iter, src, NULL, 0, format,
+                            GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    memcpy (iter->items[0].data, iter->items[1].data, iter->length * bpp);
+}
+
+static void
+copy (GeglBuffer *src,
+      GeglBuffer *dst)
+{
+  gegl_buffer_copy (src, NULL, GEGL_ABYSS_NONE, dst, NULL);
+}
+
+static void
+bench_access (const gchar *name,
+              GeglBuffer  *src,
+              GeglBuffer  *dst,
+              void       (*func) (GeglBuffer *src,
+                                  GeglBuffer *dst))
+{
+  gint i;
+
+  /* warm up */
+  func (src, dst);
+
+  test_start ();
+  for (i = 0; i < RUNS; i++)
+    {
+      test_start_iter ();
+      func (src, dst);
+      test_end_iter ();
+    }
+  test_end (name, (gdouble) WIDTH * HEIGHT *
+                  babl_format_get_bytes_per_pixel (
+                    gegl_buffer_get_format (src)) * ITERATIONS);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  gint i, j;
+
+  gegl_init (&argc, &argv);
+
+  for (i = 0; i < G_N_ELEMENTS (formats); i++)
+    for (j = 0; j < G_N_ELEMENTS (targets); j++)
+      {
+        const Babl *format = babl_format (formats[i]);
+        GeglBuffer *src;
+        GeglBuffer *dst;
+        GeglBuffer *float_dst;
+        gint        tile_width;
+        gint        tile_height;
+        gchar      *id;
+
+        g_object_set (gegl_config (), "tile-size-target", targets[j], NULL);
+
+        src       = test_buffer (WIDTH, HEIGHT, format);
+        dst       = gegl_buffer_new (gegl_buffer_get_extent (src), format);
+        float_dst = gegl_buffer_new (gegl_buffer_get_extent (src),
+                                     babl_format ("RGBA float"));
+
+        g_object_get (src,
+                      "tile-width",  &tile_width,
+                      "tile-height", &tile_height,
+                      NULL);
+
+        id = g_strdup_printf ("%s, target %d (%dx%d) iterate",
+                              formats[i], targets[j], tile_width, tile_height);
+        bench_access (id, src, dst, iterate);
+        g_free (id);
+
+        id = g_strdup_printf ("%s, target %d (%dx%d) copy",
+                              formats[i], targets[j], tile_width, tile_height);
+        bench_access (id, src, dst, copy);
+        g_free (id);
+
+        id = g_strdup_printf ("%s, target %d (%dx%d) copy to RGBA float",
+                              formats[i], targets[j], tile_width, tile_height);
+        bench_access (id, src, float_dst, copy);
+        g_free (id);
+
+        g_object_unref (float_dst);
+        g_object_unref (dst);
+        g_object_unref (src);
+      }
+
+  g_object_set (gegl_config (), "tile-size-target", 0, NULL);
+
+  gegl_exit ();
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include "test-common.h"
+
+/* the segmentations are slow on large images, only run a few iterations */
+#define RUNS 3
+
+static const gchar *operation;
+
+static void
+segment (GeglBuffer *buffer)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *source, *node, *sink;
+
+  gegl = gegl_node_new ();
+  source = gegl_node_new_child (gegl, "operation", "gegl:buffer-source", "buffer", buffer, NULL);
+  node = gegl_node_new_child (gegl, "operation", operation, NULL);
+  sink = gegl_node_new_child (gegl, "operation", "gegl:buffer-sink", "buffer", &buffer2, NULL);
+
+  gegl_node_link_many (source, node, sink, NULL);
+  gegl_node_process (sink);
+  g_object_unref (gegl);
+  g_object_unref (buffer2);
+}
+
+static void
+bench_segmentation (const gchar *name,
+                    gint         width,
+                    gint         height)
+{
+  static const gchar *operations[] = { "gegl:slic", "gegl:waterpixels" };
+  GeglBuffer *buffer;
+  gint        i, j;
+
+  buffer = test_buffer (width, height, babl_format ("RGBA float"));
+
+  for (i = 0; i < G_N_ELEMENTS (operations); i++)
+    {
+      gchar *id = g_strdup_printf ("%s %s", operations[i], name);
+
+      operation = operations[i];
+
+      test_start ();
+      for (j = 0; j < RUNS; j++)
+        {
+          test_start_iter ();
+          segment (buffer);
+          test_end_iter ();
+        }
+      test_end (id, (gdouble) width * height * 16 * ITERATIONS);
+
+      g_free (id);
+    }
+
+  g_object_unref (buffer);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  gegl_init (&argc, &argv);
+
+  g_object_set (gegl_config (),
+                "use-opencl", FALSE,
+                NULL);
+
+  bench_segmentation ("(12 MP)",  4000,  3000);
+  bench_segmentation ("(48 MP)",  8000,  6000);
+  bench_segmentation ("(100 MP)", 10000, 10000);
+
+  gegl_exit ();
+  return 0;
+}
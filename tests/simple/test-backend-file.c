@@ -20,6 +20,7 @@
 
 #include <glib/gstdio.h>
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -409,6 +410,146 @@ test_buffer_change_extent (void)
   return result;
 }
 
+static gboolean
+buffers_equal (GeglBuffer          *buf_a,
+               GeglBuffer          *buf_b,
+               const GeglRectangle *roi,
+               gdouble              scale)
+{
+  GeglRectangle  rect = { roi->x * scale, roi->y * scale,
+                          roi->width * scale, roi->height * scale };
+  gint           size = rect.width * rect.height * 4;
+  guchar        *data_a = g_malloc (size);
+  guchar        *data_b = g_malloc (size);
+  gboolean       equal;
+
+  gegl_buffer_get (buf_a, &rect, scale, babl_format ("R'G'B'A u8"), data_a,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (buf_b, &rect, scale, babl_format ("R'G'B'A u8"), data_b,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  equal = ! memcmp (data_a, data_b, size);
+
+  g_free (data_a);
+  g_free (data_b);
+
+  return equal;
+}
+
+/* files saved with gegl_buffer_save() are in the indexed format, with
+ * compressed tiles and a stored mipmap level, and can be loaded, opened, and
+ * appended to.
+ */
+static gboolean
+test_buffer_indexed (void)
+{
+  gboolean          result = TRUE;
+  gchar            *tmpdir = NULL;
+  gchar            *buf_a_path = NULL;
+  GeglBuffer       *buf_a = NULL;
+  GeglBuffer       *buf_b = NULL;
+  GeglBuffer       *buf_c = NULL;
+  GeglBufferItem   *header;
+  const Babl       *format = babl_format ("R'G'B'A u8");
+  GeglRectangle     roi = {0, 0, 400, 300};
+  GeglRectangle     noise = {130, 70, 200, 150};
+  GeglRectangle     patch = {10, 200, 100, 50};
+  GeglColor        *color;
+  GRand            *rand;
+  guchar           *data;
+  gint              fd;
+  gint              i;
+
+  tmpdir = g_dir_make_tmp ("test-backend-file-XXXXXX", NULL);
+  g_return_val_if_fail (tmpdir, FALSE);
+
+  buf_a_path = g_build_filename (tmpdir, "buf_a.gegl", NULL);
+
+  /* a buffer with uniform tiles, which compress, and noise, which doesn't */
+  buf_a = gegl_buffer_new (&roi, format);
+
+  color = gegl_color_new ("rgb(0.25, 0.5, 0.75)");
+  gegl_buffer_set_color (buf_a, &roi, color);
+  g_object_unref (color);
+
+  rand = g_rand_new_with_seed (0);
+  data = g_malloc (noise.width * noise.height * 4);
+  for (i = 0; i < noise.width * noise.height * 4; i++)
+    data[i] = g_rand_int_range (rand, 0, 256);
+  gegl_buffer_set (buf_a, &noise, 0, format, data, GEGL_AUTO_ROWSTRIDE);
+  g_free (data);
+  g_rand_free (rand);
+
+  g_object_set (gegl_config (), "file-mipmap-levels", 1, NULL);
+  gegl_buffer_save (buf_a, buf_a_path, NULL);
+  g_object_set (gegl_config (), "file-mipmap-levels", 0, NULL);
+
+  fd = g_open (buf_a_path, O_RDONLY, 0);
+  header = gegl_buffer_read_header (fd, NULL);
+  if (gegl_buffer_header_get_rev (header) != GEGL_FILE_SPEC_REV_INDEX)
+    {
+      printf ("Saved file is not in the indexed format\n");
+      result = FALSE;
+    }
+  g_free (header);
+  g_close (fd, NULL);
+
+  buf_b = gegl_buffer_load (buf_a_path);
+
+  if (!buffers_equal (buf_a, buf_b, &roi, 1.0))
+    {
+      printf ("Loaded buffer does not match\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_b);
+
+  buf_b = gegl_buffer_open (buf_a_path);
+
+  if (!buffers_equal (buf_a, buf_b, &roi, 1.0))
+    {
+      printf ("Opened buffer does not match\n");
+      result = FALSE;
+    }
+
+  if (!buffers_equal (buf_a, buf_b, &roi, 0.5))
+    {
+      printf ("Mipmap level of opened buffer does not match\n");
+      result = FALSE;
+    }
+
+  /* updates are appended to the file */
+  color = gegl_color_new ("rgb(1.0, 0.0, 0.0)");
+  gegl_buffer_set_color (buf_a, &patch, color);
+  gegl_buffer_set_color (buf_b, &patch, color);
+  g_object_unref (color);
+
+  gegl_buffer_flush (buf_b);
+  g_object_unref (buf_b);
+
+  buf_b = gegl_buffer_open (buf_a_path);
+  buf_c = gegl_buffer_load (buf_a_path);
+
+  if (!buffers_equal (buf_a, buf_b, &roi, 1.0) ||
+      !buffers_equal (buf_a, buf_c, &roi, 1.0))
+    {
+      printf ("Updated buffer does not match\n");
+      result = FALSE;
+    }
+
+  g_object_unref (buf_a);
+  g_object_unref (buf_b);
+  g_object_unref (buf_c);
+
+  g_unlink (buf_a_path);
+  g_remove (tmpdir);
+
+  g_free (tmpdir);
+  g_free (buf_a_path);
+
+  return result;
+}
+
 #define RUN_TEST(test_name) \
 { \
   if (test_name()) \
@@ -440,6 +581,7 @@ int main(int argc, char **argv)
   RUN_TEST (test_buffer_same_path)
   RUN_TEST (test_buffer_open)
   RUN_TEST (test_buffer_change_extent)
+  RUN_TEST (test_buffer_indexed)
 
   gegl_exit();
 
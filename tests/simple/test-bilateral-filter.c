@@ -0,0 +1,203 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-bilateral-filter/" #function, function);
+
+#define WIDTH   96
+#define HEIGHT  96
+
+/* a disc with a noisy color on a noisy gradient */
+static gfloat *
+create_image (void)
+{
+  gfloat *image = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand  *rand  = g_rand_new_with_seed (42);
+  gint    x, y;
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        gfloat *pixel = image + (y * WIDTH + x) * 4;
+        gfloat  noise = g_rand_double_range (rand, -0.05, 0.05);
+
+        if ((x - 48) * (x - 48) + (y - 40) * (y - 40) < 30 * 30)
+          {
+            pixel[0] = 0.8f + noise;
+            pixel[1] = 0.2f + noise;
+            pixel[2] = 0.1f + noise;
+          }
+        else
+          {
+            pixel[0] = 0.1f + noise;
+            pixel[1] = 0.3f + noise + y / 300.0f;
+            pixel[2] = 0.9f + noise;
+          }
+        pixel[3] = 1.0f;
+      }
+
+  g_rand_free (rand);
+
+  return image;
+}
+
+static gfloat
+get_component (const gfloat *image,
+               gint          x,
+               gint          y,
+               gint          c)
+{
+  if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT)
+    return 0.0f;
+
+  return image[(y * WIDTH + x) * 4 + c];
+}
+
+/* the brute-force filter, with the same weights as the exact path of the
+ * operation
+ */
+static gfloat *
+filter_exact (const gfloat *image,
+              gdouble       radius,
+              gdouble       preserve)
+{
+  gfloat *result  = g_new (gfloat, WIDTH * HEIGHT * 4);
+  gint    iradius = radius;
+  gint    x, y, u, v, c;
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        gdouble accumulated[4] = { 0, };
+        gdouble count          = 0.0;
+
+        for (v = -iradius; v <= iradius; v++)
+          for (u = -iradius; u <= iradius; u++)
+            {
+              gdouble diff = 0.0;
+              gdouble weight;
+
+              for (c = 0; c < 3; c++)
+                {
+                  gdouble d = get_component (image, x, y, c) -
+                              get_component (image, x + u, y + v, c);
+
+                  diff += d * d;
+                }
+
+              weight = exp (-0.5 * (u * u + v * v) / radius) *
+                       exp (-diff * preserve);
+
+              for (c = 0; c < 4; c++)
+                accumulated[c] += get_component (image, x + u, y + v, c) * weight;
+              count += weight;
+            }
+
+        for (c = 0; c < 4; c++)
+          result[(y * WIDTH + x) * 4 + c] = accumulated[c] / count;
+      }
+
+  return result;
+}
+
+static gdouble
+psnr (const gfloat *a,
+      const gfloat *b)
+{
+  gdouble mse = 0.0;
+  gint    i, c;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    for (c = 0; c < 3; c++)
+      {
+        gdouble d = a[i * 4 + c] - b[i * 4 + c];
+
+        mse += d * d;
+      }
+
+  mse /= WIDTH * HEIGHT * 3;
+
+  return 10.0 * log10 (1.0 / mse);
+}
+
+static void
+check_approximation (gdouble radius,
+                     gdouble preserve,
+                     gdouble min_psnr)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  gfloat        *image  = create_image ();
+  gfloat        *exact  = filter_exact (image, radius, preserve);
+  gfloat        *result = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, format);
+  GeglNode      *gegl   = gegl_node_new ();
+  GeglNode      *source;
+  GeglNode      *filter;
+
+  gegl_buffer_set (buffer, &rect, 0, format, image, GEGL_AUTO_ROWSTRIDE);
+
+  source = gegl_node_new_child (gegl,
+                                "operation",         "gegl:buffer-source",
+                                "buffer",            buffer,
+                                NULL);
+  filter = gegl_node_new_child (gegl,
+                                "operation",         "gegl:bilateral-filter",
+                                "blur-radius",       radius,
+                                "edge-preservation", preserve,
+                                NULL);
+  gegl_node_link (source, filter);
+
+  gegl_node_blit (filter, 1.0, &rect, format, result,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_assert_cmpfloat (psnr (exact, result), >, min_psnr);
+
+  g_object_unref (gegl);
+  g_object_unref (buffer);
+  g_free (image);
+  g_free (exact);
+  g_free (result);
+}
+
+static void
+approximate (void)
+{
+  check_approximation (12.0, 8.0, 40.0);
+  check_approximation (30.0, 8.0, 40.0);
+}
+
+static void
+approximate_low_preservation (void)
+{
+  check_approximation (12.0, 2.0, 30.0);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (approximate);
+  ADD_TEST (approximate_low_preservation);
+
+  return g_test_run ();
+}
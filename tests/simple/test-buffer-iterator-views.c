@@ -0,0 +1,167 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/buffer-iterator-views/" #function, function);
+
+static gint
+get_stat (const gchar *name)
+{
+  gint value;
+
+  g_object_get (gegl_stats (), name, &value, NULL);
+
+  return value;
+}
+
+/* reads the whole buffer in @format through an iterator, and compares the
+ * result against gegl_buffer_get()
+ */
+static void
+read_and_compare (GeglBuffer *buffer,
+                  const Babl *format)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (buffer);
+  GeglBufferIterator  *iter;
+  gint                 bpp    = babl_format_get_bytes_per_pixel (format);
+  guchar              *ref;
+
+  ref = g_malloc (extent->width * extent->height * bpp);
+  gegl_buffer_get (buffer, extent, 1.0, format, ref,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  iter = gegl_buffer_iterator_new (buffer, extent, 0, format,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const GeglRectangle *roi  = &iter->items[0].roi;
+      const guchar        *data = iter->items[0].data;
+      gint                 y;
+
+      for (y = 0; y < roi->height; y++)
+        {
+          const guchar *row = ref + ((roi->y + y - extent->y) * extent->width +
+                                     (roi->x     - extent->x)) * bpp;
+
+          g_assert (! memcmp (row, data + y * roi->width * bpp,
+                              roi->width * bpp));
+        }
+    }
+
+  g_free (ref);
+}
+
+static void
+reuse (void)
+{
+  GeglRectangle  rect   = { 0, 0, 256, 256 };
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, babl_format ("RGBA float"));
+  GeglColor     *color  = gegl_color_new ("rgb(0.25, 0.5, 0.75)");
+  const Babl    *format = babl_format ("R'G'B'A float");
+  gint           n_tiles;
+
+  gegl_buffer_set_color (buffer, &rect, color);
+
+  /* the first read converts every tile */
+  gegl_reset_stats ();
+  read_and_compare (buffer, format);
+  n_tiles = get_stat ("iterator-conversions");
+  g_assert_cmpint (n_tiles, >, 0);
+  g_assert_cmpint (get_stat ("iterator-conversions-cached"), ==, 0);
+
+  /* reading again in the same format reuses the converted tiles */
+  gegl_reset_stats ();
+  read_and_compare (buffer, format);
+  g_assert_cmpint (get_stat ("iterator-conversions"), ==, 0);
+  g_assert_cmpint (get_stat ("iterator-conversions-cached"), ==, n_tiles);
+
+  g_object_unref (color);
+  g_object_unref (buffer);
+}
+
+static void
+invalidate_on_write (void)
+{
+  GeglRectangle  rect   = { 0, 0, 256, 256 };
+  GeglRectangle  pixel  = { 10, 10, 1, 1 };
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, babl_format ("RGBA float"));
+  GeglColor     *color  = gegl_color_new ("rgb(0.25, 0.5, 0.75)");
+  const Babl    *format = babl_format ("R'G'B'A float");
+  gfloat         white[4] = { 1.0, 1.0, 1.0, 1.0 };
+
+  gegl_buffer_set_color (buffer, &rect, color);
+  read_and_compare (buffer, format);
+
+  /* writing to a tile drops its converted view */
+  gegl_buffer_set (buffer, &pixel, 0, babl_format ("RGBA float"), white,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  gegl_reset_stats ();
+  read_and_compare (buffer, format);
+  g_assert_cmpint (get_stat ("iterator-conversions"), ==, 1);
+
+  g_object_unref (color);
+  g_object_unref (buffer);
+}
+
+static void
+user_data (void)
+{
+  GeglRectangle  rect   = { 0, 0, 64, 64 };
+  const Babl    *format = babl_format ("R'G'B'A float");
+  gfloat        *data   = g_new (gfloat, 4 * rect.width * rect.height);
+  GeglBuffer    *buffer;
+  gint           i;
+
+  for (i = 0; i < 4 * rect.width * rect.height; i++)
+    data[i] = 0.25;
+
+  buffer = gegl_buffer_linear_new_from_data (data, babl_format ("RGBA float"),
+                                             &rect, GEGL_AUTO_ROWSTRIDE,
+                                             NULL, NULL);
+  read_and_compare (buffer, format);
+
+  /* the data of a buffer wrapping user data can change behind its back, so
+   * its tiles never keep a converted view
+   */
+  for (i = 0; i < 4 * rect.width * rect.height; i++)
+    data[i] = 0.75;
+
+  gegl_reset_stats ();
+  read_and_compare (buffer, format);
+  g_assert_cmpint (get_stat ("iterator-conversions-cached"), ==, 0);
+
+  g_object_unref (buffer);
+  g_free (data);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (reuse);
+  ADD_TEST (invalidate_on_write);
+  ADD_TEST (user_data);
+
+  return g_test_run ();
+}
@@ -0,0 +1,230 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/buffer-tile-size/" #function, function);
+
+static const GeglRectangle extent = { -7, 3, 700, 300 };
+
+static void
+get_tile_size (GeglBuffer *buffer,
+               gint       *tile_width,
+               gint       *tile_height)
+{
+  g_object_get (buffer,
+                "tile-width",  tile_width,
+                "tile-height", tile_height,
+                NULL);
+}
+
+static void
+check_tile_size (const gchar *format,
+                 gint         expected_width,
+                 gint         expected_height)
+{
+  GeglBuffer *buffer = gegl_buffer_new (&extent, babl_format (format));
+  gint        tile_width;
+  gint        tile_height;
+
+  get_tile_size (buffer, &tile_width, &tile_height);
+
+  g_assert_cmpint (tile_width,  ==, expected_width);
+  g_assert_cmpint (tile_height, ==, expected_height);
+
+  g_object_unref (buffer);
+}
+
+/* a buffer with the given tile size, filled with a gradient that differs
+ * from pixel to pixel, and from one @shade to another
+ */
+static GeglBuffer *
+create_gradient (const Babl *format,
+                 gint        tile_width,
+                 gint        tile_height,
+                 gint        shade)
+{
+  GeglBuffer *buffer;
+  gfloat     *data;
+  gint        x, y;
+
+  buffer = g_object_new (GEGL_TYPE_BUFFER,
+                         "x",           extent.x,
+                         "y",           extent.y,
+                         "width",       extent.width,
+                         "height",      extent.height,
+                         "format",      format,
+                         "tile-width",  tile_width,
+                         "tile-height", tile_height,
+                         NULL);
+
+  data = g_new (gfloat, extent.width * extent.height * 4);
+
+  for (y = 0; y < extent.height; y++)
+    for (x = 0; x < extent.width; x++)
+      {
+        gfloat *pixel = data + (y * extent.width + x) * 4;
+
+        pixel[0] = (gfloat) x / extent.width;
+        pixel[1] = (gfloat) y / extent.height;
+        pixel[2] = (gfloat) ((x + y) % 256) / 255.0f;
+        pixel[3] = (gfloat) shade / 4.0f;
+      }
+
+  gegl_buffer_set (buffer, &extent, 0, babl_format ("RGBA float"), data,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data);
+
+  return buffer;
+}
+
+static void
+compare_buffers (GeglBuffer          *buffer1,
+                 GeglBuffer          *buffer2,
+                 const GeglRectangle *rect)
+{
+  const Babl *format = gegl_buffer_get_format (buffer1);
+  gint        size   = rect->width * rect->height *
+                       babl_format_get_bytes_per_pixel (format);
+  guchar     *data1  = g_malloc (size);
+  guchar     *data2  = g_malloc (size);
+
+  gegl_buffer_get (buffer1, rect, 1.0, format, data1,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (buffer2, rect, 1.0, format, data2,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  g_assert (! memcmp (data1, data2, size));
+
+  g_free (data1);
+  g_free (data2);
+}
+
+/* with a tile size target, the tiles of new buffers are sized after their
+ * format, keeping the aspect ratio of the configured tile size
+ */
+static void
+target (void)
+{
+  GeglBuffer *buffer;
+  gint        tile_width;
+  gint        tile_height;
+
+  g_object_set (gegl_config (),
+                "tile-width",       128,
+                "tile-height",      64,
+                "tile-size-target", 128 * 64 * 16,
+                NULL);
+
+  check_tile_size ("RGBA float",  128,  64);
+  check_tile_size ("Y u8",        512, 256);
+  check_tile_size ("RGBA double",  64,  64);
+
+  /* an explicit tile size is kept */
+  buffer = create_gradient (babl_format ("Y u8"), 32, 16, 0);
+  get_tile_size (buffer, &tile_width, &tile_height);
+  g_assert_cmpint (tile_width,  ==, 32);
+  g_assert_cmpint (tile_height, ==, 16);
+  g_object_unref (buffer);
+
+  g_object_set (gegl_config (), "tile-size-target", 0, NULL);
+
+  check_tile_size ("Y u8",        128,  64);
+  check_tile_size ("RGBA double", 128,  64);
+}
+
+/* iterating over buffers whose tile grids nest gives the same result,
+ * whichever buffer has the finer grid, and leaves the pixels of the
+ * written buffer outside of the iterated area alone
+ */
+static void
+iterate_nested_grids (void)
+{
+  const Babl    *format = babl_format ("RGBA u8");
+  GeglRectangle  roi    = { 20, 10, 600, 250 };
+  GeglRectangle  above  = { extent.x, extent.y,
+                            extent.width, roi.y - extent.y };
+  GeglRectangle  left   = { extent.x, roi.y,
+                            roi.x - extent.x, roi.height };
+  gint           order;
+
+  for (order = 0; order < 2; order++)
+    {
+      GeglBuffer         *src = create_gradient (format,
+                                                 order ? 256 : 64,
+                                                 order ? 128 : 32, 1);
+      GeglBuffer         *dst = create_gradient (format,
+                                                 order ? 64  : 256,
+                                                 order ? 32  : 128, 2);
+      GeglBuffer         *untouched = create_gradient (format, 128, 64, 2);
+      GeglBufferIterator *iter;
+
+      iter = gegl_buffer_iterator_new (dst, &roi, 0, format,
+                                       GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE, 2);
+      gegl_buffer_iterator_add (iter, src, &roi, 0, format,
+                                GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+      while (gegl_buffer_iterator_next (iter))
+        {
+          g_assert_cmpint (iter->items[0].roi.x, ==, iter->items[1].roi.x);
+          g_assert_cmpint (iter->items[0].roi.y, ==, iter->items[1].roi.y);
+
+          memcpy (iter->items[0].data, iter->items[1].data, iter->length * 4);
+        }
+
+      compare_buffers (src, dst, &roi);
+      compare_buffers (untouched, dst, &above);
+      compare_buffers (untouched, dst, &left);
+
+      g_object_unref (src);
+      g_object_unref (dst);
+      g_object_unref (untouched);
+    }
+}
+
+/* copying between buffers of different tile sizes */
+static void
+copy_nested_grids (void)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglBuffer    *src    = create_gradient (format, 64, 64, 3);
+  GeglBuffer    *dst    = create_gradient (format, 128, 64, 4);
+  GeglRectangle  rect   = { 5, 30, 500, 200 };
+
+  gegl_buffer_copy (src, &rect, GEGL_ABYSS_NONE, dst, &rect);
+
+  compare_buffers (src, dst, &rect);
+
+  g_object_unref (src);
+  g_object_unref (dst);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (target);
+  ADD_TEST (iterate_nested_grids);
+  ADD_TEST (copy_nested_grids);
+
+  return g_test_run ();
+}
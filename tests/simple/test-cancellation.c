@@ -0,0 +1,167 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-cancellation/" #function, function);
+
+static void
+scopes (void)
+{
+  GCancellable *cancellable = g_cancellable_new ();
+
+  g_assert (! gegl_parallel_is_cancelled ());
+
+  gegl_parallel_push_cancellable (cancellable, 0);
+  g_assert (! gegl_parallel_is_cancelled ());
+
+  /* an inner scope is cancelled along with the outer one */
+  gegl_parallel_push_cancellable (NULL, 0);
+  g_cancellable_cancel (cancellable);
+  g_assert (gegl_parallel_is_cancelled ());
+  gegl_parallel_pop_cancellable ();
+
+  gegl_parallel_pop_cancellable ();
+  g_assert (! gegl_parallel_is_cancelled ());
+
+  /* a deadline in the past */
+  gegl_parallel_push_cancellable (NULL, g_get_monotonic_time () - 1);
+  g_assert (gegl_parallel_is_cancelled ());
+  gegl_parallel_pop_cancellable ();
+
+  g_object_unref (cancellable);
+}
+
+static void
+distribute_func (gint      i,
+                 gint      n,
+                 gpointer  user_data)
+{
+  gint *n_cancelled = user_data;
+
+  if (gegl_parallel_is_cancelled ())
+    g_atomic_int_inc (n_cancelled);
+}
+
+static void
+workers (void)
+{
+  GCancellable *cancellable = g_cancellable_new ();
+  gint          n_cancelled = 0;
+
+  g_object_set (gegl_config (), "threads", 4, NULL);
+
+  g_cancellable_cancel (cancellable);
+
+  gegl_parallel_push_cancellable (cancellable, 0);
+  gegl_parallel_distribute (4, distribute_func, &n_cancelled);
+  gegl_parallel_pop_cancellable ();
+
+  /* every worker sees the scope of the distributing thread */
+  g_assert_cmpint (n_cancelled, ==, 4);
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+
+  g_object_unref (cancellable);
+}
+
+static void
+iterator (void)
+{
+  GeglRectangle       rect        = { 0, 0, 512, 512 };
+  GeglBuffer         *buffer;
+  GeglBufferIterator *iter;
+  GCancellable       *cancellable = g_cancellable_new ();
+  gint                n_chunks    = 0;
+
+  buffer = gegl_buffer_new (&rect, babl_format ("Y float"));
+
+  gegl_parallel_push_cancellable (cancellable, 0);
+
+  iter = gegl_buffer_iterator_new (buffer, &rect, 0, NULL,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      n_chunks++;
+      g_cancellable_cancel (cancellable);
+    }
+
+  gegl_parallel_pop_cancellable ();
+
+  g_assert_cmpint (n_chunks, ==, 1);
+
+  g_object_unref (buffer);
+  g_object_unref (cancellable);
+}
+
+static void
+processor (void)
+{
+  GeglRectangle  rect        = { 0, 0, 512, 512 };
+  GCancellable  *cancellable = g_cancellable_new ();
+  GeglColor     *color       = gegl_color_new ("rgb(0.5, 0.25, 1.0)");
+  GeglNode      *gegl        = gegl_node_new ();
+  GeglNode      *source;
+  GeglNode      *crop;
+  GeglProcessor *processor;
+  gdouble        progress    = 0.0;
+
+  source = gegl_node_new_child (gegl,
+                                "operation", "gegl:color",
+                                "value",     color,
+                                NULL);
+  crop   = gegl_node_new_child (gegl,
+                                "operation", "gegl:crop",
+                                "width",     512.0,
+                                "height",    512.0,
+                                NULL);
+  gegl_node_link (source, crop);
+
+  processor = gegl_node_new_processor (crop, &rect);
+
+  g_cancellable_cancel (cancellable);
+  gegl_processor_set_cancellable (processor, cancellable);
+
+  g_assert (! gegl_processor_work (processor, &progress));
+  g_assert_cmpfloat (progress, <, 1.0);
+
+  /* rendering resumes without the cancellable */
+  gegl_processor_set_cancellable (processor, NULL);
+  while (gegl_processor_work (processor, &progress));
+  g_assert_cmpfloat (progress, ==, 1.0);
+
+  g_object_unref (processor);
+  g_object_unref (gegl);
+  g_object_unref (color);
+  g_object_unref (cancellable);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (scopes);
+  ADD_TEST (workers);
+  ADD_TEST (iterator);
+  ADD_TEST (processor);
+
+  return g_test_run ();
+}
@@ -0,0 +1,281 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+#include "gegl-plugin.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-convolution/" #function, function);
+
+#define SIZE 128
+
+static GeglBuffer *
+create_noise (void)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglRectangle  rect   = { 0, 0, SIZE, SIZE };
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, format);
+  gfloat        *data   = g_new (gfloat, SIZE * SIZE * 4);
+  GRand         *rand   = g_rand_new_with_seed (1);
+  gint           i;
+
+  for (i = 0; i < SIZE * SIZE * 4; i++)
+    data[i] = g_rand_double (rand);
+
+  gegl_buffer_set (buffer, &rect, 0, format, data, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (data);
+
+  return buffer;
+}
+
+static gfloat
+max_difference (GeglBuffer *a,
+                GeglBuffer *b)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglRectangle  rect   = { 0, 0, SIZE, SIZE };
+  gfloat        *data_a = g_new (gfloat, SIZE * SIZE * 4);
+  gfloat        *data_b = g_new (gfloat, SIZE * SIZE * 4);
+  gfloat         max    = 0.0f;
+  gint           i;
+
+  gegl_buffer_get (a, &rect, 1.0, format, data_a, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+  gegl_buffer_get (b, &rect, 1.0, format, data_b, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+
+  for (i = 0; i < SIZE * SIZE * 4; i++)
+    max = MAX (max, fabsf (data_a[i] - data_b[i]));
+
+  g_free (data_a);
+  g_free (data_b);
+
+  return max;
+}
+
+/* all methods compute the same result */
+static void
+check_methods (const gfloat *kernel,
+               gint          width,
+               gint          height,
+               gint          expected_rank)
+{
+  const Babl      *format = babl_format ("RGBA float");
+  GeglRectangle    rect   = { 0, 0, SIZE, SIZE };
+  GeglBuffer      *input  = create_noise ();
+  GeglBuffer      *direct = gegl_buffer_new (&rect, format);
+  GeglBuffer      *other  = gegl_buffer_new (&rect, format);
+  GeglConvolution *convolution;
+
+  convolution = gegl_convolution_new (kernel, width, height,
+                                      width / 2, height / 2);
+
+  g_assert_cmpint (gegl_convolution_get_rank (convolution), ==, expected_rank);
+
+  gegl_convolution_process (convolution, input, direct, &rect, format,
+                            GEGL_ABYSS_CLAMP, GEGL_CONVOLUTION_METHOD_DIRECT);
+
+  gegl_convolution_process (convolution, input, other, &rect, format,
+                            GEGL_ABYSS_CLAMP, GEGL_CONVOLUTION_METHOD_FFT);
+  g_assert_cmpfloat (max_difference (direct, other), <, 1e-4);
+
+  if (expected_rank > 0)
+    {
+      gegl_convolution_process (convolution, input, other, &rect, format,
+                                GEGL_ABYSS_CLAMP,
+                                GEGL_CONVOLUTION_METHOD_SEPARABLE);
+      g_assert_cmpfloat (max_difference (direct, other), <, 1e-4);
+    }
+
+  gegl_convolution_free (convolution);
+
+  g_object_unref (input);
+  g_object_unref (direct);
+  g_object_unref (other);
+}
+
+static void
+gaussian (void)
+{
+  gfloat kernel[21 * 21];
+  gfloat sum = 0.0f;
+  gint   x, y;
+
+  for (y = 0; y < 21; y++)
+    for (x = 0; x < 21; x++)
+      {
+        kernel[y * 21 + x] = exp (-((x - 10) * (x - 10) +
+                                    (y - 10) * (y - 10)) / 32.0);
+        sum += kernel[y * 21 + x];
+      }
+
+  for (x = 0; x < 21 * 21; x++)
+    kernel[x] /= sum;
+
+  check_methods (kernel, 21, 21, 1);
+}
+
+static void
+disc (void)
+{
+  gfloat kernel[31 * 25];
+  gint   n = 0;
+  gint   x, y;
+
+  for (y = 0; y < 25; y++)
+    for (x = 0; x < 31; x++)
+      {
+        kernel[y * 31 + x] = (x - 15) * (x - 15) + (y - 12) * (y - 12) <= 144;
+        n += kernel[y * 31 + x];
+      }
+
+  for (x = 0; x < 31 * 25; x++)
+    kernel[x] /= n;
+
+  /* a disc has no low rank decomposition */
+  check_methods (kernel, 31, 25, 0);
+}
+
+static void
+choose_method (void)
+{
+  GeglRectangle    rect = { 0, 0, 1024, 1024 };
+  gfloat          *kernel;
+  GeglConvolution *convolution;
+  gint             i;
+
+  kernel = g_new (gfloat, 65 * 65);
+  for (i = 0; i < 65 * 65; i++)
+    kernel[i] = g_random_double ();
+
+  convolution = gegl_convolution_new (kernel, 3, 3, 1, 1);
+  g_assert_cmpint (gegl_convolution_choose_method (convolution, &rect), ==,
+                   GEGL_CONVOLUTION_METHOD_DIRECT);
+  gegl_convolution_free (convolution);
+
+  convolution = gegl_convolution_new (kernel, 65, 65, 32, 32);
+  g_assert_cmpint (gegl_convolution_choose_method (convolution, &rect), ==,
+                   GEGL_CONVOLUTION_METHOD_FFT);
+  gegl_convolution_free (convolution);
+
+  g_free (kernel);
+}
+
+static GeglBuffer *
+convolve_reference (GeglBuffer      *input,
+                    GeglBuffer      *kernel,
+                    GeglAbyssPolicy  border)
+{
+  const Babl      *format = babl_format ("RaGaBaA float");
+  GeglRectangle    rect   = { 0, 0, SIZE, SIZE };
+  GeglBuffer      *reference = gegl_buffer_new (&rect, format);
+  GeglConvolution *convolution;
+
+  /* the operation applies the normalized kernel, centered */
+  convolution = gegl_convolution_new_from_buffer (kernel, NULL, TRUE);
+  gegl_convolution_process (convolution, input, reference, &rect, format,
+                            border, GEGL_CONVOLUTION_METHOD_DIRECT);
+  gegl_convolution_free (convolution);
+
+  return reference;
+}
+
+/* the operation follows its border, and changes of the kernel */
+static void
+check_operation (GeglAbyssPolicy border)
+{
+  const Babl      *format = babl_format ("RaGaBaA float");
+  GeglRectangle    box    = { 0, 0, 7, 5 };
+  GeglBuffer      *input  = create_noise ();
+  GeglBuffer      *kernel = gegl_buffer_new (&box, babl_format ("Y float"));
+  GeglBuffer      *output = NULL;
+  GeglBuffer      *reference;
+  GeglNode        *gegl   = gegl_node_new ();
+  GeglNode        *source;
+  GeglNode        *kernel_source;
+  GeglNode        *convolve;
+  GeglNode        *sink;
+  GeglColor       *white  = gegl_color_new ("white");
+  GeglColor       *black  = gegl_color_new ("black");
+
+  gegl_buffer_set_color (kernel, &box, white);
+
+  source        = gegl_node_new_child (gegl,
+                                       "operation", "gegl:buffer-source",
+                                       "buffer",    input,
+                                       NULL);
+  kernel_source = gegl_node_new_child (gegl,
+                                       "operation", "gegl:buffer-source",
+                                       "buffer",    kernel,
+                                       NULL);
+  convolve      = gegl_node_new_child (gegl,
+                                       "operation", "gegl:convolve",
+                                       "border",    border,
+                                       NULL);
+  sink          = gegl_node_new_child (gegl,
+                                       "operation", "gegl:buffer-sink",
+                                       "buffer",    &output,
+                                       "format",    format,
+                                       NULL);
+
+  gegl_node_link_many (source, convolve, sink, NULL);
+  gegl_node_connect_to (kernel_source, "output", convolve, "aux");
+  gegl_node_process (sink);
+
+  reference = convolve_reference (input, kernel, border);
+  g_assert_cmpfloat (max_difference (output, reference), <, 1e-4);
+  g_object_unref (reference);
+  g_clear_object (&output);
+
+  gegl_buffer_set_color (kernel, GEGL_RECTANGLE (0, 0, 3, 5), black);
+  gegl_node_process (sink);
+
+  reference = convolve_reference (input, kernel, border);
+  g_assert_cmpfloat (max_difference (output, reference), <, 1e-4);
+  g_object_unref (reference);
+  g_clear_object (&output);
+
+  g_object_unref (white);
+  g_object_unref (black);
+  g_object_unref (gegl);
+  g_object_unref (input);
+  g_object_unref (kernel);
+}
+
+static void
+operation (void)
+{
+  check_operation (GEGL_ABYSS_CLAMP);
+  check_operation (GEGL_ABYSS_NONE);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (gaussian);
+  ADD_TEST (disc);
+  ADD_TEST (choose_method);
+  ADD_TEST (operation);
+
+  return g_test_run ();
+}
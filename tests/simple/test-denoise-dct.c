@@ -0,0 +1,158 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-denoise-dct/" #function, function);
+
+#define WIDTH   300
+#define HEIGHT  170
+
+static GeglBuffer *
+create_noise (gdouble amplitude)
+{
+  const Babl    *format = babl_format ("R'G'B'A float");
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, format);
+  gfloat        *image  = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand         *rand   = g_rand_new_with_seed (42);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    image[i] = 0.5 + amplitude * (g_rand_double (rand) - 0.5);
+
+  gegl_buffer_set (buffer, &rect, 0, format, image, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (image);
+
+  return buffer;
+}
+
+static gfloat *
+render (GeglBuffer          *input,
+        const gchar         *patch_size,
+        const GeglRectangle *rect)
+{
+  gfloat   *result = g_new (gfloat, rect->width * rect->height * 4);
+  GeglNode *gegl   = gegl_node_new ();
+  GeglNode *source;
+  GeglNode *denoise;
+
+  source  = gegl_node_new_child (gegl,
+                                 "operation", "gegl:buffer-source",
+                                 "buffer",    input,
+                                 NULL);
+  denoise = gegl_node_new_child (gegl,
+                                 "operation", "gegl:denoise-dct",
+                                 "sigma",     20.0,
+                                 NULL);
+  gegl_node_set_enum_as_string (denoise, "patch-size", patch_size);
+  gegl_node_link (source, denoise);
+
+  gegl_node_blit (denoise, 1.0, rect, babl_format ("R'G'B'A float"), result,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (gegl);
+
+  return result;
+}
+
+/* any part of the image is the same when rendered on its own, with any
+ * number of threads
+ */
+static void
+check_regions (const gchar *patch_size)
+{
+  GeglRectangle  full   = { 0, 0, WIDTH, HEIGHT };
+  GeglRectangle  part   = { 37, 21, 150, 90 };
+  GeglBuffer    *input  = create_noise (0.4);
+  gfloat        *whole;
+  gfloat        *region;
+  gfloat        *threaded;
+  gint           y;
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+  whole  = render (input, patch_size, &full);
+  region = render (input, patch_size, &part);
+
+  g_object_set (gegl_config (), "threads", 4, NULL);
+  threaded = render (input, patch_size, &full);
+
+  g_assert (memcmp (whole, threaded,
+                    WIDTH * HEIGHT * 4 * sizeof (gfloat)) == 0);
+
+  for (y = 0; y < part.height; y++)
+    {
+      g_assert (memcmp (region + y * part.width * 4,
+                        whole + ((part.y + y) * WIDTH + part.x) * 4,
+                        part.width * 4 * sizeof (gfloat)) == 0);
+    }
+
+  g_object_unref (input);
+  g_free (whole);
+  g_free (region);
+  g_free (threaded);
+}
+
+static void
+regions_8x8 (void)
+{
+  check_regions ("size8x8");
+}
+
+static void
+regions_16x16 (void)
+{
+  check_regions ("size16x16");
+}
+
+static void
+flat (void)
+{
+  GeglRectangle  full  = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *input = create_noise (0.0);
+  gfloat        *result;
+  gint           i;
+
+  result = render (input, "size8x8", &full);
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    g_assert_cmpfloat_with_epsilon (result[i], 0.5, 1e-5);
+
+  g_object_unref (input);
+  g_free (result);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  g_object_set (gegl_config (),
+                "use-opencl", FALSE,
+                NULL);
+
+  ADD_TEST (regions_8x8);
+  ADD_TEST (regions_16x16);
+  ADD_TEST (flat);
+
+  return g_test_run ();
+}
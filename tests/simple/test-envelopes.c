@@ -0,0 +1,178 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-envelopes/" #function, function);
+
+#define WIDTH   200
+#define HEIGHT  150
+
+static GeglBuffer *
+create_image (void)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, format);
+  gfloat        *image  = g_new (gfloat, WIDTH * HEIGHT * 4);
+  gint           x, y;
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        gfloat *pixel = image + (y * WIDTH + x) * 4;
+
+        pixel[0] = 0.5f + 0.4f * sinf (x * 0.05f) * cosf (y * 0.03f);
+        pixel[1] = (gfloat) (x * y) / (WIDTH * HEIGHT);
+        pixel[2] = ((x / 32 + y / 32) & 1) ? 0.8f : 0.2f;
+        pixel[3] = 1.0f;
+      }
+
+  gegl_buffer_set (buffer, &rect, 0, format, image, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (image);
+
+  return buffer;
+}
+
+static gfloat *
+render (GeglBuffer  *input,
+        const gchar *operation,
+        gboolean     enhance_shadows)
+{
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  gfloat        *result = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GeglNode      *gegl   = gegl_node_new ();
+  GeglNode      *source;
+  GeglNode      *filter;
+
+  source = gegl_node_new_child (gegl,
+                                "operation",       "gegl:buffer-source",
+                                "buffer",          input,
+                                NULL);
+  filter = gegl_node_new_child (gegl,
+                                "operation",       operation,
+                                "radius",          60,
+                                "enhance-shadows", enhance_shadows,
+                                NULL);
+  gegl_node_link (source, filter);
+
+  gegl_node_blit (filter, 1.0, &rect, babl_format ("RGBA float"), result,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (gegl);
+
+  return result;
+}
+
+/* the sprays only depend on the pixel position, the result is the same from
+ * run to run and for any number of threads
+ */
+static void
+check_deterministic (const gchar *operation,
+                     gboolean     enhance_shadows)
+{
+  GeglBuffer *input = create_image ();
+  gfloat     *single;
+  gfloat     *multi;
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+  single = render (input, operation, enhance_shadows);
+
+  g_object_set (gegl_config (), "threads", 4, NULL);
+  multi = render (input, operation, enhance_shadows);
+
+  g_assert (memcmp (single, multi, WIDTH * HEIGHT * 4 * sizeof (gfloat)) == 0);
+
+  g_object_unref (input);
+  g_free (single);
+  g_free (multi);
+}
+
+static void
+deterministic_stress (void)
+{
+  check_deterministic ("gegl:stress", FALSE);
+  check_deterministic ("gegl:stress", TRUE);
+}
+
+static void
+deterministic_c2g (void)
+{
+  check_deterministic ("gegl:c2g", FALSE);
+  check_deterministic ("gegl:c2g", TRUE);
+}
+
+/* in a flat area there is nothing to stretch, stress maps it to white */
+static void
+flat (void)
+{
+  GeglColor     *color  = gegl_color_new ("rgb(0.3, 0.5, 0.7)");
+  GeglRectangle  rect   = { 0, 0, 64, 64 };
+  gfloat        *result = g_new (gfloat, 64 * 64 * 4);
+  GeglNode      *gegl   = gegl_node_new ();
+  GeglNode      *source;
+  GeglNode      *crop;
+  GeglNode      *stress;
+  gint           i, c;
+
+  source = gegl_node_new_child (gegl,
+                                "operation", "gegl:color",
+                                "value",     color,
+                                NULL);
+  crop   = gegl_node_new_child (gegl,
+                                "operation", "gegl:crop",
+                                "width",     64.0,
+                                "height",    64.0,
+                                NULL);
+  stress = gegl_node_new_child (gegl,
+                                "operation", "gegl:stress",
+                                "radius",    30,
+                                NULL);
+  gegl_node_link_many (source, crop, stress, NULL);
+
+  gegl_node_blit (stress, 1.0, &rect, babl_format ("RGBA float"), result,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (i = 0; i < 64 * 64; i++)
+    for (c = 0; c < 3; c++)
+      g_assert_cmpfloat (fabs (result[i * 4 + c] - 1.0f), <, 1e-5);
+
+  g_object_unref (gegl);
+  g_object_unref (color);
+  g_free (result);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  g_object_set (gegl_config (),
+                "use-opencl", FALSE,
+                NULL);
+
+  ADD_TEST (deterministic_stress);
+  ADD_TEST (deterministic_c2g);
+  ADD_TEST (flat);
+
+  return g_test_run ();
+}
@@ -16,8 +16,17 @@
  */
 
 
+#include <math.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
 #include <gegl.h>
 #include <gegl-buffer-backend.h>
+#include <gegl-tile-backend-file.h>
+#include <gegl-tile-backend-swap.h>
+
+#include "gegl-buffer-private.h"
 
 
 #define ADD_TEST(function) g_test_add_func ("/gegl-tile/" #function, function);
@@ -85,6 +94,809 @@ dup_tile (void)
   gegl_tile_unref (tile2);
 }
 
+static GeglBuffer *
+tile_buffer (gint width,
+             gint height)
+{
+  return g_object_new (GEGL_TYPE_BUFFER,
+                       "x",           0,
+                       "y",           0,
+                       "width",       width * 16,
+                       "height",      height * 16,
+                       "tile-width",  16,
+                       "tile-height", 16,
+                       "format",      babl_format ("Y u8"),
+                       NULL);
+}
+
+/**
+ * Tests that gegl_tile_source_get_tiles() returns the same tiles, in
+ * row-major order, as fetching them one at a time, and only fetches the
+ * missing ones.
+ **/
+static void
+get_tiles (void)
+{
+  GeglBuffer *buffer = tile_buffer (5, 3);
+  GeglTile   *tiles[4 * 2] = { NULL, };
+  guchar      data[16 * 16];
+  gint        i;
+
+  for (i = 0; i < 5 * 3; i++)
+    {
+      memset (data, i + 1, sizeof (data));
+
+      gegl_buffer_set (buffer,
+                       GEGL_RECTANGLE ((i % 5) * 16, (i / 5) * 16, 16, 16),
+                       0, babl_format ("Y u8"), data, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  gegl_buffer_flush (buffer);
+
+  tiles[3] = gegl_tile_new (16 * 16);
+  memset (gegl_tile_get_data (tiles[3]), 0, 16 * 16);
+
+  gegl_tile_source_get_tiles (GEGL_TILE_SOURCE (buffer), 1, 1, 0, 4, 2, tiles);
+
+  for (i = 0; i < 4 * 2; i++)
+    {
+      GeglTile *tile = gegl_buffer_get_tile (buffer, 1 + i % 4, 1 + i / 4, 0);
+
+      g_assert_nonnull (tiles[i]);
+
+      if (i == 3)
+        {
+          g_assert_cmpint (gegl_tile_get_data (tiles[i])[0], ==, 0);
+        }
+      else
+        {
+          g_assert_cmpint (gegl_tile_get_data (tiles[i])[0], ==,
+                           (1 + i / 4) * 5 + (1 + i % 4) + 1);
+          g_assert_cmpmem (gegl_tile_get_data (tiles[i]), 16 * 16,
+                           gegl_tile_get_data (tile), 16 * 16);
+        }
+
+      gegl_tile_unref (tile);
+      gegl_tile_unref (tiles[i]);
+    }
+
+  g_object_unref (buffer);
+}
+
+/**
+ * Tests that reading a row spanning several tiles, which fetches them as a
+ * batch, returns the pixels of every tile, including empty ones.
+ **/
+static void
+get_row (void)
+{
+  GeglBuffer *buffer = tile_buffer (40, 1);
+  guchar      row[40 * 16];
+  gint        i;
+
+  for (i = 0; i < 40; i += 3)
+    {
+      GeglColor *color = gegl_color_new (NULL);
+
+      gegl_color_set_rgba (color, 1.0, 1.0, 1.0, 1.0);
+      gegl_buffer_set_color (buffer, GEGL_RECTANGLE (i * 16, 0, 16, 16),
+                             color);
+
+      g_object_unref (color);
+    }
+
+  gegl_buffer_get (buffer, GEGL_RECTANGLE (5, 7, 40 * 16 - 10, 1), 1.0,
+                   babl_format ("Y u8"), row, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+
+  for (i = 0; i < 40 * 16 - 10; i++)
+    g_assert_cmpint (row[i], ==, ((5 + i) / 16) % 3 ? 0 : 255);
+
+  g_object_unref (buffer);
+}
+
+/**
+ * Tests that buffers filled with a single pixel read back correctly in other
+ * formats, through gegl_buffer_get() and iterators, and that writing to
+ * a part of a filled tile only changes that part.
+ **/
+static void
+uniform_tiles (void)
+{
+  GeglBuffer         *buffer = tile_buffer (4, 4);
+  GeglBufferIterator *iter;
+  gfloat              pixels[64 * 64];
+  guchar              value  = 128;
+  gint                i;
+
+  gegl_buffer_set_color_from_pixel (buffer, NULL, &value, NULL);
+
+  value = 0;
+
+  gegl_buffer_set (buffer, GEGL_RECTANGLE (20, 20, 1, 1), 0,
+                   babl_format ("Y u8"), &value, GEGL_AUTO_ROWSTRIDE);
+
+  gegl_buffer_get (buffer, NULL, 1.0, babl_format ("Y float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < 64 * 64; i++)
+    {
+      if (i == 20 * 64 + 20)
+        g_assert_cmpfloat (pixels[i], ==, 0.0f);
+      else
+        g_assert_cmpfloat (fabs (pixels[i] - 128.0f / 255.0f), <, 1e-6);
+    }
+
+  iter = gegl_buffer_iterator_new (buffer, NULL, 0, babl_format ("Y float"),
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE, 1);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data = iter->items[0].data;
+
+      for (i = 0; i < iter->length; i++)
+        {
+          if (data[i] == 0.0f)
+            g_assert_cmpint (--value, ==, 255);
+          else
+            g_assert_cmpfloat (fabs (data[i] - 128.0f / 255.0f), <, 1e-6);
+        }
+    }
+
+  g_assert_cmpint (value, ==, 255);
+
+  g_object_unref (buffer);
+}
+
+/* fills @buffer with tiles of 16x16 pixels which are all identical, but not
+ * uniform
+ */
+static void
+fill_identical_tiles (GeglBuffer *buffer)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (buffer);
+  guchar              *data;
+  gint                 x, y;
+
+  data = g_new (guchar, extent->width * extent->height);
+
+  for (y = 0; y < extent->height; y++)
+    for (x = 0; x < extent->width; x++)
+      data[y * extent->width + x] = (x % 16) + (y % 16) * 16;
+
+  gegl_buffer_set (buffer, extent, 0, babl_format ("Y u8"), data,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data);
+}
+
+/* checks that the tiles stored in @backend hold the data written by
+ * fill_identical_tiles(), except for the first pixel of the tile at
+ * (@x, @y), which is @value
+ */
+static void
+check_identical_tiles (GeglTileBackend *backend,
+                       gint             width,
+                       gint             height,
+                       gint             x,
+                       gint             y,
+                       guchar           value)
+{
+  gint i, j, k;
+
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++)
+      {
+        GeglTile     *tile;
+        const guchar *data;
+
+        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (backend), i, j, 0);
+
+        g_assert_nonnull (tile);
+
+        data = gegl_tile_get_data (tile);
+
+        for (k = 0; k < 16 * 16; k++)
+          {
+            if (i == x && j == y && k == 0)
+              g_assert_cmpint (data[k], ==, value);
+            else
+              g_assert_cmpint (data[k], ==, k);
+          }
+
+        gegl_tile_unref (tile);
+      }
+}
+
+/* removes a temporary swap directory, along with the swap files in it; the
+ * shared swap file stays open until gegl_exit(), which doesn't mind it being
+ * unlinked before.
+ */
+static void
+remove_swap_dir (const gchar *tmpdir)
+{
+  GDir        *dir = g_dir_open (tmpdir, 0, NULL);
+  const gchar *name;
+
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          gchar *path = g_build_filename (tmpdir, name, NULL);
+
+          g_unlink (path);
+          g_free (path);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_remove (tmpdir);
+}
+
+/**
+ * Tests that identical tiles of different buffers share their data in the
+ * swap when tile deduplication is enabled, and are copied on write.
+ **/
+static void
+dedup_swap (void)
+{
+  GeglTileBackend *backends[2];
+  GeglBuffer      *buffers[2];
+  gchar           *swap;
+  gchar           *tmpdir;
+  gint             hits;
+  gint             dedup_hits;
+  gint             i;
+
+  /* the tests run without a swap, give them one */
+  g_object_get (gegl_config (), "swap", &swap, NULL);
+
+  tmpdir = g_dir_make_tmp ("test-gegl-tile-XXXXXX", NULL);
+
+  g_object_set (gegl_config (),
+                "swap",       tmpdir,
+                "tile-dedup", TRUE,
+                NULL);
+  g_object_get (gegl_stats (), "swap-dedup-hits", &hits, NULL);
+
+  for (i = 0; i < 2; i++)
+    {
+      backends[i] = g_object_new (GEGL_TYPE_TILE_BACKEND_SWAP,
+                                  "tile-width",  16,
+                                  "tile-height", 16,
+                                  "format",      babl_format ("Y u8"),
+                                  NULL);
+      buffers[i]  = gegl_buffer_new_for_backend (GEGL_RECTANGLE (0, 0, 64, 64),
+                                                 backends[i]);
+
+      fill_identical_tiles (buffers[i]);
+      gegl_buffer_flush (buffers[i]);
+    }
+
+  /* all the tiles but the first one share its data */
+  g_object_get (gegl_stats (), "swap-dedup-hits", &dedup_hits, NULL);
+  g_assert_cmpint (dedup_hits - hits, ==, 2 * 16 - 1);
+
+  check_identical_tiles (backends[0], 4, 4, -1, -1, 0);
+  check_identical_tiles (backends[1], 4, 4, -1, -1, 0);
+
+  gegl_buffer_set (buffers[1], GEGL_RECTANGLE (16, 32, 1, 1), 0,
+                   babl_format ("Y u8"), (guchar []) { 42 },
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buffers[1]);
+
+  check_identical_tiles (backends[0], 4, 4, -1, -1, 0);
+  check_identical_tiles (backends[1], 4, 4, 1, 2, 42);
+
+  for (i = 0; i < 2; i++)
+    {
+      g_object_unref (buffers[i]);
+      g_object_unref (backends[i]);
+    }
+
+  g_object_set (gegl_config (),
+                "swap",       swap,
+                "tile-dedup", FALSE,
+                NULL);
+
+  remove_swap_dir (tmpdir);
+
+  g_free (swap);
+  g_free (tmpdir);
+}
+
+/**
+ * Tests that identical tiles of a buffer file share a single slot when tile
+ * deduplication is enabled, and are copied on write.
+ **/
+static void
+dedup_file (void)
+{
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+  gchar           *tmpdir;
+  gchar           *path;
+  guint64          total;
+  guint64          dedup_total;
+
+  g_object_set (gegl_config (), "tile-dedup", TRUE, NULL);
+
+  tmpdir = g_dir_make_tmp ("test-gegl-tile-XXXXXX", NULL);
+  path   = g_build_filename (tmpdir, "dedup.gegl", NULL);
+
+  buffer = g_object_new (GEGL_TYPE_BUFFER,
+                         "x",           0,
+                         "y",           0,
+                         "width",       64,
+                         "height",      64,
+                         "tile-width",  16,
+                         "tile-height", 16,
+                         "format",      babl_format ("Y u8"),
+                         "path",        path,
+                         NULL);
+
+  g_object_get (buffer, "backend", &backend, NULL);
+
+  g_assert_true (GEGL_IS_TILE_BACKEND_FILE (backend));
+
+  g_object_get (gegl_stats (), "file-dedup-total", &total, NULL);
+
+  fill_identical_tiles (buffer);
+  gegl_buffer_flush (buffer);
+
+  /* all the tiles but the first one share its slot */
+  g_object_get (gegl_stats (), "file-dedup-total", &dedup_total, NULL);
+  g_assert_cmpuint (dedup_total - total, ==, 15 * 16 * 16);
+
+  check_identical_tiles (backend, 4, 4, -1, -1, 0);
+
+  gegl_buffer_set (buffer, GEGL_RECTANGLE (48, 0, 1, 1), 0,
+                   babl_format ("Y u8"), (guchar []) { 42 },
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buffer);
+
+  g_object_get (gegl_stats (), "file-dedup-total", &dedup_total, NULL);
+  g_assert_cmpuint (dedup_total - total, ==, 14 * 16 * 16);
+
+  check_identical_tiles (backend, 4, 4, 3, 0, 42);
+
+  g_object_unref (buffer);
+  g_object_unref (backend);
+
+  g_unlink (path);
+  g_remove (tmpdir);
+
+  g_free (path);
+  g_free (tmpdir);
+
+  g_object_set (gegl_config (), "tile-dedup", FALSE, NULL);
+}
+
+/**
+ * Tests that tiles allocated from huge-page backed, per-node blocks hold
+ * their data.
+ **/
+static void
+alloc_options (void)
+{
+  GeglBuffer *buffers[2];
+  gint        n_nodes;
+  gint        i;
+
+  g_object_set (gegl_config (),
+                "tile-alloc-huge-pages", TRUE,
+                "tile-alloc-numa",       TRUE,
+                NULL);
+
+  g_object_get (gegl_stats (), "tile-alloc-numa-nodes", &n_nodes, NULL);
+  g_assert_cmpint (n_nodes, >=, 1);
+
+  for (i = 0; i < 2; i++)
+    {
+      buffers[i] = tile_buffer (8, 8);
+
+      fill_identical_tiles (buffers[i]);
+    }
+
+  g_object_unref (buffers[0]);
+
+  for (i = 0; i < 8; i++)
+    {
+      guchar data[16 * 16];
+      gint   k;
+
+      gegl_buffer_get (buffers[1], GEGL_RECTANGLE (16 * i, 16 * (7 - i), 16, 16),
+                       1.0, babl_format ("Y u8"), data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      for (k = 0; k < 16 * 16; k++)
+        g_assert_cmpint (data[k], ==, k);
+    }
+
+  g_object_unref (buffers[1]);
+
+  g_object_set (gegl_config (),
+                "tile-alloc-huge-pages", FALSE,
+                "tile-alloc-numa",       FALSE,
+                NULL);
+}
+
+/**
+ * Tests that the tile cache keeps the tiles of a buffer which is expensive
+ * to compute over those of cheaper buffers which were used more recently.
+ **/
+static void
+cache_cost (void)
+{
+  GeglBuffer *expensive;
+  GeglBuffer *cheap;
+  GeglBuffer *recent;
+  guint64     cache_size;
+  gint        spared_before;
+  gint        spared_after;
+  gint        n_cached = 0;
+  gint        x, y;
+
+  g_object_get (gegl_config (), "tile-cache-size", &cache_size, NULL);
+  g_object_set (gegl_config (), "tile-cache-size", (guint64) 32 * 16 * 16, NULL);
+
+  g_object_get (gegl_stats (), "tile-cache-spared", &spared_before, NULL);
+
+  /* about 4ms per tile */
+  expensive = tile_buffer (2, 2);
+  gegl_buffer_set_pixel_cost (expensive, 0.004 / (16 * 16));
+  fill_identical_tiles (expensive);
+
+  cheap = tile_buffer (4, 2);
+  fill_identical_tiles (cheap);
+
+  recent = tile_buffer (6, 4);
+  fill_identical_tiles (recent);
+
+  for (y = 0; y < 2; y++)
+    for (x = 0; x < 2; x++)
+      g_assert (gegl_tile_source_is_cached (GEGL_TILE_SOURCE (expensive),
+                                            x, y, 0));
+
+  for (y = 0; y < 2; y++)
+    for (x = 0; x < 4; x++)
+      n_cached += gegl_tile_source_is_cached (GEGL_TILE_SOURCE (cheap),
+                                              x, y, 0);
+
+  g_assert_cmpint (n_cached, <, 8);
+
+  g_object_get (gegl_stats (), "tile-cache-spared", &spared_after, NULL);
+  g_assert_cmpint (spared_after, >, spared_before);
+
+  g_object_unref (recent);
+  g_object_unref (cheap);
+  g_object_unref (expensive);
+
+  g_object_set (gegl_config (), "tile-cache-size", cache_size, NULL);
+}
+
+/**
+ * Tests that a tile which is read repeatedly through the storage index,
+ * without the storage mutex, stays in the cache while other tiles push the
+ * cache over its size, and that the reads count as cache hits.
+ **/
+static void
+cache_recency (void)
+{
+  GeglBuffer *hot;
+  GeglBuffer *cold;
+  GeglTile   *tile;
+  guint64     cache_size;
+  guchar      data[16 * 16];
+  gint        hits_before;
+  gint        hits_after;
+  gint        misses_before;
+  gint        misses_after;
+  gint        i;
+
+  g_object_get (gegl_config (), "tile-cache-size", &cache_size, NULL);
+  g_object_set (gegl_config (), "tile-cache-size", (guint64) 8 * 16 * 16, NULL);
+
+  hot  = tile_buffer (1, 1);
+  cold = tile_buffer (64, 1);
+
+  memset (data, 1, sizeof (data));
+  gegl_buffer_set (hot, GEGL_RECTANGLE (0, 0, 16, 16),
+                   0, babl_format ("Y u8"), data, GEGL_AUTO_ROWSTRIDE);
+
+  for (i = 0; i < 64; i++)
+    {
+      memset (data, i + 2, sizeof (data));
+      gegl_buffer_set (cold, GEGL_RECTANGLE (i * 16, 0, 16, 16),
+                       0, babl_format ("Y u8"), data, GEGL_AUTO_ROWSTRIDE);
+
+      /* the hot tile is never evicted, and never has to be fetched from
+       * the backend again
+       */
+      g_object_get (gegl_stats (), "tile-cache-misses", &misses_before, NULL);
+      tile = gegl_buffer_get_tile (hot, 0, 0, 0);
+      g_object_get (gegl_stats (), "tile-cache-misses", &misses_after, NULL);
+
+      g_assert_cmpint (misses_after, ==, misses_before);
+      gegl_tile_unref (tile);
+    }
+
+  g_assert (gegl_tile_source_is_cached (GEGL_TILE_SOURCE (hot), 0, 0, 0));
+
+  g_object_get (gegl_stats (), "tile-cache-hits", &hits_before, NULL);
+
+  for (i = 0; i < 16; i++)
+    {
+      tile = gegl_buffer_get_tile (hot, 0, 0, 0);
+      g_assert_cmpint (gegl_tile_get_data (tile)[0], ==, 1);
+      gegl_tile_unref (tile);
+    }
+
+  g_object_get (gegl_stats (), "tile-cache-hits", &hits_after, NULL);
+  g_assert_cmpint (hits_after - hits_before, ==, 16);
+
+  g_object_unref (cold);
+  g_object_unref (hot);
+
+  g_object_set (gegl_config (), "tile-cache-size", cache_size, NULL);
+}
+
+/* fills @buffer with tiles whose rows are flat, which compress well */
+static void
+fill_striped_tiles (GeglBuffer *buffer)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (buffer);
+  guchar              *data;
+  gint                 x, y;
+
+  data = g_new (guchar, extent->width * extent->height);
+
+  for (y = 0; y < extent->height; y++)
+    for (x = 0; x < extent->width; x++)
+      data[y * extent->width + x] = (y % 16) + 1;
+
+  gegl_buffer_set (buffer, extent, 0, babl_format ("Y u8"), data,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data);
+}
+
+static void
+check_striped_tiles (GeglTileBackend *backend,
+                     gint             width,
+                     gint             height)
+{
+  gint i, j, k;
+
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++)
+      {
+        GeglTile     *tile;
+        const guchar *data;
+
+        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (backend), i, j, 0);
+
+        g_assert_nonnull (tile);
+
+        data = gegl_tile_get_data (tile);
+
+        for (k = 0; k < 16 * 16; k++)
+          g_assert_cmpint (data[k], ==, k / 16 + 1);
+
+        gegl_tile_unref (tile);
+      }
+}
+
+static void
+wait_for_swap (void)
+{
+  gboolean busy;
+
+  do
+    {
+      g_usleep (1000);
+
+      g_object_get (gegl_stats (), "swap-busy", &busy, NULL);
+    }
+  while (busy);
+}
+
+/**
+ * Tests that compressed tiles are kept in memory by the swap, up to
+ * swap-ram-size, and are written to the swap file past it.
+ **/
+static void
+swap_ram (void)
+{
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+  gchar           *swap;
+  gchar           *tmpdir;
+  guint64          ram_total;
+  gint             ram_hits[2];
+  gint             disk_hits[2];
+
+  g_object_get (gegl_config (), "swap", &swap, NULL);
+
+  tmpdir = g_dir_make_tmp ("test-gegl-tile-XXXXXX", NULL);
+
+  g_object_set (gegl_config (),
+                "swap",          tmpdir,
+                "swap-ram-size", (guint64) 1024 * 1024,
+                NULL);
+
+  backend = g_object_new (GEGL_TYPE_TILE_BACKEND_SWAP,
+                          "tile-width",  16,
+                          "tile-height", 16,
+                          "format",      babl_format ("Y u8"),
+                          NULL);
+  buffer  = gegl_buffer_new_for_backend (GEGL_RECTANGLE (0, 0, 64, 64),
+                                         backend);
+
+  fill_striped_tiles (buffer);
+  gegl_buffer_flush (buffer);
+  wait_for_swap ();
+
+  g_object_get (gegl_stats (),
+                "swap-ram-total", &ram_total,
+                "swap-ram-hits",  &ram_hits[0],
+                "swap-disk-hits", &disk_hits[0],
+                NULL);
+
+  g_assert_cmpuint (ram_total, >, 0);
+  g_assert_cmpuint (ram_total, <, 16 * 16 * 16);
+
+  check_striped_tiles (backend, 4, 4);
+
+  g_object_get (gegl_stats (),
+                "swap-ram-hits",  &ram_hits[1],
+                "swap-disk-hits", &disk_hits[1],
+                NULL);
+
+  g_assert_cmpint (ram_hits[1] - ram_hits[0], ==, 16);
+  g_assert_cmpint (disk_hits[1], ==, disk_hits[0]);
+
+  /* shrinking the tier spills it to the swap file on the next write */
+  g_object_set (gegl_config (), "swap-ram-size", (guint64) 1, NULL);
+
+  gegl_buffer_set (buffer, GEGL_RECTANGLE (0, 0, 1, 1), 0,
+                   babl_format ("Y u8"), (guchar []) { 1 },
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buffer);
+  wait_for_swap ();
+
+  g_object_get (gegl_stats (), "swap-ram-total", &ram_total, NULL);
+  g_assert_cmpuint (ram_total, ==, 0);
+
+  check_striped_tiles (backend, 4, 4);
+
+  g_object_get (gegl_stats (), "swap-disk-hits", &disk_hits[1], NULL);
+  g_assert_cmpint (disk_hits[1] - disk_hits[0], ==, 16);
+
+  g_object_unref (buffer);
+  g_object_unref (backend);
+
+  g_object_set (gegl_config (),
+                "swap",          swap,
+                "swap-ram-size", (guint64) 0,
+                NULL);
+
+  remove_swap_dir (tmpdir);
+
+  g_free (swap);
+  g_free (tmpdir);
+}
+
+static GeglBuffer *
+noise_swap_buffer (GeglTileBackend **backend,
+                   gint              width,
+                   gint              height,
+                   guint32           seed)
+{
+  GeglBuffer *buffer;
+  GRand      *rand = g_rand_new_with_seed (seed);
+  guint32    *data;
+  gint        i;
+
+  *backend = g_object_new (GEGL_TYPE_TILE_BACKEND_SWAP,
+                           "tile-width",  128,
+                           "tile-height", 128,
+                           "format",      babl_format ("RGBA u8"),
+                           NULL);
+  buffer   = gegl_buffer_new_for_backend (
+               GEGL_RECTANGLE (0, 0, width * 128, height * 128), *backend);
+
+  data = g_new (guint32, width * 128 * height * 128);
+
+  for (i = 0; i < width * 128 * height * 128; i++)
+    data[i] = g_rand_int (rand);
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("RGBA u8"), data,
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buffer);
+
+  g_free (data);
+  g_rand_free (rand);
+
+  return buffer;
+}
+
+/**
+ * Tests that the swap file is compacted and truncated once most of it is
+ * freed, keeping the data of the remaining tiles.
+ **/
+static void
+swap_compact (void)
+{
+  GeglTileBackend *backends[2];
+  GeglBuffer      *buffers[2];
+  gchar           *swap;
+  gchar           *tmpdir;
+  guint64          file_size;
+  guint64          total;
+  gint             i, j;
+
+  g_object_get (gegl_config (), "swap", &swap, NULL);
+
+  tmpdir = g_dir_make_tmp ("test-gegl-tile-XXXXXX", NULL);
+
+  g_object_set (gegl_config (), "swap", tmpdir, NULL);
+
+  /* 4MB of incompressible tiles, followed by 2MB */
+  buffers[0] = noise_swap_buffer (&backends[0], 8, 8, 0);
+  wait_for_swap ();
+
+  buffers[1] = noise_swap_buffer (&backends[1], 8, 4, 1);
+  wait_for_swap ();
+
+  g_object_get (gegl_stats (), "swap-file-size", &file_size, NULL);
+  g_assert_cmpuint (file_size, >=, 96 * 128 * 128 * 4);
+
+  g_object_unref (buffers[0]);
+  g_object_unref (backends[0]);
+  wait_for_swap ();
+
+  g_object_get (gegl_stats (),
+                "swap-file-size", &file_size,
+                "swap-total",     &total,
+                NULL);
+  g_assert_cmpuint (total,     ==, 32 * 128 * 128 * 4);
+  g_assert_cmpuint (file_size, ==, total);
+
+  for (j = 0; j < 4; j++)
+    for (i = 0; i < 8; i++)
+      {
+        GeglTile *tile;
+        guint32  *data = g_new (guint32, 128 * 128);
+
+        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (backends[1]),
+                                          i, j, 0);
+
+        g_assert_nonnull (tile);
+
+        gegl_buffer_get (buffers[1],
+                         GEGL_RECTANGLE (128 * i, 128 * j, 128, 128), 1.0,
+                         babl_format ("RGBA u8"), data,
+                         GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+        g_assert (! memcmp (gegl_tile_get_data (tile), data, 128 * 128 * 4));
+
+        gegl_tile_unref (tile);
+        g_free (data);
+      }
+
+  g_object_unref (buffers[1]);
+  g_object_unref (backends[1]);
+
+  g_object_set (gegl_config (), "swap", swap, NULL);
+
+  remove_swap_dir (tmpdir);
+
+  g_free (swap);
+  g_free (tmpdir);
+}
+
 int
 main (int    argc,
       char **argv)
@@ -95,6 +907,16 @@ main (int    argc,
   ADD_TEST (set_unlock_notify);
   ADD_TEST (set_data_full);
   ADD_TEST (dup_tile);
+  ADD_TEST (get_tiles);
+  ADD_TEST (get_row);
+  ADD_TEST (uniform_tiles);
+  ADD_TEST (dedup_swap);
+  ADD_TEST (dedup_file);
+  ADD_TEST (alloc_options);
+  ADD_TEST (cache_cost);
+  ADD_TEST (cache_recency);
+  ADD_TEST (swap_ram);
+  ADD_TEST (swap_compact);
 
   return g_test_run ();
 }
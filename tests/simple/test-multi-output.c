@@ -0,0 +1,130 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-multi-output/" #function, function);
+
+static GeglNode *
+create_split (GeglNode **gegl)
+{
+  GeglColor *color = gegl_color_new ("rgba(0.2, 0.4, 0.6, 0.5)");
+  GeglNode  *source;
+  GeglNode  *crop;
+  GeglNode  *split;
+
+  *gegl  = gegl_node_new ();
+  source = gegl_node_new_child (*gegl,
+                                "operation", "gegl:color",
+                                "value",     color,
+                                NULL);
+  crop   = gegl_node_new_child (*gegl,
+                                "operation", "gegl:crop",
+                                "width",     64.0,
+                                "height",    64.0,
+                                NULL);
+  split  = gegl_node_new_child (*gegl,
+                                "operation", "gegl:split-alpha",
+                                NULL);
+  gegl_node_link_many (source, crop, split, NULL);
+
+  g_object_unref (color);
+
+  return split;
+}
+
+static void
+both_outputs (void)
+{
+  GeglRectangle  rect = { 0, 0, 64, 64 };
+  GeglNode      *gegl;
+  GeglNode      *split = create_split (&gegl);
+  GeglNode      *multiply;
+  gfloat        *pixels;
+  gint           i;
+
+  g_assert (gegl_node_has_pad (split, "output"));
+  g_assert (gegl_node_has_pad (split, "alpha"));
+
+  /* color multiplied by alpha, with both coming from the same node */
+  multiply = gegl_node_new_child (gegl,
+                                  "operation", "gegl:multiply",
+                                  NULL);
+  gegl_node_connect_from (multiply, "input", split, "output");
+  gegl_node_connect_from (multiply, "aux",   split, "alpha");
+
+  pixels = g_new (gfloat, rect.width * rect.height * 4);
+
+  gegl_node_blit (multiply, 1.0, &rect, babl_format ("RGBA float"),
+                  pixels, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (i = 0; i < rect.width * rect.height; i++)
+    {
+      g_assert_cmpfloat (fabs (pixels[i * 4 + 0] - 0.1f), <, 0.001);
+      g_assert_cmpfloat (fabs (pixels[i * 4 + 1] - 0.2f), <, 0.001);
+      g_assert_cmpfloat (fabs (pixels[i * 4 + 2] - 0.3f), <, 0.001);
+      g_assert_cmpfloat (fabs (pixels[i * 4 + 3] - 1.0f), <, 0.001);
+    }
+
+  g_free (pixels);
+  g_object_unref (gegl);
+}
+
+static void
+single_output (void)
+{
+  GeglRectangle  rect = { 0, 0, 64, 64 };
+  GeglNode      *gegl;
+  GeglNode      *split = create_split (&gegl);
+  GeglNode      *nop;
+  gfloat         pixel[1];
+
+  /* only the extra output is consumed */
+  nop = gegl_node_new_child (gegl,
+                             "operation", "gegl:nop",
+                             NULL);
+  gegl_node_connect_from (nop, "input", split, "alpha");
+
+  gegl_node_blit (nop, 1.0, GEGL_RECTANGLE (10, 10, 1, 1),
+                  babl_format ("Y float"), pixel,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  g_assert_cmpfloat (fabs (pixel[0] - 0.5f), <, 0.001);
+
+  /* and again, after the main output has been cached */
+  gegl_node_blit (split, 1.0, &rect, babl_format ("RGBA float"),
+                  NULL, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_CACHE);
+  gegl_node_blit (nop, 1.0, GEGL_RECTANGLE (20, 20, 1, 1),
+                  babl_format ("Y float"), pixel,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  g_assert_cmpfloat (fabs (pixel[0] - 0.5f), <, 0.001);
+
+  g_object_unref (gegl);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (both_outputs);
+  ADD_TEST (single_output);
+
+  return g_test_run ();
+}
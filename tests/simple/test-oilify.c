@@ -0,0 +1,173 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-oilify/" #function, function);
+
+#define WIDTH   150
+#define HEIGHT  110
+
+static GeglBuffer *
+create_noise (void)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&rect, format);
+  gfloat        *image  = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand         *rand   = g_rand_new_with_seed (23);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    image[i] = g_rand_double (rand);
+
+  gegl_buffer_set (buffer, &rect, 0, format, image, GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (image);
+
+  return buffer;
+}
+
+/* render oilify, with the radius buffer on aux set to 1.0 everywhere when
+ * full_radius_aux is set, which makes the operation build the histogram of
+ * every pixel separately rather than sliding it.
+ */
+static gfloat *
+render (GeglBuffer *input,
+        gint        radius,
+        gboolean    use_inten,
+        gboolean    full_radius_aux)
+{
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  gfloat        *result = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GeglNode      *gegl   = gegl_node_new ();
+  GeglNode      *source;
+  GeglNode      *oilify;
+
+  source = gegl_node_new_child (gegl,
+                                "operation",   "gegl:buffer-source",
+                                "buffer",      input,
+                                NULL);
+  oilify = gegl_node_new_child (gegl,
+                                "operation",   "gegl:oilify",
+                                "mask-radius", radius,
+                                "use-inten",   use_inten,
+                                NULL);
+  gegl_node_link (source, oilify);
+
+  if (full_radius_aux)
+    {
+      GeglColor *white = gegl_color_new ("white");
+      GeglNode  *color;
+
+      color = gegl_node_new_child (gegl,
+                                   "operation", "gegl:color",
+                                   "value",     white,
+                                   NULL);
+      gegl_node_connect (color, "output", oilify, "aux");
+
+      g_object_unref (white);
+    }
+
+  gegl_node_blit (oilify, 1.0, &rect, babl_format ("RGBA float"), result,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (gegl);
+
+  return result;
+}
+
+static void
+check_sliding (gint     radius,
+               gboolean use_inten)
+{
+  GeglBuffer *input   = create_noise ();
+  gfloat     *sliding = render (input, radius, use_inten, FALSE);
+  gfloat     *direct  = render (input, radius, use_inten, TRUE);
+
+  g_assert (memcmp (sliding, direct,
+                    WIDTH * HEIGHT * 4 * sizeof (gfloat)) == 0);
+
+  g_object_unref (input);
+  g_free (sliding);
+  g_free (direct);
+}
+
+static void
+sliding_histogram (void)
+{
+  check_sliding (1, FALSE);
+  check_sliding (7, FALSE);
+  check_sliding (20, FALSE);
+}
+
+static void
+sliding_histogram_inten (void)
+{
+  check_sliding (1, TRUE);
+  check_sliding (7, TRUE);
+  check_sliding (20, TRUE);
+}
+
+/* in intensity mode, a flat area keeps its color, the fixed point sums of
+ * the histogram are rounded rather than truncated
+ */
+static void
+flat_inten (void)
+{
+  const Babl    *format = babl_format ("RGBA float");
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglColor     *color  = gegl_color_new ("rgba(0.3, 0.6, 0.9, 1.0)");
+  GeglBuffer    *input  = gegl_buffer_new (&rect, format);
+  gfloat         pixel[4];
+  gfloat        *result;
+  gint           i, c;
+
+  gegl_buffer_set_color (input, &rect, color);
+  gegl_color_get_pixel (color, format, pixel);
+
+  result = render (input, 7, TRUE, FALSE);
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    for (c = 0; c < 4; c++)
+      g_assert_cmpfloat (fabs (result[i * 4 + c] - pixel[c]), <, 1e-6);
+
+  g_object_unref (input);
+  g_object_unref (color);
+  g_free (result);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  g_object_set (gegl_config (),
+                "use-opencl", FALSE,
+                NULL);
+
+  ADD_TEST (sliding_histogram);
+  ADD_TEST (sliding_histogram_inten);
+  ADD_TEST (flat_inten);
+
+  return g_test_run ();
+}
@@ -0,0 +1,117 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-parallel-reduce/" #function, function);
+
+typedef struct
+{
+  gint64  n_pixels;
+  gdouble sum;
+  gint    min_x;
+} Moments;
+
+static void
+moments_area (const GeglRectangle *area,
+              Moments             *partial,
+              gpointer             user_data)
+{
+  gint x, y;
+
+  partial->n_pixels += (gint64) area->width * area->height;
+  partial->min_x     = MIN (partial->min_x, area->x);
+
+  for (y = area->y; y < area->y + area->height; y++)
+    for (x = area->x; x < area->x + area->width; x++)
+      partial->sum += sin (x * 0.1) * cos (y * 0.37) * 1e-3;
+}
+
+static void
+moments_merge (Moments       *result,
+               const Moments *partial,
+               gpointer       user_data)
+{
+  result->n_pixels += partial->n_pixels;
+  result->sum      += partial->sum;
+  result->min_x     = MIN (result->min_x, partial->min_x);
+}
+
+static Moments
+reduce (const GeglRectangle *area)
+{
+  Moments moments = { 0, 0.0, G_MAXINT };
+
+  /* a low thread cost, to use all the threads */
+  gegl_parallel_reduce_area (area, NULL, 1.0, sizeof (Moments),
+                             (GeglParallelReduceAreaFunc) moments_area,
+                             (GeglParallelMergeFunc) moments_merge,
+                             &moments, NULL);
+
+  return moments;
+}
+
+static void
+coverage (void)
+{
+  GeglRectangle area    = { -1000, -77, 3001, 1234 };
+  Moments       moments = reduce (&area);
+
+  g_assert_cmpint (moments.n_pixels, ==, (gint64) area.width * area.height);
+  g_assert_cmpint (moments.min_x, ==, area.x);
+}
+
+static void
+deterministic (void)
+{
+  GeglRectangle area = { 13, 17, 2000, 1500 };
+  Moments       single;
+  Moments       multi;
+  gint          tile_width;
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+  single = reduce (&area);
+
+  g_object_set (gegl_config (), "threads", 4, NULL);
+  multi = reduce (&area);
+
+  /* bit-exact, regardless of the number of threads */
+  g_assert (single.sum == multi.sum);
+  g_assert_cmpint (single.n_pixels, ==, multi.n_pixels);
+
+  /* ... and of the configured tile size */
+  g_object_get (gegl_config (), "tile-width", &tile_width, NULL);
+  g_object_set (gegl_config (), "tile-width", 32, NULL);
+  multi = reduce (&area);
+  g_object_set (gegl_config (), "tile-width", tile_width, NULL);
+
+  g_assert (single.sum == multi.sum);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (coverage);
+  ADD_TEST (deterministic);
+
+  return g_test_run ();
+}
@@ -0,0 +1,242 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-processor/" #function, function);
+
+typedef struct
+{
+  gint          n_coarse;
+  gint          n_refined;
+  GeglRectangle first_refined;
+} ComputedData;
+
+static void
+computed_cb (GeglProcessor *processor,
+             GeglRectangle *rect,
+             gint           level,
+             ComputedData  *data)
+{
+  if (level > 0)
+    {
+      data->n_coarse++;
+    }
+  else
+    {
+      if (data->n_refined == 0)
+        data->first_refined = *rect;
+      data->n_refined++;
+    }
+}
+
+static GeglNode *
+create_graph (GeglNode **gegl)
+{
+  GeglColor *color = gegl_color_new ("rgb(0.5, 0.25, 1.0)");
+  GeglNode  *source;
+  GeglNode  *crop;
+
+  *gegl  = gegl_node_new ();
+  source = gegl_node_new_child (*gegl,
+                                "operation", "gegl:color",
+                                "value",     color,
+                                NULL);
+  crop   = gegl_node_new_child (*gegl,
+                                "operation", "gegl:crop",
+                                "width",     512.0,
+                                "height",    512.0,
+                                NULL);
+  gegl_node_link (source, crop);
+
+  g_object_unref (color);
+
+  return crop;
+}
+
+static void
+refine_order (void)
+{
+  GeglRectangle  rect = { 0, 0, 512, 512 };
+  ComputedData   data = { 0, };
+  GeglNode      *gegl;
+  GeglNode      *node = create_graph (&gegl);
+  GeglProcessor *processor;
+  gfloat         pixel[4];
+
+  g_object_set (gegl_config (), "mipmap-rendering", TRUE, NULL);
+
+  processor = gegl_node_new_processor (node, &rect);
+  gegl_processor_set_progressive (processor, 2);
+  gegl_processor_set_priority_center (processor, 500, 500);
+
+  g_signal_connect (processor, "computed", G_CALLBACK (computed_cb), &data);
+
+  while (gegl_processor_work (processor, NULL));
+
+  g_assert_cmpint (data.n_coarse, ==, 1);
+  g_assert_cmpint (data.n_refined, >, 0);
+  g_assert (data.first_refined.x <= 500 &&
+            data.first_refined.x + data.first_refined.width > 500);
+  g_assert (data.first_refined.y <= 500 &&
+            data.first_refined.y + data.first_refined.height > 500);
+
+  gegl_buffer_sample (gegl_processor_get_buffer (processor), 10, 10, NULL,
+                      pixel, babl_format ("RGBA float"),
+                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  g_assert_cmpfloat (fabs (pixel[1] - 0.25f), <, 0.001);
+
+  g_object_unref (processor);
+  g_object_unref (gegl);
+
+  g_object_set (gegl_config (), "mipmap-rendering", FALSE, NULL);
+}
+
+static void
+cancel (void)
+{
+  GeglRectangle  rect = { 0, 0, 512, 512 };
+  ComputedData   data = { 0, };
+  GeglNode      *gegl;
+  GeglNode      *node = create_graph (&gegl);
+  GeglProcessor *processor;
+
+  g_object_set (gegl_config (), "mipmap-rendering", TRUE, NULL);
+
+  processor = gegl_node_new_processor (node, &rect);
+  gegl_processor_set_progressive (processor, 2);
+
+  g_signal_connect (processor, "computed", G_CALLBACK (computed_cb), &data);
+
+  /* run the coarse pass, which also refines the first tile */
+  while (data.n_coarse == 0 && gegl_processor_work (processor, NULL));
+
+  gegl_processor_cancel_refinement (processor);
+  g_assert (! gegl_processor_work (processor, NULL));
+  g_assert_cmpint (data.n_refined, <=, 1);
+
+  g_object_unref (processor);
+  g_object_unref (gegl);
+
+  g_object_set (gegl_config (), "mipmap-rendering", FALSE, NULL);
+}
+
+static void
+set_green (GeglNode *node,
+           gdouble   green)
+{
+  GeglNode  *source = gegl_node_get_producer (node, "input", NULL);
+  GeglColor *color  = gegl_color_new (NULL);
+
+  gegl_color_set_rgba (color, 0.5, green, 1.0, 1.0);
+  gegl_node_set (source, "value", color, NULL);
+
+  g_object_unref (color);
+}
+
+static void
+check_green (GeglProcessor *processor,
+             gint           x,
+             gint           y,
+             gfloat         green)
+{
+  gfloat pixel[4];
+
+  gegl_buffer_sample (gegl_processor_get_buffer (processor), x, y, NULL,
+                      pixel, babl_format ("RGBA float"),
+                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  g_assert_cmpfloat (fabs (pixel[1] - green), <, 0.001);
+}
+
+static void
+invalidate (void)
+{
+  GeglRectangle  rect = { 0, 0, 512, 512 };
+  ComputedData   data = { 0, };
+  GeglNode      *gegl;
+  GeglNode      *node = create_graph (&gegl);
+  GeglProcessor *processor;
+  gint           tile_width;
+  gint           tile_height;
+  gint           n_tiles;
+
+  g_object_set (gegl_config (), "mipmap-rendering", TRUE, NULL);
+
+  processor = gegl_node_new_processor (node, &rect);
+  gegl_processor_set_progressive (processor, 2);
+  gegl_processor_set_priority_center (processor, 500, 500);
+
+  g_signal_connect (processor, "computed", G_CALLBACK (computed_cb), &data);
+
+  g_object_get (gegl_processor_get_buffer (processor),
+                "tile-width",  &tile_width,
+                "tile-height", &tile_height,
+                NULL);
+  n_tiles = ((512 + tile_width  - 1) / tile_width) *
+            ((512 + tile_height - 1) / tile_height);
+
+  /* run the coarse pass, which also refines the first tile */
+  while (data.n_coarse == 0 && gegl_processor_work (processor, NULL));
+  g_assert_cmpint (data.n_refined, ==, 1);
+
+  /* invalidating mid-refinement requeues the refined tile as well */
+  set_green (node, 0.75);
+
+  data = (ComputedData) { 0, };
+  while (gegl_processor_work (processor, NULL));
+
+  g_assert_cmpint (data.n_coarse, ==, 0);
+  g_assert_cmpint (data.n_refined, ==, n_tiles);
+  g_assert (data.first_refined.x <= 500 &&
+            data.first_refined.x + data.first_refined.width > 500);
+  g_assert (data.first_refined.y <= 500 &&
+            data.first_refined.y + data.first_refined.height > 500);
+  check_green (processor, 500, 500, 0.75f);
+  check_green (processor, 10, 10, 0.75f);
+
+  /* invalidating once the refinement is done renders the tiles again */
+  set_green (node, 0.5);
+
+  data = (ComputedData) { 0, };
+  g_assert (gegl_processor_work (processor, NULL));
+  while (gegl_processor_work (processor, NULL));
+
+  g_assert_cmpint (data.n_coarse, ==, 0);
+  g_assert_cmpint (data.n_refined, ==, n_tiles);
+  check_green (processor, 500, 500, 0.5f);
+  check_green (processor, 10, 10, 0.5f);
+
+  g_object_unref (processor);
+  g_object_unref (gegl);
+
+  g_object_set (gegl_config (), "mipmap-rendering", FALSE, NULL);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (refine_order);
+  ADD_TEST (cancel);
+  ADD_TEST (invalidate);
+
+  return g_test_run ();
+}
@@ -0,0 +1,250 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+#include "gegl-plugin.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-summed-area-table/" #function, function);
+
+/* the sums of every rectangle around a small grid, partly outside of it
+ * too, match the sums of its pixels
+ */
+static void
+sums (void)
+{
+  const Babl          *format = babl_format ("RGBA float");
+  GeglRectangle        grid   = { -1, 2, 4, 3 };
+  gfloat               data[3 * 4 * 4];
+  GeglBuffer          *buffer = gegl_buffer_new (&grid, format);
+  GeglSummedAreaTable *table;
+  GeglRectangle        rect;
+  gint                 i, c;
+
+  for (i = 0; i < 3 * 4; i++)
+    for (c = 0; c < 4; c++)
+      data[i * 4 + c] = i + 0.25f * c;
+
+  gegl_buffer_set (buffer, &grid, 0, format, data, GEGL_AUTO_ROWSTRIDE);
+
+  table = gegl_summed_area_table_new (buffer, NULL, format, TRUE);
+
+  g_assert_cmpint (gegl_summed_area_table_get_n_components (table), ==, 4);
+
+  for (rect.y = grid.y - 1; rect.y <= grid.y + grid.height; rect.y++)
+    for (rect.x = grid.x - 1; rect.x <= grid.x + grid.width; rect.x++)
+      for (rect.height = 0; rect.height <= grid.height + 1; rect.height++)
+        for (rect.width = 0; rect.width <= grid.width + 1; rect.width++)
+          {
+            GeglRectangle inside;
+            gdouble       sum[8];
+            gdouble       expected[8] = { 0.0, };
+            gint64        n_pixels    = 0;
+            gint          x, y;
+
+            if (gegl_rectangle_intersect (&inside, &rect, &grid))
+              {
+                for (y = inside.y; y < inside.y + inside.height; y++)
+                  for (x = inside.x; x < inside.x + inside.width; x++)
+                    {
+                      const gfloat *pixel;
+
+                      pixel = data + ((y - grid.y) * grid.width +
+                                      (x - grid.x)) * 4;
+
+                      for (c = 0; c < 4; c++)
+                        {
+                          expected[c]     += pixel[c];
+                          expected[4 + c] += pixel[c] * pixel[c];
+                        }
+                    }
+
+                n_pixels = (gint64) inside.width * inside.height;
+              }
+
+            g_assert_cmpint (gegl_summed_area_table_get_sum (table, &rect, sum),
+                             ==, n_pixels);
+
+            for (c = 0; c < 8; c++)
+              g_assert_cmpfloat (fabs (sum[c] - expected[c]), <, 1e-6);
+          }
+
+  gegl_summed_area_table_unref (table);
+  g_object_unref (buffer);
+}
+
+static void
+mean_and_variance (void)
+{
+  const Babl          *format = babl_format ("Y float");
+  GeglRectangle        rect   = { 0, 0, 4, 1 };
+  gfloat               data[] = { 1.0, 2.0, 3.0, 6.0 };
+  GeglBuffer          *buffer = gegl_buffer_new (&rect, format);
+  GeglSummedAreaTable *table;
+  gdouble              mean;
+  gdouble              variance;
+
+  gegl_buffer_set (buffer, &rect, 0, format, data, GEGL_AUTO_ROWSTRIDE);
+
+  table = gegl_summed_area_table_new (buffer, NULL, format, TRUE);
+
+  g_assert_cmpint (gegl_summed_area_table_get_variance (table, &rect,
+                                                        &mean, &variance),
+                   ==, 4);
+  g_assert_cmpfloat (fabs (mean - 3.0), <, 1e-9);
+  g_assert_cmpfloat (fabs (variance - 3.5), <, 1e-9);
+
+  g_assert_cmpint (gegl_summed_area_table_get_mean (table,
+                                                    GEGL_RECTANGLE (2, -5, 10, 10),
+                                                    &mean),
+                   ==, 2);
+  g_assert_cmpfloat (fabs (mean - 4.5), <, 1e-9);
+
+  g_assert_cmpint (gegl_summed_area_table_get_mean (table,
+                                                    GEGL_RECTANGLE (10, 0, 3, 3),
+                                                    &mean),
+                   ==, 0);
+  g_assert_cmpfloat (mean, ==, 0.0);
+
+  gegl_summed_area_table_unref (table);
+  g_object_unref (buffer);
+}
+
+typedef struct
+{
+  GeglSummedAreaTable *table;
+  GeglRectangle        extent;
+  GeglRectangle        white;
+  gint                 n_errors;
+} ThreadData;
+
+/* queries rectangles crossing the tiles of the table, the sum of each is
+ * the area it shares with the white rectangle
+ */
+static void
+query_rects (gsize       offset,
+             gsize       size,
+             ThreadData *data)
+{
+  gsize i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      GeglRectangle rect;
+      GeglRectangle inside;
+      gdouble       sum;
+
+      rect.x      = data->extent.x - 20 + (gint) (i * 37 % 320);
+      rect.y      = data->extent.y - 20 + (gint) (i * 53 % 220);
+      rect.width  = (gint) (i * 71 % 300);
+      rect.height = (gint) (i * 29 % 200);
+
+      gegl_summed_area_table_get_sum (data->table, &rect, &sum);
+
+      gegl_rectangle_intersect (&inside, &rect, &data->white);
+
+      if (fabs (sum - (gdouble) inside.width * inside.height) > 1e-6)
+        g_atomic_int_inc (&data->n_errors);
+    }
+}
+
+/* tiles are computed correctly when queried from several threads at once */
+static void
+threads (void)
+{
+  const Babl *format = babl_format ("Y float");
+  GeglColor  *color  = gegl_color_new ("white");
+  GeglBuffer *buffer;
+  ThreadData  thread_data;
+
+  thread_data.extent   = *GEGL_RECTANGLE (-13, 7, 300, 200);
+  thread_data.white    = *GEGL_RECTANGLE (100, 50, 120, 90);
+  thread_data.n_errors = 0;
+
+  buffer = gegl_buffer_new (&thread_data.extent, format);
+  gegl_buffer_set_color (buffer, &thread_data.white, color);
+
+  g_object_set (gegl_config (), "threads", 4, NULL);
+
+  thread_data.table = gegl_summed_area_table_new (buffer, NULL, format, FALSE);
+
+  gegl_parallel_distribute_range (500, 0.0,
+                                  (GeglParallelDistributeRangeFunc) query_rects,
+                                  &thread_data);
+
+  g_assert_cmpint (thread_data.n_errors, ==, 0);
+
+  gegl_summed_area_table_unref (thread_data.table);
+  g_object_unref (buffer);
+  g_object_unref (color);
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+}
+
+/* the table attached to a buffer is shared until the buffer is written to,
+ * tables obtained before keep the old content
+ */
+static void
+attached (void)
+{
+  const Babl          *format = babl_format ("Y float");
+  GeglRectangle        rect   = { 0, 0, 64, 64 };
+  GeglColor           *color  = gegl_color_new ("white");
+  GeglBuffer          *buffer = gegl_buffer_new (&rect, format);
+  GeglSummedAreaTable *table1;
+  GeglSummedAreaTable *table2;
+  GeglSummedAreaTable *table3;
+  gdouble              sum;
+
+  table1 = gegl_buffer_get_summed_area_table (buffer, format, FALSE);
+  table2 = gegl_buffer_get_summed_area_table (buffer, format, FALSE);
+
+  g_assert_true (table1 == table2);
+
+  gegl_buffer_set_color (buffer, GEGL_RECTANGLE (0, 0, 8, 8), color);
+
+  table3 = gegl_buffer_get_summed_area_table (buffer, format, FALSE);
+
+  g_assert_true (table3 != table1);
+
+  gegl_summed_area_table_get_sum (table1, &rect, &sum);
+  g_assert_cmpfloat (sum, ==, 0.0);
+
+  gegl_summed_area_table_get_sum (table3, &rect, &sum);
+  g_assert_cmpfloat (fabs (sum - 64.0), <, 1e-9);
+
+  gegl_summed_area_table_unref (table1);
+  gegl_summed_area_table_unref (table2);
+  gegl_summed_area_table_unref (table3);
+  g_object_unref (buffer);
+  g_object_unref (color);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (sums);
+  ADD_TEST (mean_and_variance);
+  ADD_TEST (threads);
+  ADD_TEST (attached);
+
+  return g_test_run ();
+}
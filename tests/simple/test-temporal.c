@@ -0,0 +1,169 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gegl.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-temporal/" #function, function);
+
+#define SIZE 16
+
+typedef struct
+{
+  GeglNode *gegl;
+  GeglNode *color;
+  GeglNode *denoise;
+} Video;
+
+static void
+video_init (Video   *video,
+            gint     frames,
+            gint     lookahead,
+            gdouble  noise)
+{
+  GeglNode *crop;
+
+  video->gegl    = gegl_node_new ();
+  video->color   = gegl_node_new_child (video->gegl,
+                                        "operation", "gegl:color",
+                                        NULL);
+  crop           = gegl_node_new_child (video->gegl,
+                                        "operation", "gegl:crop",
+                                        "width",     (gdouble) SIZE,
+                                        "height",    (gdouble) SIZE,
+                                        NULL);
+  video->denoise = gegl_node_new_child (video->gegl,
+                                        "operation", "gegl:temporal-denoise",
+                                        "frames",    frames,
+                                        "lookahead", lookahead,
+                                        "noise",     noise,
+                                        NULL);
+
+  gegl_node_link_many (video->color, crop, video->denoise, NULL);
+}
+
+static void
+video_clear (Video *video)
+{
+  g_object_unref (video->gegl);
+}
+
+/* feeds a grey frame of the given value, and returns the value of the
+ * resulting frame, which has to be flat
+ */
+static gfloat
+video_frame (Video   *video,
+             gdouble  value)
+{
+  GeglColor *color  = gegl_color_new (NULL);
+  gfloat     pixels[SIZE * SIZE * 4];
+  gint       i;
+
+  gegl_color_set_rgba (color, value, value, value, 1.0);
+  gegl_node_set (video->color, "value", color, NULL);
+  g_object_unref (color);
+
+  gegl_node_blit (video->denoise, 1.0, GEGL_RECTANGLE (0, 0, SIZE, SIZE),
+                  babl_format ("RGBA float"), pixels,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (i = 1; i < SIZE * SIZE; i++)
+    g_assert_cmpfloat (pixels[4 * i], ==, pixels[0]);
+
+  return pixels[0];
+}
+
+static void
+static_scene (void)
+{
+  Video video;
+  gint  i;
+
+  video_init (&video, 4, 0, 0.05);
+
+  for (i = 0; i < 6; i++)
+    g_assert_cmpfloat_with_epsilon (video_frame (&video, 0.5), 0.5, 1e-6);
+
+  video_clear (&video);
+}
+
+static void
+flicker (void)
+{
+  Video  video;
+  gfloat value;
+  gint   i;
+
+  video_init (&video, 3, 0, 1.0);
+
+  for (i = 0; i < 4; i++)
+    {
+      video_frame (&video, 0.4);
+      value = video_frame (&video, 0.6);
+
+      /* the frames are averaged */
+      g_assert_cmpfloat (value, >, 0.45);
+      g_assert_cmpfloat (value, <, 0.55);
+    }
+
+  video_clear (&video);
+}
+
+static void
+scene_cut (void)
+{
+  Video video;
+  gint  i;
+
+  video_init (&video, 4, 0, 0.01);
+
+  for (i = 0; i < 5; i++)
+    video_frame (&video, 0.1);
+
+  /* the previous frames are too different to be blended in */
+  g_assert_cmpfloat_with_epsilon (video_frame (&video, 0.9), 0.9, 1e-4);
+
+  video_clear (&video);
+}
+
+static void
+lookahead (void)
+{
+  Video video;
+
+  video_init (&video, 0, 1, 0.01);
+
+  g_assert_cmpfloat_with_epsilon (video_frame (&video, 0.2), 0.2, 1e-4);
+  g_assert_cmpfloat_with_epsilon (video_frame (&video, 0.4), 0.2, 1e-4);
+  g_assert_cmpfloat_with_epsilon (video_frame (&video, 0.8), 0.4, 1e-4);
+
+  video_clear (&video);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (static_scene);
+  ADD_TEST (flicker);
+  ADD_TEST (scene_cut);
+  ADD_TEST (lookahead);
+
+  return g_test_run ();
+}
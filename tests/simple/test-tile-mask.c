@@ -0,0 +1,252 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gegl.h"
+#include "gegl-plugin.h"
+#include "graph/gegl-cache.h"
+#include "graph/gegl-tile-mask.h"
+
+#define ADD_TEST(function) g_test_add_func ("/gegl-tile-mask/" #function, function);
+
+#define INFINITE_PLANE G_MININT / 2, G_MININT / 2, G_MAXINT, G_MAXINT
+
+static void
+add_remove (void)
+{
+  GeglTileMask  *mask     = gegl_tile_mask_new ();
+  GeglRectangle  rect     = {  -64, -64, 256, 128 };
+  GeglRectangle  hole     = {   10,  10,   4,   4 };
+  GeglRectangle  cell     = {    8,   8,   8,   8 };
+  GeglRectangle  infinite = { INFINITE_PLANE };
+
+  g_assert (gegl_tile_mask_is_empty (mask));
+
+  gegl_tile_mask_add_rect (mask, &rect);
+  g_assert_cmpint (gegl_tile_mask_rect_in (mask, &rect), ==,
+                   GEGL_OVERLAP_RECTANGLE_IN);
+  g_assert_cmpint (gegl_tile_mask_get_area (mask, &rect), ==,
+                   rect.width * rect.height);
+
+  /* removing a few pixels clears the whole cell they are in */
+  gegl_tile_mask_remove_rect (mask, &hole);
+  g_assert_cmpint (gegl_tile_mask_rect_in (mask, &cell), ==,
+                   GEGL_OVERLAP_RECTANGLE_OUT);
+  g_assert_cmpint (gegl_tile_mask_rect_in (mask, &rect), ==,
+                   GEGL_OVERLAP_RECTANGLE_PART);
+  g_assert_cmpint (gegl_tile_mask_get_area (mask, &rect), ==,
+                   rect.width * rect.height - 64);
+
+  gegl_tile_mask_remove_rect (mask, &infinite);
+  g_assert (gegl_tile_mask_is_empty (mask));
+
+  gegl_tile_mask_free (mask);
+}
+
+/* a source counting how often it is processed */
+
+typedef struct
+{
+  GeglOperationSource  parent_instance;
+} GeglTestOperationCount;
+
+typedef struct
+{
+  GeglOperationSourceClass  parent_class;
+} GeglTestOperationCountClass;
+
+GType   gegl_test_operation_count_get_type (void);
+
+G_DEFINE_TYPE (GeglTestOperationCount, gegl_test_operation_count,
+               GEGL_TYPE_OPERATION_SOURCE);
+
+static gint n_processed;
+
+static void
+gegl_test_operation_count_init (GeglTestOperationCount *self)
+{
+}
+
+static void
+count_prepare (GeglOperation *operation)
+{
+  gegl_operation_set_format (operation, "output", babl_format ("RGBA float"));
+}
+
+static GeglRectangle
+count_get_bounding_box (GeglOperation *operation)
+{
+  /* neither edge of the extent is on the cell grid */
+  return *GEGL_RECTANGLE (0, 0, 203, 203);
+}
+
+static gboolean
+count_process (GeglOperation       *operation,
+               GeglBuffer          *output,
+               const GeglRectangle *roi,
+               gint                 level)
+{
+  g_atomic_int_inc (&n_processed);
+
+  return TRUE;
+}
+
+static void
+gegl_test_operation_count_class_init (GeglTestOperationCountClass *klass)
+{
+  GeglOperationClass       *operation_class = GEGL_OPERATION_CLASS (klass);
+  GeglOperationSourceClass *source_class    = GEGL_OPERATION_SOURCE_CLASS (klass);
+
+  operation_class->prepare          = count_prepare;
+  operation_class->get_bounding_box = count_get_bounding_box;
+  source_class->process             = count_process;
+
+  gegl_operation_class_set_keys (operation_class,
+                                 "name",        "gegl-test:count",
+                                 "description", "",
+                                 NULL);
+}
+
+static void
+blit_twice (const GeglRectangle *roi)
+{
+  GeglNode *graph = gegl_node_new ();
+  GeglNode *node  = gegl_node_new_child (graph,
+                                         "operation",    "gegl-test:count",
+                                         "cache-policy", GEGL_CACHE_POLICY_ALWAYS,
+                                         NULL);
+
+  n_processed = 0;
+  gegl_node_blit (node, 1.0, roi, NULL, NULL,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_CACHE);
+  g_assert_cmpint (n_processed, >, 0);
+
+  /* the same unaligned roi is found in the cache the second time */
+  n_processed = 0;
+  gegl_node_blit (node, 1.0, roi, NULL, NULL,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_CACHE);
+  g_assert_cmpint (n_processed, ==, 0);
+
+  g_object_unref (graph);
+}
+
+static void
+unaligned_blit (void)
+{
+  /* inside the extent, and reaching its unaligned edges */
+  blit_twice (GEGL_RECTANGLE (  3,   5, 101, 101));
+  blit_twice (GEGL_RECTANGLE (102, 102, 101, 101));
+}
+
+static void
+unset_rect (void)
+{
+  GeglTileMask  *mask  = gegl_tile_mask_new ();
+  GeglRectangle  rect  = { 0, 0, 1000, 1000 };
+  GeglRectangle  done  = { 0, 0, 1000, 200 };
+  GeglRectangle  result;
+  gint           x;
+
+  /* a fragmented valid area, as left by brush strokes */
+  for (x = 0; x < 1000; x += 16)
+    {
+      GeglRectangle stroke = { x, 200, 8, 8 };
+
+      gegl_tile_mask_add_rect (mask, &stroke);
+    }
+  gegl_tile_mask_add_rect (mask, &done);
+
+  g_assert (gegl_tile_mask_get_unset_rect (mask, &rect, &result));
+  g_assert_cmpint (result.x,      ==,   8);
+  g_assert_cmpint (result.y,      ==, 200);
+  g_assert_cmpint (result.width,  ==,   8);
+  g_assert_cmpint (result.height, ==, 800);
+
+  gegl_tile_mask_add_rect (mask, &rect);
+  g_assert (! gegl_tile_mask_get_unset_rect (mask, &rect, &result));
+
+  gegl_tile_mask_free (mask);
+}
+
+static void
+rectangles (void)
+{
+  GeglTileMask  *mask  = gegl_tile_mask_new ();
+  GeglRectangle  rect  = { -100, -100, 1000, 64 };
+  GeglRectangle *rects;
+  gint           n_rects;
+  gint64         area  = 0;
+  gint           i;
+
+  gegl_tile_mask_add_rect (mask, &rect);
+  gegl_tile_mask_get_rectangles (mask, &rects, &n_rects);
+
+  for (i = 0; i < n_rects; i++)
+    area += (gint64) rects[i].width * rects[i].height;
+
+  g_assert_cmpint (area, ==, gegl_tile_mask_get_area (mask, &rect));
+
+  g_free (rects);
+  gegl_tile_mask_free (mask);
+}
+
+/* the cache only marks the cells of its extent at each level as valid,
+ * whatever the size of the computed rectangle
+ */
+static void
+cache_extent (void)
+{
+  GeglRectangle  extent   = { 3, 5, 100, 60 };
+  GeglRectangle  infinite = { INFINITE_PLANE };
+  GeglCache     *cache;
+
+  cache = g_object_new (GEGL_TYPE_CACHE,
+                        "format", babl_format ("RGBA float"),
+                        NULL);
+  gegl_buffer_set_extent (GEGL_BUFFER (cache), &extent);
+
+  gegl_cache_computed (cache, &infinite, 0);
+  g_assert (gegl_cache_is_valid (cache, &extent, 0));
+  g_assert_cmpint (gegl_cache_get_valid_area (cache, &infinite, 0), ==,
+                   104 * 72);
+
+  /* at level 1, the extent is 1,2 to 52,33 */
+  g_assert (! gegl_cache_is_valid (cache, GEGL_RECTANGLE (1, 2, 51, 31), 1));
+  gegl_cache_computed (cache, &infinite, 1);
+  g_assert (gegl_cache_is_valid (cache, GEGL_RECTANGLE (1, 2, 51, 31), 1));
+  g_assert_cmpint (gegl_cache_get_valid_area (cache, &infinite, 1), ==,
+                   56 * 40);
+
+  g_object_unref (cache);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  g_type_class_peek (gegl_test_operation_count_get_type ());
+
+  ADD_TEST (add_remove);
+  ADD_TEST (unaligned_blit);
+  ADD_TEST (unset_rect);
+  ADD_TEST (rectangles);
+  ADD_TEST (cache_extent);
+
+  return g_test_run ();
+}